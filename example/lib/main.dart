@@ -16,9 +16,29 @@ void main() {
   logMessages.attachToLogger(Logger.root);
   _logger.fine('Application launched. (v2)');
   _setTargetPlatformForDesktop();
+  final coldStart = Platform.isLinux
+      ? Platform.environment['BIOMETRIC_STORAGE_COLD_START']
+      : null;
+  if (coldStart != null) {
+    WidgetsFlutterBinding.ensureInitialized();
+    _runColdStart(coldStart);
+  }
   runApp(MyApp());
 }
 
+/// Driven by linux/benchmark/cold_start_benchmark.sh: stores (`seed`) or
+/// reads (`read`) one secret right after launch and exits.
+Future<void> _runColdStart(String mode) async {
+  final storage = await BiometricStorage().getStorage('cold_start',
+      options: StorageFileInitOptions(authenticationRequired: false));
+  if (mode == 'seed') {
+    await storage.write('cold start secret');
+  } else {
+    await storage.read();
+  }
+  exit(0);
+}
+
 /// If the current platform is desktop, override the default platform to
 /// a supported platform (iOS for macOS, Android for Linux and Windows).
 /// Otherwise, do nothing.
@@ -1,6 +1,8 @@
 #include "my_application.h"
+#include "startup_trace.h"
 
 int main(int argc, char** argv) {
+  startup_trace("main");
   // Only X11 is currently supported.
   // Wayland support is being developed: https://github.com/flutter/flutter/issues/57932.
   gdk_set_allowed_backends("x11");
@@ -3,6 +3,7 @@
 #include <flutter_linux/flutter_linux.h>
 
 #include "flutter/generated_plugin_registrant.h"
+#include "startup_trace.h"
 
 struct _MyApplication {
   GtkApplication parent_instance;
@@ -12,6 +13,7 @@ G_DEFINE_TYPE(MyApplication, my_application, GTK_TYPE_APPLICATION)
 
 // Implements GApplication::activate.
 static void my_application_activate(GApplication* application) {
+  startup_trace("activate");
   GtkWindow* window =
       GTK_WINDOW(gtk_application_window_new(GTK_APPLICATION(application)));
   GtkHeaderBar *header_bar = GTK_HEADER_BAR(gtk_header_bar_new());
@@ -28,7 +30,9 @@ static void my_application_activate(GApplication* application) {
   gtk_widget_show(GTK_WIDGET(view));
   gtk_container_add(GTK_CONTAINER(window), GTK_WIDGET(view));
 
+  startup_trace("register_plugins_start");
   fl_register_plugins(FL_PLUGIN_REGISTRY(view));
+  startup_trace("register_plugins_done");
 
   gtk_widget_grab_focus(GTK_WIDGET(view));
 }
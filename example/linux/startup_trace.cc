@@ -0,0 +1,48 @@
+#include "startup_trace.h"
+
+#include <stdio.h>
+#include <string.h>
+#include <time.h>
+#include <unistd.h>
+
+// Same format as the plugin's milestones (with BIOMETRIC_STORAGE_BENCHMARKS):
+// "<event>,<microseconds since the process started>".
+
+static gint64 boottime_us() {
+  struct timespec now;
+  clock_gettime(CLOCK_BOOTTIME, &now);
+  return (gint64)now.tv_sec * G_USEC_PER_SEC + now.tv_nsec / 1000;
+}
+
+// Start time of this process on the CLOCK_BOOTTIME scale, from field 22 of
+// /proc/self/stat (in clock ticks since boot).
+static gint64 process_start_us() {
+  g_autofree gchar* stat = nullptr;
+  if (!g_file_get_contents("/proc/self/stat", &stat, nullptr, nullptr)) {
+    return boottime_us();
+  }
+  // The command name in field 2 may contain spaces, count after it.
+  const gchar* fields = strrchr(stat, ')');
+  g_auto(GStrv) parts =
+      g_strsplit(fields != nullptr ? fields + 2 : stat, " ", 21);
+  if (g_strv_length(parts) < 21) {
+    return boottime_us();
+  }
+  guint64 ticks = g_ascii_strtoull(parts[19], nullptr, 10);
+  return (gint64)(ticks * G_USEC_PER_SEC / sysconf(_SC_CLK_TCK));
+}
+
+void startup_trace(const gchar* event) {
+  const gchar* path = g_getenv("BIOMETRIC_STORAGE_TRACE");
+  if (path == nullptr) {
+    return;
+  }
+  gint64 now = boottime_us();
+  FILE* trace = fopen(path, "a");
+  if (trace == nullptr) {
+    return;
+  }
+  fprintf(trace, "%s,%" G_GINT64_FORMAT "\n", event,
+          now - process_start_us());
+  fclose(trace);
+}
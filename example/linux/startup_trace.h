@@ -0,0 +1,11 @@
+#ifndef STARTUP_TRACE_H_
+#define STARTUP_TRACE_H_
+
+#include <glib.h>
+
+// Records the time since process start at which `event` first happened, for
+// linux/benchmark/cold_start_benchmark.sh of the plugin. Does nothing unless
+// BIOMETRIC_STORAGE_TRACE is set to the file to append to.
+void startup_trace(const gchar* event);
+
+#endif  // STARTUP_TRACE_H_
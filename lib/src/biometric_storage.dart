@@ -1,6 +1,9 @@
 import 'dart:async';
 import 'dart:io';
+import 'dart:typed_data';
 
+import 'package:biometric_storage/src/biometric_storage_linux_buffer_noop.dart'
+    if (dart.library.io) 'package:biometric_storage/src/biometric_storage_linux_buffer.dart';
 import 'package:biometric_storage/src/biometric_storage_win32_noop.dart'
     if (dart.library.io) 'package:biometric_storage/src/biometric_storage_win32.dart';
 import 'package:flutter/foundation.dart';
@@ -73,10 +76,214 @@ class AuthException implements Exception {
   }
 }
 
+/// Result of one item of a linux batch operation, see
+/// [MethodChannelBiometricStorage.linuxReadMany].
+class BatchProgress<T> {
+  BatchProgress._(this.index, this.name, this.done, this.total, this.value,
+      this.error);
+
+  /// Position of [name] in the list passed to the batch operation.
+  final int index;
+  final String name;
+
+  /// Number of items finished so far (including this one), and in total.
+  /// Items finish in any order.
+  final int done;
+  final int total;
+
+  /// Result of the operation for [name], `null` if it failed (or the
+  /// storage does not exist, for reads).
+  final T? value;
+
+  /// Error of the operation for [name], transformed like the errors of the
+  /// single item methods.
+  final Object? error;
+
+  @override
+  String toString() {
+    return 'BatchProgress{name: $name, done: $done/$total, '
+        'error: $error}';
+  }
+}
+
+/// Read, write or delete of one storage in a
+/// [MethodChannelBiometricStorage.linuxBatch] call.
+class LinuxBatchOperation {
+  const LinuxBatchOperation.read(this.name, {this.barrier = false})
+      : method = 'read',
+        content = null,
+        tags = null;
+  const LinuxBatchOperation.write(this.name, String this.content,
+      {this.tags, this.barrier = false})
+      : method = 'write';
+  const LinuxBatchOperation.delete(this.name, {this.barrier = false})
+      : method = 'delete',
+        content = null,
+        tags = null;
+
+  final String method;
+  final String name;
+  final String? content;
+  final LinuxStorageTags? tags;
+
+  /// Whether the operation waits until all operations before it finished.
+  /// Operations on the same storage always run in the order given.
+  final bool barrier;
+
+  Map<String, dynamic> _toJson() => <String, dynamic>{
+        'method': method,
+        'name': name,
+        if (content != null) 'content': content,
+        if (tags != null) 'tags': tags!._toJson(),
+        if (barrier) 'barrier': true,
+      };
+}
+
+/// Result of one [LinuxBatchOperation].
+class LinuxBatchResult {
+  LinuxBatchResult._(this.value, this.error);
+
+  /// The content read (`null` if the storage does not exist), whether the
+  /// deleted storage existed, or `true` for writes. `'queued'` for writes and
+  /// deletes which only went to the offline queue
+  /// ([StorageFileInitOptions.linuxOfflineQueue]). `null` if the operation
+  /// failed.
+  final Object? value;
+
+  /// Error of the operation, transformed like the errors of the single item
+  /// methods.
+  final Object? error;
+}
+
+/// Kind of a [LinuxStorageChange].
+enum LinuxChangeKind {
+  /// Written, and not existing before as far as the change log knows.
+  created,
+  modified,
+  deleted,
+}
+
+/// Last change of one storage in a [LinuxChanges].
+class LinuxStorageChange {
+  LinuxStorageChange._(this.name, this.kind, this.generation);
+
+  final String name;
+  final LinuxChangeKind kind;
+
+  /// Generation of the change log at this change.
+  final int generation;
+
+  @override
+  String toString() {
+    return 'LinuxStorageChange{name: $name, kind: ${kind.name}, '
+        'generation: $generation}';
+  }
+}
+
+/// Result of [MethodChannelBiometricStorage.linuxChangesSince].
+class LinuxChanges {
+  LinuxChanges._(this.epoch, this.generation, this.reset, this.changes);
+
+  /// Identifies the change log, pass it to the next call.
+  final String epoch;
+
+  /// Current generation, pass it to the next call.
+  final int generation;
+
+  /// Whether the changes since the given generation are unknown (it is too
+  /// old, or from another [epoch]). [changes] is empty then and all
+  /// storages have to be read again.
+  final bool reset;
+
+  /// Last change of each storage changed since the given generation, in
+  /// generation order.
+  final List<LinuxStorageChange> changes;
+
+  @override
+  String toString() {
+    return 'LinuxChanges{epoch: $epoch, generation: $generation, '
+        'reset: $reset, changes: $changes}';
+  }
+}
+
+/// Indexed attributes of a storage on linux, stored next to the secret in
+/// the keyring. See [MethodChannelBiometricStorage.linuxFindByTags].
+class LinuxStorageTags {
+  const LinuxStorageTags({this.account, this.kind, this.sensitivity});
+
+  final String? account;
+  final String? kind;
+  final String? sensitivity;
+
+  Map<String, String> _toJson() => <String, String>{
+        if (account != null) 'account': account!,
+        if (kind != null) 'kind': kind!,
+        if (sensitivity != null) 'sensitivity': sensitivity!,
+      };
+}
+
+/// Where a storage is kept on linux. See [StorageFileInitOptions.linuxTier].
+enum LinuxStorageTier {
+  /// One item in the Secret Service (the default, unless the Secret portal
+  /// is used).
+  secretService,
+
+  /// A key in the kernel's user keyring: one syscall instead of a D-Bus
+  /// round trip, but gone after a reboot or once the user logged out, and
+  /// limited to 20000 bytes for all keys of a user by default. Writes which
+  /// do not fit are stored in the default tier instead.
+  kernelKeyring,
+
+  /// Several Secret Service items of at most 512 KiB, for large secrets.
+  /// Not supported by `linuxReadSnapshot()`.
+  sharded,
+
+  /// The encrypted log file of [StorageFileInitOptions.linuxFileStore].
+  /// The default when the key comes from the Secret portal
+  /// (`BIOMETRIC_STORAGE_SECRET_PORTAL=1`, see the README).
+  file,
+}
+
+/// Outcome of [MethodChannelBiometricStorage.linuxWrite].
+enum LinuxWriteResult {
+  /// Stored by the Secret Service (or the storage's tier).
+  stored,
+
+  /// The Secret Service was unreachable, the write only went to the
+  /// in-memory queue of [StorageFileInitOptions.linuxOfflineQueue]. It is
+  /// lost if the app exits before the Secret Service is back.
+  queued,
+}
+
+/// Rule of the policy set by
+/// [MethodChannelBiometricStorage.linuxSetTierPolicy]. Matches writes to
+/// storages whose name matches the glob [pattern] (any if `null`), of at
+/// least [minSize] and at most [maxSize] bytes.
+class LinuxTierRule {
+  const LinuxTierRule(this.tier, {this.pattern, this.minSize, this.maxSize});
+
+  final LinuxStorageTier tier;
+  final String? pattern;
+  final int? minSize;
+  final int? maxSize;
+
+  Map<String, dynamic> _toJson() => <String, dynamic>{
+        'tier': tier.name,
+        if (pattern != null) 'pattern': pattern,
+        if (minSize != null) 'minSize': minSize,
+        if (maxSize != null) 'maxSize': maxSize,
+      };
+}
+
 class StorageFileInitOptions {
   StorageFileInitOptions({
     this.authenticationValidityDurationSeconds = 10,
     this.authenticationRequired = true,
+    this.linuxOfflineQueue = false,
+    this.linuxWarmStart = false,
+    this.linuxFileStore = false,
+    this.linuxPrefetch = false,
+    this.linuxTier,
   });
 
   final int authenticationValidityDurationSeconds;
@@ -86,10 +293,52 @@ class StorageFileInitOptions {
   /// will simply be save encrypted. (default: true)
   final bool authenticationRequired;
 
+  /// Linux only: while the Secret Service is unreachable (e.g. at session
+  /// start), writes and deletes are queued in memory until it is back
+  /// instead of failing. Reads return the queued content. Queued operations
+  /// are lost if the app exits before they were replayed, use
+  /// `linuxWrite()` to find out whether a write was only queued.
+  /// (default: false)
+  final bool linuxOfflineQueue;
+
+  /// Linux only: the secret is kept in a snapshot file, encrypted with a key
+  /// stored in the keyring. On the next start, reads are answered from the
+  /// snapshot after one keyring lookup for that key, while the plugin checks
+  /// the cached secrets against the keyring in the background. A secret
+  /// changed by another app may be read out of date once. (default: false)
+  final bool linuxWarmStart;
+
+  /// Linux only: the secret is stored in a log file in the app's data
+  /// directory instead of the keyring, encrypted with a key stored in the
+  /// keyring. Writes return once they are on disk, concurrent writes share
+  /// one sync. Tags (`linuxWriteTagged()`) are not supported. Secrets
+  /// already in the keyring are not moved. (default: false)
+  final bool linuxFileStore;
+
+  /// Linux only: the plugin learns which of the storages initialized with
+  /// this option are usually read shortly after each other, and reads the
+  /// likely next ones from the keyring ahead of time. Prefetched secrets are
+  /// kept encrypted in memory for a few seconds and never trigger an unlock
+  /// prompt. Hit rate and wasted prefetches are reported under `prefetch` in
+  /// `linuxStats()`. (default: false)
+  final bool linuxPrefetch;
+
+  /// Linux only: keeps the storage in [linuxTier] regardless of the policy
+  /// set by `linuxSetTierPolicy()`. Tags (`linuxWriteTagged()`) are only
+  /// supported in [LinuxStorageTier.secretService]. A storage written to
+  /// another tier before is moved on its next write. (default: `null`,
+  /// follow the policy)
+  final LinuxStorageTier? linuxTier;
+
   Map<String, dynamic> toJson() => <String, dynamic>{
         'authenticationValidityDurationSeconds':
             authenticationValidityDurationSeconds,
         'authenticationRequired': authenticationRequired,
+        'linuxOfflineQueue': linuxOfflineQueue,
+        'linuxWarmStart': linuxWarmStart,
+        'linuxFileStore': linuxFileStore,
+        'linuxPrefetch': linuxPrefetch,
+        if (linuxTier != null) 'linuxTier': linuxTier!.name,
       };
 }
 
@@ -200,6 +449,21 @@ class MethodChannelBiometricStorage extends BiometricStorage {
 
   static const MethodChannel _channel = MethodChannel('biometric_storage');
 
+  /// Progress events of batch operations for all running batches.
+  static final Stream<dynamic> _progressEvents =
+      const EventChannel('biometric_storage/progress')
+          .receiveBroadcastStream();
+
+  /// The linux plugin pauses a batch when this many progress events are not
+  /// acknowledged, acknowledgements are sent more often than that.
+  static const _batchAckInterval = 16;
+
+  static int _nextBatchId = 0;
+
+  /// Result of linux writes and deletes which were only queued, see
+  /// [StorageFileInitOptions.linuxOfflineQueue].
+  static const _queuedResult = 'queued';
+
   @override
   Future<CanAuthenticateResponse> canAuthenticate() async {
     if (kIsWeb) {
@@ -255,6 +519,240 @@ class MethodChannelBiometricStorage extends BiometricStorage {
     }
   }
 
+  /// Runtime statistics of the linux plugin, e.g. utilization and queue wait
+  /// times of the thread pool used for large secrets.
+  /// Returns an empty map on other platforms.
+  Future<Map<String, dynamic>> linuxStats() async {
+    if (kIsWeb || !Platform.isLinux) {
+      return {};
+    }
+    return await _channel.invokeMapMethod<String, dynamic>('stats') ?? {};
+  }
+
+  /// Writes [content] to storage [name] on linux like [write], and returns
+  /// whether it was stored or only queued
+  /// ([StorageFileInitOptions.linuxOfflineQueue]).
+  Future<LinuxWriteResult> linuxWrite(String name, String content) async {
+    final result = await _transformErrors(
+        _channel.invokeMethod<Object>('write', <String, dynamic>{
+      'name': name,
+      'content': content,
+    }));
+    return result == _queuedResult
+        ? LinuxWriteResult.queued
+        : LinuxWriteResult.stored;
+  }
+
+  /// Writes [content] to storage [name] on linux, tagged with [tags].
+  /// Tags are replaced by every write, a plain [write] removes them.
+  Future<void> linuxWriteTagged(
+    String name,
+    String content,
+    LinuxStorageTags tags,
+  ) =>
+      _transformErrors(_channel.invokeMethod('write', <String, dynamic>{
+        'name': name,
+        'content': content,
+        'tags': tags._toJson(),
+      }));
+
+  /// Returns the names of all storages written with [linuxWriteTagged]
+  /// whose tags match all non null fields of [tags]. The matching is done by
+  /// the Secret Service, no secret is read.
+  Future<List<String>> linuxFindByTags(LinuxStorageTags tags) async {
+    final names = await _transformErrors(_channel.invokeListMethod<String>(
+        'findByTags', <String, dynamic>{'tags': tags._toJson()}));
+    return names ?? [];
+  }
+
+  /// Runs [operations] on linux in one platform channel call and returns
+  /// their results in the same order. Independent operations run
+  /// concurrently, see [LinuxBatchOperation.barrier] for ordering. A failed
+  /// operation does not stop the others.
+  Future<List<LinuxBatchResult>> linuxBatch(
+      List<LinuxBatchOperation> operations) async {
+    final results = await _transformErrors(_channel
+        .invokeListMethod<Map<dynamic, dynamic>>('batch', <String, dynamic>{
+      'operations': operations.map((o) => o._toJson()).toList(),
+    }));
+    return (results ?? []).map((result) {
+      final error = result['error'] as Map<dynamic, dynamic>?;
+      return LinuxBatchResult._(
+        error == null ? result['value'] : null,
+        error == null
+            ? null
+            : _transformError(
+                PlatformException(
+                  code: error['code'] as String,
+                  message: error['message'] as String?,
+                  details: error['details'],
+                ),
+                StackTrace.current),
+      );
+    }).toList();
+  }
+
+  /// Returns the storages written or deleted on linux after [generation],
+  /// by any process of the app. Start with generation 0 and then pass the
+  /// [LinuxChanges.generation] and [LinuxChanges.epoch] of the last result.
+  Future<LinuxChanges> linuxChangesSince(int generation,
+      {String? epoch}) async {
+    final result = await _transformErrors(
+        _channel.invokeMapMethod<String, dynamic>(
+            'changesSince', <String, dynamic>{
+      'generation': generation,
+      if (epoch != null) 'epoch': epoch,
+    }));
+    final changes = result!['changes'] as List<dynamic>;
+    return LinuxChanges._(
+      result['epoch'] as String,
+      result['generation'] as int,
+      result['reset'] as bool,
+      changes.map((dynamic change) {
+        final map = change as Map<dynamic, dynamic>;
+        return LinuxStorageChange._(
+          map['name'] as String,
+          LinuxChangeKind.values.byName(map['change'] as String),
+          map['generation'] as int,
+        );
+      }).toList(),
+    );
+  }
+
+  /// Sets the policy picking the [LinuxStorageTier] of writes on linux to
+  /// storages without [StorageFileInitOptions.linuxTier]: the first of
+  /// [rules] matching a write decides, writes matching none go to the Secret
+  /// Service. Storages move on their next write, reads follow them through
+  /// an index in `$XDG_DATA_HOME/biometric_storage/routes.ini` which holds
+  /// hashes of their names. Tagged writes always go to the Secret Service.
+  Future<void> linuxSetTierPolicy(List<LinuxTierRule> rules) =>
+      _transformErrors(_channel.invokeMethod<bool>('setTierPolicy',
+          <String, dynamic>{'rules': rules.map((r) => r._toJson()).toList()}));
+
+  /// Reads storage [name] on linux as bytes (utf8 encoded).
+  ///
+  /// Unlike [read] the secret is not copied through the platform channel:
+  /// it is kept in a locked native buffer which is mapped directly as the
+  /// returned list, and wiped once the list is garbage collected. Use this
+  /// for large secrets, and avoid converting the result to a [String].
+  ///
+  /// The wipe runs from a [Finalizer], which is best-effort: Dart does not
+  /// guarantee it runs, e.g. when the isolate shuts down first. The plugin
+  /// wipes the buffers still alive when it is disposed, after which their
+  /// lists read as zeros. Overwrite the list yourself (`fillRange`) as soon
+  /// as the secret is no longer needed.
+  Future<Uint8List?> linuxReadBytes(String name) async {
+    final result = await _transformErrors(_channel
+        .invokeMapMethod<String, dynamic>(
+            'readBuffer', <String, dynamic>{'name': name}));
+    if (result == null) {
+      return null;
+    }
+    final bytes =
+        acquireLinuxBuffer(result['handle'] as int, result['length'] as int);
+    if (bytes == null) {
+      throw StateError('Secret buffer of $name is gone.');
+    }
+    return bytes;
+  }
+
+  /// Reads all storages in [names] on linux as of a single point in time:
+  /// if another process writes some of them meanwhile, the result contains
+  /// either all of its writes or none. Missing storages map to `null`.
+  ///
+  /// The plugin retries a few times when the storages change while they are
+  /// read, and then fails with a [PlatformException] with the code
+  /// `Snapshot Conflict`.
+  Future<Map<String, String?>> linuxReadSnapshot(List<String> names) async {
+    final result = await _transformErrors(_channel
+        .invokeMapMethod<String, String?>(
+            'readSnapshot', <String, dynamic>{'names': names}));
+    return result ?? {};
+  }
+
+  /// Reads all storages in [names] on linux, emitting each result as soon as
+  /// it is available. Items are read concurrently, so results arrive out of
+  /// order. While the subscription is paused the plugin stops reading after
+  /// a few items, until it is resumed.
+  Stream<BatchProgress<String>> linuxReadMany(List<String> names) =>
+      _linuxBatch('readMany', names);
+
+  /// Deletes all storages in [names] on linux. The value of each item is
+  /// true if the storage existed. See [linuxReadMany].
+  Stream<BatchProgress<bool>> linuxDeleteMany(List<String> names) =>
+      _linuxBatch('deleteMany', names);
+
+  Stream<BatchProgress<T>> _linuxBatch<T>(String method, List<String> names) {
+    if (kIsWeb || !Platform.isLinux) {
+      return Stream.error(
+          UnsupportedError('$method is only supported on linux.'));
+    }
+    final batchId = _nextBatchId++;
+    late StreamController<BatchProgress<T>> controller;
+    StreamSubscription<dynamic>? events;
+    var received = 0;
+    var acked = 0;
+
+    void ack({bool force = false}) {
+      if (controller.isPaused ||
+          received == acked ||
+          (!force && received - acked < _batchAckInterval)) {
+        return;
+      }
+      acked = received;
+      _channel.invokeMethod<bool>(
+          'batchAck', <String, dynamic>{'batchId': batchId, 'count': acked});
+    }
+
+    void onEvent(dynamic event) {
+      final map = event as Map<dynamic, dynamic>;
+      if (map['batchId'] != batchId) {
+        return;
+      }
+      received++;
+      final error = map['error'] as Map<dynamic, dynamic>?;
+      controller.add(BatchProgress._(
+        map['index'] as int,
+        map['name'] as String,
+        map['done'] as int,
+        map['total'] as int,
+        error == null ? map['value'] as T? : null,
+        error == null
+            ? null
+            : _transformError(
+                PlatformException(
+                  code: error['code'] as String,
+                  message: error['message'] as String?,
+                  details: error['details'],
+                ),
+                StackTrace.current),
+      ));
+      ack();
+    }
+
+    controller = StreamController<BatchProgress<T>>(
+      onListen: () {
+        // Listen before starting the batch, so no event is missed.
+        events = _progressEvents.listen(onEvent, onError: controller.addError);
+        _transformErrors(_channel.invokeMethod<void>(method, <String, dynamic>{
+          'batchId': batchId,
+          'names': names,
+        })).catchError(controller.addError).whenComplete(() {
+          events?.cancel();
+          controller.close();
+        });
+      },
+      onResume: () => ack(force: true),
+      onCancel: () {
+        events?.cancel();
+        // Nobody consumes the remaining events, let the batch run to its end.
+        _channel.invokeMethod<bool>('batchAck',
+            <String, dynamic>{'batchId': batchId, 'count': names.length});
+      },
+    );
+    return controller.stream;
+  }
+
   /// Retrieves the given biometric storage file.
   /// Each store is completely separated, and has it's own encryption and
   /// biometric lock.
@@ -303,11 +801,15 @@ class MethodChannelBiometricStorage extends BiometricStorage {
   Future<bool?> delete(
     String name,
     AndroidPromptInfo androidPromptInfo,
-  ) =>
-      _transformErrors(_channel.invokeMethod<bool>('delete', <String, dynamic>{
-        'name': name,
-        ..._androidPromptInfoOnlyOnAndroid(androidPromptInfo),
-      }));
+  ) async {
+    final result = await _transformErrors(
+        _channel.invokeMethod<Object>('delete', <String, dynamic>{
+      'name': name,
+      ..._androidPromptInfoOnlyOnAndroid(androidPromptInfo),
+    }));
+    // A queued delete removes the storage once it is replayed.
+    return result == _queuedResult ? true : result as bool?;
+  }
 
   @override
   Future<void> write(
@@ -330,35 +832,33 @@ class MethodChannelBiometricStorage extends BiometricStorage {
   }
 
   Future<T> _transformErrors<T>(Future<T> future) =>
-      future.catchError((Object error, StackTrace stackTrace) {
-        if (error is PlatformException) {
-          _logger.warning(
-              'Error during plugin operation (details: ${error.details})',
-              error,
-              stackTrace);
-          if (error.code.startsWith('AuthError:')) {
-            return Future<T>.error(
-              AuthException(
-                _authErrorCodeMapping[error.code] ?? AuthExceptionCode.unknown,
-                error.message ?? 'Unknown error',
-              ),
-              stackTrace,
-            );
-          }
-          if (error.details is Map) {
-            final message = error.details['message'] as String;
-            if (message.contains('org.freedesktop.DBus.Error.AccessDenied') ||
-                message.contains('AppArmor')) {
-              _logger.fine('Got app armor error.');
-              return Future<T>.error(
-                  AuthException(
-                      AuthExceptionCode.linuxAppArmorDenied, error.message!),
-                  stackTrace);
-            }
-          }
+      future.catchError((Object error, StackTrace stackTrace) =>
+          Future<T>.error(_transformError(error, stackTrace), stackTrace));
+
+  Object _transformError(Object error, StackTrace stackTrace) {
+    if (error is PlatformException) {
+      _logger.warning(
+          'Error during plugin operation (details: ${error.details})',
+          error,
+          stackTrace);
+      if (error.code.startsWith('AuthError:')) {
+        return AuthException(
+          _authErrorCodeMapping[error.code] ?? AuthExceptionCode.unknown,
+          error.message ?? 'Unknown error',
+        );
+      }
+      if (error.details is Map) {
+        final message = error.details['message'] as String;
+        if (message.contains('org.freedesktop.DBus.Error.AccessDenied') ||
+            message.contains('AppArmor')) {
+          _logger.fine('Got app armor error.');
+          return AuthException(
+              AuthExceptionCode.linuxAppArmorDenied, error.message!);
         }
-        return Future<T>.error(error, stackTrace);
-      });
+      }
+    }
+    return error;
+  }
 }
 
 class BiometricStorageFile {
@@ -370,6 +870,9 @@ class BiometricStorageFile {
 
   /// read from the secure file and returns the content.
   /// Will return `null` if file does not exist.
+  /// On linux, fails with a [PlatformException] with the code
+  /// `Corrupted Secret` if the keyring returned a value which does not match
+  /// the checksum stored with it.
   Future<String?> read() => _plugin.read(name, androidPromptInfo);
 
   /// Write content of this file. Previous value will be overwritten.
@@ -0,0 +1,34 @@
+import 'dart:ffi';
+import 'dart:typed_data';
+
+// Secret buffers owned by the linux plugin, see
+// linux/biometric_storage_buffer.h.
+
+typedef _AcquireNative = Pointer<Uint8> Function(Int64 handle);
+typedef _Acquire = Pointer<Uint8> Function(int handle);
+typedef _ReleaseNative = Void Function(Pointer<Uint8> data);
+typedef _Release = void Function(Pointer<Uint8> data);
+
+final _library = DynamicLibrary.process();
+
+final _acquire = _library.lookupFunction<_AcquireNative, _Acquire>(
+    'biometric_storage_buffer_acquire');
+final _release = _library.lookupFunction<_ReleaseNative, _Release>(
+    'biometric_storage_buffer_release');
+
+/// Wipes and frees the buffer once the [Uint8List] wrapping it is garbage
+/// collected. NativeFinalizer only accepts `Finalizable` objects, which typed
+/// data is not.
+final _finalizer = Finalizer<Pointer<Uint8>>(_release);
+
+/// Takes ownership of the plugin buffer [handle] and returns it as external
+/// typed data, without copying it. Returns `null` if the handle is unknown.
+Uint8List? acquireLinuxBuffer(int handle, int length) {
+  final data = _acquire(handle);
+  if (data == nullptr) {
+    return null;
+  }
+  final bytes = data.asTypedList(length);
+  _finalizer.attach(bytes, data);
+  return bytes;
+}
@@ -0,0 +1,6 @@
+// workaround import for web platform.
+
+import 'dart:typed_data';
+
+Uint8List? acquireLinuxBuffer(int handle, int length) =>
+    throw UnsupportedError('Secret buffers are only supported on linux.');
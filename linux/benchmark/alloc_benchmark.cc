@@ -0,0 +1,315 @@
+// Counts allocations and copies for each phase of the plugin's read and write
+// paths, for a range of payload sizes.
+//
+// The phases mirror what happens to a secret between dart and the keyring:
+//
+//   write: decode the method call -> biometric_storage_plugin_call()
+//          -> encode the response envelope
+//   read:  decode the method call -> biometric_storage_plugin_call()
+//          -> encode the response envelope -> decode it again (stands in for
+//          the copy made on the dart side, which we can not observe here)
+//
+// Calls go through the same entry point as the method channel, so the `call`
+// phases include everything the plugin does for them: envelopes, checksums,
+// caches and the D-Bus traffic to the Secret Service on the session bus. Run
+// it against the mock Secret Service on a private bus (see README.md) to
+// keep the numbers independent of the installed keyring daemon. The test
+// item is stored under the storage name "alloc_benchmark" and deleted
+// afterwards.
+
+#include <flutter_linux/flutter_linux.h>
+#include <stdio.h>
+
+#include "../biometric_storage_plugin_private.h"
+#include "alloc_hooks.h"
+#include "bench_util.h"
+
+#define BENCH_STORAGE_NAME "alloc_benchmark"
+
+typedef enum {
+  PHASE_WRITE_DECODE_CALL,
+  PHASE_WRITE_CALL,
+  PHASE_WRITE_ENCODE_RESPONSE,
+  PHASE_READ_DECODE_CALL,
+  PHASE_READ_CALL,
+  PHASE_READ_ENCODE_RESPONSE,
+  PHASE_READ_DECODE_RESPONSE,
+  PHASE_COUNT,
+} Phase;
+
+static const struct {
+  const gchar *path;
+  const gchar *name;
+} kPhases[PHASE_COUNT] = {
+    {"write", "decode_call"}, {"write", "call"},
+    {"write", "encode_response"}, {"read", "decode_call"},
+    {"read", "call"}, {"read", "encode_response"},
+    {"read", "decode_response"},
+};
+
+static gint iterations = 10;
+static gchar *sizes_spec = nullptr;
+static gboolean csv = FALSE;
+static gdouble max_read_copies = 0;
+
+static GOptionEntry entries[] = {
+    {"iterations", 'n', 0, G_OPTION_ARG_INT, &iterations,
+     "Measured iterations per payload size (default: 10)", "N"},
+    {"sizes", 's', 0, G_OPTION_ARG_STRING, &sizes_spec,
+     "Comma separated payload sizes (default: 16,1k,64k,1m,4m)", "SIZES"},
+    {"csv", 0, 0, G_OPTION_ARG_NONE, &csv, "Print results as CSV", nullptr},
+    {"max-read-copies", 0, 0, G_OPTION_ARG_DOUBLE, &max_read_copies,
+     "Fail if a read copies the payload more often than this (payloads "
+     ">= 64KiB only)",
+     "COPIES"},
+    {nullptr}};
+
+typedef struct {
+  AllocStats totals[PHASE_COUNT];
+  AllocStats start;
+} Measurement;
+
+static void phase_begin(Measurement *m) { m->start = alloc_stats_snapshot(); }
+
+static void phase_end(Measurement *m, Phase phase) {
+  AllocStats now = alloc_stats_snapshot();
+  AllocStats diff = alloc_stats_diff(&m->start, &now);
+  AllocStats *total = &m->totals[phase];
+  total->allocs += diff.allocs;
+  total->alloc_bytes += diff.alloc_bytes;
+  total->frees += diff.frees;
+  total->copies += diff.copies;
+  total->copy_bytes += diff.copy_bytes;
+}
+
+static GBytes *encode_call(FlMethodCodec *codec, const gchar *method,
+                           const gchar *content) {
+  g_autoptr(FlValue) args = fl_value_new_map();
+  fl_value_set_string_take(args, "name",
+                           fl_value_new_string(BENCH_STORAGE_NAME));
+  if (content != nullptr) {
+    fl_value_set_string_take(args, "content", fl_value_new_string(content));
+  }
+  return FL_METHOD_CODEC_GET_CLASS(codec)->encode_method_call(codec, method,
+                                                              args, nullptr);
+}
+
+// Sets `error` from an error response, returns whether `response` is a
+// success.
+static bool check_response(FlMethodResponse *response, GError **error) {
+  if (FL_IS_METHOD_SUCCESS_RESPONSE(response)) {
+    return true;
+  }
+  FlMethodErrorResponse *error_response = FL_METHOD_ERROR_RESPONSE(response);
+  g_set_error(error, G_IO_ERROR, G_IO_ERROR_FAILED, "%s: %s",
+              fl_method_error_response_get_code(error_response),
+              fl_method_error_response_get_message(error_response));
+  return false;
+}
+
+// Runs one write and one read, attributing the work to the phases.
+// Measured phases only contain what the method channel and the plugin do,
+// the fixtures (`write_call` and `read_call` as dart would send them) are
+// encoded by the caller.
+static Task<bool> run_once(BiometricStoragePlugin *plugin,
+                           FlMethodCodec *codec, GBytes *write_call,
+                           GBytes *read_call, Measurement *m, GError **error) {
+  FlMethodCodecClass *codec_class = FL_METHOD_CODEC_GET_CLASS(codec);
+  gchar *method = nullptr;
+  FlValue *args = nullptr;
+
+  phase_begin(m);
+  codec_class->decode_method_call(codec, write_call, &method, &args,
+                                  nullptr);
+  GAutoFree<gchar> write_method(method);
+  RefPtr<FlValue> write_args = RefPtr<FlValue>::adopt(args);
+  phase_end(m, PHASE_WRITE_DECODE_CALL);
+
+  phase_begin(m);
+  RefPtr<FlMethodResponse> response = co_await biometric_storage_plugin_call(
+      plugin, write_method.get(), write_args.get());
+  phase_end(m, PHASE_WRITE_CALL);
+  if (!check_response(response.get(), error)) {
+    co_return false;
+  }
+
+  phase_begin(m);
+  g_bytes_unref(codec_class->encode_success_envelope(
+      codec,
+      fl_method_success_response_get_result(
+          FL_METHOD_SUCCESS_RESPONSE(response.get())),
+      nullptr));
+  phase_end(m, PHASE_WRITE_ENCODE_RESPONSE);
+
+  phase_begin(m);
+  codec_class->decode_method_call(codec, read_call, &method, &args,
+                                  nullptr);
+  GAutoFree<gchar> read_method(method);
+  RefPtr<FlValue> read_args = RefPtr<FlValue>::adopt(args);
+  phase_end(m, PHASE_READ_DECODE_CALL);
+
+  phase_begin(m);
+  response = co_await biometric_storage_plugin_call(plugin, read_method.get(),
+                                                    read_args.get());
+  phase_end(m, PHASE_READ_CALL);
+  if (!check_response(response.get(), error)) {
+    co_return false;
+  }
+  FlValue *result = fl_method_success_response_get_result(
+      FL_METHOD_SUCCESS_RESPONSE(response.get()));
+  if (fl_value_get_type(result) != FL_VALUE_TYPE_STRING) {
+    g_set_error(error, G_IO_ERROR, G_IO_ERROR_NOT_FOUND,
+                "Stored item %s not found", BENCH_STORAGE_NAME);
+    co_return false;
+  }
+
+  phase_begin(m);
+  GBytes *envelope =
+      codec_class->encode_success_envelope(codec, result, nullptr);
+  phase_end(m, PHASE_READ_ENCODE_RESPONSE);
+
+  phase_begin(m);
+  g_object_unref(codec_class->decode_response(codec, envelope, nullptr));
+  phase_end(m, PHASE_READ_DECODE_RESPONSE);
+  g_bytes_unref(envelope);
+
+  co_return true;
+}
+
+static void print_header() {
+  if (csv) {
+    printf("size,path,phase,allocs,alloc_bytes,frees,copies,copy_bytes,"
+           "payload_copies\n");
+  } else {
+    printf("%-8s %-6s %-16s %10s %14s %10s %10s %14s %8s\n", "size", "path",
+           "phase", "allocs", "alloc_bytes", "frees", "copies", "copy_bytes",
+           "x_copy");
+  }
+}
+
+static void print_row(gsize size, const gchar *path, const gchar *phase,
+                      const AllocStats *total, gint runs) {
+  gdouble allocs = (gdouble)total->allocs / runs;
+  gdouble alloc_bytes = (gdouble)total->alloc_bytes / runs;
+  gdouble frees = (gdouble)total->frees / runs;
+  gdouble copies = (gdouble)total->copies / runs;
+  gdouble copy_bytes = (gdouble)total->copy_bytes / runs;
+  gdouble payload_copies = size > 0 ? copy_bytes / size : 0;
+  if (csv) {
+    printf("%" G_GSIZE_FORMAT ",%s,%s,%.1f,%.0f,%.1f,%.1f,%.0f,%.2f\n", size,
+           path, phase, allocs, alloc_bytes, frees, copies, copy_bytes,
+           payload_copies);
+  } else {
+    g_autofree gchar *size_str = bench_format_size(size);
+    printf("%-8s %-6s %-16s %10.1f %14.0f %10.1f %10.1f %14.0f %8.2f\n",
+           size_str, path, phase, allocs, alloc_bytes, frees, copies,
+           copy_bytes, payload_copies);
+  }
+}
+
+// Prints all phases of one payload size and returns the number of times the
+// read path copied the payload.
+static gdouble report(gsize size, Measurement *m) {
+  AllocStats path_totals[2] = {};
+  for (gint phase = 0; phase < PHASE_COUNT; phase++) {
+    print_row(size, kPhases[phase].path, kPhases[phase].name,
+              &m->totals[phase], iterations);
+    AllocStats *path_total =
+        &path_totals[phase < PHASE_READ_DECODE_CALL ? 0 : 1];
+    path_total->allocs += m->totals[phase].allocs;
+    path_total->alloc_bytes += m->totals[phase].alloc_bytes;
+    path_total->frees += m->totals[phase].frees;
+    path_total->copies += m->totals[phase].copies;
+    path_total->copy_bytes += m->totals[phase].copy_bytes;
+  }
+  print_row(size, "write", "total", &path_totals[0], iterations);
+  print_row(size, "read", "total", &path_totals[1], iterations);
+  return size > 0 ? (gdouble)path_totals[1].copy_bytes / iterations / size
+                  : 0;
+}
+
+// Measures all sizes, sets `status` to the exit code of the benchmark.
+static Task<> run_benchmark(BiometricStoragePlugin *plugin,
+                            FlMethodCodec *codec, GArray *sizes,
+                            GMainLoop *loop, int *status) {
+  GError *error = nullptr;
+  print_header();
+  for (guint i = 0; i < sizes->len; i++) {
+    gsize size = g_array_index(sizes, gsize, i);
+    GAutoFree<gchar> payload(bench_payload_new(size));
+    GBytes *write_call = encode_call(codec, "write", payload.get());
+    GBytes *read_call = encode_call(codec, "read", nullptr);
+    Measurement measurement = {};
+
+    // Warm up, so opening the keyring session is not attributed to the
+    // first size.
+    Measurement warmup = {};
+    bool ok = co_await run_once(plugin, codec, write_call, read_call, &warmup,
+                                &error);
+    if (!ok) {
+      g_printerr("Keyring operation failed, is a Secret Service running? %s\n",
+                 error->message);
+    }
+    for (gint run = 0; ok && run < iterations; run++) {
+      ok = co_await run_once(plugin, codec, write_call, read_call,
+                             &measurement, &error);
+      if (!ok) {
+        g_printerr("Keyring operation failed: %s\n", error->message);
+      }
+    }
+    g_bytes_unref(write_call);
+    g_bytes_unref(read_call);
+    if (!ok) {
+      g_clear_error(&error);
+      *status = 1;
+      break;
+    }
+
+    gdouble read_copies = report(size, &measurement);
+    if (max_read_copies > 0 && size >= 64 * 1024 &&
+        read_copies > max_read_copies) {
+      g_printerr("Read path copied %" G_GSIZE_FORMAT
+                 " byte payload %.2f times (max %.2f)\n",
+                 size, read_copies, max_read_copies);
+      *status = 2;
+    }
+  }
+
+  RefPtr<FlValue> args = RefPtr<FlValue>::adopt(fl_value_new_map());
+  fl_value_set_string_take(args.get(), "name",
+                           fl_value_new_string(BENCH_STORAGE_NAME));
+  co_await biometric_storage_plugin_call(plugin, "delete", args.get());
+  g_main_loop_quit(loop);
+}
+
+int main(int argc, char **argv) {
+  // Make sure every glib allocation goes through malloc.
+  g_setenv("G_SLICE", "always-malloc", TRUE);
+
+  g_autoptr(GError) error = nullptr;
+  GOptionContext *context = g_option_context_new("- allocation benchmark");
+  g_option_context_add_main_entries(context, entries, nullptr);
+  gboolean parsed = g_option_context_parse(context, &argc, &argv, &error);
+  g_option_context_free(context);
+  if (!parsed) {
+    g_printerr("%s\n", error->message);
+    return 1;
+  }
+
+  g_autoptr(GArray) sizes = bench_parse_sizes(
+      sizes_spec != nullptr ? sizes_spec : "16,1k,64k,1m,4m", &error);
+  if (sizes == nullptr) {
+    g_printerr("%s\n", error->message);
+    return 1;
+  }
+
+  g_autoptr(GObject) plugin = G_OBJECT(
+      g_object_new(biometric_storage_plugin_get_type(), nullptr));
+  g_autoptr(FlStandardMethodCodec) codec = fl_standard_method_codec_new();
+  g_autoptr(GMainLoop) loop = g_main_loop_new(nullptr, FALSE);
+  int status = 0;
+  task_detach(run_benchmark(reinterpret_cast<BiometricStoragePlugin *>(plugin),
+                            FL_METHOD_CODEC(codec), sizes, loop, &status));
+  g_main_loop_run(loop);
+  return status;
+}
@@ -0,0 +1,147 @@
+#include "alloc_hooks.h"
+
+#include <atomic>
+#include <dlfcn.h>
+#include <errno.h>
+#include <malloc.h>
+#include <stddef.h>
+
+// glibc exports its allocator under these names, which lets the hooks below
+// forward without going through dlsym (which allocates itself).
+extern "C" {
+void *__libc_malloc(size_t size);
+void *__libc_calloc(size_t nmemb, size_t size);
+void *__libc_realloc(void *ptr, size_t size);
+void *__libc_memalign(size_t alignment, size_t size);
+void __libc_free(void *ptr);
+}
+
+typedef void *(*CopyFunc)(void *dest, const void *src, size_t n);
+
+static std::atomic<uint64_t> allocs{0};
+static std::atomic<uint64_t> alloc_bytes{0};
+static std::atomic<uint64_t> frees{0};
+static std::atomic<uint64_t> copies{0};
+static std::atomic<uint64_t> copy_bytes{0};
+
+static CopyFunc real_memcpy = nullptr;
+static CopyFunc real_memmove = nullptr;
+
+static void count_alloc(void *ptr, size_t size) {
+  if (ptr == nullptr) {
+    return;
+  }
+  allocs.fetch_add(1, std::memory_order_relaxed);
+  alloc_bytes.fetch_add(size, std::memory_order_relaxed);
+}
+
+static void count_copy(size_t n) {
+  copies.fetch_add(1, std::memory_order_relaxed);
+  copy_bytes.fetch_add(n, std::memory_order_relaxed);
+}
+
+// Used until the real implementations are resolved. Written with volatile
+// accesses so the compiler can not turn the loop back into a memmove call.
+static void *fallback_move(void *dest, const void *src, size_t n) {
+  volatile unsigned char *d = static_cast<volatile unsigned char *>(dest);
+  const volatile unsigned char *s =
+      static_cast<const volatile unsigned char *>(src);
+  if (d < s) {
+    for (size_t i = 0; i < n; i++) {
+      d[i] = s[i];
+    }
+  } else {
+    for (size_t i = n; i > 0; i--) {
+      d[i - 1] = s[i - 1];
+    }
+  }
+  return dest;
+}
+
+__attribute__((constructor)) static void alloc_hooks_init() {
+  real_memcpy = reinterpret_cast<CopyFunc>(dlsym(RTLD_NEXT, "memcpy"));
+  real_memmove = reinterpret_cast<CopyFunc>(dlsym(RTLD_NEXT, "memmove"));
+}
+
+extern "C" {
+
+void *malloc(size_t size) noexcept {
+  void *ptr = __libc_malloc(size);
+  count_alloc(ptr, size);
+  return ptr;
+}
+
+void *calloc(size_t nmemb, size_t size) noexcept {
+  void *ptr = __libc_calloc(nmemb, size);
+  count_alloc(ptr, nmemb * size);
+  return ptr;
+}
+
+void *realloc(void *old, size_t size) noexcept {
+  if (old != nullptr) {
+    frees.fetch_add(1, std::memory_order_relaxed);
+  }
+  void *ptr = __libc_realloc(old, size);
+  count_alloc(ptr, size);
+  return ptr;
+}
+
+void *memalign(size_t alignment, size_t size) noexcept {
+  void *ptr = __libc_memalign(alignment, size);
+  count_alloc(ptr, size);
+  return ptr;
+}
+
+void *aligned_alloc(size_t alignment, size_t size) noexcept {
+  return memalign(alignment, size);
+}
+
+int posix_memalign(void **result, size_t alignment, size_t size) noexcept {
+  void *ptr = memalign(alignment, size);
+  if (ptr == nullptr) {
+    return ENOMEM;
+  }
+  *result = ptr;
+  return 0;
+}
+
+void free(void *ptr) noexcept {
+  if (ptr != nullptr) {
+    frees.fetch_add(1, std::memory_order_relaxed);
+  }
+  __libc_free(ptr);
+}
+
+void *memcpy(void *dest, const void *src, size_t n) noexcept {
+  count_copy(n);
+  CopyFunc copy = real_memcpy != nullptr ? real_memcpy : fallback_move;
+  return copy(dest, src, n);
+}
+
+void *memmove(void *dest, const void *src, size_t n) noexcept {
+  count_copy(n);
+  CopyFunc copy = real_memmove != nullptr ? real_memmove : fallback_move;
+  return copy(dest, src, n);
+}
+
+}  // extern "C"
+
+AllocStats alloc_stats_snapshot(void) {
+  AllocStats stats;
+  stats.allocs = allocs.load(std::memory_order_relaxed);
+  stats.alloc_bytes = alloc_bytes.load(std::memory_order_relaxed);
+  stats.frees = frees.load(std::memory_order_relaxed);
+  stats.copies = copies.load(std::memory_order_relaxed);
+  stats.copy_bytes = copy_bytes.load(std::memory_order_relaxed);
+  return stats;
+}
+
+AllocStats alloc_stats_diff(const AllocStats *before, const AllocStats *after) {
+  AllocStats diff;
+  diff.allocs = after->allocs - before->allocs;
+  diff.alloc_bytes = after->alloc_bytes - before->alloc_bytes;
+  diff.frees = after->frees - before->frees;
+  diff.copies = after->copies - before->copies;
+  diff.copy_bytes = after->copy_bytes - before->copy_bytes;
+  return diff;
+}
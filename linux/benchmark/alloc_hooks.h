@@ -0,0 +1,27 @@
+#ifndef BIOMETRIC_STORAGE_BENCHMARK_ALLOC_HOOKS_H_
+#define BIOMETRIC_STORAGE_BENCHMARK_ALLOC_HOOKS_H_
+
+#include <stdint.h>
+
+// Process wide allocation and copy counters. Linking alloc_hooks.cc into an
+// executable interposes malloc/free and memcpy/memmove for the executable and
+// every shared library it loads (glib, libsecret, libflutter_linux_gtk), so
+// the counters include work done on the gdbus worker thread as well.
+//
+// Memory allocated by libsecret for secrets comes from its own mlock()ed
+// pool and does not show up as allocations, but copies into it do.
+typedef struct {
+  uint64_t allocs;
+  uint64_t alloc_bytes;
+  uint64_t frees;
+  uint64_t copies;
+  uint64_t copy_bytes;
+} AllocStats;
+
+// Returns the current counter values.
+AllocStats alloc_stats_snapshot(void);
+
+// Returns the difference `after - before`.
+AllocStats alloc_stats_diff(const AllocStats *before, const AllocStats *after);
+
+#endif  // BIOMETRIC_STORAGE_BENCHMARK_ALLOC_HOOKS_H_
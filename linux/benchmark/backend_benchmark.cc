@@ -0,0 +1,189 @@
+// Latency and throughput of the plugin's write, read and delete operations
+// against whatever Secret Service owns org.freedesktop.secrets on the
+// session bus. run_backend_matrix.sh runs it against each locally available
+// daemon on a private bus and merges the reports.
+//
+// Operations go through biometric_storage_plugin_call(), the same entry
+// point the method channel uses, `--concurrency` of them in flight at a
+// time. For every payload size the benchmark writes `--items` items, reads
+// them back and deletes them. Items are named "backend_benchmark.<n>".
+
+#include <flutter_linux/flutter_linux.h>
+#include <stdio.h>
+#include <string.h>
+
+#include <algorithm>
+#include <vector>
+
+#include "../biometric_storage_plugin_private.h"
+#include "bench_util.h"
+
+static gchar *backend = nullptr;
+static gchar *sizes_spec = nullptr;
+static gint items = 64;
+static gint concurrency = 1;
+static gboolean csv = FALSE;
+
+static GOptionEntry entries[] = {
+    {"backend", 'b', 0, G_OPTION_ARG_STRING, &backend,
+     "Name of the backend in the report (default: session)", "NAME"},
+    {"sizes", 's', 0, G_OPTION_ARG_STRING, &sizes_spec,
+     "Comma separated payload sizes (default: 16,1k,64k,1m)", "SIZES"},
+    {"items", 'n', 0, G_OPTION_ARG_INT, &items,
+     "Items written, read and deleted per payload size (default: 64)", "N"},
+    {"concurrency", 'c', 0, G_OPTION_ARG_INT, &concurrency,
+     "Operations in flight at a time (default: 1)", "N"},
+    {"csv", 0, 0, G_OPTION_ARG_NONE, &csv, "Print results as CSV", nullptr},
+    {nullptr}};
+
+static const gchar *const kOperations[] = {"write", "read", "delete"};
+
+// One operation over all items of one payload size.
+struct Phase {
+  const gchar *method;
+  const gchar *payload;
+  gint next = 0;
+  guint running = 0;
+  gint failed = 0;
+  std::vector<gint64> latencies_ns;
+  AsyncCondition done;
+};
+
+static Task<> run_worker(BiometricStoragePlugin *plugin, Phase *phase) {
+  while (phase->next < items) {
+    gint index = phase->next++;
+    RefPtr<FlValue> args = RefPtr<FlValue>::adopt(fl_value_new_map());
+    GAutoFree<gchar> name(g_strdup_printf("backend_benchmark.%d", index));
+    fl_value_set_string_take(args.get(), "name",
+                             fl_value_new_string(name.get()));
+    if (strcmp(phase->method, "write") == 0) {
+      fl_value_set_string_take(args.get(), "content",
+                               fl_value_new_string(phase->payload));
+    }
+    gint64 started = bench_now_ns();
+    RefPtr<FlMethodResponse> response = co_await biometric_storage_plugin_call(
+        plugin, phase->method, args.get());
+    phase->latencies_ns.push_back(bench_now_ns() - started);
+    if (FL_IS_METHOD_ERROR_RESPONSE(response.get())) {
+      if (phase->failed++ == 0) {
+        g_printerr("%s failed: %s\n", phase->method,
+                   fl_method_error_response_get_message(
+                       FL_METHOD_ERROR_RESPONSE(response.get())));
+      }
+    }
+  }
+  phase->running--;
+  phase->done.notify_all();
+}
+
+static gint64 percentile(const std::vector<gint64> &sorted, gdouble p) {
+  if (sorted.empty()) {
+    return 0;
+  }
+  gsize index = (gsize)(p * (sorted.size() - 1) + 0.5);
+  return sorted[index];
+}
+
+static void print_header() {
+  if (csv) {
+    printf("backend,operation,size,concurrency,ops,failed,mean_us,p50_us,"
+           "p95_us,p99_us,ops_per_s,mib_per_s\n");
+  } else {
+    printf("%-14s %-7s %-8s %4s %6s %6s %10s %10s %10s %10s %10s %9s\n",
+           "backend", "op", "size", "conc", "ops", "failed", "mean_us",
+           "p50_us", "p95_us", "p99_us", "ops/s", "MiB/s");
+  }
+}
+
+static void report(gsize size, Phase *phase, gint64 wall_ns) {
+  std::vector<gint64> &latencies = phase->latencies_ns;
+  std::sort(latencies.begin(), latencies.end());
+  gdouble total = 0;
+  for (gint64 latency : latencies) {
+    total += latency;
+  }
+  gsize ops = latencies.size();
+  gdouble mean_us = ops > 0 ? total / ops / 1000 : 0;
+  gdouble ops_per_s = wall_ns > 0 ? ops * 1e9 / wall_ns : 0;
+  gdouble mib_per_s = ops_per_s * size / (1024 * 1024);
+  const gchar *name = backend != nullptr ? backend : "session";
+  if (csv) {
+    printf("%s,%s,%" G_GSIZE_FORMAT ",%d,%" G_GSIZE_FORMAT
+           ",%d,%.1f,%.1f,%.1f,%.1f,%.1f,%.2f\n",
+           name, phase->method, size, concurrency, ops, phase->failed,
+           mean_us, percentile(latencies, 0.5) / 1000.0,
+           percentile(latencies, 0.95) / 1000.0,
+           percentile(latencies, 0.99) / 1000.0, ops_per_s, mib_per_s);
+  } else {
+    g_autofree gchar *size_str = bench_format_size(size);
+    printf("%-14s %-7s %-8s %4d %6" G_GSIZE_FORMAT
+           " %6d %10.1f %10.1f %10.1f %10.1f %10.1f %9.2f\n",
+           name, phase->method, size_str, concurrency, ops, phase->failed,
+           mean_us, percentile(latencies, 0.5) / 1000.0,
+           percentile(latencies, 0.95) / 1000.0,
+           percentile(latencies, 0.99) / 1000.0, ops_per_s, mib_per_s);
+  }
+  fflush(stdout);
+}
+
+static Task<> run_phase(BiometricStoragePlugin *plugin, Phase *phase) {
+  for (gint i = 0; i < concurrency; i++) {
+    phase->running++;
+    task_detach(run_worker(plugin, phase));
+  }
+  while (phase->running > 0) {
+    co_await phase->done.wait();
+  }
+}
+
+static Task<> run_benchmark(BiometricStoragePlugin *plugin, GArray *sizes,
+                            GMainLoop *loop, gint *failed) {
+  print_header();
+  for (guint i = 0; i < sizes->len; i++) {
+    gsize size = g_array_index(sizes, gsize, i);
+    GAutoFree<gchar> payload(bench_payload_new(size));
+    for (const gchar *method : kOperations) {
+      Phase phase;
+      phase.method = method;
+      phase.payload = payload.get();
+      phase.latencies_ns.reserve(items);
+      gint64 started = bench_now_ns();
+      co_await run_phase(plugin, &phase);
+      report(size, &phase, bench_now_ns() - started);
+      *failed += phase.failed;
+    }
+  }
+  g_main_loop_quit(loop);
+}
+
+int main(int argc, char **argv) {
+  g_autoptr(GError) error = nullptr;
+  GOptionContext *context = g_option_context_new("- backend benchmark");
+  g_option_context_add_main_entries(context, entries, nullptr);
+  gboolean parsed = g_option_context_parse(context, &argc, &argv, &error);
+  g_option_context_free(context);
+  if (!parsed) {
+    g_printerr("%s\n", error->message);
+    return 1;
+  }
+  if (items < 1 || concurrency < 1) {
+    g_printerr("--items and --concurrency must be positive\n");
+    return 1;
+  }
+
+  g_autoptr(GArray) sizes = bench_parse_sizes(
+      sizes_spec != nullptr ? sizes_spec : "16,1k,64k,1m", &error);
+  if (sizes == nullptr) {
+    g_printerr("%s\n", error->message);
+    return 1;
+  }
+
+  g_autoptr(GObject) plugin = G_OBJECT(
+      g_object_new(biometric_storage_plugin_get_type(), nullptr));
+  g_autoptr(GMainLoop) loop = g_main_loop_new(nullptr, FALSE);
+  gint failed = 0;
+  task_detach(run_benchmark(reinterpret_cast<BiometricStoragePlugin *>(plugin),
+                            sizes, loop, &failed));
+  g_main_loop_run(loop);
+  return failed > 0 ? 1 : 0;
+}
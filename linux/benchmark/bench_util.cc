@@ -0,0 +1,50 @@
+#include "bench_util.h"
+
+#include <time.h>
+
+GArray *bench_parse_sizes(const gchar *spec, GError **error) {
+  g_auto(GStrv) parts = g_strsplit(spec, ",", -1);
+  GArray *sizes = g_array_new(FALSE, FALSE, sizeof(gsize));
+  for (gchar **part = parts; *part != nullptr; part++) {
+    gchar *end = nullptr;
+    gsize size = g_ascii_strtoull(*part, &end, 10);
+    if (end == *part) {
+      g_set_error(error, G_OPTION_ERROR, G_OPTION_ERROR_BAD_VALUE,
+                  "Invalid size: %s", *part);
+      g_array_unref(sizes);
+      return nullptr;
+    }
+    if (*end == 'k' || *end == 'K') {
+      size *= 1024;
+    } else if (*end == 'm' || *end == 'M') {
+      size *= 1024 * 1024;
+    }
+    g_array_append_val(sizes, size);
+  }
+  return sizes;
+}
+
+gchar *bench_payload_new(gsize size) {
+  gchar *payload = static_cast<gchar *>(g_malloc(size + 1));
+  for (gsize i = 0; i < size; i++) {
+    payload[i] = 'a' + (i % 26);
+  }
+  payload[size] = '\0';
+  return payload;
+}
+
+gchar *bench_format_size(gsize size) {
+  if (size >= 1024 * 1024 && size % (1024 * 1024) == 0) {
+    return g_strdup_printf("%" G_GSIZE_FORMAT "MiB", size / (1024 * 1024));
+  }
+  if (size >= 1024 && size % 1024 == 0) {
+    return g_strdup_printf("%" G_GSIZE_FORMAT "KiB", size / 1024);
+  }
+  return g_strdup_printf("%" G_GSIZE_FORMAT "B", size);
+}
+
+gint64 bench_now_ns(void) {
+  struct timespec now;
+  clock_gettime(CLOCK_MONOTONIC, &now);
+  return (gint64)now.tv_sec * 1000000000 + now.tv_nsec;
+}
@@ -0,0 +1,19 @@
+#ifndef BIOMETRIC_STORAGE_BENCHMARK_BENCH_UTIL_H_
+#define BIOMETRIC_STORAGE_BENCHMARK_BENCH_UTIL_H_
+
+#include <glib.h>
+
+// Parses a comma separated list of payload sizes with an optional k/m suffix
+// (e.g. "16,1k,64k,4m") into a GArray of gsize.
+GArray *bench_parse_sizes(const gchar *spec, GError **error);
+
+// Returns a nul terminated payload of `size` printable ASCII characters.
+gchar *bench_payload_new(gsize size);
+
+// Returns a monotonic timestamp in nanoseconds.
+gint64 bench_now_ns(void);
+
+// Formats a payload size for humans, e.g. "64KiB".
+gchar *bench_format_size(gsize size);
+
+#endif  // BIOMETRIC_STORAGE_BENCHMARK_BENCH_UTIL_H_
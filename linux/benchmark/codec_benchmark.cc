@@ -0,0 +1,284 @@
+// Measures how long encoding and decoding the plugin's method calls and
+// responses takes, and how much it allocates, for payloads from 16 bytes up
+// to 16 MiB.
+//
+// The messages are exactly the ones exchanged by the plugin: the `init`,
+// `read`, `write` and `delete` argument maps sent by dart, the success
+// responses and the error envelope built by
+// `biometric_storage_handle_error`. Every message is run through
+// FlStandardMethodCodec, which is what the plugin registers its channel
+// with. FlJsonMethodCodec is measured as well as a reference point, the
+// plugin does not offer any other codec.
+
+#include <flutter_linux/flutter_linux.h>
+#include <stdio.h>
+
+#include "../biometric_storage_plugin_private.h"
+#include "alloc_hooks.h"
+#include "bench_util.h"
+
+typedef enum {
+  FIXTURE_METHOD_CALL,
+  FIXTURE_SUCCESS,
+  FIXTURE_ERROR,
+} FixtureType;
+
+typedef struct {
+  FixtureType type;
+  const gchar *method;
+  FlValue *value;
+  const gchar *error_code;
+  const gchar *error_message;
+} Fixture;
+
+typedef struct {
+  const gchar *name;
+  // Whether the message contains the payload, otherwise it is only run once.
+  gboolean sized;
+  void (*build)(Fixture *fixture, const gchar *payload);
+} Shape;
+
+static gint min_time_ms = 200;
+static gchar *sizes_spec = nullptr;
+static gboolean csv = FALSE;
+
+static GOptionEntry entries[] = {
+    {"min-time", 't', 0, G_OPTION_ARG_INT, &min_time_ms,
+     "Minimum time to run each measurement in ms (default: 200)", "MS"},
+    {"sizes", 's', 0, G_OPTION_ARG_STRING, &sizes_spec,
+     "Comma separated payload sizes (default: 16,256,4k,64k,1m,16m)",
+     "SIZES"},
+    {"csv", 0, 0, G_OPTION_ARG_NONE, &csv, "Print results as CSV", nullptr},
+    {nullptr}};
+
+static FlValue *name_args(const gchar *name) {
+  FlValue *args = fl_value_new_map();
+  fl_value_set_string_take(args, "name", fl_value_new_string(name));
+  return args;
+}
+
+static void build_init_call(Fixture *fixture, const gchar *payload) {
+  FlValue *options = fl_value_new_map();
+  fl_value_set_string_take(options, "authenticationValidityDurationSeconds",
+                           fl_value_new_int(10));
+  fl_value_set_string_take(options, "authenticationRequired",
+                           fl_value_new_bool(false));
+  fixture->type = FIXTURE_METHOD_CALL;
+  fixture->method = "init";
+  fixture->value = name_args("codec_benchmark");
+  fl_value_set_string_take(fixture->value, "options", options);
+  fl_value_set_string_take(fixture->value, "forceInit",
+                           fl_value_new_bool(false));
+}
+
+static void build_read_call(Fixture *fixture, const gchar *payload) {
+  fixture->type = FIXTURE_METHOD_CALL;
+  fixture->method = "read";
+  fixture->value = name_args("codec_benchmark");
+}
+
+static void build_write_call(Fixture *fixture, const gchar *payload) {
+  fixture->type = FIXTURE_METHOD_CALL;
+  fixture->method = "write";
+  fixture->value = name_args("codec_benchmark");
+  fl_value_set_string_take(fixture->value, "content",
+                           fl_value_new_string(payload));
+}
+
+static void build_read_response(Fixture *fixture, const gchar *payload) {
+  fixture->type = FIXTURE_SUCCESS;
+  fixture->value = fl_value_new_string(payload);
+}
+
+static void build_not_found_response(Fixture *fixture, const gchar *payload) {
+  fixture->type = FIXTURE_SUCCESS;
+  fixture->value = fl_value_new_null();
+}
+
+static void build_bool_response(Fixture *fixture, const gchar *payload) {
+  fixture->type = FIXTURE_SUCCESS;
+  fixture->value = fl_value_new_bool(true);
+}
+
+static void build_error_response(Fixture *fixture, const gchar *payload) {
+  // A typical failure when the keyring is not reachable.
+  g_autoptr(GError) error = g_error_new_literal(
+      G_DBUS_ERROR, G_DBUS_ERROR_SERVICE_UNKNOWN,
+      "GDBus.Error:org.freedesktop.DBus.Error.ServiceUnknown: The name "
+      "org.freedesktop.secrets was not provided by any .service files");
+  g_autoptr(FlMethodResponse) response =
+      biometric_storage_handle_error("Failed to store secret", error);
+  FlMethodErrorResponse *error_response = FL_METHOD_ERROR_RESPONSE(response);
+  fixture->type = FIXTURE_ERROR;
+  fixture->error_code =
+      g_strdup(fl_method_error_response_get_code(error_response));
+  fixture->error_message =
+      g_strdup(fl_method_error_response_get_message(error_response));
+  fixture->value =
+      fl_value_ref(fl_method_error_response_get_details(error_response));
+}
+
+static const Shape kShapes[] = {
+    {"call/init", FALSE, build_init_call},
+    {"call/read", FALSE, build_read_call},
+    {"call/write", TRUE, build_write_call},
+    {"response/read", TRUE, build_read_response},
+    {"response/read_null", FALSE, build_not_found_response},
+    {"response/bool", FALSE, build_bool_response},
+    {"error/handle_error", FALSE, build_error_response},
+};
+
+static void fixture_clear(Fixture *fixture) {
+  fl_value_unref(fixture->value);
+  g_free((gchar *)fixture->error_code);
+  g_free((gchar *)fixture->error_message);
+}
+
+static GBytes *encode(FlMethodCodec *codec, const Fixture *fixture) {
+  FlMethodCodecClass *codec_class = FL_METHOD_CODEC_GET_CLASS(codec);
+  switch (fixture->type) {
+    case FIXTURE_METHOD_CALL:
+      return codec_class->encode_method_call(codec, fixture->method,
+                                             fixture->value, nullptr);
+    case FIXTURE_SUCCESS:
+      return codec_class->encode_success_envelope(codec, fixture->value,
+                                                  nullptr);
+    case FIXTURE_ERROR:
+      return codec_class->encode_error_envelope(
+          codec, fixture->error_code, fixture->error_message, fixture->value,
+          nullptr);
+  }
+  return nullptr;
+}
+
+static void decode(FlMethodCodec *codec, const Fixture *fixture,
+                   GBytes *message) {
+  FlMethodCodecClass *codec_class = FL_METHOD_CODEC_GET_CLASS(codec);
+  if (fixture->type == FIXTURE_METHOD_CALL) {
+    g_autofree gchar *name = nullptr;
+    g_autoptr(FlValue) args = nullptr;
+    codec_class->decode_method_call(codec, message, &name, &args, nullptr);
+  } else {
+    g_object_unref(codec_class->decode_response(codec, message, nullptr));
+  }
+}
+
+typedef struct {
+  gdouble ns_per_op;
+  gdouble allocs_per_op;
+  gdouble bytes_per_op;
+} Result;
+
+// Runs encode (message == nullptr) or decode until min_time_ms passed.
+static Result measure(FlMethodCodec *codec, const Fixture *fixture,
+                      GBytes *message) {
+  gint64 deadline = bench_now_ns() + (gint64)min_time_ms * 1000000;
+  guint64 ops = 0;
+  AllocStats before = alloc_stats_snapshot();
+  gint64 start = bench_now_ns();
+  gint64 now = start;
+  while (now < deadline || ops < 3) {
+    if (message == nullptr) {
+      g_bytes_unref(encode(codec, fixture));
+    } else {
+      decode(codec, fixture, message);
+    }
+    ops++;
+    now = bench_now_ns();
+  }
+  AllocStats after = alloc_stats_snapshot();
+  AllocStats diff = alloc_stats_diff(&before, &after);
+  Result result;
+  result.ns_per_op = (gdouble)(now - start) / ops;
+  result.allocs_per_op = (gdouble)diff.allocs / ops;
+  result.bytes_per_op = (gdouble)diff.alloc_bytes / ops;
+  return result;
+}
+
+static void print_row(const gchar *codec_name, const gchar *shape, gsize size,
+                      const gchar *op, gsize message_size,
+                      const Result *result) {
+  gdouble mib_per_s =
+      message_size / (result->ns_per_op / 1e9) / (1024.0 * 1024.0);
+  if (csv) {
+    printf("%s,%s,%" G_GSIZE_FORMAT ",%s,%" G_GSIZE_FORMAT
+           ",%.1f,%.1f,%.0f,%.1f\n",
+           codec_name, shape, size, op, message_size, result->ns_per_op,
+           result->allocs_per_op, result->bytes_per_op, mib_per_s);
+  } else {
+    g_autofree gchar *size_str = bench_format_size(size);
+    printf("%-8s %-20s %-8s %-6s %12" G_GSIZE_FORMAT
+           " %14.1f %10.1f %14.0f %10.1f\n",
+           codec_name, shape, size_str, op, message_size, result->ns_per_op,
+           result->allocs_per_op, result->bytes_per_op, mib_per_s);
+  }
+}
+
+static void run_shape(const gchar *codec_name, FlMethodCodec *codec,
+                      const Shape *shape, gsize size, const gchar *payload) {
+  Fixture fixture = {};
+  shape->build(&fixture, payload);
+  g_autoptr(GBytes) message = encode(codec, &fixture);
+
+  Result encoded = measure(codec, &fixture, nullptr);
+  print_row(codec_name, shape->name, size, "encode", g_bytes_get_size(message),
+            &encoded);
+  Result decoded = measure(codec, &fixture, message);
+  print_row(codec_name, shape->name, size, "decode", g_bytes_get_size(message),
+            &decoded);
+  fixture_clear(&fixture);
+}
+
+int main(int argc, char **argv) {
+  g_setenv("G_SLICE", "always-malloc", TRUE);
+
+  g_autoptr(GError) error = nullptr;
+  GOptionContext *context = g_option_context_new("- codec benchmark");
+  g_option_context_add_main_entries(context, entries, nullptr);
+  gboolean parsed = g_option_context_parse(context, &argc, &argv, &error);
+  g_option_context_free(context);
+  if (!parsed) {
+    g_printerr("%s\n", error->message);
+    return 1;
+  }
+  g_autoptr(GArray) sizes = bench_parse_sizes(
+      sizes_spec != nullptr ? sizes_spec : "16,256,4k,64k,1m,16m", &error);
+  if (sizes == nullptr) {
+    g_printerr("%s\n", error->message);
+    return 1;
+  }
+
+  g_autoptr(FlStandardMethodCodec) standard_codec =
+      fl_standard_method_codec_new();
+  g_autoptr(FlJsonMethodCodec) json_codec = fl_json_method_codec_new();
+  const struct {
+    const gchar *name;
+    FlMethodCodec *codec;
+  } codecs[] = {
+      {"standard", FL_METHOD_CODEC(standard_codec)},
+      {"json", FL_METHOD_CODEC(json_codec)},
+  };
+
+  if (csv) {
+    printf("codec,shape,size,op,message_bytes,ns_per_op,allocs_per_op,"
+           "alloc_bytes_per_op,mib_per_s\n");
+  } else {
+    printf("%-8s %-20s %-8s %-6s %12s %14s %10s %14s %10s\n", "codec",
+           "shape", "payload", "op", "msg_bytes", "ns/op", "allocs/op",
+           "bytes/op", "MiB/s");
+  }
+  for (const auto &codec : codecs) {
+    for (const Shape &shape : kShapes) {
+      if (!shape.sized) {
+        run_shape(codec.name, codec.codec, &shape, 0, "");
+        continue;
+      }
+      for (guint i = 0; i < sizes->len; i++) {
+        gsize size = g_array_index(sizes, gsize, i);
+        g_autofree gchar *payload = bench_payload_new(size);
+        run_shape(codec.name, codec.codec, &shape, size, payload);
+      }
+    }
+  }
+  return 0;
+}
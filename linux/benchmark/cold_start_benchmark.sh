@@ -0,0 +1,143 @@
+#!/bin/sh
+# Launches the example app over and over and reports how long it takes from
+# process start until the first secret was read, with a freshly started
+# (cold) and an already running (warm) keyring daemon.
+#
+#   cold_start_benchmark.sh BUNDLE_DIR [RUNS]
+#
+# The plugin needs to be built with -DBIOMETRIC_STORAGE_BENCHMARKS=ON, see
+# README.md. The app and the plugin record these events when
+# BIOMETRIC_STORAGE_TRACE is set, as microseconds since process start:
+#
+#   main                    main() entered
+#   activate                my_application_activate()
+#   register_plugins_start  before fl_register_plugins()
+#   plugin_registered       biometric_storage registered its channels
+#   register_plugins_done   after fl_register_plugins()
+#   plugin_first_init       first `init` answered
+#   plugin_first_read       first `read` answered
+#
+# BIOMETRIC_STORAGE_COLD_START makes the example app read one secret right
+# after launch and exit. Uses gnome-keyring-daemon if installed, otherwise
+# the mock Secret Service from $MOCK_SERVICE (its items do not survive a
+# restart, so cold reads miss there). Starts Xvfb if there is no $DISPLAY.
+# Raw results go to $REPORT (default: cold_start.csv).
+
+set -eu
+
+start_daemon() {
+  if [ "$backend" = gnome-keyring ]; then
+    printf bench | gnome-keyring-daemon --unlock --components=secrets \
+      >/dev/null
+  else
+    "$MOCK_SERVICE" >/dev/null &
+  fi
+  tries=0
+  until gdbus call --session --dest org.freedesktop.DBus \
+      --object-path /org/freedesktop/DBus \
+      --method org.freedesktop.DBus.NameHasOwner org.freedesktop.secrets \
+      2>/dev/null | grep -q true; do
+    tries=$((tries + 1))
+    if [ $tries -gt 100 ]; then
+      echo "Secret Service did not show up" >&2
+      exit 1
+    fi
+    sleep 0.1
+  done
+}
+
+# Runs the app once in `mode` and appends its trace to the report.
+launch() {
+  label=$1
+  mode=$2
+  trace=$(mktemp)
+  BIOMETRIC_STORAGE_TRACE="$trace" BIOMETRIC_STORAGE_COLD_START="$mode" \
+    "$bundle/biometric_storage_example" >/dev/null 2>&1
+  if [ -n "$label" ]; then
+    sed "s/^/$label,/" "$trace" >> "$report"
+  fi
+  rm -f "$trace"
+}
+
+if [ "${1:-}" = "--session" ]; then
+  # On a private bus started by dbus-run-session, the data dir with the
+  # seeded keyring is shared between sessions.
+  shift
+  mode=$1 run=$2 bundle=$3 report=$4 backend=$5
+  start_daemon
+  case "$mode" in
+    seed)
+      launch "" seed
+      ;;
+    cold)
+      launch "$mode,$run" read
+      ;;
+    warm)
+      # Writing the secret (again) warms up the daemon.
+      launch "" seed
+      launch "$mode,$run" read
+      ;;
+  esac
+  exit 0
+fi
+
+if [ $# -lt 1 ]; then
+  sed -n '2,24p' "$0" | sed 's/^# \{0,1\}//' >&2
+  exit 1
+fi
+bundle=$(cd "$1" && pwd)
+runs=${2:-10}
+report=$(pwd)/${REPORT:-cold_start.csv}
+script=$(cd "$(dirname "$0")" && pwd)/$(basename "$0")
+if command -v gnome-keyring-daemon >/dev/null; then
+  backend=gnome-keyring
+elif [ -n "${MOCK_SERVICE:-}" ]; then
+  backend=mock
+else
+  echo "Needs gnome-keyring-daemon or MOCK_SERVICE" >&2
+  exit 1
+fi
+
+if [ -z "${DISPLAY:-}" ]; then
+  Xvfb :97 >/dev/null 2>&1 &
+  xvfb=$!
+  export DISPLAY=:97
+  trap 'kill $xvfb' EXIT
+  sleep 1
+fi
+
+data=$(mktemp -d)
+export HOME="$data" XDG_DATA_HOME="$data/data" XDG_CONFIG_HOME="$data/config"
+mkdir -p "$XDG_DATA_HOME" "$XDG_CONFIG_HOME"
+
+# Stores the secret once, cold runs read it from the keyring on disk.
+dbus-run-session -- "$script" --session seed 0 "$bundle" "$report" "$backend"
+echo "mode,run,event,us" > "$report"
+for run in $(seq "$runs"); do
+  for mode in cold warm; do
+    dbus-run-session -- "$script" --session "$mode" "$run" "$bundle" \
+      "$report" "$backend"
+  done
+done
+rm -rf "$data"
+if ! grep -q plugin_registered "$report"; then
+  echo "No plugin milestones, was it built with" \
+    "-DBIOMETRIC_STORAGE_BENCHMARKS=ON?" >&2
+fi
+
+# Median and p90 of every event per mode.
+echo "mode,event,runs,median_us,p90_us"
+tail -n +2 "$report" | sort -t, -k1,1 -k3,3 -k4,4n | awk -F, '
+  function flush() {
+    if (n > 0) {
+      p90 = int(n * 0.9 + 0.5)
+      if (p90 < 1) p90 = 1
+      printf "%s,%s,%d,%d,%d\n", mode, event, n, v[int((n + 1) / 2)],
+        v[p90]
+    }
+    n = 0
+  }
+  $1 != mode || $3 != event { flush(); mode = $1; event = $3 }
+  { v[++n] = $4 }
+  END { flush() }'
+echo "Raw results: $report" >&2
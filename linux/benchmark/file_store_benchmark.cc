@@ -0,0 +1,239 @@
+// Durable write throughput of the file store (`linuxFileStore`) and how it
+// depends on the size of the group commits. For every combination of
+// `--writers` (writes in flight) and `--max-batch` (records per commit, 0
+// for no limit) it performs `--writes` writes against a fresh log and
+// reports writes/s, the records per fdatasync() actually achieved and the
+// write latency. `--modes` compares io_uring submission with the thread
+// pool fallback.
+//
+// No keyring is needed, the store is opened with a random key. The log is
+// written to `--dir`, which should be on the file system the app's data
+// dir lives on, fdatasync() costs differ a lot between devices.
+
+#include <flutter_linux/flutter_linux.h>
+#include <glib/gstdio.h>
+#include <stdio.h>
+#include <string.h>
+
+#include <algorithm>
+#include <vector>
+
+#include "../biometric_storage_file_store.h"
+#include "bench_util.h"
+
+static gchar *writers_spec = nullptr;
+static gchar *max_batch_spec = nullptr;
+static gchar *modes_spec = nullptr;
+static gint writes = 2000;
+static gint payload_size = 256;
+static gchar *dir = nullptr;
+static gboolean csv = FALSE;
+
+static GOptionEntry entries[] = {
+    {"writers", 'w', 0, G_OPTION_ARG_STRING, &writers_spec,
+     "Comma separated numbers of writes in flight (default: 1,4,16,64)",
+     "LIST"},
+    {"max-batch", 'b', 0, G_OPTION_ARG_STRING, &max_batch_spec,
+     "Comma separated limits of records per commit, 0 for none (default: 0)",
+     "LIST"},
+    {"modes", 'm', 0, G_OPTION_ARG_STRING, &modes_spec,
+     "Comma separated commit modes, io_uring and thread (default: both)",
+     "LIST"},
+    {"writes", 'n', 0, G_OPTION_ARG_INT, &writes,
+     "Writes per configuration (default: 2000)", "N"},
+    {"payload", 'p', 0, G_OPTION_ARG_INT, &payload_size,
+     "Payload size in bytes (default: 256)", "BYTES"},
+    {"dir", 'd', 0, G_OPTION_ARG_FILENAME, &dir,
+     "Directory for the log (default: a temporary directory)", "DIR"},
+    {"csv", 0, 0, G_OPTION_ARG_NONE, &csv, "Print results as CSV", nullptr},
+    {nullptr}};
+
+struct Run {
+  FileStore *store;
+  const gchar *payload;
+  gint next = 0;
+  guint running = 0;
+  gint failed = 0;
+  std::vector<gint64> latencies_ns;
+  AsyncCondition done;
+};
+
+static Task<> run_writer(Run *run) {
+  while (run->next < writes) {
+    // A few names written over and over, as autosave does.
+    GAutoFree<gchar> name(g_strdup_printf("item.%d", run->next++ % 16));
+    gint64 started = bench_now_ns();
+    if (!co_await run->store->put(name.get(), run->payload, payload_size)) {
+      run->failed++;
+    }
+    run->latencies_ns.push_back(bench_now_ns() - started);
+  }
+  run->running--;
+  run->done.notify_all();
+}
+
+static gint64 percentile(const std::vector<gint64> &sorted, gdouble p) {
+  if (sorted.empty()) {
+    return 0;
+  }
+  return sorted[(gsize)(p * (sorted.size() - 1) + 0.5)];
+}
+
+static gint64 stat_int(FlValue *stats, const gchar *key) {
+  return fl_value_get_int(fl_value_lookup_string(stats, key));
+}
+
+static void print_header() {
+  if (csv) {
+    printf("mode,writers,max_batch,writes,failed,writes_per_s,commits,"
+           "records_per_commit,p50_us,p99_us\n");
+  } else {
+    printf("%-9s %7s %9s %7s %6s %12s %8s %11s %10s %10s\n", "mode",
+           "writers", "max_batch", "writes", "failed", "writes/s", "commits",
+           "rec/commit", "p50_us", "p99_us");
+  }
+}
+
+static Task<> run_config(ThreadPool *pool, FileLog::Mode mode,
+                         const gchar *mode_name, gsize writers,
+                         gsize max_batch, const guint8 *key,
+                         const gchar *path, const gchar *payload,
+                         gint *failed) {
+  g_unlink(path);
+  FileStore store(key, pool, mode, max_batch);
+  GError *error = nullptr;
+  if (!store.open(path, &error)) {
+    g_printerr("%s\n", error->message);
+    g_error_free(error);
+    (*failed)++;
+    co_return;
+  }
+  RefPtr<FlValue> before = RefPtr<FlValue>::adopt(store.stats());
+  if (mode == FileLog::Mode::kIoUring &&
+      !fl_value_get_bool(fl_value_lookup_string(before.get(), "ioUring"))) {
+    g_printerr("io_uring is not available, skipping\n");
+    co_return;
+  }
+
+  Run run;
+  run.store = &store;
+  run.payload = payload;
+  run.latencies_ns.reserve(writes);
+  gint64 started = bench_now_ns();
+  for (gsize i = 0; i < writers; i++) {
+    run.running++;
+    task_detach(run_writer(&run));
+  }
+  while (run.running > 0) {
+    co_await run.done.wait();
+  }
+  gint64 wall_ns = bench_now_ns() - started;
+  *failed += run.failed;
+
+  RefPtr<FlValue> stats = RefPtr<FlValue>::adopt(store.stats());
+  gint64 commits = stat_int(stats.get(), "commits");
+  std::vector<gint64> &latencies = run.latencies_ns;
+  std::sort(latencies.begin(), latencies.end());
+  gdouble writes_per_s = latencies.size() * 1e9 / wall_ns;
+  gdouble per_commit =
+      commits > 0 ? (gdouble)stat_int(stats.get(), "records") / commits : 0;
+  printf(csv ? "%s,%" G_GSIZE_FORMAT ",%" G_GSIZE_FORMAT
+               ",%" G_GSIZE_FORMAT ",%d,%.1f,%" G_GINT64_FORMAT
+               ",%.2f,%.1f,%.1f\n"
+             : "%-9s %7" G_GSIZE_FORMAT " %9" G_GSIZE_FORMAT
+               " %7" G_GSIZE_FORMAT " %6d %12.1f %8" G_GINT64_FORMAT
+               " %11.2f %10.1f %10.1f\n",
+         mode_name, writers, max_batch, latencies.size(), run.failed,
+         writes_per_s, commits, per_commit,
+         percentile(latencies, 0.5) / 1000.0,
+         percentile(latencies, 0.99) / 1000.0);
+  fflush(stdout);
+}
+
+static Task<> run_benchmark(GArray *writer_counts, GArray *max_batches,
+                            gchar **modes, const gchar *path,
+                            GMainLoop *loop, gint *failed) {
+  ThreadPool pool(4, 64);
+  guint8 key[BIOMETRIC_AEAD_KEY_SIZE];
+  GError *error = nullptr;
+  if (!biometric_random_bytes(key, sizeof(key), &error)) {
+    g_printerr("%s\n", error->message);
+    g_error_free(error);
+    (*failed)++;
+    g_main_loop_quit(loop);
+    co_return;
+  }
+  GAutoFree<gchar> payload(bench_payload_new(payload_size));
+  print_header();
+  for (gchar **mode = modes; *mode != nullptr; mode++) {
+    FileLog::Mode log_mode = strcmp(*mode, "thread") == 0
+                                 ? FileLog::Mode::kThread
+                                 : FileLog::Mode::kIoUring;
+    for (guint b = 0; b < max_batches->len; b++) {
+      for (guint w = 0; w < writer_counts->len; w++) {
+        co_await run_config(&pool, log_mode, *mode,
+                            g_array_index(writer_counts, gsize, w),
+                            g_array_index(max_batches, gsize, b), key, path,
+                            payload.get(), failed);
+      }
+    }
+  }
+  g_unlink(path);
+  g_main_loop_quit(loop);
+}
+
+int main(int argc, char **argv) {
+  g_autoptr(GError) error = nullptr;
+  GOptionContext *context = g_option_context_new("- file store benchmark");
+  g_option_context_add_main_entries(context, entries, nullptr);
+  gboolean parsed = g_option_context_parse(context, &argc, &argv, &error);
+  g_option_context_free(context);
+  if (!parsed) {
+    g_printerr("%s\n", error->message);
+    return 1;
+  }
+  if (writes < 1 || payload_size < 1) {
+    g_printerr("--writes and --payload must be positive\n");
+    return 1;
+  }
+  g_autoptr(GArray) writer_counts = bench_parse_sizes(
+      writers_spec != nullptr ? writers_spec : "1,4,16,64", &error);
+  g_autoptr(GArray) max_batches =
+      writer_counts != nullptr
+          ? bench_parse_sizes(
+                max_batch_spec != nullptr ? max_batch_spec : "0", &error)
+          : nullptr;
+  if (max_batches == nullptr) {
+    g_printerr("%s\n", error->message);
+    return 1;
+  }
+  g_auto(GStrv) modes = g_strsplit(
+      modes_spec != nullptr ? modes_spec : "io_uring,thread", ",", -1);
+  for (gchar **mode = modes; *mode != nullptr; mode++) {
+    if (strcmp(*mode, "io_uring") != 0 && strcmp(*mode, "thread") != 0) {
+      g_printerr("Unknown mode: %s\n", *mode);
+      return 1;
+    }
+  }
+
+  g_autofree gchar *tmp_dir = nullptr;
+  if (dir == nullptr) {
+    tmp_dir = g_dir_make_tmp("file_store_benchmark.XXXXXX", &error);
+    if (tmp_dir == nullptr) {
+      g_printerr("%s\n", error->message);
+      return 1;
+    }
+  }
+  g_autofree gchar *path = g_build_filename(
+      dir != nullptr ? dir : tmp_dir, "store.log", NULL);
+
+  g_autoptr(GMainLoop) loop = g_main_loop_new(nullptr, FALSE);
+  gint failed = 0;
+  task_detach(run_benchmark(writer_counts, max_batches, modes, path, loop,
+                            &failed));
+  g_main_loop_run(loop);
+  if (tmp_dir != nullptr) {
+    g_rmdir(tmp_dir);
+  }
+  return failed > 0 ? 1 : 0;
+}
@@ -0,0 +1,207 @@
+// Stand-in org.freedesktop.portal.Secret for running the plugin with
+// BIOMETRIC_STORAGE_SECRET_PORTAL=1 outside of Flatpak, the "portal" backend
+// of run_backend_matrix.sh.
+//
+// Owns org.freedesktop.portal.Desktop on the session bus (run it on a
+// private one, e.g. inside dbus-run-session) and answers RetrieveSecret like
+// xdg-desktop-portal does: the secret is written to the passed file
+// descriptor, then the Response signal of the request object is emitted.
+// The secret is random per run unless `--secret-file` keeps it, so that the
+// file store of an earlier run can be opened again. `--response` answers
+// with another response code (1: cancelled, 2: failed) to exercise errors.
+
+#include <gio/gio.h>
+#include <gio/gunixfdlist.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <unistd.h>
+
+#define PORTAL_PATH "/org/freedesktop/portal/desktop"
+
+// Like the secrets of xdg-desktop-portal-gnome and -kde.
+static const gsize kSecretSize = 64;
+
+static gchar *secret_file = nullptr;
+static gint response_code = 0;
+static gint latency_us = 0;
+
+static GOptionEntry entries[] = {
+    {"secret-file", 's', 0, G_OPTION_ARG_FILENAME, &secret_file,
+     "Keep the secret in FILE, created if missing (default: random)", "FILE"},
+    {"response", 'r', 0, G_OPTION_ARG_INT, &response_code,
+     "Response code of every request (default: 0)", "CODE"},
+    {"latency-us", 'l', 0, G_OPTION_ARG_INT, &latency_us,
+     "Delay of every response (default: 0)", "US"},
+    {nullptr}};
+
+static const gchar kIntrospection[] =
+    "<node>"
+    " <interface name='org.freedesktop.portal.Secret'>"
+    "  <method name='RetrieveSecret'>"
+    "   <arg name='fd' type='h' direction='in'/>"
+    "   <arg name='options' type='a{sv}' direction='in'/>"
+    "   <arg name='handle' type='o' direction='out'/>"
+    "  </method>"
+    "  <property name='version' type='u' access='read'/>"
+    " </interface>"
+    "</node>";
+
+struct MockPortal {
+  GDBusNodeInfo *info = nullptr;
+  GBytes *secret = nullptr;
+  guint64 next_request = 1;
+};
+
+static MockPortal portal;
+
+static GBytes *load_secret(GError **error) {
+  if (secret_file != nullptr) {
+    gchar *contents;
+    gsize length;
+    if (g_file_get_contents(secret_file, &contents, &length, nullptr)) {
+      return g_bytes_new_take(contents, length);
+    }
+  }
+  guint8 *secret = static_cast<guint8 *>(g_malloc(kSecretSize));
+  for (gsize i = 0; i < kSecretSize; i++) {
+    secret[i] = g_random_int_range(0, 256);
+  }
+  if (secret_file != nullptr &&
+      !g_file_set_contents(secret_file, reinterpret_cast<gchar *>(secret),
+                           kSecretSize, error)) {
+    g_free(secret);
+    return nullptr;
+  }
+  return g_bytes_new_take(secret, kSecretSize);
+}
+
+static gboolean write_all(int fd, const guint8 *data, gsize length) {
+  while (length > 0) {
+    ssize_t n = write(fd, data, length);
+    if (n < 0) {
+      return FALSE;
+    }
+    data += n;
+    length -= n;
+  }
+  return TRUE;
+}
+
+// The path a client expects for `token`, see the Request documentation of
+// xdg-desktop-portal.
+static gchar *request_path(const gchar *sender, const gchar *token) {
+  g_autofree gchar *escaped = g_strdup(sender + 1);
+  g_strdelimit(escaped, ".", '_');
+  return g_strdup_printf(PORTAL_PATH "/request/%s/%s", escaped, token);
+}
+
+static void portal_method_call(GDBusConnection *connection,
+                               const gchar *sender, const gchar *object_path,
+                               const gchar *interface_name,
+                               const gchar *method_name, GVariant *parameters,
+                               GDBusMethodInvocation *invocation,
+                               gpointer user_data) {
+  gint32 handle;
+  g_autoptr(GVariant) options = nullptr;
+  g_variant_get(parameters, "(h@a{sv})", &handle, &options);
+  GUnixFDList *fds = g_dbus_message_get_unix_fd_list(
+      g_dbus_method_invocation_get_message(invocation));
+  g_autoptr(GError) error = nullptr;
+  int fd = fds != nullptr ? g_unix_fd_list_get(fds, handle, &error) : -1;
+  if (fd < 0) {
+    g_dbus_method_invocation_return_dbus_error(
+        invocation, "org.freedesktop.portal.Error.InvalidArgument",
+        "No file descriptor passed");
+    return;
+  }
+  const gchar *token = nullptr;
+  g_autofree gchar *default_token = g_strdup_printf(
+      "mock%" G_GUINT64_FORMAT, portal.next_request++);
+  if (!g_variant_lookup(options, "handle_token", "&s", &token)) {
+    token = default_token;
+  }
+  g_autofree gchar *path = request_path(sender, token);
+  g_dbus_method_invocation_return_value(invocation,
+                                        g_variant_new("(o)", path));
+
+  if (latency_us > 0) {
+    g_usleep(latency_us);
+  }
+  guint32 response = response_code;
+  if (response == 0) {
+    gsize length;
+    const guint8 *secret =
+        static_cast<const guint8 *>(g_bytes_get_data(portal.secret, &length));
+    if (!write_all(fd, secret, length)) {
+      response = 2;
+    }
+  }
+  close(fd);
+  GVariantBuilder results;
+  g_variant_builder_init(&results, G_VARIANT_TYPE_VARDICT);
+  g_dbus_connection_emit_signal(
+      connection, nullptr, path, "org.freedesktop.portal.Request", "Response",
+      g_variant_new("(u@a{sv})", response, g_variant_builder_end(&results)),
+      nullptr);
+}
+
+static GVariant *portal_get_property(GDBusConnection *connection,
+                                     const gchar *sender,
+                                     const gchar *object_path,
+                                     const gchar *interface_name,
+                                     const gchar *property_name,
+                                     GError **error, gpointer user_data) {
+  return g_variant_new_uint32(1);
+}
+
+static const GDBusInterfaceVTable kPortalVTable = {
+    portal_method_call,
+    portal_get_property,
+    nullptr,
+};
+
+static void bus_acquired_cb(GDBusConnection *connection, const gchar *name,
+                            gpointer user_data) {
+  g_dbus_connection_register_object(
+      connection, PORTAL_PATH,
+      g_dbus_node_info_lookup_interface(portal.info,
+                                        "org.freedesktop.portal.Secret"),
+      &kPortalVTable, nullptr, nullptr, nullptr);
+}
+
+static void name_acquired_cb(GDBusConnection *connection, const gchar *name,
+                             gpointer user_data) {
+  g_print("%s ready\n", name);
+}
+
+static void name_lost_cb(GDBusConnection *connection, const gchar *name,
+                         gpointer user_data) {
+  g_printerr("Could not own %s, is a portal running on this bus?\n", name);
+  exit(1);
+}
+
+int main(int argc, char **argv) {
+  g_autoptr(GError) error = nullptr;
+  GOptionContext *context = g_option_context_new("- mock Secret portal");
+  g_option_context_add_main_entries(context, entries, nullptr);
+  gboolean parsed = g_option_context_parse(context, &argc, &argv, &error);
+  g_option_context_free(context);
+  if (!parsed) {
+    g_printerr("%s\n", error->message);
+    return 1;
+  }
+
+  portal.secret = load_secret(&error);
+  if (portal.secret == nullptr) {
+    g_printerr("Failed to save the secret: %s\n", error->message);
+    return 1;
+  }
+  portal.info = g_dbus_node_info_new_for_xml(kIntrospection, &error);
+  g_assert_no_error(error);
+  g_bus_own_name(G_BUS_TYPE_SESSION, "org.freedesktop.portal.Desktop",
+                 G_BUS_NAME_OWNER_FLAGS_NONE, bus_acquired_cb,
+                 name_acquired_cb, name_lost_cb, nullptr, nullptr);
+  g_autoptr(GMainLoop) loop = g_main_loop_new(nullptr, FALSE);
+  g_main_loop_run(loop);
+  return 0;
+}
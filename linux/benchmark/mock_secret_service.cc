@@ -0,0 +1,536 @@
+// In memory org.freedesktop.secrets implementation, the "mock" backend of
+// the backend benchmark (see run_backend_matrix.sh).
+//
+// Implements the subset of the Secret Service API libsecret uses for the
+// plugin's operations: plain sessions, one unlocked collection which is also
+// the "default" alias, item search, creation, replacement, deletion and
+// GetSecret(s). Nothing is persisted and no prompts are ever shown.
+// `--latency-us` delays every method call, one after the other like a single
+// threaded daemon would, to emulate a slower one.
+
+#include <gio/gio.h>
+#include <stdio.h>
+#include <stdlib.h>
+
+#include <map>
+#include <memory>
+#include <string>
+#include <vector>
+
+#define SERVICE_PATH "/org/freedesktop/secrets"
+#define COLLECTION_PATH "/org/freedesktop/secrets/collection/login"
+#define ALIAS_PATH "/org/freedesktop/secrets/aliases/default"
+
+static gint latency_us = 0;
+
+static GOptionEntry entries[] = {
+    {"latency-us", 'l', 0, G_OPTION_ARG_INT, &latency_us,
+     "Delay of every method reply (default: 0)", "US"},
+    {nullptr}};
+
+static const gchar kIntrospection[] =
+    "<node>"
+    " <interface name='org.freedesktop.Secret.Service'>"
+    "  <method name='OpenSession'>"
+    "   <arg name='algorithm' type='s' direction='in'/>"
+    "   <arg name='input' type='v' direction='in'/>"
+    "   <arg name='output' type='v' direction='out'/>"
+    "   <arg name='result' type='o' direction='out'/>"
+    "  </method>"
+    "  <method name='SearchItems'>"
+    "   <arg name='attributes' type='a{ss}' direction='in'/>"
+    "   <arg name='unlocked' type='ao' direction='out'/>"
+    "   <arg name='locked' type='ao' direction='out'/>"
+    "  </method>"
+    "  <method name='Unlock'>"
+    "   <arg name='objects' type='ao' direction='in'/>"
+    "   <arg name='unlocked' type='ao' direction='out'/>"
+    "   <arg name='prompt' type='o' direction='out'/>"
+    "  </method>"
+    "  <method name='Lock'>"
+    "   <arg name='objects' type='ao' direction='in'/>"
+    "   <arg name='locked' type='ao' direction='out'/>"
+    "   <arg name='prompt' type='o' direction='out'/>"
+    "  </method>"
+    "  <method name='GetSecrets'>"
+    "   <arg name='items' type='ao' direction='in'/>"
+    "   <arg name='session' type='o' direction='in'/>"
+    "   <arg name='secrets' type='a{o(oayays)}' direction='out'/>"
+    "  </method>"
+    "  <method name='ReadAlias'>"
+    "   <arg name='name' type='s' direction='in'/>"
+    "   <arg name='collection' type='o' direction='out'/>"
+    "  </method>"
+    "  <property name='Collections' type='ao' access='read'/>"
+    " </interface>"
+    " <interface name='org.freedesktop.Secret.Session'>"
+    "  <method name='Close'/>"
+    " </interface>"
+    " <interface name='org.freedesktop.Secret.Collection'>"
+    "  <method name='CreateItem'>"
+    "   <arg name='properties' type='a{sv}' direction='in'/>"
+    "   <arg name='secret' type='(oayays)' direction='in'/>"
+    "   <arg name='replace' type='b' direction='in'/>"
+    "   <arg name='item' type='o' direction='out'/>"
+    "   <arg name='prompt' type='o' direction='out'/>"
+    "  </method>"
+    "  <method name='SearchItems'>"
+    "   <arg name='attributes' type='a{ss}' direction='in'/>"
+    "   <arg name='results' type='ao' direction='out'/>"
+    "  </method>"
+    "  <property name='Items' type='ao' access='read'/>"
+    "  <property name='Label' type='s' access='read'/>"
+    "  <property name='Locked' type='b' access='read'/>"
+    "  <property name='Created' type='t' access='read'/>"
+    "  <property name='Modified' type='t' access='read'/>"
+    " </interface>"
+    " <interface name='org.freedesktop.Secret.Item'>"
+    "  <method name='Delete'>"
+    "   <arg name='prompt' type='o' direction='out'/>"
+    "  </method>"
+    "  <method name='GetSecret'>"
+    "   <arg name='session' type='o' direction='in'/>"
+    "   <arg name='secret' type='(oayays)' direction='out'/>"
+    "  </method>"
+    "  <method name='SetSecret'>"
+    "   <arg name='secret' type='(oayays)' direction='in'/>"
+    "  </method>"
+    "  <property name='Attributes' type='a{ss}' access='read'/>"
+    "  <property name='Label' type='s' access='read'/>"
+    "  <property name='Locked' type='b' access='read'/>"
+    "  <property name='Created' type='t' access='read'/>"
+    "  <property name='Modified' type='t' access='read'/>"
+    " </interface>"
+    "</node>";
+
+struct Item {
+  std::string path;
+  guint registration = 0;
+  std::string label;
+  std::map<std::string, std::string> attributes;
+  std::string secret;
+  std::string content_type;
+  guint64 created = 0;
+  guint64 modified = 0;
+};
+
+struct MockService {
+  GDBusConnection *connection = nullptr;
+  GDBusNodeInfo *info = nullptr;
+  guint64 next_item = 1;
+  guint64 next_session = 1;
+  guint64 created = 0;
+  // By object path.
+  std::map<std::string, std::unique_ptr<Item>> items;
+};
+
+static MockService service;
+
+static GDBusInterfaceInfo *interface_info(const gchar *name) {
+  return g_dbus_node_info_lookup_interface(service.info, name);
+}
+
+static std::map<std::string, std::string> attributes_from_variant(
+    GVariant *variant) {
+  std::map<std::string, std::string> attributes;
+  GVariantIter iter;
+  const gchar *key;
+  const gchar *value;
+  g_variant_iter_init(&iter, variant);
+  while (g_variant_iter_next(&iter, "{&s&s}", &key, &value)) {
+    attributes[key] = value;
+  }
+  return attributes;
+}
+
+static GVariant *attributes_to_variant(
+    const std::map<std::string, std::string> &attributes) {
+  GVariantBuilder builder;
+  g_variant_builder_init(&builder, G_VARIANT_TYPE("a{ss}"));
+  for (const auto &attribute : attributes) {
+    g_variant_builder_add(&builder, "{ss}", attribute.first.c_str(),
+                          attribute.second.c_str());
+  }
+  return g_variant_builder_end(&builder);
+}
+
+// Whether `item` has all of `query`.
+static bool matches(const Item &item,
+                    const std::map<std::string, std::string> &query) {
+  for (const auto &attribute : query) {
+    auto found = item.attributes.find(attribute.first);
+    if (found == item.attributes.end() || found->second != attribute.second) {
+      return false;
+    }
+  }
+  return true;
+}
+
+static GVariant *paths_variant(const std::vector<std::string> &paths) {
+  GVariantBuilder builder;
+  g_variant_builder_init(&builder, G_VARIANT_TYPE("ao"));
+  for (const std::string &path : paths) {
+    g_variant_builder_add(&builder, "o", path.c_str());
+  }
+  return g_variant_builder_end(&builder);
+}
+
+static std::vector<std::string> search(GVariant *query_variant) {
+  std::map<std::string, std::string> query =
+      attributes_from_variant(query_variant);
+  std::vector<std::string> paths;
+  for (const auto &item : service.items) {
+    if (matches(*item.second, query)) {
+      paths.push_back(item.first);
+    }
+  }
+  return paths;
+}
+
+static GVariant *secret_variant(const Item &item, const gchar *session) {
+  return g_variant_new(
+      "(o@ay@ays)", session,
+      g_variant_new_fixed_array(G_VARIANT_TYPE_BYTE, "", 0, 1),
+      g_variant_new_fixed_array(G_VARIANT_TYPE_BYTE, item.secret.data(),
+                                item.secret.size(), 1),
+      item.content_type.c_str());
+}
+
+static void remove_item(const std::string &path) {
+  auto found = service.items.find(path);
+  if (found == service.items.end()) {
+    return;
+  }
+  g_dbus_connection_unregister_object(service.connection,
+                                      found->second->registration);
+  service.items.erase(found);
+}
+
+// Stores a (oayays) secret struct in `item`. Sessions are plain, the
+// parameters are ignored.
+static void set_secret(Item *item, GVariant *secret) {
+  g_autoptr(GVariant) value = nullptr;
+  const gchar *content_type;
+  g_variant_get(secret, "(&o@ay@ay&s)", nullptr, nullptr, &value,
+                &content_type);
+  gsize length;
+  const gchar *data =
+      static_cast<const gchar *>(g_variant_get_fixed_array(value, &length, 1));
+  item->secret.assign(data, length);
+  item->content_type = content_type;
+  item->modified = g_get_real_time() / G_USEC_PER_SEC;
+}
+
+static void item_method_call(GDBusConnection *connection, const gchar *sender,
+                             const gchar *object_path,
+                             const gchar *interface_name,
+                             const gchar *method_name, GVariant *parameters,
+                             GDBusMethodInvocation *invocation,
+                             gpointer user_data) {
+  auto found = service.items.find(object_path);
+  if (found == service.items.end()) {
+    g_dbus_method_invocation_return_dbus_error(
+        invocation, "org.freedesktop.Secret.Error.NoSuchObject",
+        "No such item");
+    return;
+  }
+  Item *item = found->second.get();
+  if (g_strcmp0(method_name, "Delete") == 0) {
+    remove_item(object_path);
+    g_dbus_method_invocation_return_value(invocation,
+                                          g_variant_new("(o)", "/"));
+  } else if (g_strcmp0(method_name, "GetSecret") == 0) {
+    const gchar *session;
+    g_variant_get(parameters, "(&o)", &session);
+    g_dbus_method_invocation_return_value(
+        invocation,
+        g_variant_new("(@(oayays))", secret_variant(*item, session)));
+  } else if (g_strcmp0(method_name, "SetSecret") == 0) {
+    g_autoptr(GVariant) secret = g_variant_get_child_value(parameters, 0);
+    set_secret(item, secret);
+    g_dbus_method_invocation_return_value(invocation, nullptr);
+  }
+}
+
+static GVariant *item_get_property(GDBusConnection *connection,
+                                   const gchar *sender,
+                                   const gchar *object_path,
+                                   const gchar *interface_name,
+                                   const gchar *property_name, GError **error,
+                                   gpointer user_data) {
+  auto found = service.items.find(object_path);
+  if (found == service.items.end()) {
+    g_set_error(error, G_DBUS_ERROR, G_DBUS_ERROR_UNKNOWN_OBJECT,
+                "No such item");
+    return nullptr;
+  }
+  const Item &item = *found->second;
+  if (g_strcmp0(property_name, "Attributes") == 0) {
+    return attributes_to_variant(item.attributes);
+  } else if (g_strcmp0(property_name, "Label") == 0) {
+    return g_variant_new_string(item.label.c_str());
+  } else if (g_strcmp0(property_name, "Locked") == 0) {
+    return g_variant_new_boolean(FALSE);
+  } else if (g_strcmp0(property_name, "Created") == 0) {
+    return g_variant_new_uint64(item.created);
+  }
+  return g_variant_new_uint64(item.modified);
+}
+
+static const GDBusInterfaceVTable kItemVTable = {
+    item_method_call,
+    item_get_property,
+    nullptr,
+};
+
+static std::string create_item(GVariant *properties, GVariant *secret,
+                               gboolean replace) {
+  g_autoptr(GVariant) label_variant = g_variant_lookup_value(
+      properties, "org.freedesktop.Secret.Item.Label", G_VARIANT_TYPE_STRING);
+  g_autoptr(GVariant) attributes_variant = g_variant_lookup_value(
+      properties, "org.freedesktop.Secret.Item.Attributes",
+      G_VARIANT_TYPE("a{ss}"));
+  std::map<std::string, std::string> attributes;
+  if (attributes_variant != nullptr) {
+    attributes = attributes_from_variant(attributes_variant);
+  }
+
+  Item *item = nullptr;
+  if (replace) {
+    for (const auto &existing : service.items) {
+      if (existing.second->attributes == attributes) {
+        item = existing.second.get();
+        break;
+      }
+    }
+  }
+  if (item == nullptr) {
+    auto created = std::make_unique<Item>();
+    created->path = std::string(COLLECTION_PATH "/") +
+                    std::to_string(service.next_item++);
+    created->created = g_get_real_time() / G_USEC_PER_SEC;
+    created->registration = g_dbus_connection_register_object(
+        service.connection, created->path.c_str(),
+        interface_info("org.freedesktop.Secret.Item"), &kItemVTable, nullptr,
+        nullptr, nullptr);
+    item = created.get();
+    service.items[created->path] = std::move(created);
+  }
+  item->label =
+      label_variant != nullptr ? g_variant_get_string(label_variant, nullptr)
+                               : "";
+  item->attributes = attributes;
+  set_secret(item, secret);
+  return item->path;
+}
+
+static void collection_method_call(GDBusConnection *connection,
+                                   const gchar *sender,
+                                   const gchar *object_path,
+                                   const gchar *interface_name,
+                                   const gchar *method_name,
+                                   GVariant *parameters,
+                                   GDBusMethodInvocation *invocation,
+                                   gpointer user_data) {
+  if (g_strcmp0(method_name, "CreateItem") == 0) {
+    g_autoptr(GVariant) properties = nullptr;
+    g_autoptr(GVariant) secret = nullptr;
+    gboolean replace;
+    g_variant_get(parameters, "(@a{sv}@(oayays)b)", &properties, &secret,
+                  &replace);
+    std::string path = create_item(properties, secret, replace);
+    g_dbus_method_invocation_return_value(
+        invocation, g_variant_new("(oo)", path.c_str(), "/"));
+  } else if (g_strcmp0(method_name, "SearchItems") == 0) {
+    g_autoptr(GVariant) query = g_variant_get_child_value(parameters, 0);
+    g_dbus_method_invocation_return_value(
+        invocation, g_variant_new("(@ao)", paths_variant(search(query))));
+  }
+}
+
+static GVariant *collection_get_property(GDBusConnection *connection,
+                                         const gchar *sender,
+                                         const gchar *object_path,
+                                         const gchar *interface_name,
+                                         const gchar *property_name,
+                                         GError **error, gpointer user_data) {
+  if (g_strcmp0(property_name, "Items") == 0) {
+    std::vector<std::string> paths;
+    for (const auto &item : service.items) {
+      paths.push_back(item.first);
+    }
+    return paths_variant(paths);
+  } else if (g_strcmp0(property_name, "Label") == 0) {
+    return g_variant_new_string("Login");
+  } else if (g_strcmp0(property_name, "Locked") == 0) {
+    return g_variant_new_boolean(FALSE);
+  }
+  return g_variant_new_uint64(service.created);
+}
+
+static const GDBusInterfaceVTable kCollectionVTable = {
+    collection_method_call,
+    collection_get_property,
+    nullptr,
+};
+
+// Sessions have no state, closing them does nothing.
+static void session_method_call(GDBusConnection *connection,
+                                const gchar *sender, const gchar *object_path,
+                                const gchar *interface_name,
+                                const gchar *method_name, GVariant *parameters,
+                                GDBusMethodInvocation *invocation,
+                                gpointer user_data) {
+  g_dbus_method_invocation_return_value(invocation, nullptr);
+}
+
+static const GDBusInterfaceVTable kSessionVTable = {
+    session_method_call,
+    nullptr,
+    nullptr,
+};
+
+static void service_method_call(GDBusConnection *connection,
+                                const gchar *sender, const gchar *object_path,
+                                const gchar *interface_name,
+                                const gchar *method_name, GVariant *parameters,
+                                GDBusMethodInvocation *invocation,
+                                gpointer user_data) {
+  if (g_strcmp0(method_name, "OpenSession") == 0) {
+    const gchar *algorithm;
+    g_variant_get(parameters, "(&sv)", &algorithm, nullptr);
+    // libsecret falls back to plain sessions when encryption is not
+    // supported.
+    if (g_strcmp0(algorithm, "plain") != 0) {
+      g_dbus_method_invocation_return_dbus_error(
+          invocation, "org.freedesktop.DBus.Error.NotSupported",
+          "Only plain sessions are supported");
+      return;
+    }
+    g_autofree gchar *path = g_strdup_printf(
+        SERVICE_PATH "/session/%" G_GUINT64_FORMAT, service.next_session++);
+    g_dbus_connection_register_object(
+        connection, path, interface_info("org.freedesktop.Secret.Session"),
+        &kSessionVTable, nullptr, nullptr, nullptr);
+    g_dbus_method_invocation_return_value(
+        invocation,
+        g_variant_new("(vo)", g_variant_new_string(""), path));
+  } else if (g_strcmp0(method_name, "SearchItems") == 0) {
+    g_autoptr(GVariant) query = g_variant_get_child_value(parameters, 0);
+    g_dbus_method_invocation_return_value(
+        invocation, g_variant_new("(@ao@ao)", paths_variant(search(query)),
+                                  paths_variant({})));
+  } else if (g_strcmp0(method_name, "Unlock") == 0 ||
+             g_strcmp0(method_name, "Lock") == 0) {
+    // Everything is unlocked, and stays unlocked.
+    g_autoptr(GVariant) objects = g_variant_get_child_value(parameters, 0);
+    gboolean unlock = g_strcmp0(method_name, "Unlock") == 0;
+    g_dbus_method_invocation_return_value(
+        invocation,
+        g_variant_new("(@ao@o)",
+                      unlock ? objects : paths_variant({}),
+                      g_variant_new_object_path("/")));
+  } else if (g_strcmp0(method_name, "GetSecrets") == 0) {
+    GVariantIter *paths;
+    const gchar *session;
+    g_variant_get(parameters, "(ao&o)", &paths, &session);
+    GVariantBuilder builder;
+    g_variant_builder_init(&builder, G_VARIANT_TYPE("a{o(oayays)}"));
+    const gchar *path;
+    while (g_variant_iter_next(paths, "&o", &path)) {
+      auto found = service.items.find(path);
+      if (found != service.items.end()) {
+        g_variant_builder_add(&builder, "{o@(oayays)}", path,
+                              secret_variant(*found->second, session));
+      }
+    }
+    g_variant_iter_free(paths);
+    g_dbus_method_invocation_return_value(
+        invocation,
+        g_variant_new("(@a{o(oayays)})", g_variant_builder_end(&builder)));
+  } else if (g_strcmp0(method_name, "ReadAlias") == 0) {
+    const gchar *alias;
+    g_variant_get(parameters, "(&s)", &alias);
+    g_dbus_method_invocation_return_value(
+        invocation,
+        g_variant_new("(o)", g_strcmp0(alias, "default") == 0 ? COLLECTION_PATH
+                                                               : "/"));
+  }
+}
+
+static GVariant *service_get_property(GDBusConnection *connection,
+                                      const gchar *sender,
+                                      const gchar *object_path,
+                                      const gchar *interface_name,
+                                      const gchar *property_name,
+                                      GError **error, gpointer user_data) {
+  return paths_variant({COLLECTION_PATH});
+}
+
+static const GDBusInterfaceVTable kServiceVTable = {
+    service_method_call,
+    service_get_property,
+    nullptr,
+};
+
+// Delays replies by --latency-us, by holding every message of a method call
+// before it is dispatched.
+static GDBusMessage *delay_filter(GDBusConnection *connection,
+                                  GDBusMessage *message, gboolean incoming,
+                                  gpointer user_data) {
+  if (incoming &&
+      g_dbus_message_get_message_type(message) ==
+          G_DBUS_MESSAGE_TYPE_METHOD_CALL) {
+    g_usleep(latency_us);
+  }
+  return message;
+}
+
+static void bus_acquired_cb(GDBusConnection *connection, const gchar *name,
+                            gpointer user_data) {
+  service.connection = connection;
+  service.created = g_get_real_time() / G_USEC_PER_SEC;
+  g_dbus_connection_register_object(
+      connection, SERVICE_PATH, interface_info("org.freedesktop.Secret.Service"),
+      &kServiceVTable, nullptr, nullptr, nullptr);
+  for (const gchar *path : {COLLECTION_PATH, ALIAS_PATH}) {
+    g_dbus_connection_register_object(
+        connection, path, interface_info("org.freedesktop.Secret.Collection"),
+        &kCollectionVTable, nullptr, nullptr, nullptr);
+  }
+  if (latency_us > 0) {
+    g_dbus_connection_add_filter(connection, delay_filter, nullptr, nullptr);
+  }
+}
+
+static void name_acquired_cb(GDBusConnection *connection, const gchar *name,
+                             gpointer user_data) {
+  g_print("%s ready\n", name);
+}
+
+static void name_lost_cb(GDBusConnection *connection, const gchar *name,
+                         gpointer user_data) {
+  g_printerr("Could not own %s, is another Secret Service running?\n", name);
+  exit(1);
+}
+
+int main(int argc, char **argv) {
+  g_autoptr(GError) error = nullptr;
+  GOptionContext *context = g_option_context_new("- mock Secret Service");
+  g_option_context_add_main_entries(context, entries, nullptr);
+  gboolean parsed = g_option_context_parse(context, &argc, &argv, &error);
+  g_option_context_free(context);
+  if (!parsed) {
+    g_printerr("%s\n", error->message);
+    return 1;
+  }
+
+  service.info = g_dbus_node_info_new_for_xml(kIntrospection, &error);
+  g_assert_no_error(error);
+  g_bus_own_name(G_BUS_TYPE_SESSION, "org.freedesktop.secrets",
+                 G_BUS_NAME_OWNER_FLAGS_NONE, bus_acquired_cb,
+                 name_acquired_cb, name_lost_cb, nullptr, nullptr);
+  g_autoptr(GMainLoop) loop = g_main_loop_new(nullptr, FALSE);
+  g_main_loop_run(loop);
+  return 0;
+}
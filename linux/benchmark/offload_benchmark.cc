@@ -0,0 +1,212 @@
+// Where offloading CPU work on secrets to the thread pool starts to pay off,
+// i.e. the evidence behind kOffloadMinSize.
+//
+// For every payload size each stage the plugin offloads (verifying and
+// creating the envelope of a secret, sealing and opening it) is run inline
+// and through run_on() on a pool like the plugin's. `inline_us` is how long
+// the stage blocks the main thread when run inline, `pool_us` how long the
+// awaiting coroutine waits for it on the pool, including the hop to a worker
+// and back through the main context. Offloading costs `pool_us - inline_us`
+// of latency and frees the main thread for `inline_us`: it pays off from the
+// first size at which `inline_us` exceeds that round trip, which is printed
+// for each stage at the end. No keyring is needed.
+
+#include <flutter_linux/flutter_linux.h>
+#include <stdio.h>
+
+#include <functional>
+
+#include "../biometric_storage_async.h"
+#include "../biometric_storage_crypto.h"
+#include "../biometric_storage_envelope.h"
+#include "../biometric_storage_thread_pool.h"
+#include "bench_util.h"
+
+static gint min_time_ms = 200;
+static gchar *sizes_spec = nullptr;
+static gboolean csv = FALSE;
+
+static GOptionEntry entries[] = {
+    {"min-time", 't', 0, G_OPTION_ARG_INT, &min_time_ms,
+     "Minimum time to run each measurement in ms (default: 200)", "MS"},
+    {"sizes", 's', 0, G_OPTION_ARG_STRING, &sizes_spec,
+     "Comma separated payload sizes (default: 1k,4k,16k,64k,256k,1m,4m)",
+     "SIZES"},
+    {"csv", 0, 0, G_OPTION_ARG_NONE, &csv, "Print results as CSV", nullptr},
+    {nullptr}};
+
+// Inputs of the stages for one payload size.
+struct Fixture {
+  guint8 key[BIOMETRIC_AEAD_KEY_SIZE] = {};
+  guint8 nonce[BIOMETRIC_AEAD_NONCE_SIZE] = {};
+  gchar *payload = nullptr;
+  gsize length = 0;
+  gchar *envelope = nullptr;
+  guint8 *sealed = nullptr;
+  guint8 *out = nullptr;
+};
+
+struct Stage {
+  const gchar *name;
+  std::function<void(Fixture *)> run;
+};
+
+static const Stage kStages[] = {
+    {"envelope_open",
+     [](Fixture *f) {
+       gchar generation[BIOMETRIC_GENERATION_LENGTH + 1];
+       biometric_envelope_open(f->envelope,
+                               BIOMETRIC_ENVELOPE_HEADER_SIZE + f->length,
+                               TRUE, generation);
+     }},
+    {"envelope_new",
+     [](Fixture *f) {
+       biometric_secret_free(biometric_envelope_new(BIOMETRIC_GENERATION_NONE,
+                                                    f->payload, f->length));
+     }},
+    {"aead_seal",
+     [](Fixture *f) {
+       biometric_aead_seal(f->key, f->nonce, nullptr, 0,
+                           (const guint8 *)f->payload, f->length, f->out,
+                           nullptr);
+     }},
+    {"aead_open",
+     [](Fixture *f) {
+       biometric_aead_open(f->key, f->nonce, nullptr, 0, f->sealed,
+                           f->length + BIOMETRIC_AEAD_TAG_SIZE, f->out);
+     }},
+};
+const gsize kStageCount = G_N_ELEMENTS(kStages);
+
+static void fixture_init(Fixture *f, gsize length) {
+  f->payload = bench_payload_new(length);
+  f->length = length;
+  f->envelope =
+      biometric_envelope_new(BIOMETRIC_GENERATION_NONE, f->payload, length);
+  f->sealed = static_cast<guint8 *>(
+      g_malloc(length + BIOMETRIC_AEAD_TAG_SIZE));
+  f->out = static_cast<guint8 *>(g_malloc(length + BIOMETRIC_AEAD_TAG_SIZE));
+  biometric_aead_seal(f->key, f->nonce, nullptr, 0,
+                      (const guint8 *)f->payload, length, f->sealed, nullptr);
+}
+
+static void fixture_clear(Fixture *f) {
+  g_free(f->payload);
+  biometric_secret_free(f->envelope);
+  g_free(f->sealed);
+  g_free(f->out);
+}
+
+// Runs `stage` inline until min_time_ms passed, returns µs per run.
+static gdouble measure_inline(const Stage *stage, Fixture *fixture) {
+  gint64 deadline = bench_now_ns() + (gint64)min_time_ms * 1000000;
+  guint64 runs = 0;
+  gint64 start = bench_now_ns();
+  gint64 now = start;
+  while (now < deadline || runs < 3) {
+    stage->run(fixture);
+    runs++;
+    now = bench_now_ns();
+  }
+  return (gdouble)(now - start) / runs / 1000;
+}
+
+// Awaits `stage` (or nothing, with nullptr) on `pool` one run at a time
+// until min_time_ms passed, sets `us` to µs per run.
+static Task<> measure_pool(ThreadPool *pool, const Stage *stage,
+                           Fixture *fixture, gdouble *us) {
+  gint64 deadline = bench_now_ns() + (gint64)min_time_ms * 1000000;
+  guint64 runs = 0;
+  gint64 start = bench_now_ns();
+  gint64 now = start;
+  while (now < deadline || runs < 3) {
+    co_await run_on(pool, [stage, fixture] {
+      if (stage != nullptr) {
+        stage->run(fixture);
+      }
+      return true;
+    });
+    runs++;
+    now = bench_now_ns();
+  }
+  *us = (gdouble)(now - start) / runs / 1000;
+}
+
+static void print_row(const gchar *stage, gsize size, gdouble inline_us,
+                      gdouble pool_us) {
+  if (csv) {
+    printf("%s,%" G_GSIZE_FORMAT ",%.2f,%.2f\n", stage, size, inline_us,
+           pool_us);
+  } else {
+    g_autofree gchar *size_str = bench_format_size(size);
+    printf("%-14s %-8s %12.2f %12.2f\n", stage, size_str, inline_us,
+           pool_us);
+  }
+}
+
+static Task<> run_benchmark(GArray *sizes, GMainLoop *loop) {
+  // Like plugin_thread_pool().
+  ThreadPool pool(MIN(g_get_num_processors(), 4), 64);
+  gdouble round_trip_us;
+  co_await measure_pool(&pool, nullptr, nullptr, &round_trip_us);
+  if (csv) {
+    printf("stage,size,inline_us,pool_us\n");
+  } else {
+    printf("%-14s %-8s %12s %12s\n", "stage", "size", "inline_us",
+           "pool_us");
+  }
+  print_row("round_trip", 0, 0, round_trip_us);
+
+  // First size at which each stage took longer inline than the round trip.
+  gsize pays_off[kStageCount] = {};
+  for (guint i = 0; i < sizes->len; i++) {
+    gsize size = g_array_index(sizes, gsize, i);
+    Fixture fixture;
+    fixture_init(&fixture, size);
+    for (gsize s = 0; s < kStageCount; s++) {
+      gdouble inline_us = measure_inline(&kStages[s], &fixture);
+      gdouble pool_us;
+      co_await measure_pool(&pool, &kStages[s], &fixture, &pool_us);
+      print_row(kStages[s].name, size, inline_us, pool_us);
+      if (pays_off[s] == 0 && inline_us > round_trip_us) {
+        pays_off[s] = size;
+      }
+    }
+    fixture_clear(&fixture);
+  }
+
+  FILE *summary = csv ? stderr : stdout;
+  fprintf(summary, "\nkOffloadMinSize is %" G_GSIZE_FORMAT
+          " bytes, offloading pays off from:\n", kOffloadMinSize);
+  for (gsize s = 0; s < kStageCount; s++) {
+    g_autofree gchar *size_str =
+        pays_off[s] > 0 ? bench_format_size(pays_off[s])
+                        : g_strdup("(beyond the largest size)");
+    fprintf(summary, "  %-14s %s\n", kStages[s].name, size_str);
+  }
+  g_main_loop_quit(loop);
+}
+
+int main(int argc, char **argv) {
+  g_autoptr(GError) error = nullptr;
+  GOptionContext *context = g_option_context_new("- offload benchmark");
+  g_option_context_add_main_entries(context, entries, nullptr);
+  gboolean parsed = g_option_context_parse(context, &argc, &argv, &error);
+  g_option_context_free(context);
+  if (!parsed) {
+    g_printerr("%s\n", error->message);
+    return 1;
+  }
+  g_autoptr(GArray) sizes = bench_parse_sizes(
+      sizes_spec != nullptr ? sizes_spec : "1k,4k,16k,64k,256k,1m,4m",
+      &error);
+  if (sizes == nullptr) {
+    g_printerr("%s\n", error->message);
+    return 1;
+  }
+
+  g_autoptr(GMainLoop) loop = g_main_loop_new(nullptr, FALSE);
+  task_detach(run_benchmark(sizes, loop));
+  g_main_loop_run(loop);
+  return 0;
+}
@@ -0,0 +1,146 @@
+#!/bin/sh
+# Runs biometric_storage_backend_benchmark against every Secret Service
+# implementation available on this machine, each on its own private session
+# bus with a throw away keyring, and prints one comparative report.
+#
+#   run_backend_matrix.sh BUILD_DIR [benchmark options...]
+#
+# e.g. run_backend_matrix.sh build/bench --sizes 16,64k,1m --concurrency 4
+#
+# Backends, skipped if not installed:
+#   mock           biometric_storage_mock_secret_service (always available)
+#   portal         the file store keyed by biometric_storage_mock_portal, as
+#                  with BIOMETRIC_STORAGE_SECRET_PORTAL=1 in Flatpak (always
+#                  available)
+#   gnome-keyring  gnome-keyring-daemon, unlocked headless
+#   oo7            oo7-daemon
+#   keepassxc      KeePassXC's Secret Service integration. Needs a database
+#                  with a group exposed to the Secret Service, passed as
+#                  KEEPASSXC_DB and KEEPASSXC_PASSWORD.
+#
+# The merged CSV is written to $REPORT (default: backend_matrix.csv).
+
+set -eu
+
+if [ "${1:-}" = "--inner" ]; then
+  # On the private bus started by dbus-run-session.
+  backend=$2
+  build_dir=$3
+  shift 3
+  tmp=$(mktemp -d)
+  export HOME="$tmp" XDG_DATA_HOME="$tmp/data" XDG_CONFIG_HOME="$tmp/config"
+  export XDG_CACHE_HOME="$tmp/cache"
+  mkdir -p "$XDG_DATA_HOME" "$XDG_CONFIG_HOME" "$XDG_CACHE_HOME"
+
+  service=org.freedesktop.secrets
+  case "$backend" in
+    mock)
+      "$build_dir/biometric_storage_mock_secret_service" >/dev/null &
+      ;;
+    portal)
+      "$build_dir/biometric_storage_mock_portal" >/dev/null &
+      export BIOMETRIC_STORAGE_SECRET_PORTAL=1
+      service=org.freedesktop.portal.Desktop
+      ;;
+    gnome-keyring)
+      # Creates and unlocks a login keyring with this password.
+      printf bench | gnome-keyring-daemon --unlock --components=secrets \
+        >/dev/null
+      ;;
+    oo7)
+      printf bench | oo7-daemon --login >/dev/null 2>&1 &
+      ;;
+    keepassxc)
+      mkdir -p "$XDG_CONFIG_HOME/keepassxc"
+      cat > "$XDG_CONFIG_HOME/keepassxc/keepassxc.ini" <<EOF
+[FdoSecrets]
+Enabled=true
+ShowNotification=false
+ConfirmAccessItem=false
+ConfirmDeleteItem=false
+EOF
+      printf '%s' "$KEEPASSXC_PASSWORD" |
+        QT_QPA_PLATFORM=offscreen keepassxc --pw-stdin "$KEEPASSXC_DB" \
+          >/dev/null 2>&1 &
+      ;;
+  esac
+
+  tries=0
+  until gdbus call --session --dest org.freedesktop.DBus \
+      --object-path /org/freedesktop/DBus \
+      --method org.freedesktop.DBus.NameHasOwner "$service" \
+      2>/dev/null | grep -q true; do
+    tries=$((tries + 1))
+    if [ $tries -gt 100 ]; then
+      echo "$backend: $service did not show up" >&2
+      exit 1
+    fi
+    sleep 0.1
+  done
+
+  status=0
+  "$build_dir/biometric_storage_backend_benchmark" --csv --backend "$backend" \
+    "$@" || status=$?
+  kill $(jobs -p) 2>/dev/null || true
+  rm -rf "$tmp"
+  exit $status
+fi
+
+if [ $# -lt 1 ]; then
+  sed -n '2,21p' "$0" | sed 's/^# \{0,1\}//' >&2
+  exit 1
+fi
+build_dir=$(cd "$1" && pwd)
+shift
+report=${REPORT:-backend_matrix.csv}
+script=$(cd "$(dirname "$0")" && pwd)/$(basename "$0")
+
+backends="mock portal"
+command -v gnome-keyring-daemon >/dev/null && backends="$backends gnome-keyring"
+command -v oo7-daemon >/dev/null && backends="$backends oo7"
+if command -v keepassxc >/dev/null && [ -n "${KEEPASSXC_DB:-}" ]; then
+  backends="$backends keepassxc"
+fi
+
+: > "$report"
+for backend in $backends; do
+  echo "Running $backend" >&2
+  out=$(dbus-run-session -- "$script" --inner "$backend" "$build_dir" "$@") ||
+    echo "$backend: benchmark failed" >&2
+  [ -n "$out" ] || continue
+  if [ ! -s "$report" ]; then
+    printf '%s\n' "$out" | head -n 1 > "$report"
+  fi
+  printf '%s\n' "$out" | tail -n +2 >> "$report"
+done
+
+# One row per operation and payload size, p50 latency and throughput of
+# every backend side by side.
+awk -F, -v backends="$backends" '
+  NR == 1 { next }
+  {
+    key = $2 "," $3
+    if (!(key in seen)) { seen[key] = 1; keys[++n] = key }
+    p50[key, $1] = $8
+    ops[key, $1] = $11
+  }
+  END {
+    count = split(backends, names, " ")
+    printf "%-7s %10s", "op", "size"
+    for (i = 1; i <= count; i++) {
+      printf " %16s", names[i] " p50us"
+      printf " %16s", names[i] " ops/s"
+    }
+    printf "\n"
+    for (k = 1; k <= n; k++) {
+      split(keys[k], parts, ",")
+      printf "%-7s %10s", parts[1], parts[2]
+      for (i = 1; i <= count; i++) {
+        b = names[i]
+        printf " %16s", ((keys[k], b) in p50) ? p50[keys[k], b] : "-"
+        printf " %16s", ((keys[k], b) in ops) ? ops[keys[k], b] : "-"
+      }
+      printf "\n"
+    }
+  }' "$report"
+echo "Full results: $report" >&2
@@ -0,0 +1,345 @@
+// How the plugin's operations scale with the number of items in the
+// keyring. The keyring is filled step by step up to each of `--counts`
+// items, `--own-percent` of them written by the plugin and the rest foreign
+// items of another schema, and at every step read, read_miss, write, delete
+// and list (findByTags) latencies are sampled. Prints plot-ready CSV.
+//
+// Every step is measured in each of the plugin's lookup modes:
+//
+//   default   reads which miss fall through to the legacy schema, as they
+//             do until the background migration completed
+//   migrated  the migration completed, misses are answered by one search
+//
+// Run it against a throw away keyring, e.g. on a private bus with the mock
+// Secret Service or an unlocked gnome-keyring-daemon (see README.md). All
+// items are removed at the end.
+
+#include <flutter_linux/flutter_linux.h>
+#include <glib/gstdio.h>
+#include <libsecret/secret.h>
+#include <stdio.h>
+#include <string.h>
+
+#include <algorithm>
+#include <vector>
+
+#include "../biometric_storage_plugin_private.h"
+#include "bench_util.h"
+
+static gchar *counts_spec = nullptr;
+static gint own_percent = 10;
+static gint samples = 50;
+static gint payload_size = 256;
+static gint populate_concurrency = 32;
+
+static GOptionEntry entries[] = {
+    {"counts", 'n', 0, G_OPTION_ARG_STRING, &counts_spec,
+     "Comma separated total item counts (default: 10,100,1000,10000,100000)",
+     "COUNTS"},
+    {"own-percent", 'o', 0, G_OPTION_ARG_INT, &own_percent,
+     "Share of items written by the plugin (default: 10)", "PERCENT"},
+    {"samples", 's', 0, G_OPTION_ARG_INT, &samples,
+     "Samples per operation and step (default: 50)", "N"},
+    {"payload", 'p', 0, G_OPTION_ARG_INT, &payload_size,
+     "Payload size of the items in bytes (default: 256)", "BYTES"},
+    {"populate-concurrency", 0, 0, G_OPTION_ARG_INT, &populate_concurrency,
+     "Items stored in parallel while filling the keyring (default: 32)", "N"},
+    {nullptr}};
+
+// Stand-in for other applications' items.
+static const SecretSchema kForeignSchema = {
+    "org.example.ScalingBenchmark.Foreign",
+    SECRET_SCHEMA_NONE,
+    {
+        {"id", SECRET_SCHEMA_ATTRIBUTE_STRING},
+        {"benchmark", SECRET_SCHEMA_ATTRIBUTE_STRING},
+    }};
+
+static const gchar *const kModes[] = {"default", "migrated"};
+static const gchar *const kOperations[] = {"read", "read_miss", "write",
+                                           "delete", "list"};
+
+struct Keyring {
+  gint foreign = 0;
+  gint own = 0;
+  gchar *payload = nullptr;
+};
+
+static RefPtr<FlValue> own_args(gint index, const gchar *content) {
+  RefPtr<FlValue> args = RefPtr<FlValue>::adopt(fl_value_new_map());
+  GAutoFree<gchar> name(g_strdup_printf("scaling.%d", index));
+  fl_value_set_string_take(args.get(), "name",
+                           fl_value_new_string(name.get()));
+  if (content != nullptr) {
+    fl_value_set_string_take(args.get(), "content",
+                             fl_value_new_string(content));
+    FlValue *tags = fl_value_new_map();
+    fl_value_set_string_take(tags, "account",
+                             fl_value_new_string("scaling_benchmark"));
+    fl_value_set_string_take(args.get(), "tags", tags);
+  }
+  return args;
+}
+
+// Calls `method` and returns its latency in nanoseconds, or -1 if it failed.
+static Task<gint64> timed_call(BiometricStoragePlugin *plugin,
+                               const gchar *method, FlValue *args) {
+  gint64 started = bench_now_ns();
+  RefPtr<FlMethodResponse> response =
+      co_await biometric_storage_plugin_call(plugin, method, args);
+  gint64 latency = bench_now_ns() - started;
+  if (FL_IS_METHOD_ERROR_RESPONSE(response.get())) {
+    g_printerr("%s failed: %s\n", method,
+               fl_method_error_response_get_message(
+                   FL_METHOD_ERROR_RESPONSE(response.get())));
+    co_return -1;
+  }
+  co_return latency;
+}
+
+static Task<gboolean> store_foreign(gint index, const gchar *payload) {
+  RefPtr<GHashTable> attributes = RefPtr<GHashTable>::adopt(
+      g_hash_table_new_full(g_str_hash, g_str_equal, nullptr, g_free));
+  g_hash_table_insert(attributes.get(), (gpointer) "id",
+                      g_strdup_printf("%d", index));
+  g_hash_table_insert(attributes.get(), (gpointer) "benchmark",
+                      g_strdup("scaling"));
+  RefPtr<GAsyncResult> result = co_await gio_async(
+      [&](GAsyncReadyCallback callback, gpointer user_data) {
+        secret_password_storev(&kForeignSchema, attributes.get(),
+                               SECRET_COLLECTION_DEFAULT, "foreign", payload,
+                               nullptr, callback, user_data);
+      });
+  GError *error = nullptr;
+  if (!secret_password_store_finish(result.get(), &error)) {
+    g_printerr("Storing a foreign item failed: %s\n", error->message);
+    g_error_free(error);
+    co_return FALSE;
+  }
+  co_return TRUE;
+}
+
+struct Populate {
+  BiometricStoragePlugin *plugin;
+  Keyring *keyring;
+  gint own_target;
+  gint foreign_target;
+  guint running = 0;
+  gboolean failed = FALSE;
+  AsyncCondition done;
+};
+
+static Task<> populate_worker(Populate *populate) {
+  Keyring *keyring = populate->keyring;
+  while (!populate->failed) {
+    if (keyring->own < populate->own_target) {
+      RefPtr<FlValue> args = own_args(keyring->own++, keyring->payload);
+      populate->failed =
+          co_await timed_call(populate->plugin, "write", args.get()) < 0;
+    } else if (keyring->foreign < populate->foreign_target) {
+      populate->failed =
+          !co_await store_foreign(keyring->foreign++, keyring->payload);
+    } else {
+      break;
+    }
+  }
+  populate->running--;
+  populate->done.notify_all();
+}
+
+// Adds items until there are `total`, `own_percent` of them the plugin's.
+static Task<gboolean> populate(BiometricStoragePlugin *plugin,
+                               Keyring *keyring, gint total) {
+  Populate state;
+  state.plugin = plugin;
+  state.keyring = keyring;
+  state.own_target = MAX(1, (gint)((gint64)total * own_percent / 100));
+  state.foreign_target = MAX(0, total - state.own_target);
+  for (gint i = 0; i < populate_concurrency; i++) {
+    state.running++;
+    task_detach(populate_worker(&state));
+  }
+  while (state.running > 0) {
+    co_await state.done.wait();
+  }
+  co_return !state.failed;
+}
+
+static gint64 percentile(const std::vector<gint64> &sorted, gdouble p) {
+  if (sorted.empty()) {
+    return 0;
+  }
+  return sorted[(gsize)(p * (sorted.size() - 1) + 0.5)];
+}
+
+static void report(const gchar *mode, const Keyring *keyring,
+                   const gchar *operation, std::vector<gint64> *latencies) {
+  std::sort(latencies->begin(), latencies->end());
+  gdouble total = 0;
+  for (gint64 latency : *latencies) {
+    total += latency;
+  }
+  gdouble mean_us =
+      latencies->empty() ? 0 : total / latencies->size() / 1000;
+  printf("%s,%d,%d,%s,%" G_GSIZE_FORMAT ",%.1f,%.1f,%.1f,%.1f\n", mode,
+         keyring->own + keyring->foreign, keyring->own, operation,
+         latencies->size(), mean_us, percentile(*latencies, 0.5) / 1000.0,
+         percentile(*latencies, 0.95) / 1000.0,
+         percentile(*latencies, 0.99) / 1000.0);
+  fflush(stdout);
+}
+
+// Samples `operation` on random own items.
+static Task<gboolean> measure(BiometricStoragePlugin *plugin,
+                              const gchar *mode, Keyring *keyring,
+                              const gchar *operation, GRand *rand) {
+  std::vector<gint64> latencies;
+  for (gint i = 0; i < samples; i++) {
+    gint index = g_rand_int_range(rand, 0, keyring->own);
+    gint64 latency;
+    if (strcmp(operation, "read") == 0) {
+      RefPtr<FlValue> args = own_args(index, nullptr);
+      latency = co_await timed_call(plugin, "read", args.get());
+    } else if (strcmp(operation, "read_miss") == 0) {
+      RefPtr<FlValue> args = own_args(-1 - index, nullptr);
+      latency = co_await timed_call(plugin, "read", args.get());
+    } else if (strcmp(operation, "write") == 0) {
+      RefPtr<FlValue> args = own_args(index, keyring->payload);
+      latency = co_await timed_call(plugin, "write", args.get());
+    } else if (strcmp(operation, "delete") == 0) {
+      RefPtr<FlValue> args = own_args(index, nullptr);
+      latency = co_await timed_call(plugin, "delete", args.get());
+      // Puts it back, unmeasured.
+      RefPtr<FlValue> write_args = own_args(index, keyring->payload);
+      if (co_await timed_call(plugin, "write", write_args.get()) < 0) {
+        co_return FALSE;
+      }
+    } else {
+      RefPtr<FlValue> args = RefPtr<FlValue>::adopt(fl_value_new_map());
+      FlValue *tags = fl_value_new_map();
+      fl_value_set_string_take(tags, "account",
+                               fl_value_new_string("scaling_benchmark"));
+      fl_value_set_string_take(args.get(), "tags", tags);
+      latency = co_await timed_call(plugin, "findByTags", args.get());
+    }
+    if (latency < 0) {
+      co_return FALSE;
+    }
+    latencies.push_back(latency);
+  }
+  report(mode, keyring, operation, &latencies);
+  co_return TRUE;
+}
+
+static Task<> cleanup(BiometricStoragePlugin *plugin, Keyring *keyring) {
+  for (gint i = 0; i < keyring->own; i++) {
+    RefPtr<FlValue> args = own_args(i, nullptr);
+    co_await timed_call(plugin, "delete", args.get());
+  }
+  RefPtr<GAsyncResult> result = co_await gio_async(
+      [&](GAsyncReadyCallback callback, gpointer user_data) {
+        secret_password_clear(&kForeignSchema, nullptr, callback, user_data,
+                              "benchmark", "scaling", nullptr);
+      });
+  secret_password_clear_finish(result.get(), nullptr);
+}
+
+static Task<> run_benchmark(BiometricStoragePlugin **plugins, GArray *counts,
+                            GMainLoop *loop, gboolean *failed) {
+  Keyring keyring;
+  GAutoFree<gchar> payload(bench_payload_new(payload_size));
+  keyring.payload = payload.get();
+  GRand *rand = g_rand_new_with_seed(87);
+
+  RefPtr<FlValue> init_args = RefPtr<FlValue>::adopt(fl_value_new_map());
+  fl_value_set_string_take(init_args.get(), "name",
+                           fl_value_new_string("scaling.init"));
+  FlValue *options = fl_value_new_map();
+  fl_value_set_string_take(options, "authenticationRequired",
+                           fl_value_new_bool(false));
+  fl_value_set_string_take(init_args.get(), "options", options);
+  co_await biometric_storage_plugin_call(plugins[1], "init", init_args.get());
+
+  printf("mode,items,own_items,operation,samples,mean_us,p50_us,p95_us,"
+         "p99_us\n");
+  for (guint i = 0; i < counts->len && !*failed; i++) {
+    gint total = (gint)g_array_index(counts, gsize, i);
+    if (!co_await populate(plugins[0], &keyring, total)) {
+      *failed = TRUE;
+      break;
+    }
+    for (gsize mode = 0; mode < G_N_ELEMENTS(kModes) && !*failed; mode++) {
+      for (const gchar *operation : kOperations) {
+        if (!co_await measure(plugins[mode], kModes[mode], &keyring,
+                              operation, rand)) {
+          *failed = TRUE;
+          break;
+        }
+      }
+    }
+  }
+  g_rand_free(rand);
+  co_await cleanup(plugins[0], &keyring);
+  g_main_loop_quit(loop);
+}
+
+int main(int argc, char **argv) {
+  g_autoptr(GError) error = nullptr;
+  GOptionContext *context = g_option_context_new("- scaling benchmark");
+  g_option_context_add_main_entries(context, entries, nullptr);
+  gboolean parsed = g_option_context_parse(context, &argc, &argv, &error);
+  g_option_context_free(context);
+  if (!parsed) {
+    g_printerr("%s\n", error->message);
+    return 1;
+  }
+  if (samples < 1 || populate_concurrency < 1 || own_percent < 1 ||
+      own_percent > 100) {
+    g_printerr("--samples and --populate-concurrency must be positive, "
+               "--own-percent between 1 and 100\n");
+    return 1;
+  }
+  g_autoptr(GArray) counts = bench_parse_sizes(
+      counts_spec != nullptr ? counts_spec : "10,100,1000,10000,100000",
+      &error);
+  if (counts == nullptr) {
+    g_printerr("%s\n", error->message);
+    return 1;
+  }
+
+  // The "migrated" plugin finds a completed migration checkpoint in its
+  // data dir, the "default" one is never initialized and so never loads it.
+  g_autofree gchar *data_dir = g_dir_make_tmp("scaling_benchmark_XXXXXX",
+                                              &error);
+  if (data_dir == nullptr) {
+    g_printerr("%s\n", error->message);
+    return 1;
+  }
+  g_setenv("XDG_DATA_HOME", data_dir, TRUE);
+  g_autofree gchar *checkpoint_dir =
+      g_build_filename(data_dir, "biometric_storage", NULL);
+  g_autofree gchar *checkpoint =
+      g_build_filename(checkpoint_dir, "migration.ini", NULL);
+  g_mkdir_with_parents(checkpoint_dir, 0700);
+  g_file_set_contents(checkpoint,
+                      "[migration]\nlayout=2\ncompleted=true\nmigrated=0\n",
+                      -1, nullptr);
+
+  BiometricStoragePlugin *plugins[G_N_ELEMENTS(kModes)];
+  for (gsize mode = 0; mode < G_N_ELEMENTS(kModes); mode++) {
+    plugins[mode] = reinterpret_cast<BiometricStoragePlugin *>(
+        g_object_new(biometric_storage_plugin_get_type(), nullptr));
+  }
+  g_autoptr(GMainLoop) loop = g_main_loop_new(nullptr, FALSE);
+  gboolean failed = FALSE;
+  task_detach(run_benchmark(plugins, counts, loop, &failed));
+  g_main_loop_run(loop);
+
+  for (BiometricStoragePlugin *plugin : plugins) {
+    g_object_unref(plugin);
+  }
+  g_unlink(checkpoint);
+  g_rmdir(checkpoint_dir);
+  g_rmdir(data_dir);
+  return failed ? 1 : 0;
+}
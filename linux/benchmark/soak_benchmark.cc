@@ -0,0 +1,606 @@
+// Long running soak test of the plugin: drives millions of mixed `read`,
+// `write`, `delete` and `readBuffer` calls against the Secret Service on the
+// session bus (the mock Secret Service on a private bus, see README.md) and
+// samples resident memory, heap in use, open file descriptors and live
+// GObject instances every `--interval` seconds, together with the latency
+// percentiles of each operation in that interval.
+//
+// Every call is encoded and decoded with FlStandardMethodCodec like on the
+// method channel, dispatched through biometric_storage_plugin_call() and its
+// response encoded again. `readBuffer` results are acquired and released
+// like dart does. Samples are taken with no call in flight, so they do not
+// depend on how many calls happened to be pending.
+//
+// At the end the samples after `--warmup` are split into thirds. A metric
+// whose median grew from each third to the next, and by more than its
+// slack, is reported as growing and makes the benchmark exit with code 2.
+//
+// GObject instances are only counted with GOBJECT_DEBUG=instance-count,
+// which GLib reads when it is loaded. The benchmark re-executes itself with
+// it set if needed.
+
+#include <flutter_linux/flutter_linux.h>
+#include <glib-unix.h>
+#include <malloc.h>
+#include <signal.h>
+#include <stdio.h>
+#include <string.h>
+#include <unistd.h>
+
+#include <algorithm>
+#include <map>
+#include <string>
+#include <vector>
+
+#include "../biometric_storage_buffer.h"
+#include "../biometric_storage_plugin_private.h"
+#include "bench_util.h"
+
+static gint64 operations = 1000000;
+static gint duration_s = 0;
+static gint interval_s = 10;
+static gint warmup_samples = 2;
+static gint keys = 256;
+static gint concurrency = 4;
+static gchar *sizes_spec = nullptr;
+static gchar *mix_spec = nullptr;
+static gint seed = 1;
+static gint rss_slack_kib = 4096;
+static gint heap_slack_kib = 1024;
+static gdouble latency_drift = 1.5;
+static gboolean csv = FALSE;
+
+static GOptionEntry entries[] = {
+    {"operations", 'n', 0, G_OPTION_ARG_INT64, &operations,
+     "Calls to make, 0 for no limit (default: 1000000)", "N"},
+    {"duration", 'd', 0, G_OPTION_ARG_INT, &duration_s,
+     "Stop after this many seconds, 0 for no limit (default: 0)", "SECONDS"},
+    {"interval", 'i', 0, G_OPTION_ARG_INT, &interval_s,
+     "Seconds between samples (default: 10)", "SECONDS"},
+    {"warmup", 'w', 0, G_OPTION_ARG_INT, &warmup_samples,
+     "Samples ignored by the growth check (default: 2)", "N"},
+    {"keys", 'k', 0, G_OPTION_ARG_INT, &keys,
+     "Number of distinct storages (default: 256)", "N"},
+    {"concurrency", 'c', 0, G_OPTION_ARG_INT, &concurrency,
+     "Calls in flight at a time (default: 4)", "N"},
+    {"sizes", 's', 0, G_OPTION_ARG_STRING, &sizes_spec,
+     "Comma separated payload sizes of writes (default: 16,1k,16k)", "SIZES"},
+    {"mix", 'm', 0, G_OPTION_ARG_STRING, &mix_spec,
+     "Weights of the operations (default: read=6,write=2,delete=1,"
+     "readBuffer=1)",
+     "MIX"},
+    {"seed", 0, 0, G_OPTION_ARG_INT, &seed,
+     "Seed of the operation sequence (default: 1)", "N"},
+    {"rss-slack", 0, 0, G_OPTION_ARG_INT, &rss_slack_kib,
+     "Resident memory growth in KiB tolerated (default: 4096)", "KIB"},
+    {"heap-slack", 0, 0, G_OPTION_ARG_INT, &heap_slack_kib,
+     "Heap growth in KiB tolerated (default: 1024)", "KIB"},
+    {"latency-drift", 0, 0, G_OPTION_ARG_DOUBLE, &latency_drift,
+     "Growth factor of p50 latency tolerated (default: 1.5)", "FACTOR"},
+    {"csv", 0, 0, G_OPTION_ARG_NONE, &csv, "Print samples as CSV", nullptr},
+    {nullptr}};
+
+static const gchar *const kOperations[] = {"read", "write", "delete",
+                                           "readBuffer"};
+static const guint kOperationCount = G_N_ELEMENTS(kOperations);
+
+// Lets callbacks scheduled by the last calls run before a sample is taken.
+static const guint kSettleMs = 20;
+
+struct Sample {
+  gdouble elapsed_s;
+  gint64 ops;
+  gdouble ops_per_s;
+  gint64 failed;
+  gint64 rss_kib;
+  gint64 heap_kib;
+  gint64 fds;
+  gint64 gobjects;
+  gdouble p50_us[kOperationCount];
+  gdouble p99_us[kOperationCount];
+};
+
+struct Soak {
+  BiometricStoragePlugin *plugin;
+  FlMethodCodec *codec;
+  GRand *rand;
+  std::vector<std::string> payloads;
+  guint weights[kOperationCount] = {};
+  guint total_weight = 0;
+
+  gint64 issued = 0;
+  gint64 completed = 0;
+  gint64 failed = 0;
+  gboolean stop = FALSE;
+  // Set by the sampler, workers wait until it is cleared.
+  gboolean pausing = FALSE;
+  guint in_flight = 0;
+  guint workers = 0;
+  AsyncCondition changed;
+
+  // Latencies of the current interval by operation.
+  std::vector<gint64> latencies_ns[kOperationCount];
+  std::vector<Sample> samples;
+  // Live instances by GObject type, after the warmup and at the end.
+  std::map<std::string, gint64> types_start;
+  std::map<std::string, gint64> types_end;
+};
+
+static gboolean parse_mix(Soak *soak, const gchar *spec, GError **error) {
+  g_auto(GStrv) parts = g_strsplit(spec, ",", -1);
+  for (gchar **part = parts; *part != nullptr; part++) {
+    g_auto(GStrv) pair = g_strsplit(*part, "=", 2);
+    guint index = 0;
+    while (index < kOperationCount &&
+           g_strcmp0(pair[0], kOperations[index]) != 0) {
+      index++;
+    }
+    gchar *end = nullptr;
+    guint64 weight =
+        pair[1] != nullptr ? g_ascii_strtoull(pair[1], &end, 10) : 0;
+    if (index == kOperationCount || end == pair[1] || *end != '\0' ||
+        weight > 1000) {
+      g_set_error(error, G_OPTION_ERROR, G_OPTION_ERROR_BAD_VALUE,
+                  "Invalid mix entry: %s", *part);
+      return FALSE;
+    }
+    soak->weights[index] = weight;
+  }
+  for (guint weight : soak->weights) {
+    soak->total_weight += weight;
+  }
+  if (soak->total_weight == 0) {
+    g_set_error(error, G_OPTION_ERROR, G_OPTION_ERROR_BAD_VALUE,
+                "The mix has no operation");
+    return FALSE;
+  }
+  return TRUE;
+}
+
+static guint pick_operation(Soak *soak) {
+  guint pick = g_rand_int_range(soak->rand, 0, soak->total_weight);
+  guint index = 0;
+  while (pick >= soak->weights[index]) {
+    pick -= soak->weights[index++];
+  }
+  return index;
+}
+
+static gboolean instance_counting() {
+  const gchar *debug = g_getenv("GOBJECT_DEBUG");
+  return debug != nullptr && strstr(debug, "instance-count") != nullptr;
+}
+
+static gint64 count_instances(GType type,
+                              std::map<std::string, gint64> *by_type) {
+  gint64 count = g_type_get_instance_count(type);
+  if (by_type != nullptr && count > 0) {
+    (*by_type)[g_type_name(type)] = count;
+  }
+  guint n_children = 0;
+  GType *children = g_type_children(type, &n_children);
+  for (guint i = 0; i < n_children; i++) {
+    count += count_instances(children[i], by_type);
+  }
+  g_free(children);
+  return count;
+}
+
+static gint64 rss_kib() {
+  g_autofree gchar *statm = nullptr;
+  if (!g_file_get_contents("/proc/self/statm", &statm, nullptr, nullptr)) {
+    return -1;
+  }
+  g_auto(GStrv) fields = g_strsplit(statm, " ", 3);
+  if (fields[0] == nullptr || fields[1] == nullptr) {
+    return -1;
+  }
+  return g_ascii_strtoll(fields[1], nullptr, 10) * sysconf(_SC_PAGESIZE) /
+         1024;
+}
+
+static gint64 heap_kib() {
+#if defined(__GLIBC__) && __GLIBC_PREREQ(2, 33)
+  return mallinfo2().uordblks / 1024;
+#else
+  return (guint)mallinfo().uordblks / 1024;
+#endif
+}
+
+static gint64 open_fds() {
+  GDir *dir = g_dir_open("/proc/self/fd", 0, nullptr);
+  if (dir == nullptr) {
+    return -1;
+  }
+  gint64 count = 0;
+  while (g_dir_read_name(dir) != nullptr) {
+    count++;
+  }
+  g_dir_close(dir);
+  // Without the descriptor of `dir` itself.
+  return count - 1;
+}
+
+static gdouble percentile_us(std::vector<gint64> *latencies, gdouble p) {
+  if (latencies->empty()) {
+    return 0;
+  }
+  std::sort(latencies->begin(), latencies->end());
+  gsize index = (gsize)(p * (latencies->size() - 1) + 0.5);
+  return (*latencies)[index] / 1000.0;
+}
+
+static void print_header() {
+  if (csv) {
+    printf("elapsed_s,ops,ops_per_s,failed,rss_kib,heap_kib,fds,gobjects");
+    for (const gchar *operation : kOperations) {
+      printf(",%s_p50_us,%s_p99_us", operation, operation);
+    }
+    printf("\n");
+  } else {
+    printf("%9s %10s %8s %6s %9s %9s %5s %8s", "elapsed_s", "ops", "ops/s",
+           "failed", "rss_kib", "heap_kib", "fds", "gobjects");
+    for (const gchar *operation : kOperations) {
+      g_autofree gchar *title = g_strdup_printf("%s p50/p99", operation);
+      printf(" %20s", title);
+    }
+    printf("\n");
+  }
+  fflush(stdout);
+}
+
+static void print_sample(const Sample &sample) {
+  if (csv) {
+    printf("%.1f,%" G_GINT64_FORMAT ",%.1f,%" G_GINT64_FORMAT
+           ",%" G_GINT64_FORMAT ",%" G_GINT64_FORMAT ",%" G_GINT64_FORMAT
+           ",%" G_GINT64_FORMAT,
+           sample.elapsed_s, sample.ops, sample.ops_per_s, sample.failed,
+           sample.rss_kib, sample.heap_kib, sample.fds, sample.gobjects);
+    for (guint i = 0; i < kOperationCount; i++) {
+      printf(",%.1f,%.1f", sample.p50_us[i], sample.p99_us[i]);
+    }
+    printf("\n");
+  } else {
+    printf("%9.1f %10" G_GINT64_FORMAT " %8.1f %6" G_GINT64_FORMAT
+           " %9" G_GINT64_FORMAT " %9" G_GINT64_FORMAT " %5" G_GINT64_FORMAT
+           " %8" G_GINT64_FORMAT,
+           sample.elapsed_s, sample.ops, sample.ops_per_s, sample.failed,
+           sample.rss_kib, sample.heap_kib, sample.fds, sample.gobjects);
+    for (guint i = 0; i < kOperationCount; i++) {
+      g_autofree gchar *latency =
+          g_strdup_printf("%.0f/%.0f", sample.p50_us[i], sample.p99_us[i]);
+      printf(" %20s", latency);
+    }
+    printf("\n");
+  }
+  fflush(stdout);
+}
+
+static void take_sample(Soak *soak, gdouble elapsed_s) {
+  Sample sample = {};
+  sample.elapsed_s = elapsed_s;
+  sample.ops = soak->completed;
+  if (!soak->samples.empty()) {
+    const Sample &previous = soak->samples.back();
+    gdouble seconds = elapsed_s - previous.elapsed_s;
+    sample.ops_per_s =
+        seconds > 0 ? (sample.ops - previous.ops) / seconds : 0;
+  } else if (elapsed_s > 0) {
+    sample.ops_per_s = sample.ops / elapsed_s;
+  }
+  sample.failed = soak->failed;
+  sample.rss_kib = rss_kib();
+  sample.heap_kib = heap_kib();
+  sample.fds = open_fds();
+  gboolean counting = instance_counting();
+  gboolean first_checked = soak->samples.size() == (gsize)warmup_samples;
+  sample.gobjects =
+      counting ? count_instances(G_TYPE_OBJECT,
+                                 first_checked ? &soak->types_start : nullptr)
+               : -1;
+  for (guint i = 0; i < kOperationCount; i++) {
+    sample.p50_us[i] = percentile_us(&soak->latencies_ns[i], 0.5);
+    sample.p99_us[i] = percentile_us(&soak->latencies_ns[i], 0.99);
+    soak->latencies_ns[i].clear();
+  }
+  soak->samples.push_back(sample);
+  print_sample(sample);
+}
+
+static RefPtr<FlValue> call_args(Soak *soak, guint operation) {
+  RefPtr<FlValue> args = RefPtr<FlValue>::adopt(fl_value_new_map());
+  GAutoFree<gchar> name(g_strdup_printf(
+      "soak_benchmark.%d", g_rand_int_range(soak->rand, 0, keys)));
+  fl_value_set_string_take(args.get(), "name",
+                           fl_value_new_string(name.get()));
+  if (strcmp(kOperations[operation], "write") == 0) {
+    const std::string &payload = soak->payloads[g_rand_int_range(
+        soak->rand, 0, (gint32)soak->payloads.size())];
+    fl_value_set_string_take(args.get(), "content",
+                             fl_value_new_string(payload.c_str()));
+  }
+  return args;
+}
+
+// Does with a `readBuffer` result what dart does: takes the buffer and
+// lets its finalizer release it.
+static void release_buffer(FlValue *result) {
+  if (fl_value_get_type(result) != FL_VALUE_TYPE_MAP) {
+    return;
+  }
+  gint64 handle = fl_value_get_int(fl_value_lookup_string(result, "handle"));
+  guint8 *buffer = biometric_storage_buffer_acquire(handle);
+  if (buffer != nullptr) {
+    biometric_storage_buffer_release(buffer);
+  }
+}
+
+static Task<> run_call(Soak *soak, guint operation) {
+  const gchar *method = kOperations[operation];
+  RefPtr<FlValue> args = call_args(soak, operation);
+  FlMethodCodecClass *codec_class = FL_METHOD_CODEC_GET_CLASS(soak->codec);
+  g_autoptr(GBytes) message = codec_class->encode_method_call(
+      soak->codec, method, args.get(), nullptr);
+
+  gint64 started = bench_now_ns();
+  GAutoFree<gchar> decoded_method;
+  RefPtr<FlValue> decoded_args;
+  {
+    gchar *name = nullptr;
+    FlValue *value = nullptr;
+    codec_class->decode_method_call(soak->codec, message, &name, &value,
+                                    nullptr);
+    decoded_method.reset(name);
+    decoded_args = RefPtr<FlValue>::adopt(value);
+  }
+  RefPtr<FlMethodResponse> response = co_await biometric_storage_plugin_call(
+      soak->plugin, decoded_method.get(), decoded_args.get());
+  GBytes *envelope;
+  if (FL_IS_METHOD_SUCCESS_RESPONSE(response.get())) {
+    FlValue *result = fl_method_success_response_get_result(
+        FL_METHOD_SUCCESS_RESPONSE(response.get()));
+    envelope =
+        codec_class->encode_success_envelope(soak->codec, result, nullptr);
+    if (strcmp(method, "readBuffer") == 0) {
+      release_buffer(result);
+    }
+  } else {
+    FlMethodErrorResponse *error = FL_METHOD_ERROR_RESPONSE(response.get());
+    envelope = codec_class->encode_error_envelope(
+        soak->codec, fl_method_error_response_get_code(error),
+        fl_method_error_response_get_message(error),
+        fl_method_error_response_get_details(error), nullptr);
+    if (soak->failed++ == 0) {
+      g_printerr("%s failed: %s\n", method,
+                 fl_method_error_response_get_message(error));
+    }
+  }
+  g_bytes_unref(envelope);
+  soak->latencies_ns[operation].push_back(bench_now_ns() - started);
+}
+
+static Task<> run_worker(Soak *soak) {
+  while (TRUE) {
+    while (soak->pausing && !soak->stop) {
+      co_await soak->changed.wait();
+    }
+    if (soak->stop || (operations > 0 && soak->issued >= operations)) {
+      break;
+    }
+    soak->issued++;
+    soak->in_flight++;
+    co_await run_call(soak, pick_operation(soak));
+    soak->in_flight--;
+    soak->completed++;
+    soak->changed.notify_all();
+  }
+  soak->workers--;
+  soak->changed.notify_all();
+}
+
+static gdouble median(std::vector<gdouble> values) {
+  std::sort(values.begin(), values.end());
+  return values[values.size() / 2];
+}
+
+// Whether `values` grew from each third to the next by more than `slack`
+// in total and, for latencies, by more than `factor`.
+static gboolean growing(const std::vector<gdouble> &values, gdouble slack,
+                        gdouble factor, gdouble *first, gdouble *last) {
+  gsize third = values.size() / 3;
+  gdouble a = median({values.begin(), values.begin() + third});
+  gdouble b = median({values.begin() + third, values.end() - third});
+  gdouble c = median({values.end() - third, values.end()});
+  *first = a;
+  *last = c;
+  return a < b && b < c && c - a > slack && c > a * factor;
+}
+
+// Prints the growth check of all metrics, returns FALSE if any grew.
+static gboolean check_growth(Soak *soak) {
+  if (soak->samples.size() < (gsize)warmup_samples + 6) {
+    g_printerr("growth check skipped: %" G_GSIZE_FORMAT
+               " samples, needs %d (run longer or lower --interval)\n",
+               soak->samples.size(), warmup_samples + 6);
+    return TRUE;
+  }
+  std::vector<const Sample *> checked;
+  for (gsize i = warmup_samples; i < soak->samples.size(); i++) {
+    checked.push_back(&soak->samples[i]);
+  }
+  struct Metric {
+    std::string name;
+    std::vector<gdouble> values;
+    gdouble slack;
+    gdouble factor;
+  };
+  std::vector<Metric> metrics = {{"rss_kib", {}, (gdouble)rss_slack_kib, 1},
+                                 {"heap_kib", {}, (gdouble)heap_slack_kib, 1},
+                                 {"fds", {}, 0, 1}};
+  if (instance_counting()) {
+    metrics.push_back({"gobjects", {}, 0, 1});
+  }
+  for (const gchar *operation : kOperations) {
+    metrics.push_back({std::string(operation) + "_p50_us", {}, 0,
+                       latency_drift});
+  }
+  for (const Sample *sample : checked) {
+    metrics[0].values.push_back(sample->rss_kib);
+    metrics[1].values.push_back(sample->heap_kib);
+    metrics[2].values.push_back(sample->fds);
+    gsize next = 3;
+    if (instance_counting()) {
+      metrics[next++].values.push_back(sample->gobjects);
+    }
+    for (guint i = 0; i < kOperationCount; i++) {
+      metrics[next + i].values.push_back(sample->p50_us[i]);
+    }
+  }
+
+  gboolean ok = TRUE;
+  for (const Metric &metric : metrics) {
+    gdouble first, last;
+    gboolean grew =
+        growing(metric.values, metric.slack, metric.factor, &first, &last);
+    g_printerr("%-20s %12.1f -> %12.1f %s\n", metric.name.c_str(), first,
+               last, grew ? "GROWING" : "ok");
+    if (grew && metric.name == "gobjects") {
+      for (const auto &type : soak->types_end) {
+        auto start = soak->types_start.find(type.first);
+        gint64 before = start != soak->types_start.end() ? start->second : 0;
+        if (type.second > before) {
+          g_printerr("  %-30s +%" G_GINT64_FORMAT "\n", type.first.c_str(),
+                     type.second - before);
+        }
+      }
+    }
+    ok = ok && !grew;
+  }
+  return ok;
+}
+
+static Task<> run_sampler(Soak *soak) {
+  gint64 started = bench_now_ns();
+  while (soak->workers > 0) {
+    gint64 deadline = bench_now_ns() + (gint64)interval_s * 1000000000;
+    while (soak->workers > 0 && bench_now_ns() < deadline) {
+      co_await sleep_ms(100);
+    }
+    gdouble elapsed_s = (bench_now_ns() - started) / 1e9;
+    if (duration_s > 0 && elapsed_s >= duration_s) {
+      soak->stop = TRUE;
+    }
+    soak->pausing = TRUE;
+    while (soak->in_flight > 0) {
+      co_await soak->changed.wait();
+    }
+    co_await sleep_ms(kSettleMs);
+    take_sample(soak, (bench_now_ns() - started) / 1e9);
+    soak->pausing = FALSE;
+    soak->changed.notify_all();
+  }
+  if (instance_counting()) {
+    count_instances(G_TYPE_OBJECT, &soak->types_end);
+  }
+}
+
+static Task<> remove_items(Soak *soak) {
+  for (gint i = 0; i < keys; i++) {
+    RefPtr<FlValue> args = RefPtr<FlValue>::adopt(fl_value_new_map());
+    GAutoFree<gchar> name(g_strdup_printf("soak_benchmark.%d", i));
+    fl_value_set_string_take(args.get(), "name",
+                             fl_value_new_string(name.get()));
+    co_await biometric_storage_plugin_call(soak->plugin, "delete", args.get());
+  }
+}
+
+static Task<> run_soak(Soak *soak, GMainLoop *loop, int *status) {
+  print_header();
+  for (gint i = 0; i < concurrency; i++) {
+    soak->workers++;
+    task_detach(run_worker(soak));
+  }
+  co_await run_sampler(soak);
+  gboolean ok = check_growth(soak);
+  co_await remove_items(soak);
+  *status = !ok ? 2 : soak->failed > 0 ? 1 : 0;
+  g_main_loop_quit(loop);
+}
+
+static gboolean stop_cb(gpointer user_data) {
+  Soak *soak = static_cast<Soak *>(user_data);
+  g_printerr("Stopping after the calls in flight\n");
+  soak->stop = TRUE;
+  soak->changed.notify_all();
+  return G_SOURCE_CONTINUE;
+}
+
+int main(int argc, char **argv) {
+  if (!instance_counting()) {
+    g_autofree gchar *debug = g_strdup(g_getenv("GOBJECT_DEBUG"));
+    g_autofree gchar *value =
+        debug != nullptr ? g_strconcat(debug, ":instance-count", nullptr)
+                         : g_strdup("instance-count");
+    g_setenv("GOBJECT_DEBUG", value, TRUE);
+    execv("/proc/self/exe", argv);
+    g_printerr("Failed to re-execute, GObject instances are not counted\n");
+    if (debug != nullptr) {
+      g_setenv("GOBJECT_DEBUG", debug, TRUE);
+    } else {
+      g_unsetenv("GOBJECT_DEBUG");
+    }
+  }
+
+  g_autoptr(GError) error = nullptr;
+  GOptionContext *context = g_option_context_new("- soak benchmark");
+  g_option_context_add_main_entries(context, entries, nullptr);
+  gboolean parsed = g_option_context_parse(context, &argc, &argv, &error);
+  g_option_context_free(context);
+  if (!parsed) {
+    g_printerr("%s\n", error->message);
+    return 1;
+  }
+  if (operations < 0 || interval_s < 1 || warmup_samples < 0 || keys < 1 ||
+      concurrency < 1) {
+    g_printerr("--interval, --keys and --concurrency must be positive\n");
+    return 1;
+  }
+
+  Soak soak;
+  if (!parse_mix(&soak, mix_spec != nullptr
+                            ? mix_spec
+                            : "read=6,write=2,delete=1,readBuffer=1",
+                 &error)) {
+    g_printerr("%s\n", error->message);
+    return 1;
+  }
+  g_autoptr(GArray) sizes = bench_parse_sizes(
+      sizes_spec != nullptr ? sizes_spec : "16,1k,16k", &error);
+  if (sizes == nullptr) {
+    g_printerr("%s\n", error->message);
+    return 1;
+  }
+  for (guint i = 0; i < sizes->len; i++) {
+    g_autofree gchar *payload =
+        bench_payload_new(g_array_index(sizes, gsize, i));
+    soak.payloads.emplace_back(payload);
+  }
+
+  g_autoptr(GObject) plugin = G_OBJECT(
+      g_object_new(biometric_storage_plugin_get_type(), nullptr));
+  g_autoptr(FlStandardMethodCodec) codec = fl_standard_method_codec_new();
+  g_autoptr(GRand) rand = g_rand_new_with_seed(seed);
+  soak.plugin = reinterpret_cast<BiometricStoragePlugin *>(plugin);
+  soak.codec = FL_METHOD_CODEC(codec);
+  soak.rand = rand;
+
+  g_autoptr(GMainLoop) loop = g_main_loop_new(nullptr, FALSE);
+  guint sigint = g_unix_signal_add(SIGINT, stop_cb, &soak);
+  guint sigterm = g_unix_signal_add(SIGTERM, stop_cb, &soak);
+  int status = 0;
+  task_detach(run_soak(&soak, loop, &status));
+  g_main_loop_run(loop);
+  g_source_remove(sigint);
+  g_source_remove(sigterm);
+  return status;
+}
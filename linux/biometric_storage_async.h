@@ -0,0 +1,312 @@
+#ifndef FLUTTER_PLUGIN_BIOMETRIC_STORAGE_ASYNC_H_
+#define FLUTTER_PLUGIN_BIOMETRIC_STORAGE_ASYNC_H_
+
+// Small C++20 coroutine layer on top of GIO style async operations.
+//
+// Operations are written as coroutines returning Task<T>. A GIO
+// foo_async()/foo_finish() pair is awaited with gio_async(), which resumes
+// the coroutine from the GAsyncReadyCallback on the main context the
+// operation was started on:
+//
+//   static Task<bool> store(GCancellable *cancellable, const gchar *name) {
+//     RefPtr<GAsyncResult> result = co_await gio_async(
+//         [&](GAsyncReadyCallback callback, gpointer user_data) {
+//           secret_password_store(..., cancellable, callback, user_data, ...);
+//         });
+//     co_return secret_password_store_finish(result.get(), nullptr);
+//   }
+//
+// Tasks are lazy, they start running when awaited or when handed to
+// task_detach(). References which have to outlive a suspension point are
+// kept in RefPtr<T> instead of manual g_object_ref()/g_object_unref(), the
+// g_autoptr()/g_autofree cleanup attributes are not used in coroutines.
+
+#include <flutter_linux/flutter_linux.h>
+#include <gio/gio.h>
+
+#include <coroutine>
+#include <exception>
+#include <memory>
+#include <utility>
+#include <vector>
+
+// Frees a g_malloc()ed pointer, for use with std::unique_ptr. Coroutine
+// bodies use GAutoFree<T> instead of g_autofree.
+struct GFreeDeleter {
+  void operator()(gpointer ptr) const { g_free(ptr); }
+};
+
+template <typename T>
+using GAutoFree = std::unique_ptr<T, GFreeDeleter>;
+
+// Reference counting for the types held in a RefPtr<T>. Defaults to GObject.
+template <typename T>
+struct RefTraits {
+  static T *ref(T *ptr) { return static_cast<T *>(g_object_ref(ptr)); }
+  static void unref(T *ptr) { g_object_unref(ptr); }
+};
+
+template <>
+struct RefTraits<FlValue> {
+  static FlValue *ref(FlValue *ptr) { return fl_value_ref(ptr); }
+  static void unref(FlValue *ptr) { fl_value_unref(ptr); }
+};
+
+template <>
+struct RefTraits<GHashTable> {
+  static GHashTable *ref(GHashTable *ptr) { return g_hash_table_ref(ptr); }
+  static void unref(GHashTable *ptr) { g_hash_table_unref(ptr); }
+};
+
+// Owning reference, safe to keep in coroutine frames.
+template <typename T>
+class RefPtr {
+ public:
+  RefPtr() = default;
+  RefPtr(std::nullptr_t) {}
+  RefPtr(const RefPtr &other)
+      : ptr_(other.ptr_ ? RefTraits<T>::ref(other.ptr_) : nullptr) {}
+  RefPtr(RefPtr &&other) noexcept : ptr_(std::exchange(other.ptr_, nullptr)) {}
+  ~RefPtr() { reset(); }
+
+  RefPtr &operator=(RefPtr other) noexcept {
+    std::swap(ptr_, other.ptr_);
+    return *this;
+  }
+
+  // Takes a new reference to `ptr`.
+  static RefPtr ref(T *ptr) {
+    return RefPtr(ptr ? RefTraits<T>::ref(ptr) : nullptr);
+  }
+  // Takes over the (floating or full) reference owned by the caller.
+  static RefPtr adopt(T *ptr) { return RefPtr(ptr); }
+
+  T *get() const { return ptr_; }
+  T *steal() { return std::exchange(ptr_, nullptr); }
+  explicit operator bool() const { return ptr_ != nullptr; }
+
+  void reset() {
+    if (ptr_ != nullptr) {
+      RefTraits<T>::unref(std::exchange(ptr_, nullptr));
+    }
+  }
+
+ private:
+  explicit RefPtr(T *ptr) : ptr_(ptr) {}
+  T *ptr_ = nullptr;
+};
+
+template <typename T = void>
+class Task;
+
+namespace async_detail {
+
+struct PromiseBase {
+  std::coroutine_handle<> continuation;
+  bool detached = false;
+
+  std::suspend_always initial_suspend() noexcept { return {}; }
+  void unhandled_exception() noexcept { std::terminate(); }
+
+  // Resumes whoever awaited the task, or frees a detached task.
+  struct FinalAwaiter {
+    bool await_ready() const noexcept { return false; }
+    template <typename Promise>
+    std::coroutine_handle<> await_suspend(
+        std::coroutine_handle<Promise> handle) noexcept {
+      PromiseBase &promise = handle.promise();
+      if (promise.detached) {
+        handle.destroy();
+        return std::noop_coroutine();
+      }
+      if (promise.continuation) {
+        return promise.continuation;
+      }
+      return std::noop_coroutine();
+    }
+    void await_resume() const noexcept {}
+  };
+  FinalAwaiter final_suspend() noexcept { return {}; }
+};
+
+template <typename T>
+struct Promise : PromiseBase {
+  T value{};
+  Task<T> get_return_object() noexcept;
+  void return_value(T result) { value = std::move(result); }
+  T take() { return std::move(value); }
+};
+
+template <>
+struct Promise<void> : PromiseBase {
+  Task<void> get_return_object() noexcept;
+  void return_void() noexcept {}
+  void take() {}
+};
+
+}  // namespace async_detail
+
+// A lazily started coroutine producing a T.
+template <typename T>
+class [[nodiscard]] Task {
+ public:
+  using promise_type = async_detail::Promise<T>;
+  using Handle = std::coroutine_handle<promise_type>;
+
+  Task(Task &&other) noexcept
+      : handle_(std::exchange(other.handle_, nullptr)) {}
+  Task(const Task &) = delete;
+  Task &operator=(const Task &) = delete;
+  ~Task() {
+    if (handle_) {
+      handle_.destroy();
+    }
+  }
+
+  bool await_ready() const noexcept { return false; }
+  std::coroutine_handle<> await_suspend(
+      std::coroutine_handle<> awaiting) noexcept {
+    handle_.promise().continuation = awaiting;
+    return handle_;
+  }
+  T await_resume() { return handle_.promise().take(); }
+
+  // Starts the task without anybody awaiting it, its frame is freed once it
+  // completes.
+  friend void task_detach(Task task) {
+    Handle handle = std::exchange(task.handle_, nullptr);
+    handle.promise().detached = true;
+    handle.resume();
+  }
+
+ private:
+  friend struct async_detail::Promise<T>;
+  explicit Task(Handle handle) : handle_(handle) {}
+  Handle handle_;
+};
+
+namespace async_detail {
+
+template <typename T>
+Task<T> Promise<T>::get_return_object() noexcept {
+  return Task<T>(Task<T>::Handle::from_promise(*this));
+}
+
+inline Task<void> Promise<void>::get_return_object() noexcept {
+  return Task<void>(Task<void>::Handle::from_promise(*this));
+}
+
+}  // namespace async_detail
+
+// Awaitable for a GIO async operation. `start` receives the callback and
+// user data to pass to the *_async function, the awaiting coroutine resumes
+// with the GAsyncResult to pass to the matching *_finish function.
+template <typename Start>
+class GAsyncAwaiter {
+ public:
+  explicit GAsyncAwaiter(Start start) : start_(std::move(start)) {}
+
+  bool await_ready() const noexcept { return false; }
+  void await_suspend(std::coroutine_handle<> handle) {
+    handle_ = handle;
+    start_(&GAsyncAwaiter::on_ready, this);
+  }
+  RefPtr<GAsyncResult> await_resume() { return std::move(result_); }
+
+ private:
+  static void on_ready(GObject *source, GAsyncResult *result,
+                       gpointer user_data) {
+    auto *self = static_cast<GAsyncAwaiter *>(user_data);
+    self->result_ = RefPtr<GAsyncResult>::ref(result);
+    self->handle_.resume();
+  }
+
+  Start start_;
+  std::coroutine_handle<> handle_;
+  RefPtr<GAsyncResult> result_;
+};
+
+template <typename Start>
+GAsyncAwaiter<Start> gio_async(Start start) {
+  return GAsyncAwaiter<Start>(std::move(start));
+}
+
+// Awaitable which resumes the coroutine from the default main context after
+// `interval` milliseconds.
+class SleepAwaiter {
+ public:
+  explicit SleepAwaiter(guint interval) : interval_(interval) {}
+
+  bool await_ready() const noexcept { return false; }
+  void await_suspend(std::coroutine_handle<> handle) {
+    handle_ = handle;
+    g_timeout_add(interval_, &SleepAwaiter::on_timeout, this);
+  }
+  void await_resume() const noexcept {}
+
+ private:
+  static gboolean on_timeout(gpointer user_data) {
+    static_cast<SleepAwaiter *>(user_data)->handle_.resume();
+    return G_SOURCE_REMOVE;
+  }
+
+  guint interval_;
+  std::coroutine_handle<> handle_;
+};
+
+inline SleepAwaiter sleep_ms(guint interval) { return SleepAwaiter(interval); }
+
+// Lets coroutines on the main context wait for a change of shared state.
+// Waiters re-check their condition after waking up:
+//
+//   while (batch->running >= kLimit) {
+//     co_await batch->changed.wait();
+//   }
+//
+// notify_all() never resumes a waiter from inside the caller, they are
+// resumed from an idle source on the default main context.
+class AsyncCondition {
+ public:
+  class Awaiter {
+   public:
+    explicit Awaiter(AsyncCondition *condition) : condition_(condition) {}
+    bool await_ready() const noexcept { return false; }
+    void await_suspend(std::coroutine_handle<> handle) {
+      condition_->waiters_.push_back(handle);
+    }
+    void await_resume() const noexcept {}
+
+   private:
+    AsyncCondition *condition_;
+  };
+
+  AsyncCondition() = default;
+  AsyncCondition(const AsyncCondition &) = delete;
+  AsyncCondition &operator=(const AsyncCondition &) = delete;
+
+  Awaiter wait() { return Awaiter(this); }
+
+  void notify_all() {
+    if (waiters_.empty()) {
+      return;
+    }
+    auto *waiters = new std::vector<std::coroutine_handle<>>();
+    waiters->swap(waiters_);
+    g_idle_add(resume_all, waiters);
+  }
+
+ private:
+  static gboolean resume_all(gpointer user_data) {
+    auto *waiters = static_cast<std::vector<std::coroutine_handle<>> *>(
+        user_data);
+    for (std::coroutine_handle<> handle : *waiters) {
+      handle.resume();
+    }
+    delete waiters;
+    return G_SOURCE_REMOVE;
+  }
+
+  std::vector<std::coroutine_handle<>> waiters_;
+};
+
+#endif  // FLUTTER_PLUGIN_BIOMETRIC_STORAGE_ASYNC_H_
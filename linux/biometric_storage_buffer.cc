@@ -0,0 +1,131 @@
+#include "biometric_storage_buffer.h"
+
+#include <sys/mman.h>
+#include <unistd.h>
+
+#include "biometric_storage_crypto.h"
+
+// Stored in front of the data, 16 bytes to keep the data aligned.
+typedef struct {
+  gsize mapped_size;
+  // Registry key while registered.
+  gint64 handle;
+} BufferHeader;
+
+G_STATIC_ASSERT(sizeof(BufferHeader) == 16);
+
+static GMutex registry_mutex;
+static GHashTable *registry = nullptr;
+static gint64 next_handle = 1;
+// Buffers dart acquired and not yet released, a set of their data.
+static GHashTable *acquired = nullptr;
+
+static BufferHeader *buffer_header(gpointer data) {
+  return reinterpret_cast<BufferHeader *>(static_cast<guint8 *>(data) -
+                                          sizeof(BufferHeader));
+}
+
+guint8 *biometric_buffer_new(gsize length) {
+  gsize page_size = sysconf(_SC_PAGESIZE);
+  gsize size = (sizeof(BufferHeader) + length + page_size - 1) / page_size *
+               page_size;
+  void *base = mmap(nullptr, size, PROT_READ | PROT_WRITE,
+                    MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+  if (base == MAP_FAILED) {
+    return nullptr;
+  }
+  madvise(base, size, MADV_DONTDUMP);
+  if (mlock(base, size) != 0) {
+    static gsize warned = 0;
+    if (g_once_init_enter(&warned)) {
+      g_warning("Could not lock secret buffers into memory, consider "
+                "raising RLIMIT_MEMLOCK.");
+      g_once_init_leave(&warned, 1);
+    }
+  }
+  BufferHeader *header = static_cast<BufferHeader *>(base);
+  header->mapped_size = size;
+  header->handle = 0;
+  return static_cast<guint8 *>(base) + sizeof(BufferHeader);
+}
+
+void biometric_buffer_free(guint8 *data) {
+  if (data == nullptr) {
+    return;
+  }
+  BufferHeader *header = buffer_header(data);
+  gsize size = header->mapped_size;
+  biometric_wipe(header, size);
+  munlock(header, size);
+  munmap(header, size);
+}
+
+gint64 biometric_buffer_register(guint8 *data) {
+  BufferHeader *header = buffer_header(data);
+  g_mutex_lock(&registry_mutex);
+  if (registry == nullptr) {
+    registry = g_hash_table_new(g_int64_hash, g_int64_equal);
+  }
+  header->handle = next_handle++;
+  g_hash_table_insert(registry, &header->handle, data);
+  g_mutex_unlock(&registry_mutex);
+  return header->handle;
+}
+
+void biometric_buffer_free_unclaimed(void) {
+  g_mutex_lock(&registry_mutex);
+  GHashTable *unclaimed = registry;
+  registry = nullptr;
+  g_mutex_unlock(&registry_mutex);
+  if (unclaimed == nullptr) {
+    return;
+  }
+  GHashTableIter iter;
+  gpointer data;
+  g_hash_table_iter_init(&iter, unclaimed);
+  while (g_hash_table_iter_next(&iter, nullptr, &data)) {
+    // Frees the key as well.
+    g_hash_table_iter_steal(&iter);
+    biometric_buffer_free(static_cast<guint8 *>(data));
+  }
+  g_hash_table_unref(unclaimed);
+}
+
+guint8 *biometric_storage_buffer_acquire(gint64 handle) {
+  g_mutex_lock(&registry_mutex);
+  gpointer data =
+      registry != nullptr ? g_hash_table_lookup(registry, &handle) : nullptr;
+  if (data != nullptr) {
+    g_hash_table_remove(registry, &handle);
+    if (acquired == nullptr) {
+      acquired = g_hash_table_new(g_direct_hash, g_direct_equal);
+    }
+    g_hash_table_add(acquired, data);
+  }
+  g_mutex_unlock(&registry_mutex);
+  return static_cast<guint8 *>(data);
+}
+
+void biometric_buffer_wipe_acquired(void) {
+  g_mutex_lock(&registry_mutex);
+  if (acquired != nullptr) {
+    GHashTableIter iter;
+    gpointer data;
+    g_hash_table_iter_init(&iter, acquired);
+    while (g_hash_table_iter_next(&iter, &data, nullptr)) {
+      // Under the lock, so a concurrent release does not unmap it meanwhile.
+      biometric_wipe(data,
+                     buffer_header(data)->mapped_size - sizeof(BufferHeader));
+    }
+  }
+  g_mutex_unlock(&registry_mutex);
+}
+
+void biometric_storage_buffer_release(void *data) {
+  g_mutex_lock(&registry_mutex);
+  if (acquired != nullptr) {
+    g_hash_table_remove(acquired, data);
+  }
+  g_mutex_unlock(&registry_mutex);
+  biometric_buffer_free(static_cast<guint8 *>(data));
+}
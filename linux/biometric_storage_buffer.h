@@ -0,0 +1,52 @@
+#ifndef FLUTTER_PLUGIN_BIOMETRIC_STORAGE_BUFFER_H_
+#define FLUTTER_PLUGIN_BIOMETRIC_STORAGE_BUFFER_H_
+
+#include <glib.h>
+
+#include "include/biometric_storage/biometric_storage_plugin.h"
+
+// Locked buffers holding secrets which are handed to dart without copying
+// them (`readBuffer`).
+//
+// The plugin fills a buffer and registers it, which yields a handle that is
+// sent to dart over the method channel. Dart takes ownership of the buffer
+// through biometric_storage_buffer_acquire() (via FFI), wraps it in an
+// external Uint8List and attaches biometric_storage_buffer_release() as
+// native finalizer, which wipes and frees it. Dart does not guarantee
+// finalizers run, e.g. when the isolate shuts down, so acquired buffers stay
+// tracked until released and biometric_buffer_wipe_acquired() wipes those
+// left when the plugin goes away.
+
+G_BEGIN_DECLS
+
+// Allocates a zeroed buffer of `length` bytes, which is excluded from core
+// dumps and locked into memory if RLIMIT_MEMLOCK allows it. Returns nullptr
+// if the allocation failed.
+guint8 *biometric_buffer_new(gsize length);
+
+// Wipes and frees a buffer returned by biometric_buffer_new().
+void biometric_buffer_free(guint8 *data);
+
+// Makes `data` available to biometric_storage_buffer_acquire() and returns
+// its handle.
+gint64 biometric_buffer_register(guint8 *data);
+
+// Frees all registered buffers dart never acquired.
+void biometric_buffer_free_unclaimed(void);
+
+// Wipes all acquired buffers dart has not released yet. They stay mapped,
+// as dart may still reference them, and are freed on release.
+void biometric_buffer_wipe_acquired(void);
+
+// FFI: moves buffer `handle` from the registry to the acquired buffers and
+// returns it, dart owns it from now on. Returns nullptr for unknown handles. May be called from
+// any thread.
+FLUTTER_PLUGIN_EXPORT guint8 *biometric_storage_buffer_acquire(gint64 handle);
+
+// FFI: native finalizer of acquired buffers, stops tracking `data` and
+// frees it like biometric_buffer_free().
+FLUTTER_PLUGIN_EXPORT void biometric_storage_buffer_release(void *data);
+
+G_END_DECLS
+
+#endif  // FLUTTER_PLUGIN_BIOMETRIC_STORAGE_BUFFER_H_
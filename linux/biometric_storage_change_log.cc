@@ -0,0 +1,361 @@
+#include "biometric_storage_change_log.h"
+
+#include <errno.h>
+#include <fcntl.h>
+#include <gio/gio.h>
+#include <string.h>
+#include <sys/file.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+#include <algorithm>
+
+static const char kMagic[] = "biometric_storage-changes";
+static const guint kVersion = 1;
+// Codes of ChangeLog::Change in the file, and their names for dart.
+static const char kChangeCodes[] = {'c', 'm', 'd'};
+static const char *const kChangeNames[] = {"created", "modified", "deleted"};
+
+static gboolean set_errno_error(GError **error, const gchar *operation,
+                                const gchar *path, int saved_errno) {
+  g_set_error(error, G_IO_ERROR, g_io_error_from_errno(saved_errno),
+              "%s %s: %s", operation, path, g_strerror(saved_errno));
+  return FALSE;
+}
+
+static gboolean write_all(int fd, const gchar *data, gsize length) {
+  while (length > 0) {
+    ssize_t written = write(fd, data, length);
+    if (written < 0 && errno == EINTR) {
+      continue;
+    }
+    if (written < 0) {
+      return FALSE;
+    }
+    data += written;
+    length -= written;
+  }
+  return TRUE;
+}
+
+// Replaces `path` with `data` atomically.
+static gboolean replace_file(const gchar *path, const GString *data,
+                             GError **error) {
+  g_autofree gchar *tmp_path = g_strconcat(path, ".tmp", NULL);
+  int fd = open(tmp_path, O_WRONLY | O_CREAT | O_TRUNC | O_CLOEXEC, 0600);
+  if (fd < 0) {
+    return set_errno_error(error, "Failed to create", tmp_path, errno);
+  }
+  gboolean written = write_all(fd, data->str, data->len) && fsync(fd) == 0;
+  int saved_errno = errno;
+  close(fd);
+  if (!written || rename(tmp_path, path) != 0) {
+    saved_errno = written ? errno : saved_errno;
+    unlink(tmp_path);
+    return set_errno_error(error, "Failed to write", path, saved_errno);
+  }
+  return TRUE;
+}
+
+static void append_entry(GString *out, const ChangeLog::Entry &entry) {
+  g_autofree gchar *escaped = g_strescape(entry.name.c_str(), NULL);
+  g_string_append_printf(out, "%" G_GUINT64_FORMAT " %c %s\n",
+                         entry.generation,
+                         kChangeCodes[static_cast<int>(entry.change)],
+                         escaped);
+}
+
+// Holds the lock shared by all processes writing the log while in scope.
+class ChangeLog::Lock {
+ public:
+  Lock(ChangeLog *log, GError **error) : log_(log) {
+    if (log->lock_fd_ < 0) {
+      g_autofree gchar *dir = g_path_get_dirname(log->lock_path_);
+      if (g_mkdir_with_parents(dir, 0700) != 0) {
+        set_errno_error(error, "Failed to create", dir, errno);
+        return;
+      }
+      log->lock_fd_ =
+          open(log->lock_path_, O_RDWR | O_CREAT | O_CLOEXEC, 0600);
+      if (log->lock_fd_ < 0) {
+        set_errno_error(error, "Failed to open", log->lock_path_, errno);
+        return;
+      }
+    }
+    int result;
+    while ((result = flock(log->lock_fd_, LOCK_EX)) != 0 && errno == EINTR) {
+    }
+    if (result != 0) {
+      set_errno_error(error, "Failed to lock", log->lock_path_, errno);
+      return;
+    }
+    locked_ = TRUE;
+  }
+
+  ~Lock() {
+    if (locked_) {
+      flock(log_->lock_fd_, LOCK_UN);
+    }
+  }
+
+  gboolean locked() const { return locked_; }
+
+ private:
+  ChangeLog *log_;
+  gboolean locked_ = FALSE;
+};
+
+ChangeLog::ChangeLog(const gchar *path, gsize max_records)
+    : path_(g_strdup(path)),
+      lock_path_(g_strconcat(path, ".lock", NULL)),
+      max_records_(max_records) {}
+
+ChangeLog::~ChangeLog() {
+  if (fd_ >= 0) {
+    close(fd_);
+  }
+  if (lock_fd_ >= 0) {
+    close(lock_fd_);
+  }
+  g_free(path_);
+  g_free(lock_path_);
+}
+
+const gchar *ChangeLog::change_name(Change change) {
+  return kChangeNames[static_cast<int>(change)];
+}
+
+// Starts a new log with a new epoch. Generations continue where this
+// process saw the old one end.
+gboolean ChangeLog::create(GError **error) {
+  g_autofree gchar *dir = g_path_get_dirname(path_);
+  if (g_mkdir_with_parents(dir, 0700) != 0) {
+    return set_errno_error(error, "Failed to create", dir, errno);
+  }
+  g_autoptr(GString) header = g_string_new(nullptr);
+  g_string_append_printf(header, "%s %u %08x%08x %" G_GUINT64_FORMAT "\n",
+                         kMagic, kVersion, g_random_int(), g_random_int(),
+                         generation_);
+  return replace_file(path_, header, error);
+}
+
+gboolean ChangeLog::reopen(GError **error) {
+  int fd = open(path_, O_RDWR | O_APPEND | O_CLOEXEC);
+  struct stat st;
+  if (fd < 0 || fstat(fd, &st) != 0) {
+    int saved_errno = errno;
+    if (fd >= 0) {
+      close(fd);
+    }
+    return set_errno_error(error, "Failed to open", path_, saved_errno);
+  }
+  if (fd_ >= 0) {
+    close(fd_);
+    reloads_++;
+  }
+  fd_ = fd;
+  inode_ = st.st_ino;
+  offset_ = 0;
+  header_read_ = FALSE;
+  epoch_.clear();
+  latest_.clear();
+  records_ = 0;
+  return TRUE;
+}
+
+// Applies the complete lines of `data`, `consumed` is set to their length.
+void ChangeLog::parse(const gchar *data, gsize length, gsize *consumed) {
+  *consumed = 0;
+  while (*consumed < length) {
+    const gchar *line = data + *consumed;
+    const gchar *end =
+        static_cast<const gchar *>(memchr(line, '\n', length - *consumed));
+    if (end == nullptr) {
+      return;
+    }
+    std::string text(line, end - line);
+    *consumed += end - line + 1;
+    if (!header_read_) {
+      g_auto(GStrv) fields = g_strsplit(text.c_str(), " ", 4);
+      guint64 version, base;
+      if (g_strv_length(fields) != 4 || strcmp(fields[0], kMagic) != 0 ||
+          !g_ascii_string_to_unsigned(fields[1], 10, kVersion, kVersion,
+                                      &version, NULL) ||
+          !g_ascii_string_to_unsigned(fields[3], 10, 0, G_MAXUINT64, &base,
+                                      NULL)) {
+        *consumed = 0;
+        return;
+      }
+      header_read_ = TRUE;
+      epoch_ = fields[2];
+      base_ = generation_ = base;
+      continue;
+    }
+    gchar *rest;
+    guint64 generation = g_ascii_strtoull(text.c_str(), &rest, 10);
+    const gchar *code =
+        rest[0] == ' ' && rest[1] != '\0' && rest[2] == ' '
+            ? static_cast<const gchar *>(
+                  memchr(kChangeCodes, rest[1], sizeof(kChangeCodes)))
+            : nullptr;
+    if (rest == text.c_str() || code == nullptr) {
+      g_warning("Skipping malformed change in %s", path_);
+      continue;
+    }
+    g_autofree gchar *name = g_strcompress(rest + 3);
+    Entry &entry = latest_[name];
+    entry.generation = generation;
+    entry.change = static_cast<Change>(code - kChangeCodes);
+    entry.name = name;
+    generation_ = MAX(generation_, generation);
+    records_++;
+  }
+}
+
+// Brings the view of the log up to date with what other processes wrote.
+// Called with the lock held.
+gboolean ChangeLog::refresh(GError **error) {
+  struct stat st;
+  if (stat(path_, &st) != 0) {
+    if (errno != ENOENT) {
+      return set_errno_error(error, "Failed to stat", path_, errno);
+    }
+    return create(error) && refresh(error);
+  }
+  if (fd_ < 0 || st.st_ino != inode_ || st.st_size < offset_) {
+    if (!reopen(error)) {
+      return FALSE;
+    }
+  }
+  std::string data;
+  gchar buffer[16 * 1024];
+  while (TRUE) {
+    ssize_t n = pread(fd_, buffer, sizeof(buffer), offset_ + data.size());
+    if (n < 0 && errno == EINTR) {
+      continue;
+    }
+    if (n < 0) {
+      return set_errno_error(error, "Failed to read", path_, errno);
+    }
+    if (n == 0) {
+      break;
+    }
+    data.append(buffer, n);
+  }
+  gsize consumed;
+  parse(data.data(), data.size(), &consumed);
+  if (!header_read_) {
+    g_warning("Starting a new change log, %s is malformed", path_);
+    return create(error) && refresh(error);
+  }
+  if (consumed < data.size()) {
+    // Left by a process which died while appending, nobody else writes.
+    g_warning("Dropping %" G_GSIZE_FORMAT " bytes of a torn change in %s",
+              data.size() - consumed, path_);
+    if (ftruncate(fd_, offset_ + consumed) != 0) {
+      return set_errno_error(error, "Failed to truncate", path_, errno);
+    }
+  }
+  offset_ += consumed;
+  return TRUE;
+}
+
+// Rewrites the log with the last change of each name, dropping the oldest
+// if there are too many names. Called with the lock held.
+gboolean ChangeLog::compact(GError **error) {
+  std::vector<const Entry *> kept;
+  for (const auto &latest : latest_) {
+    kept.push_back(&latest.second);
+  }
+  std::sort(kept.begin(), kept.end(), [](const Entry *a, const Entry *b) {
+    return a->generation < b->generation;
+  });
+  guint64 base = base_;
+  if (kept.size() > max_records_ / 2) {
+    gsize drop = kept.size() - max_records_ / 2;
+    base = kept[drop - 1]->generation;
+    kept.erase(kept.begin(), kept.begin() + drop);
+    dropped_ += drop;
+  }
+  g_autoptr(GString) content = g_string_new(nullptr);
+  g_string_append_printf(content, "%s %u %s %" G_GUINT64_FORMAT "\n", kMagic,
+                         kVersion, epoch_.c_str(), base);
+  for (const Entry *entry : kept) {
+    append_entry(content, *entry);
+  }
+  if (!replace_file(path_, content, error)) {
+    return FALSE;
+  }
+  compactions_++;
+  return refresh(error);
+}
+
+gboolean ChangeLog::record(const gchar *name, gboolean deleted,
+                           GError **error) {
+  Lock lock(this, error);
+  if (!lock.locked() || !refresh(error)) {
+    return FALSE;
+  }
+  auto found = latest_.find(name);
+  Entry entry;
+  entry.generation = generation_ + 1;
+  entry.change = deleted ? Change::kDeleted
+                 : found != latest_.end() &&
+                         found->second.change != Change::kDeleted
+                     ? Change::kModified
+                     : Change::kCreated;
+  entry.name = name;
+  g_autoptr(GString) line = g_string_new(nullptr);
+  append_entry(line, entry);
+  if (!write_all(fd_, line->str, line->len)) {
+    return set_errno_error(error, "Failed to append to", path_, errno);
+  }
+  offset_ += line->len;
+  generation_ = entry.generation;
+  latest_[name] = std::move(entry);
+  records_++;
+  appended_++;
+  if (records_ > max_records_) {
+    return compact(error);
+  }
+  return TRUE;
+}
+
+gboolean ChangeLog::changes_since(guint64 generation, const gchar *epoch,
+                                  std::vector<Entry> *changes,
+                                  gboolean *reset, GError **error) {
+  changes->clear();
+  Lock lock(this, error);
+  if (!lock.locked() || !refresh(error)) {
+    return FALSE;
+  }
+  *reset = (epoch != nullptr && epoch_ != epoch) || generation < base_ ||
+           generation > generation_;
+  if (*reset) {
+    return TRUE;
+  }
+  for (const auto &latest : latest_) {
+    if (latest.second.generation > generation) {
+      changes->push_back(latest.second);
+    }
+  }
+  std::sort(changes->begin(), changes->end(),
+            [](const Entry &a, const Entry &b) {
+              return a.generation < b.generation;
+            });
+  return TRUE;
+}
+
+FlValue *ChangeLog::stats() const {
+  FlValue *stats = fl_value_new_map();
+  fl_value_set_string_take(stats, "generation", fl_value_new_int(generation_));
+  fl_value_set_string_take(stats, "baseGeneration", fl_value_new_int(base_));
+  fl_value_set_string_take(stats, "records", fl_value_new_int(records_));
+  fl_value_set_string_take(stats, "names", fl_value_new_int(latest_.size()));
+  fl_value_set_string_take(stats, "appended", fl_value_new_int(appended_));
+  fl_value_set_string_take(stats, "compactions",
+                           fl_value_new_int(compactions_));
+  fl_value_set_string_take(stats, "dropped", fl_value_new_int(dropped_));
+  fl_value_set_string_take(stats, "reloads", fl_value_new_int(reloads_));
+  return stats;
+}
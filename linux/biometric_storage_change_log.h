@@ -0,0 +1,99 @@
+#ifndef FLUTTER_PLUGIN_BIOMETRIC_STORAGE_CHANGE_LOG_H_
+#define FLUTTER_PLUGIN_BIOMETRIC_STORAGE_CHANGE_LOG_H_
+
+#include <flutter_linux/flutter_linux.h>
+#include <sys/types.h>
+
+#include <map>
+#include <string>
+#include <vector>
+
+// Log of the storages written and deleted, so that a mirror of them can be
+// brought up to date by reading only what changed (`changesSince`).
+//
+// Every change gets the next generation of the log. The file is a text
+// header ("biometric_storage-changes 1 <epoch> <base generation>") followed
+// by one line per change ("<generation> <c|m|d> <escaped name>"), appended
+// by every process of the app under an flock(2) of `<path>.lock`, and
+// re-read incrementally when another process appended to it.
+//
+// Once it holds more than `max_records` lines the log is compacted to the
+// last change of each name, which answers every query exactly. If that is
+// still more than half of `max_records`, the oldest changes are dropped and
+// the base generation raised: callers which are further behind have to
+// read everything again. A new log (deleted, or unreadable) gets a new
+// random epoch, which tells callers to do the same.
+//
+// Only used on the main context, the calls are short blocking file
+// operations.
+class ChangeLog {
+ public:
+  enum class Change { kCreated, kModified, kDeleted };
+
+  struct Entry {
+    guint64 generation;
+    Change change;
+    std::string name;
+  };
+
+  ChangeLog(const gchar *path, gsize max_records);
+  ~ChangeLog();
+
+  ChangeLog(const ChangeLog &) = delete;
+  ChangeLog &operator=(const ChangeLog &) = delete;
+
+  // Appends a write (`deleted` FALSE) or delete of `name`. A write is a
+  // creation unless the last change of `name` in the log was a write.
+  gboolean record(const gchar *name, gboolean deleted, GError **error);
+
+  // Sets `changes` to the last change of each name after `generation`, in
+  // generation order, and `reset` if the log cannot tell (`generation` is
+  // from before the base generation, after the current one, or `epoch` is
+  // not nullptr and not the log's epoch). `changes` is empty then.
+  gboolean changes_since(guint64 generation, const gchar *epoch,
+                         std::vector<Entry> *changes, gboolean *reset,
+                         GError **error);
+
+  // Current generation and epoch, as of the last call.
+  guint64 generation() const { return generation_; }
+  const std::string &epoch() const { return epoch_; }
+
+  static const gchar *change_name(Change change);
+
+  // Size of the log and counts of appends, compactions and reloads as a map
+  // for the `stats` method.
+  FlValue *stats() const;
+
+ private:
+  class Lock;
+
+  gboolean refresh(GError **error);
+  gboolean create(GError **error);
+  gboolean reopen(GError **error);
+  void parse(const gchar *data, gsize length, gsize *consumed);
+  gboolean compact(GError **error);
+
+  gchar *path_;
+  gchar *lock_path_;
+  const gsize max_records_;
+  int fd_ = -1;
+  int lock_fd_ = -1;
+  ino_t inode_ = 0;
+  // Bytes of the file parsed so far.
+  off_t offset_ = 0;
+  gboolean header_read_ = FALSE;
+
+  std::string epoch_;
+  guint64 base_ = 0;
+  guint64 generation_ = 0;
+  gsize records_ = 0;
+  // Last change by name.
+  std::map<std::string, Entry> latest_;
+
+  guint64 appended_ = 0;
+  guint64 compactions_ = 0;
+  guint64 reloads_ = 0;
+  guint64 dropped_ = 0;
+};
+
+#endif  // FLUTTER_PLUGIN_BIOMETRIC_STORAGE_CHANGE_LOG_H_
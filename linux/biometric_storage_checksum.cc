@@ -0,0 +1,243 @@
+#include "biometric_storage_checksum.h"
+
+#include <string.h>
+
+#if defined(__SSE2__)
+#include <emmintrin.h>
+#endif
+
+// Constants and layout of XXH3, see
+// https://github.com/Cyan4973/xxHash/blob/dev/doc/xxhash_spec.md
+static const guint32 kPrime32_1 = 0x9E3779B1U;
+static const guint32 kPrime32_2 = 0x85EBCA77U;
+static const guint32 kPrime32_3 = 0xC2B2AE3DU;
+static const guint64 kPrime64_1 = 0x9E3779B185EBCA87ULL;
+static const guint64 kPrime64_2 = 0xC2B2AE3D27D4EB4FULL;
+static const guint64 kPrime64_3 = 0x165667B19E3779F9ULL;
+static const guint64 kPrime64_4 = 0x85EBCA77C2B2AE63ULL;
+static const guint64 kPrime64_5 = 0x27D4EB2F165667C5ULL;
+static const guint64 kPrimeMx1 = 0x165667919E3779F9ULL;
+static const guint64 kPrimeMx2 = 0x9FB21C651E98DF25ULL;
+
+static const gsize kStripeLength = 64;
+static const gsize kSecretConsumeRate = 8;
+static const gsize kAccumulators = 8;
+static const gsize kMidSizeMax = 240;
+static const gsize kMidSizeStartOffset = 3;
+static const gsize kMidSizeLastOffset = 17;
+static const gsize kSecretLastAccStart = 7;
+static const gsize kSecretMergeAccsStart = 11;
+static const gsize kSecretSizeMin = 136;
+
+static const guint8 kSecret[192] = {
+    0xb8, 0xfe, 0x6c, 0x39, 0x23, 0xa4, 0x4b, 0xbe, 0x7c, 0x01, 0x81, 0x2c,
+    0xf7, 0x21, 0xad, 0x1c, 0xde, 0xd4, 0x6d, 0xe9, 0x83, 0x90, 0x97, 0xdb,
+    0x72, 0x40, 0xa4, 0xa4, 0xb7, 0xb3, 0x67, 0x1f, 0xcb, 0x79, 0xe6, 0x4e,
+    0xcc, 0xc0, 0xe5, 0x78, 0x82, 0x5a, 0xd0, 0x7d, 0xcc, 0xff, 0x72, 0x21,
+    0xb8, 0x08, 0x46, 0x74, 0xf7, 0x43, 0x24, 0x8e, 0xe0, 0x35, 0x90, 0xe6,
+    0x81, 0x3a, 0x26, 0x4c, 0x3c, 0x28, 0x52, 0xbb, 0x91, 0xc3, 0x00, 0xcb,
+    0x88, 0xd0, 0x65, 0x8b, 0x1b, 0x53, 0x2e, 0xa3, 0x71, 0x64, 0x48, 0x97,
+    0xa2, 0x0d, 0xf9, 0x4e, 0x38, 0x19, 0xef, 0x46, 0xa9, 0xde, 0xac, 0xd8,
+    0xa8, 0xfa, 0x76, 0x3f, 0xe3, 0x9c, 0x34, 0x3f, 0xf9, 0xdc, 0xbb, 0xc7,
+    0xc7, 0x0b, 0x4f, 0x1d, 0x8a, 0x51, 0xe0, 0x4b, 0xcd, 0xb4, 0x59, 0x31,
+    0xc8, 0x9f, 0x7e, 0xc9, 0xd9, 0x78, 0x73, 0x64, 0xea, 0xc5, 0xac, 0x83,
+    0x34, 0xd3, 0xeb, 0xc3, 0xc5, 0x81, 0xa0, 0xff, 0xfa, 0x13, 0x63, 0xeb,
+    0x17, 0x0d, 0xdd, 0x51, 0xb7, 0xf0, 0xda, 0x49, 0xd3, 0x16, 0x55, 0x26,
+    0x29, 0xd4, 0x68, 0x9e, 0x2b, 0x16, 0xbe, 0x58, 0x7d, 0x47, 0xa1, 0xfc,
+    0x8f, 0xf8, 0xb8, 0xd1, 0x7a, 0xd0, 0x31, 0xce, 0x45, 0xcb, 0x3a, 0x8f,
+    0x95, 0x16, 0x04, 0x28, 0xaf, 0xd7, 0xfb, 0xca, 0xbb, 0x4b, 0x40, 0x7e,
+};
+
+static guint32 read32(const guint8 *p) {
+  guint32 v;
+  memcpy(&v, p, sizeof(v));
+  return GUINT32_FROM_LE(v);
+}
+
+static guint64 read64(const guint8 *p) {
+  guint64 v;
+  memcpy(&v, p, sizeof(v));
+  return GUINT64_FROM_LE(v);
+}
+
+static guint64 rotl64(guint64 v, int n) { return (v << n) | (v >> (64 - n)); }
+
+static guint64 mul128_fold64(guint64 a, guint64 b) {
+  unsigned __int128 product = (unsigned __int128)a * b;
+  return (guint64)product ^ (guint64)(product >> 64);
+}
+
+static guint64 xxh64_avalanche(guint64 h) {
+  h ^= h >> 33;
+  h *= kPrime64_2;
+  h ^= h >> 29;
+  h *= kPrime64_3;
+  return h ^ (h >> 32);
+}
+
+static guint64 avalanche(guint64 h) {
+  h ^= h >> 37;
+  h *= kPrimeMx1;
+  return h ^ (h >> 32);
+}
+
+static guint64 rrmxmx(guint64 h, guint64 length) {
+  h ^= rotl64(h, 49) ^ rotl64(h, 24);
+  h *= kPrimeMx2;
+  h ^= (h >> 35) + length;
+  h *= kPrimeMx2;
+  return h ^ (h >> 28);
+}
+
+static guint64 mix16(const guint8 *input, const guint8 *secret) {
+  return mul128_fold64(read64(input) ^ read64(secret),
+                       read64(input + 8) ^ read64(secret + 8));
+}
+
+static guint64 hash_short(const guint8 *input, gsize length) {
+  if (length > 8) {
+    guint64 low = read64(input) ^ (read64(kSecret + 24) ^ read64(kSecret + 32));
+    guint64 high = read64(input + length - 8) ^
+                   (read64(kSecret + 40) ^ read64(kSecret + 48));
+    return avalanche(length + GUINT64_SWAP_LE_BE(low) + high +
+                     mul128_fold64(low, high));
+  }
+  if (length >= 4) {
+    guint64 combined =
+        read32(input + length - 4) + ((guint64)read32(input) << 32);
+    return rrmxmx(combined ^ (read64(kSecret + 8) ^ read64(kSecret + 16)),
+                  length);
+  }
+  if (length > 0) {
+    guint32 combined = ((guint32)input[0] << 16) |
+                       ((guint32)input[length >> 1] << 24) |
+                       input[length - 1] | ((guint32)length << 8);
+    return xxh64_avalanche(combined ^ (read32(kSecret) ^ read32(kSecret + 4)));
+  }
+  return xxh64_avalanche(read64(kSecret + 56) ^ read64(kSecret + 64));
+}
+
+static guint64 hash_medium(const guint8 *input, gsize length) {
+  guint64 acc = length * kPrime64_1;
+  if (length <= 128) {
+    // Pairs of 16 byte blocks from both ends, as many as the length needs.
+    gsize pairs = (length - 1) / 32;
+    for (gsize i = pairs + 1; i-- > 0;) {
+      acc += mix16(input + 16 * i, kSecret + 32 * i);
+      acc += mix16(input + length - 16 * (i + 1), kSecret + 32 * i + 16);
+    }
+    return avalanche(acc);
+  }
+  for (gsize i = 0; i < 8; i++) {
+    acc += mix16(input + 16 * i, kSecret + 16 * i);
+  }
+  acc = avalanche(acc);
+  guint64 last = mix16(input + length - 16,
+                       kSecret + kSecretSizeMin - kMidSizeLastOffset);
+  for (gsize i = 8; i < length / 16; i++) {
+    last += mix16(input + 16 * i, kSecret + 16 * (i - 8) + kMidSizeStartOffset);
+  }
+  return avalanche(acc + last);
+}
+
+#if defined(__SSE2__)
+
+static void accumulate_stripe(guint64 *acc, const guint8 *input,
+                              const guint8 *secret) {
+  __m128i *xacc = (__m128i *)acc;
+  for (gsize i = 0; i < kStripeLength / sizeof(__m128i); i++) {
+    __m128i data = _mm_loadu_si128((const __m128i *)input + i);
+    __m128i key = _mm_loadu_si128((const __m128i *)secret + i);
+    __m128i keyed = _mm_xor_si128(data, key);
+    // Low times high 32 bits of each 64 bit lane.
+    __m128i product = _mm_mul_epu32(
+        keyed, _mm_shuffle_epi32(keyed, _MM_SHUFFLE(0, 3, 0, 1)));
+    __m128i swapped = _mm_shuffle_epi32(data, _MM_SHUFFLE(1, 0, 3, 2));
+    xacc[i] = _mm_add_epi64(product, _mm_add_epi64(xacc[i], swapped));
+  }
+}
+
+static void scramble(guint64 *acc, const guint8 *secret) {
+  __m128i *xacc = (__m128i *)acc;
+  const __m128i prime = _mm_set1_epi32((int)kPrime32_1);
+  for (gsize i = 0; i < kStripeLength / sizeof(__m128i); i++) {
+    __m128i value = _mm_xor_si128(xacc[i], _mm_srli_epi64(xacc[i], 47));
+    value = _mm_xor_si128(value,
+                          _mm_loadu_si128((const __m128i *)secret + i));
+    __m128i high = _mm_shuffle_epi32(value, _MM_SHUFFLE(0, 3, 0, 1));
+    xacc[i] = _mm_add_epi64(_mm_mul_epu32(value, prime),
+                            _mm_slli_epi64(_mm_mul_epu32(high, prime), 32));
+  }
+}
+
+#else
+
+static void accumulate_stripe(guint64 *acc, const guint8 *input,
+                              const guint8 *secret) {
+  for (gsize i = 0; i < kAccumulators; i++) {
+    guint64 data = read64(input + 8 * i);
+    guint64 keyed = data ^ read64(secret + 8 * i);
+    acc[i ^ 1] += data;
+    acc[i] += (guint64)(guint32)keyed * (keyed >> 32);
+  }
+}
+
+static void scramble(guint64 *acc, const guint8 *secret) {
+  for (gsize i = 0; i < kAccumulators; i++) {
+    guint64 value = acc[i] ^ (acc[i] >> 47);
+    acc[i] = (value ^ read64(secret + 8 * i)) * kPrime32_1;
+  }
+}
+
+#endif
+
+static void accumulate(guint64 *acc, const guint8 *input, gsize stripes) {
+  for (gsize n = 0; n < stripes; n++) {
+    accumulate_stripe(acc, input + n * kStripeLength,
+                      kSecret + n * kSecretConsumeRate);
+  }
+}
+
+static guint64 hash_long(const guint8 *input, gsize length) {
+  alignas(16) guint64 acc[kAccumulators] = {
+      kPrime32_3, kPrime64_1, kPrime64_2, kPrime64_3,
+      kPrime64_4, kPrime32_2, kPrime64_5, kPrime32_1};
+  const gsize stripes_per_block =
+      (sizeof(kSecret) - kStripeLength) / kSecretConsumeRate;
+  const gsize block_length = kStripeLength * stripes_per_block;
+  const gsize blocks = (length - 1) / block_length;
+  const guint8 *scramble_secret = kSecret + sizeof(kSecret) - kStripeLength;
+
+  for (gsize n = 0; n < blocks; n++) {
+    accumulate(acc, input + n * block_length, stripes_per_block);
+    scramble(acc, scramble_secret);
+  }
+  gsize stripes = ((length - 1) - block_length * blocks) / kStripeLength;
+  accumulate(acc, input + blocks * block_length, stripes);
+  accumulate_stripe(acc, input + length - kStripeLength,
+                    scramble_secret - kSecretLastAccStart);
+
+  guint64 result = length * kPrime64_1;
+  for (gsize i = 0; i < 4; i++) {
+    result += mul128_fold64(
+        acc[2 * i] ^ read64(kSecret + kSecretMergeAccsStart + 16 * i),
+        acc[2 * i + 1] ^ read64(kSecret + kSecretMergeAccsStart + 16 * i + 8));
+  }
+  return avalanche(result);
+}
+
+guint64 biometric_checksum(const void *data, gsize length) {
+  const guint8 *input = (const guint8 *)data;
+  if (length <= 16) {
+    return hash_short(input, length);
+  }
+  if (length <= kMidSizeMax) {
+    return hash_medium(input, length);
+  }
+  return hash_long(input, length);
+}
+
+gchar *biometric_checksum_encode(const void *data, gsize length) {
+  return g_strdup_printf("%016" G_GINT64_MODIFIER "x",
+                         biometric_checksum(data, length));
+}
@@ -0,0 +1,18 @@
+#ifndef FLUTTER_PLUGIN_BIOMETRIC_STORAGE_CHECKSUM_H_
+#define FLUTTER_PLUGIN_BIOMETRIC_STORAGE_CHECKSUM_H_
+
+#include <glib.h>
+
+// XXH3-64 (seed 0, default secret) of `length` bytes of `data`, stored with
+// every secret to detect values corrupted or truncated by the Secret Service.
+// Not a MAC, anyone able to modify the item can update the checksum too.
+//
+// Inputs longer than 240 bytes are hashed with SSE2 where available, which
+// runs at about memory bandwidth. The result is the same on every platform
+// and matches XXH3_64bits() of the reference implementation.
+guint64 biometric_checksum(const void *data, gsize length);
+
+// biometric_checksum() as 16 lowercase hex digits, free with g_free().
+gchar *biometric_checksum_encode(const void *data, gsize length);
+
+#endif  // FLUTTER_PLUGIN_BIOMETRIC_STORAGE_CHECKSUM_H_
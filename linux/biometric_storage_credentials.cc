@@ -0,0 +1,158 @@
+#include "biometric_storage_credentials.h"
+
+#include <gio/gio.h>
+#include <string.h>
+
+const char kCredentialsOverlayKey[] = "biometric_storage_overlay.key";
+
+// First byte of an overlay entry: the content follows, or the storage was
+// deleted and hides its credential.
+static const gchar kOverlayValue = 'v';
+static const gchar kOverlayWhiteout = 'd';
+
+CredentialStore::CredentialStore(const gchar *directory, ThreadPool *pool)
+    : directory_(g_strdup(directory)), pool_(pool) {}
+
+CredentialStore::~CredentialStore() { g_free(directory_); }
+
+bool CredentialStore::open(const gchar *path, GError **error) {
+  g_autofree gchar *key_path =
+      g_build_filename(directory_, kCredentialsOverlayKey, NULL);
+  gchar *encoded = nullptr;
+  GError *local_error = nullptr;
+  if (!g_file_get_contents(key_path, &encoded, nullptr, &local_error)) {
+    if (g_error_matches(local_error, G_FILE_ERROR, G_FILE_ERROR_NOENT)) {
+      g_error_free(local_error);
+      return true;
+    }
+    g_propagate_error(error, local_error);
+    return false;
+  }
+  guint8 key[BIOMETRIC_AEAD_KEY_SIZE];
+  gboolean decoded = biometric_key_decode(g_strstrip(encoded), key);
+  biometric_secret_free(encoded);
+  if (!decoded) {
+    g_set_error(error, G_IO_ERROR, G_IO_ERROR_INVALID_DATA,
+                "Credential %s is not a base64 encoded 32 byte key",
+                kCredentialsOverlayKey);
+    return false;
+  }
+  auto overlay = std::make_unique<FileStore>(key, pool_,
+                                             FileLog::Mode::kAuto, 0);
+  biometric_wipe(key, sizeof(key));
+  if (!overlay->open(path, error)) {
+    return false;
+  }
+  overlay_ = std::move(overlay);
+  return true;
+}
+
+bool CredentialStore::has_credential(const gchar *name) const {
+  // Credentials are files directly in the directory.
+  if (strchr(name, G_DIR_SEPARATOR) != nullptr) {
+    return false;
+  }
+  g_autofree gchar *path = g_build_filename(directory_, name, NULL);
+  return g_file_test(path, G_FILE_TEST_IS_REGULAR);
+}
+
+bool CredentialStore::overlay_available(GError **error) const {
+  if (overlay_ == nullptr) {
+    g_set_error(error, G_IO_ERROR, G_IO_ERROR_READ_ONLY,
+                "Storages are read only without the %s credential",
+                kCredentialsOverlayKey);
+    return false;
+  }
+  return true;
+}
+
+bool CredentialStore::lookup(const gchar *name, SecretPtr *content,
+                             GError **error) {
+  content->reset();
+  SecretPtr stored;
+  if (overlay_ != nullptr && overlay_->lookup(name, &stored)) {
+    overlay_reads_++;
+    if (stored.get()[0] == kOverlayValue) {
+      content->reset(g_strdup(stored.get() + 1));
+    }
+    return true;
+  }
+  if (strchr(name, G_DIR_SEPARATOR) != nullptr) {
+    misses_++;
+    return true;
+  }
+  g_autofree gchar *path = g_build_filename(directory_, name, NULL);
+  gchar *data = nullptr;
+  GError *local_error = nullptr;
+  if (!g_file_get_contents(path, &data, nullptr, &local_error)) {
+    if (g_error_matches(local_error, G_FILE_ERROR, G_FILE_ERROR_NOENT)) {
+      g_error_free(local_error);
+      misses_++;
+      return true;
+    }
+    g_propagate_error(error, local_error);
+    return false;
+  }
+  credential_reads_++;
+  content->reset(data);
+  return true;
+}
+
+Task<bool> CredentialStore::put(std::string name, const gchar *content,
+                                GError **error) {
+  if (!overlay_available(error)) {
+    co_return false;
+  }
+  gsize length = strlen(content);
+  gchar *value = static_cast<gchar *>(g_malloc(length + 2));
+  value[0] = kOverlayValue;
+  memcpy(value + 1, content, length + 1);
+  bool committed = co_await overlay_->put(name, value, length + 1);
+  biometric_secret_free(value);
+  if (!committed) {
+    g_set_error(error, G_IO_ERROR, G_IO_ERROR_FAILED,
+                "Failed to commit write to the credentials overlay");
+  }
+  co_return committed;
+}
+
+Task<bool> CredentialStore::remove(std::string name, bool *existed,
+                                   GError **error) {
+  if (!overlay_available(error)) {
+    co_return false;
+  }
+  SecretPtr stored;
+  bool in_overlay = overlay_->lookup(name.c_str(), &stored);
+  bool credential = has_credential(name.c_str());
+  *existed = in_overlay ? stored.get()[0] == kOverlayValue : credential;
+  if (!*existed) {
+    co_return true;
+  }
+  bool committed;
+  if (credential) {
+    committed = co_await overlay_->put(name, &kOverlayWhiteout, 1);
+    whiteouts_ += committed ? 1 : 0;
+  } else {
+    bool removed;
+    committed = co_await overlay_->remove(name, &removed);
+  }
+  if (!committed) {
+    g_set_error(error, G_IO_ERROR, G_IO_ERROR_FAILED,
+                "Failed to commit delete to the credentials overlay");
+  }
+  co_return committed;
+}
+
+FlValue *CredentialStore::stats() const {
+  FlValue *stats = fl_value_new_map();
+  fl_value_set_string_take(stats, "credentialReads",
+                           fl_value_new_int(credential_reads_));
+  fl_value_set_string_take(stats, "overlayReads",
+                           fl_value_new_int(overlay_reads_));
+  fl_value_set_string_take(stats, "misses", fl_value_new_int(misses_));
+  fl_value_set_string_take(stats, "whiteouts", fl_value_new_int(whiteouts_));
+  fl_value_set_string_take(stats, "overlay",
+                           overlay_ != nullptr ? overlay_->stats()
+                                               : fl_value_new_null());
+  return stats;
+}
@@ -0,0 +1,65 @@
+#ifndef FLUTTER_PLUGIN_BIOMETRIC_STORAGE_CREDENTIALS_H_
+#define FLUTTER_PLUGIN_BIOMETRIC_STORAGE_CREDENTIALS_H_
+
+#include <flutter_linux/flutter_linux.h>
+
+#include <memory>
+#include <string>
+
+#include "biometric_storage_file_store.h"
+
+// Secrets passed to a systemd service as credentials (LoadCredential=,
+// LoadCredentialEncrypted=, SetCredential=), read from
+// $CREDENTIALS_DIRECTORY without any D-Bus round trip. systemd decrypts
+// encrypted credentials before the service starts, with the host key and/or
+// the TPM as configured by `systemd-creds encrypt`.
+//
+// The credential of a storage is named like its keyring item. The
+// credentials directory is read only, writes and deletes go to an overlay
+// FileStore whose key is the credential kCredentialsOverlayKey (base64, like
+// biometric_key_new_encoded()). Without that credential the storages are
+// read only. A delete of a storage provided as credential is recorded as a
+// whiteout in the overlay.
+class CredentialStore {
+ public:
+  CredentialStore(const gchar *directory, ThreadPool *pool);
+  ~CredentialStore();
+
+  CredentialStore(const CredentialStore &) = delete;
+  CredentialStore &operator=(const CredentialStore &) = delete;
+
+  // Opens the overlay at `path` if the overlay key credential exists.
+  // Blocks, run it on the thread pool.
+  bool open(const gchar *path, GError **error);
+
+  // Sets `content` to the secret of `name`, nullptr if there is none.
+  // Returns false if the credential could not be read.
+  bool lookup(const gchar *name, SecretPtr *content, GError **error);
+
+  Task<bool> put(std::string name, const gchar *content, GError **error);
+
+  // Deletes `name`, sets `existed` if there was such a storage.
+  Task<bool> remove(std::string name, bool *existed, GError **error);
+
+  // Reads by source and the overlay statistics as a map for the `stats`
+  // method.
+  FlValue *stats() const;
+
+ private:
+  bool has_credential(const gchar *name) const;
+  bool overlay_available(GError **error) const;
+
+  gchar *directory_;
+  ThreadPool *pool_;
+  std::unique_ptr<FileStore> overlay_;
+
+  guint64 credential_reads_ = 0;
+  guint64 overlay_reads_ = 0;
+  guint64 misses_ = 0;
+  guint64 whiteouts_ = 0;
+};
+
+// Name of the credential holding the key of the overlay.
+extern const char kCredentialsOverlayKey[];
+
+#endif  // FLUTTER_PLUGIN_BIOMETRIC_STORAGE_CREDENTIALS_H_
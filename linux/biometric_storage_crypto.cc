@@ -0,0 +1,183 @@
+#include "biometric_storage_crypto.h"
+
+#include <errno.h>
+#include <gcrypt.h>
+#include <gio/gio.h>
+#include <string.h>
+#include <sys/random.h>
+
+// libsecret initializes libgcrypt as well, whoever comes first does it.
+static void crypto_init() {
+  static gsize initialized = 0;
+  if (g_once_init_enter(&initialized)) {
+    if (!gcry_control(GCRYCTL_INITIALIZATION_FINISHED_P)) {
+      gcry_check_version(nullptr);
+      gcry_control(GCRYCTL_INITIALIZATION_FINISHED, 0);
+    }
+    g_once_init_leave(&initialized, 1);
+  }
+}
+
+// Opens a ChaCha20-Poly1305 handle for `key` and `nonce` and authenticates
+// `ad`. Returns nullptr on failure, e.g. if FIPS mode rejects the cipher.
+static gcry_cipher_hd_t aead_open_handle(
+    const guint8 key[BIOMETRIC_AEAD_KEY_SIZE],
+    const guint8 nonce[BIOMETRIC_AEAD_NONCE_SIZE], const guint8 *ad,
+    gsize ad_length, GError **error) {
+  crypto_init();
+  gcry_cipher_hd_t handle;
+  gcry_error_t err = gcry_cipher_open(&handle, GCRY_CIPHER_CHACHA20,
+                                      GCRY_CIPHER_MODE_POLY1305, 0);
+  if (err == 0) {
+    err = gcry_cipher_setkey(handle, key, BIOMETRIC_AEAD_KEY_SIZE);
+    if (err == 0) {
+      err = gcry_cipher_setiv(handle, nonce, BIOMETRIC_AEAD_NONCE_SIZE);
+    }
+    if (err == 0 && ad_length > 0) {
+      err = gcry_cipher_authenticate(handle, ad, ad_length);
+    }
+    if (err != 0) {
+      gcry_cipher_close(handle);
+    }
+  }
+  if (err != 0) {
+    g_set_error(error, G_IO_ERROR, G_IO_ERROR_FAILED,
+                "ChaCha20-Poly1305 failed: %s", gcry_strerror(err));
+    return nullptr;
+  }
+  return handle;
+}
+
+gboolean biometric_aead_seal(const guint8 key[BIOMETRIC_AEAD_KEY_SIZE],
+                             const guint8 nonce[BIOMETRIC_AEAD_NONCE_SIZE],
+                             const guint8 *ad, gsize ad_length,
+                             const guint8 *plaintext, gsize length,
+                             guint8 *out, GError **error) {
+  gcry_cipher_hd_t handle =
+      aead_open_handle(key, nonce, ad, ad_length, error);
+  if (handle == nullptr) {
+    return FALSE;
+  }
+  gcry_error_t err = 0;
+  if (length > 0) {
+    err = gcry_cipher_encrypt(handle, out, length, plaintext, length);
+  }
+  if (err == 0) {
+    err = gcry_cipher_gettag(handle, out + length, BIOMETRIC_AEAD_TAG_SIZE);
+  }
+  gcry_cipher_close(handle);
+  if (err != 0) {
+    biometric_wipe(out, length + BIOMETRIC_AEAD_TAG_SIZE);
+    g_set_error(error, G_IO_ERROR, G_IO_ERROR_FAILED,
+                "ChaCha20-Poly1305 failed: %s", gcry_strerror(err));
+    return FALSE;
+  }
+  return TRUE;
+}
+
+gboolean biometric_aead_open(const guint8 key[BIOMETRIC_AEAD_KEY_SIZE],
+                             const guint8 nonce[BIOMETRIC_AEAD_NONCE_SIZE],
+                             const guint8 *ad, gsize ad_length,
+                             const guint8 *ciphertext, gsize length,
+                             guint8 *out) {
+  if (length < BIOMETRIC_AEAD_TAG_SIZE) {
+    return FALSE;
+  }
+  length -= BIOMETRIC_AEAD_TAG_SIZE;
+  gcry_cipher_hd_t handle =
+      aead_open_handle(key, nonce, ad, ad_length, nullptr);
+  if (handle == nullptr) {
+    memset(out, 0, length);
+    return FALSE;
+  }
+  gcry_error_t err = 0;
+  if (length > 0) {
+    err = gcry_cipher_decrypt(handle, out, length, ciphertext, length);
+  }
+  if (err == 0) {
+    err = gcry_cipher_checktag(handle, ciphertext + length,
+                               BIOMETRIC_AEAD_TAG_SIZE);
+  }
+  gcry_cipher_close(handle);
+  if (err != 0) {
+    biometric_wipe(out, length);
+    return FALSE;
+  }
+  return TRUE;
+}
+
+gboolean biometric_random_bytes(guint8 *buffer, gsize length,
+                                GError **error) {
+  gsize filled = 0;
+  while (filled < length) {
+    ssize_t n = getrandom(buffer + filled, length - filled, 0);
+    if (n < 0) {
+      if (errno == EINTR) {
+        continue;
+      }
+      int saved_errno = errno;
+      g_set_error(error, G_IO_ERROR, g_io_error_from_errno(saved_errno),
+                  "getrandom failed: %s", g_strerror(saved_errno));
+      return FALSE;
+    }
+    filled += n;
+  }
+  return TRUE;
+}
+
+gchar *biometric_key_new_encoded(GError **error) {
+  guint8 key[BIOMETRIC_AEAD_KEY_SIZE];
+  if (!biometric_random_bytes(key, sizeof(key), error)) {
+    return nullptr;
+  }
+  gchar *encoded = g_base64_encode(key, sizeof(key));
+  biometric_wipe(key, sizeof(key));
+  return encoded;
+}
+
+gboolean biometric_key_decode(const gchar *encoded,
+                              guint8 key[BIOMETRIC_AEAD_KEY_SIZE]) {
+  gsize length;
+  guchar *decoded = g_base64_decode(encoded, &length);
+  gboolean valid = length == BIOMETRIC_AEAD_KEY_SIZE;
+  if (valid) {
+    memcpy(key, decoded, BIOMETRIC_AEAD_KEY_SIZE);
+  }
+  biometric_wipe(decoded, length);
+  g_free(decoded);
+  return valid;
+}
+
+void biometric_key_derive(const guint8 *secret, gsize length,
+                          const gchar *info,
+                          guint8 key[BIOMETRIC_AEAD_KEY_SIZE]) {
+  // One block of expand output is exactly one key.
+  G_STATIC_ASSERT(BIOMETRIC_AEAD_KEY_SIZE == 32);
+  guint8 zeros[32] = {};
+  guint8 prk[32];
+  gsize digest_length = sizeof(prk);
+  GHmac *hmac = g_hmac_new(G_CHECKSUM_SHA256, zeros, sizeof(zeros));
+  g_hmac_update(hmac, secret, length);
+  g_hmac_get_digest(hmac, prk, &digest_length);
+  g_hmac_unref(hmac);
+
+  const guint8 counter = 1;
+  hmac = g_hmac_new(G_CHECKSUM_SHA256, prk, sizeof(prk));
+  g_hmac_update(hmac, reinterpret_cast<const guchar *>(info), strlen(info));
+  g_hmac_update(hmac, &counter, 1);
+  digest_length = BIOMETRIC_AEAD_KEY_SIZE;
+  g_hmac_get_digest(hmac, key, &digest_length);
+  g_hmac_unref(hmac);
+  biometric_wipe(prk, sizeof(prk));
+}
+
+void biometric_wipe(gpointer data, gsize length) {
+  explicit_bzero(data, length);
+}
+
+void biometric_secret_free(gchar *secret) {
+  if (secret != nullptr) {
+    biometric_wipe(secret, strlen(secret));
+    g_free(secret);
+  }
+}
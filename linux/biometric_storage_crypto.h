@@ -0,0 +1,57 @@
+#ifndef FLUTTER_PLUGIN_BIOMETRIC_STORAGE_CRYPTO_H_
+#define FLUTTER_PLUGIN_BIOMETRIC_STORAGE_CRYPTO_H_
+
+#include <glib.h>
+
+// ChaCha20-Poly1305 (RFC 8439, implemented by libgcrypt) for secrets the
+// plugin has to keep outside of the keyring. The keyring itself encrypts
+// everything it stores, this is only used for copies held by the plugin.
+
+#define BIOMETRIC_AEAD_KEY_SIZE 32
+#define BIOMETRIC_AEAD_NONCE_SIZE 12
+#define BIOMETRIC_AEAD_TAG_SIZE 16
+
+// Encrypts `length` bytes of `plaintext` into `out`, which must have room for
+// `length + BIOMETRIC_AEAD_TAG_SIZE` bytes. A nonce must never be used twice
+// with the same key. Returns FALSE if libgcrypt refused, e.g. in FIPS mode.
+gboolean biometric_aead_seal(const guint8 key[BIOMETRIC_AEAD_KEY_SIZE],
+                             const guint8 nonce[BIOMETRIC_AEAD_NONCE_SIZE],
+                             const guint8 *ad, gsize ad_length,
+                             const guint8 *plaintext, gsize length,
+                             guint8 *out, GError **error);
+
+// Decrypts `length` bytes of `ciphertext` (including the tag) into `out`,
+// which must have room for `length - BIOMETRIC_AEAD_TAG_SIZE` bytes. Returns
+// FALSE, leaving `out` zeroed, if the ciphertext or `ad` were modified or
+// libgcrypt refused.
+gboolean biometric_aead_open(const guint8 key[BIOMETRIC_AEAD_KEY_SIZE],
+                             const guint8 nonce[BIOMETRIC_AEAD_NONCE_SIZE],
+                             const guint8 *ad, gsize ad_length,
+                             const guint8 *ciphertext, gsize length,
+                             guint8 *out);
+
+// Fills `buffer` from the kernel's random number generator.
+gboolean biometric_random_bytes(guint8 *buffer, gsize length, GError **error);
+
+// Returns a new random key, base64 encoded to be stored in the keyring (free
+// with biometric_secret_free()), or nullptr if that failed.
+gchar *biometric_key_new_encoded(GError **error);
+
+// Decodes a key returned by biometric_key_new_encoded(). Returns FALSE if
+// `encoded` is not a key.
+gboolean biometric_key_decode(const gchar *encoded,
+                              guint8 key[BIOMETRIC_AEAD_KEY_SIZE]);
+
+// Derives a key from `length` bytes of `secret` with HKDF-SHA256 (RFC 5869)
+// without salt. Different `info` strings give independent keys.
+void biometric_key_derive(const guint8 *secret, gsize length,
+                          const gchar *info,
+                          guint8 key[BIOMETRIC_AEAD_KEY_SIZE]);
+
+// Overwrites a secret with zeros, the compiler may not drop this.
+void biometric_wipe(gpointer data, gsize length);
+
+// Wipes and frees a g_malloc()ed secret string.
+void biometric_secret_free(gchar *secret);
+
+#endif  // FLUTTER_PLUGIN_BIOMETRIC_STORAGE_CRYPTO_H_
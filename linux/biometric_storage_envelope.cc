@@ -0,0 +1,93 @@
+#include "biometric_storage_envelope.h"
+
+#include <string.h>
+
+#include "biometric_storage_checksum.h"
+
+static const gchar kMagic[] = "bs2:";
+static const gsize kMagicSize = sizeof(kMagic) - 1;
+static const gsize kChecksumLength = 16;
+
+G_STATIC_ASSERT(BIOMETRIC_ENVELOPE_HEADER_SIZE ==
+                kMagicSize + BIOMETRIC_GENERATION_LENGTH + 1 +
+                    kChecksumLength + 1);
+
+static gboolean is_hex(const gchar *data, gsize length) {
+  for (gsize i = 0; i < length; i++) {
+    if (!g_ascii_isxdigit(data[i])) {
+      return FALSE;
+    }
+  }
+  return TRUE;
+}
+
+static gboolean is_generation(const gchar *data) {
+  return is_hex(data, 16) && data[16] == '.' && is_hex(data + 17, 8);
+}
+
+gchar *biometric_generation_new(guint64 *clock) {
+  *clock = MAX(*clock + 1, (guint64)g_get_real_time());
+  return g_strdup_printf("%016" G_GINT64_MODIFIER "x.%08x", *clock,
+                         g_random_int());
+}
+
+void biometric_generation_observe(guint64 *clock, const gchar *generation) {
+  if (generation != nullptr &&
+      strlen(generation) == BIOMETRIC_GENERATION_LENGTH &&
+      is_generation(generation)) {
+    *clock = MAX(*clock, g_ascii_strtoull(generation, nullptr, 16));
+  }
+}
+
+gboolean biometric_generation_supersedes(const gchar *generation,
+                                         const gchar *other) {
+  return g_strcmp0(other, generation) < 0;
+}
+
+gchar *biometric_envelope_new(const gchar *generation, const gchar *content,
+                              gsize length) {
+  g_return_val_if_fail(strlen(generation) == BIOMETRIC_GENERATION_LENGTH,
+                       nullptr);
+  g_autofree gchar *checksum = biometric_checksum_encode(content, length);
+  gchar *envelope = static_cast<gchar *>(
+      g_malloc(BIOMETRIC_ENVELOPE_HEADER_SIZE + length + 1));
+  gchar *p = envelope;
+  memcpy(p, kMagic, kMagicSize);
+  p += kMagicSize;
+  memcpy(p, generation, BIOMETRIC_GENERATION_LENGTH);
+  p += BIOMETRIC_GENERATION_LENGTH;
+  *p++ = ':';
+  memcpy(p, checksum, kChecksumLength);
+  p += kChecksumLength;
+  *p++ = '\n';
+  memcpy(p, content, length);
+  p[length] = '\0';
+  return envelope;
+}
+
+gboolean biometric_envelope_open(const gchar *data, gsize length,
+                                 gboolean verify,
+                                 gchar generation[BIOMETRIC_GENERATION_LENGTH +
+                                                  1]) {
+  if (length < BIOMETRIC_ENVELOPE_HEADER_SIZE ||
+      memcmp(data, kMagic, kMagicSize) != 0) {
+    return FALSE;
+  }
+  const gchar *stored_generation = data + kMagicSize;
+  const gchar *checksum = stored_generation + BIOMETRIC_GENERATION_LENGTH + 1;
+  if (!is_generation(stored_generation) || checksum[-1] != ':' ||
+      !is_hex(checksum, kChecksumLength) || checksum[kChecksumLength] != '\n') {
+    return FALSE;
+  }
+  if (verify) {
+    g_autofree gchar *actual =
+        biometric_checksum_encode(data + BIOMETRIC_ENVELOPE_HEADER_SIZE,
+                                  length - BIOMETRIC_ENVELOPE_HEADER_SIZE);
+    if (g_ascii_strncasecmp(actual, checksum, kChecksumLength) != 0) {
+      return FALSE;
+    }
+  }
+  memcpy(generation, stored_generation, BIOMETRIC_GENERATION_LENGTH);
+  generation[BIOMETRIC_GENERATION_LENGTH] = '\0';
+  return TRUE;
+}
@@ -0,0 +1,53 @@
+#ifndef FLUTTER_PLUGIN_BIOMETRIC_STORAGE_ENVELOPE_H_
+#define FLUTTER_PLUGIN_BIOMETRIC_STORAGE_ENVELOPE_H_
+
+#include <glib.h>
+
+// Secrets stored with the current schema start with a header carrying the
+// generation of the write and a checksum of the content:
+//
+//   bs2:<generation>:<biometric_checksum_encode() of the content>\n
+//
+// Keeping both out of the item attributes lets a write replace the item in
+// place, the Secret Service only does that for identical attributes.
+
+// "%016x.%08x" of the generation clock and a random number, ordered by
+// g_strcmp0() as long as the clocks of all writers roughly agree.
+#define BIOMETRIC_GENERATION_LENGTH 25
+#define BIOMETRIC_ENVELOPE_HEADER_SIZE (4 + BIOMETRIC_GENERATION_LENGTH + 18)
+
+// Generation given to secrets of earlier plugin versions, older than any
+// written since.
+#define BIOMETRIC_GENERATION_NONE "0000000000000000.00000000"
+
+// Returns a new generation, free with g_free(). `clock` is a hybrid logical
+// clock: the wall clock in microseconds, but always ahead of every
+// generation this process wrote or observed before, so that a wall clock
+// stepping back cannot order a write before one it has seen.
+gchar *biometric_generation_new(guint64 *clock);
+
+// Advances `clock` past `generation`, read from the keyring.
+void biometric_generation_observe(guint64 *clock, const gchar *generation);
+
+// Whether a write of `generation` supersedes a variant of the same storage
+// written with `other`, which is only the case if `other` is strictly
+// older. Of two writers racing each other, only the older one loses its
+// item.
+gboolean biometric_generation_supersedes(const gchar *generation,
+                                         const gchar *other);
+
+// Returns `length` bytes of `content` behind a header with `generation`,
+// NUL terminated. Free with biometric_secret_free().
+gchar *biometric_envelope_new(const gchar *generation, const gchar *content,
+                              gsize length);
+
+// Copies the generation in the header of `length` bytes of `data` to
+// `generation`. With `verify`, also checks the content after the header
+// against the checksum. Returns FALSE if there is no valid header or the
+// checksum does not match.
+gboolean biometric_envelope_open(const gchar *data, gsize length,
+                                 gboolean verify,
+                                 gchar generation[BIOMETRIC_GENERATION_LENGTH +
+                                                  1]);
+
+#endif  // FLUTTER_PLUGIN_BIOMETRIC_STORAGE_ENVELOPE_H_
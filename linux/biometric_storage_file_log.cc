@@ -0,0 +1,509 @@
+#include "biometric_storage_file_log.h"
+
+#include <errno.h>
+#include <fcntl.h>
+#include <gio/gio.h>
+#include <glib-unix.h>
+#include <linux/io_uring.h>
+#include <stdio.h>
+#include <string.h>
+#include <sys/eventfd.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <sys/syscall.h>
+#include <unistd.h>
+
+#include <algorithm>
+
+static const gsize kFrameHeaderSize = 8;
+// Each commit takes a write and a sync entry, one commit is in flight at a
+// time.
+static const guint kRingEntries = 4;
+
+static guint32 fnv1a(const guint8 *data, gsize length) {
+  guint32 hash = 2166136261u;
+  for (gsize i = 0; i < length; i++) {
+    hash = (hash ^ data[i]) * 16777619u;
+  }
+  return hash;
+}
+
+static void store32(guint8 *p, guint32 v) {
+  p[0] = v;
+  p[1] = v >> 8;
+  p[2] = v >> 16;
+  p[3] = v >> 24;
+}
+
+static guint32 load32(const guint8 *p) {
+  return (guint32)p[0] | ((guint32)p[1] << 8) | ((guint32)p[2] << 16) |
+         ((guint32)p[3] << 24);
+}
+
+static void append_frame(std::vector<guint8> *out,
+                         const std::vector<guint8> &record) {
+  gsize start = out->size();
+  out->resize(start + kFrameHeaderSize + record.size());
+  store32(out->data() + start, record.size());
+  store32(out->data() + start + 4, fnv1a(record.data(), record.size()));
+  memcpy(out->data() + start + kFrameHeaderSize, record.data(),
+         record.size());
+}
+
+static gboolean set_errno_error(GError **error, const gchar *what,
+                                const gchar *path, int saved_errno) {
+  g_set_error(error, G_IO_ERROR, g_io_error_from_errno(saved_errno),
+              "%s %s: %s", what, path, g_strerror(saved_errno));
+  return FALSE;
+}
+
+// Writes all of `data` at `offset` and syncs it, returns 0 or an errno.
+static int write_and_sync(int fd, const guint8 *data, gsize length,
+                          gsize offset) {
+  gsize written = 0;
+  while (written < length) {
+    ssize_t n = pwrite(fd, data + written, length - written, offset + written);
+    if (n < 0 && errno == EINTR) {
+      continue;
+    }
+    if (n < 0) {
+      return errno;
+    }
+    written += n;
+  }
+  return fdatasync(fd) == 0 ? 0 : errno;
+}
+
+// Minimal io_uring on raw system calls, only what FileLog needs: a write
+// linked to an fdatasync, completed through an eventfd on the main context.
+class IoUring {
+ public:
+  // Outcome of a write followed by a sync, see write_and_sync().
+  struct Commit {
+    int write_result = 0;
+    int sync_result = 0;
+    int remaining = 2;
+    // Set if the ring failed to take the requests, it must not be used
+    // anymore then.
+    bool submit_failed = false;
+    std::coroutine_handle<> handle;
+  };
+
+  class CommitAwaiter {
+   public:
+    CommitAwaiter(IoUring *ring, int fd, const guint8 *data, gsize length,
+                  gsize offset)
+        : ring_(ring), fd_(fd), data_(data), length_(length),
+          offset_(offset) {}
+
+    bool await_ready() const noexcept { return false; }
+    bool await_suspend(std::coroutine_handle<> handle) {
+      commit_.handle = handle;
+      int result = ring_->submit(fd_, data_, length_, offset_, &commit_);
+      if (result < 0) {
+        commit_.write_result = result;
+        commit_.submit_failed = true;
+        return false;
+      }
+      return true;
+    }
+    Commit await_resume() const { return commit_; }
+
+   private:
+    IoUring *ring_;
+    int fd_;
+    const guint8 *data_;
+    gsize length_;
+    gsize offset_;
+    Commit commit_;
+  };
+
+  // Returns nullptr (and sets `error`) if the kernel does not support
+  // io_uring or it is not allowed.
+  static IoUring *create(GError **error) {
+    struct io_uring_params params;
+    memset(&params, 0, sizeof(params));
+    int fd = syscall(__NR_io_uring_setup, kRingEntries, &params);
+    if (fd < 0) {
+      set_errno_error(error, "Failed to set up", "io_uring", errno);
+      return nullptr;
+    }
+    std::unique_ptr<IoUring> ring(new IoUring(fd));
+    if (!ring->map(&params, error)) {
+      return nullptr;
+    }
+    ring->event_fd_ = eventfd(0, EFD_CLOEXEC | EFD_NONBLOCK);
+    if (ring->event_fd_ < 0 ||
+        syscall(__NR_io_uring_register, fd, IORING_REGISTER_EVENTFD,
+                &ring->event_fd_, 1) < 0) {
+      set_errno_error(error, "Failed to register eventfd with", "io_uring",
+                      errno);
+      return nullptr;
+    }
+    ring->source_id_ =
+        g_unix_fd_add(ring->event_fd_, G_IO_IN, on_event, ring.get());
+    return ring.release();
+  }
+
+  ~IoUring() {
+    if (source_id_ != 0) {
+      g_source_remove(source_id_);
+    }
+    if (event_fd_ >= 0) {
+      close(event_fd_);
+    }
+    if (sqes_ != MAP_FAILED) {
+      munmap(sqes_, sqes_size_);
+    }
+    if (cq_ring_ != MAP_FAILED && cq_ring_ != sq_ring_) {
+      munmap(cq_ring_, cq_ring_size_);
+    }
+    if (sq_ring_ != MAP_FAILED) {
+      munmap(sq_ring_, sq_ring_size_);
+    }
+    close(fd_);
+  }
+
+  CommitAwaiter write_and_sync(int fd, const guint8 *data, gsize length,
+                               gsize offset) {
+    return CommitAwaiter(this, fd, data, length, offset);
+  }
+
+ private:
+  explicit IoUring(int fd) : fd_(fd) {}
+
+  bool map(const struct io_uring_params *params, GError **error) {
+    sq_ring_size_ = params->sq_off.array + params->sq_entries * sizeof(guint32);
+    cq_ring_size_ = params->cq_off.cqes +
+                    params->cq_entries * sizeof(struct io_uring_cqe);
+    bool single_mmap = params->features & IORING_FEAT_SINGLE_MMAP;
+    if (single_mmap) {
+      sq_ring_size_ = cq_ring_size_ = MAX(sq_ring_size_, cq_ring_size_);
+    }
+    sq_ring_ = mmap(nullptr, sq_ring_size_, PROT_READ | PROT_WRITE,
+                    MAP_SHARED | MAP_POPULATE, fd_, IORING_OFF_SQ_RING);
+    if (sq_ring_ == MAP_FAILED) {
+      return set_errno_error(error, "Failed to map", "io_uring", errno);
+    }
+    cq_ring_ = single_mmap
+                   ? sq_ring_
+                   : mmap(nullptr, cq_ring_size_, PROT_READ | PROT_WRITE,
+                          MAP_SHARED | MAP_POPULATE, fd_, IORING_OFF_CQ_RING);
+    if (cq_ring_ == MAP_FAILED) {
+      return set_errno_error(error, "Failed to map", "io_uring", errno);
+    }
+    sqes_size_ = params->sq_entries * sizeof(struct io_uring_sqe);
+    sqes_ = mmap(nullptr, sqes_size_, PROT_READ | PROT_WRITE,
+                 MAP_SHARED | MAP_POPULATE, fd_, IORING_OFF_SQES);
+    if (sqes_ == MAP_FAILED) {
+      return set_errno_error(error, "Failed to map", "io_uring", errno);
+    }
+
+    guint8 *sq = static_cast<guint8 *>(sq_ring_);
+    sq_tail_ = reinterpret_cast<guint32 *>(sq + params->sq_off.tail);
+    sq_mask_ = *reinterpret_cast<guint32 *>(sq + params->sq_off.ring_mask);
+    sq_array_ = reinterpret_cast<guint32 *>(sq + params->sq_off.array);
+    guint8 *cq = static_cast<guint8 *>(cq_ring_);
+    cq_head_ = reinterpret_cast<guint32 *>(cq + params->cq_off.head);
+    cq_tail_ = reinterpret_cast<guint32 *>(cq + params->cq_off.tail);
+    cq_mask_ = *reinterpret_cast<guint32 *>(cq + params->cq_off.ring_mask);
+    cqes_ = reinterpret_cast<struct io_uring_cqe *>(cq + params->cq_off.cqes);
+    return true;
+  }
+
+  struct io_uring_sqe *next_sqe(guint32 *tail) {
+    guint32 index = *tail & sq_mask_;
+    struct io_uring_sqe *sqe =
+        &static_cast<struct io_uring_sqe *>(sqes_)[index];
+    memset(sqe, 0, sizeof(*sqe));
+    sq_array_[index] = index;
+    (*tail)++;
+    return sqe;
+  }
+
+  // Queues the write linked to the sync, returns a negative errno if they
+  // could not be submitted.
+  int submit(int fd, const guint8 *data, gsize length, gsize offset,
+             Commit *commit) {
+    guint32 tail = *sq_tail_;
+    struct io_uring_sqe *write = next_sqe(&tail);
+    write->opcode = IORING_OP_WRITE;
+    write->flags = IOSQE_IO_LINK;
+    write->fd = fd;
+    write->addr = (guint64)(uintptr_t)data;
+    write->len = length;
+    write->off = offset;
+    write->user_data = (guint64)(uintptr_t)&commit->write_result;
+    struct io_uring_sqe *sync = next_sqe(&tail);
+    sync->opcode = IORING_OP_FSYNC;
+    sync->fd = fd;
+    sync->fsync_flags = IORING_FSYNC_DATASYNC;
+    sync->user_data = (guint64)(uintptr_t)&commit->sync_result;
+    __atomic_store_n(sq_tail_, tail, __ATOMIC_RELEASE);
+
+    int submitted;
+    do {
+      submitted = syscall(__NR_io_uring_enter, fd_, 2, 0, 0, nullptr, 0);
+    } while (submitted < 0 && errno == EINTR);
+    if (submitted != 2) {
+      // What is left in the submission queue would be submitted again with
+      // the next commit, the ring is given up instead.
+      return submitted < 0 ? -errno : -EIO;
+    }
+    pending_ = commit;
+    return 0;
+  }
+
+  static gboolean on_event(gint fd, GIOCondition condition,
+                           gpointer user_data) {
+    IoUring *self = static_cast<IoUring *>(user_data);
+    guint64 count;
+    while (read(fd, &count, sizeof(count)) > 0) {
+    }
+    guint32 head = *self->cq_head_;
+    guint32 tail = __atomic_load_n(self->cq_tail_, __ATOMIC_ACQUIRE);
+    Commit *done = nullptr;
+    for (; head != tail; head++) {
+      struct io_uring_cqe *cqe = &self->cqes_[head & self->cq_mask_];
+      *reinterpret_cast<int *>((uintptr_t)cqe->user_data) = cqe->res;
+      if (--self->pending_->remaining == 0) {
+        done = self->pending_;
+        self->pending_ = nullptr;
+      }
+    }
+    __atomic_store_n(self->cq_head_, head, __ATOMIC_RELEASE);
+    if (done != nullptr) {
+      done->handle.resume();
+    }
+    return G_SOURCE_CONTINUE;
+  }
+
+  int fd_;
+  int event_fd_ = -1;
+  guint source_id_ = 0;
+  void *sq_ring_ = MAP_FAILED;
+  void *cq_ring_ = MAP_FAILED;
+  void *sqes_ = MAP_FAILED;
+  gsize sq_ring_size_ = 0;
+  gsize cq_ring_size_ = 0;
+  gsize sqes_size_ = 0;
+  guint32 *sq_tail_ = nullptr;
+  guint32 sq_mask_ = 0;
+  guint32 *sq_array_ = nullptr;
+  guint32 *cq_head_ = nullptr;
+  guint32 *cq_tail_ = nullptr;
+  guint32 cq_mask_ = 0;
+  struct io_uring_cqe *cqes_ = nullptr;
+  // The commit in flight.
+  Commit *pending_ = nullptr;
+};
+
+FileLog::FileLog(ThreadPool *pool, Mode mode, gsize max_batch)
+    : pool_(pool), mode_(mode), max_batch_(max_batch) {}
+
+FileLog::~FileLog() {
+  if (fd_ >= 0) {
+    close(fd_);
+  }
+}
+
+bool FileLog::open(const gchar *path,
+                   const std::function<void(const guint8 *, gsize)> &record,
+                   GError **error) {
+  g_autofree gchar *dir = g_path_get_dirname(path);
+  if (g_mkdir_with_parents(dir, 0700) != 0) {
+    return set_errno_error(error, "Failed to create", dir, errno);
+  }
+  int fd = ::open(path, O_RDWR | O_CREAT | O_CLOEXEC, 0600);
+  if (fd < 0) {
+    return set_errno_error(error, "Failed to open", path, errno);
+  }
+  gchar *contents;
+  gsize length;
+  if (!g_file_get_contents(path, &contents, &length, error)) {
+    close(fd);
+    return false;
+  }
+  const guint8 *data = (const guint8 *)contents;
+  gsize offset = 0;
+  while (length - offset >= kFrameHeaderSize) {
+    guint32 size = load32(data + offset);
+    const guint8 *payload = data + offset + kFrameHeaderSize;
+    if (length - offset - kFrameHeaderSize < size ||
+        fnv1a(payload, size) != load32(data + offset + 4)) {
+      break;
+    }
+    record(payload, size);
+    offset += kFrameHeaderSize + size;
+  }
+  g_free(contents);
+  if (offset < length) {
+    g_warning("Dropping %" G_GSIZE_FORMAT " bytes of a torn record in %s",
+              length - offset, path);
+    if (ftruncate(fd, offset) != 0) {
+      int saved_errno = errno;
+      close(fd);
+      return set_errno_error(error, "Failed to truncate", path, saved_errno);
+    }
+  }
+
+  if (fd_ >= 0) {
+    close(fd_);
+  }
+  fd_ = fd;
+  offset_ = offset;
+  if (mode_ != Mode::kThread && ring_ == nullptr) {
+    g_autoptr(GError) ring_error = nullptr;
+    ring_.reset(IoUring::create(&ring_error));
+    if (ring_ == nullptr) {
+      g_message("Committing %s on the thread pool: %s", path,
+                ring_error->message);
+    }
+  }
+  return true;
+}
+
+bool FileLog::rewrite(const gchar *path,
+                      const std::vector<std::vector<guint8>> &records,
+                      GError **error) {
+  std::vector<guint8> data;
+  for (const std::vector<guint8> &record : records) {
+    append_frame(&data, record);
+  }
+  g_autofree gchar *tmp_path = g_strconcat(path, ".tmp", NULL);
+  int fd = ::open(tmp_path, O_WRONLY | O_CREAT | O_TRUNC | O_CLOEXEC, 0600);
+  if (fd < 0) {
+    return set_errno_error(error, "Failed to create", tmp_path, errno);
+  }
+  int result = write_and_sync(fd, data.data(), data.size(), 0);
+  close(fd);
+  if (result != 0 || rename(tmp_path, path) != 0) {
+    int saved_errno = result != 0 ? result : errno;
+    unlink(tmp_path);
+    return set_errno_error(error, "Failed to write", tmp_path, saved_errno);
+  }
+  return open(path, [](const guint8 *, gsize) {}, error);
+}
+
+Task<bool> FileLog::append(std::vector<guint8> record) {
+  Waiter waiter;
+  append_frame(&pending_, record);
+  pending_waiters_.push_back(&waiter);
+  if (!flushing_) {
+    task_detach(flush());
+  }
+  while (!waiter.done) {
+    co_await committed_.wait();
+  }
+  co_return waiter.ok;
+}
+
+// Commits pending records until there are none left. Runs while records are
+// appended, those arriving during a commit make up the next batch.
+Task<> FileLog::flush() {
+  flushing_ = true;
+  while (!pending_waiters_.empty()) {
+    std::vector<guint8> batch;
+    std::vector<Waiter *> waiters;
+    if (max_batch_ == 0 || pending_waiters_.size() <= max_batch_) {
+      batch.swap(pending_);
+      waiters.swap(pending_waiters_);
+    } else {
+      // Splits off the first max_batch_ frames.
+      gsize end = 0;
+      for (gsize i = 0; i < max_batch_; i++) {
+        end += kFrameHeaderSize + load32(pending_.data() + end);
+      }
+      batch.assign(pending_.begin(), pending_.begin() + end);
+      pending_.erase(pending_.begin(), pending_.begin() + end);
+      waiters.assign(pending_waiters_.begin(),
+                     pending_waiters_.begin() + max_batch_);
+      pending_waiters_.erase(pending_waiters_.begin(),
+                             pending_waiters_.begin() + max_batch_);
+    }
+
+    gint64 started = g_get_monotonic_time();
+    int result = co_await commit(batch.data(), batch.size(), offset_);
+    gint64 latency = g_get_monotonic_time() - started;
+    commits_++;
+    commit_total_us_ += latency;
+    commit_max_us_ = MAX(commit_max_us_, latency);
+    if (result == 0) {
+      // A failed commit is overwritten by the next one.
+      offset_ += batch.size();
+      records_ += waiters.size();
+      bytes_ += batch.size();
+      max_batch_records_ = MAX(max_batch_records_, (guint64)waiters.size());
+    } else {
+      failed_commits_++;
+      g_warning("Failed to commit %" G_GSIZE_FORMAT " records: %s",
+                waiters.size(), g_strerror(result));
+    }
+    for (Waiter *waiter : waiters) {
+      waiter->done = true;
+      waiter->ok = result == 0;
+    }
+    committed_.notify_all();
+  }
+  flushing_ = false;
+}
+
+// Writes `length` bytes at `offset` and syncs them, resolves to 0 or an
+// errno.
+Task<int> FileLog::commit(const guint8 *data, gsize length, gsize offset) {
+  gsize written = 0;
+  while (ring_ != nullptr) {
+    IoUring::Commit result = co_await ring_->write_and_sync(
+        fd_, data + written, length - written, offset + written);
+    if (result.submit_failed || result.write_result == -EINVAL ||
+        result.write_result == -EOPNOTSUPP) {
+      // IORING_OP_WRITE needs Linux 5.6.
+      g_message("Committing on the thread pool, io_uring failed: %s",
+                g_strerror(-result.write_result));
+      ring_.reset();
+      break;
+    }
+    if (result.write_result < 0) {
+      co_return -result.write_result;
+    }
+    written += result.write_result;
+    if (written == length) {
+      co_return -result.sync_result;
+    }
+    // A short write cancels the linked sync, submits the rest.
+  }
+  co_return co_await commit_on_thread(data + written, length - written,
+                                      offset + written);
+}
+
+Task<int> FileLog::commit_on_thread(const guint8 *data, gsize length,
+                                    gsize offset) {
+  int fd = fd_;
+  co_return co_await run_on(pool_, [fd, data, length, offset] {
+    return write_and_sync(fd, data, length, offset);
+  });
+}
+
+FlValue *FileLog::stats() const {
+  FlValue *stats = fl_value_new_map();
+  fl_value_set_string_take(stats, "ioUring",
+                           fl_value_new_bool(ring_ != nullptr));
+  fl_value_set_string_take(stats, "size", fl_value_new_int(offset_));
+  fl_value_set_string_take(stats, "records", fl_value_new_int(records_));
+  fl_value_set_string_take(stats, "commits", fl_value_new_int(commits_));
+  fl_value_set_string_take(stats, "failedCommits",
+                           fl_value_new_int(failed_commits_));
+  fl_value_set_string_take(
+      stats, "recordsPerCommitAvg",
+      fl_value_new_float(commits_ > 0 ? (gdouble)records_ / commits_ : 0));
+  fl_value_set_string_take(stats, "recordsPerCommitMax",
+                           fl_value_new_int(max_batch_records_));
+  fl_value_set_string_take(stats, "bytes", fl_value_new_int(bytes_));
+  fl_value_set_string_take(
+      stats, "commitLatencyAvgUs",
+      fl_value_new_float(commits_ > 0 ? (gdouble)commit_total_us_ / commits_
+                                      : 0));
+  fl_value_set_string_take(stats, "commitLatencyMaxUs",
+                           fl_value_new_int(commit_max_us_));
+  return stats;
+}
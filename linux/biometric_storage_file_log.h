@@ -0,0 +1,94 @@
+#ifndef FLUTTER_PLUGIN_BIOMETRIC_STORAGE_FILE_LOG_H_
+#define FLUTTER_PLUGIN_BIOMETRIC_STORAGE_FILE_LOG_H_
+
+#include <flutter_linux/flutter_linux.h>
+
+#include <functional>
+#include <memory>
+#include <vector>
+
+#include "biometric_storage_async.h"
+#include "biometric_storage_thread_pool.h"
+
+class IoUring;
+
+// Append only log of records with group commit: records appended while a
+// commit is in flight are collected and written together by the next one,
+// followed by a single fdatasync(). Every append() resolves once the commit
+// containing its record landed, so concurrent writers share the cost of the
+// sync instead of paying one each.
+//
+// The write and the sync are submitted as one linked io_uring request and
+// completed through an eventfd watched on the main context. Where io_uring
+// is not available (old kernel, seccomp) they run on the thread pool
+// instead.
+//
+// Records are framed as a little endian 32 bit length, a 32 bit FNV-1a
+// checksum and the payload. open() drops a torn record at the end.
+class FileLog {
+ public:
+  enum class Mode { kAuto, kIoUring, kThread };
+
+  // Commits hold at most `max_batch` records, 0 for no limit.
+  FileLog(ThreadPool *pool, Mode mode, gsize max_batch);
+  ~FileLog();
+
+  FileLog(const FileLog &) = delete;
+  FileLog &operator=(const FileLog &) = delete;
+
+  // Opens or creates the log at `path` and calls `record` for each intact
+  // record in order. Blocks, run it on the thread pool.
+  bool open(const gchar *path,
+            const std::function<void(const guint8 *, gsize)> &record,
+            GError **error);
+
+  // Replaces the log at `path` with `records` and opens it, used to compact
+  // it. Blocks like open().
+  bool rewrite(const gchar *path,
+               const std::vector<std::vector<guint8>> &records,
+               GError **error);
+
+  // Appends a record, resolves to false if its commit failed.
+  Task<bool> append(std::vector<guint8> record);
+
+  // Bytes in the log, including committed records only.
+  gsize size() const { return offset_; }
+
+  bool uses_io_uring() const { return ring_ != nullptr; }
+
+  // Batch sizes and commit latency as a map for the `stats` method.
+  FlValue *stats() const;
+
+ private:
+  struct Waiter {
+    bool done = false;
+    bool ok = false;
+  };
+
+  Task<> flush();
+  Task<int> commit(const guint8 *data, gsize length, gsize offset);
+  Task<int> commit_on_thread(const guint8 *data, gsize length, gsize offset);
+
+  ThreadPool *pool_;
+  const Mode mode_;
+  const gsize max_batch_;
+  int fd_ = -1;
+  gsize offset_ = 0;
+  std::unique_ptr<IoUring> ring_;
+
+  // Framed records and waiters of the next commit.
+  std::vector<guint8> pending_;
+  std::vector<Waiter *> pending_waiters_;
+  bool flushing_ = false;
+  AsyncCondition committed_;
+
+  guint64 records_ = 0;
+  guint64 commits_ = 0;
+  guint64 failed_commits_ = 0;
+  guint64 max_batch_records_ = 0;
+  guint64 bytes_ = 0;
+  gint64 commit_total_us_ = 0;
+  gint64 commit_max_us_ = 0;
+};
+
+#endif  // FLUTTER_PLUGIN_BIOMETRIC_STORAGE_FILE_LOG_H_
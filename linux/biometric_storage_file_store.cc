@@ -0,0 +1,198 @@
+#include "biometric_storage_file_store.h"
+
+#include <string.h>
+#include <sys/mman.h>
+
+// Logs smaller than this are never compacted.
+static const gsize kCompactMinBytes = 64 * 1024;
+
+static const guint8 kRecordPut = 'P';
+static const guint8 kRecordDelete = 'D';
+
+static void append32(std::vector<guint8> *out, guint32 v) {
+  out->push_back(v);
+  out->push_back(v >> 8);
+  out->push_back(v >> 16);
+  out->push_back(v >> 24);
+}
+
+static guint32 load32(const guint8 *p) {
+  return (guint32)p[0] | ((guint32)p[1] << 8) | ((guint32)p[2] << 16) |
+         ((guint32)p[3] << 24);
+}
+
+static std::vector<guint8> put_record(const std::string &name,
+                                      const std::vector<guint8> &sealed) {
+  std::vector<guint8> record;
+  record.reserve(1 + 4 + name.size() + sealed.size());
+  record.push_back(kRecordPut);
+  record.insert(record.end(), sealed.begin(),
+                sealed.begin() + BIOMETRIC_AEAD_NONCE_SIZE);
+  append32(&record, name.size());
+  record.insert(record.end(), name.begin(), name.end());
+  record.insert(record.end(), sealed.begin() + BIOMETRIC_AEAD_NONCE_SIZE,
+                sealed.end());
+  return record;
+}
+
+FileStore::FileStore(const guint8 key[BIOMETRIC_AEAD_KEY_SIZE],
+                     ThreadPool *pool, FileLog::Mode mode, gsize max_batch)
+    : pool_(pool), log_(pool, mode, max_batch) {
+  // Best effort, keeps the key out of swap.
+  mlock(key_, sizeof(key_));
+  memcpy(key_, key, sizeof(key_));
+}
+
+FileStore::~FileStore() {
+  biometric_wipe(key_, sizeof(key_));
+  munlock(key_, sizeof(key_));
+}
+
+// Replays one record of the log.
+void FileStore::apply(const guint8 *record, gsize length) {
+  if (length == 0) {
+    corrupt_records_++;
+    return;
+  }
+  gsize header = record[0] == kRecordPut ? 1 + BIOMETRIC_AEAD_NONCE_SIZE : 1;
+  if (length < header + 4 ||
+      (record[0] != kRecordPut && record[0] != kRecordDelete)) {
+    corrupt_records_++;
+    return;
+  }
+  guint32 name_length = load32(record + header);
+  if (length - header - 4 < name_length) {
+    corrupt_records_++;
+    return;
+  }
+  std::string name((const gchar *)record + header + 4, name_length);
+  auto existing = entries_.find(name);
+  if (existing != entries_.end()) {
+    live_bytes_ -= existing->second.size();
+    entries_.erase(existing);
+  }
+  if (record[0] == kRecordDelete) {
+    return;
+  }
+  const guint8 *sealed = record + header + 4 + name_length;
+  gsize sealed_length = length - header - 4 - name_length;
+  if (sealed_length < BIOMETRIC_AEAD_TAG_SIZE) {
+    corrupt_records_++;
+    return;
+  }
+  std::vector<guint8> entry(record + 1,
+                            record + 1 + BIOMETRIC_AEAD_NONCE_SIZE);
+  entry.insert(entry.end(), sealed, sealed + sealed_length);
+  live_bytes_ += entry.size();
+  entries_[name] = std::move(entry);
+}
+
+bool FileStore::open(const gchar *path, GError **error) {
+  entries_.clear();
+  live_bytes_ = 0;
+  if (!log_.open(
+          path,
+          [this](const guint8 *record, gsize length) {
+            apply(record, length);
+          },
+          error)) {
+    return false;
+  }
+  if (log_.size() < kCompactMinBytes || log_.size() < 2 * live_bytes_) {
+    return true;
+  }
+  std::vector<std::vector<guint8>> records;
+  records.reserve(entries_.size());
+  for (const auto &entry : entries_) {
+    records.push_back(put_record(entry.first, entry.second));
+  }
+  compactions_++;
+  return log_.rewrite(path, records, error);
+}
+
+Task<bool> FileStore::put(std::string name, const gchar *content,
+                          gsize length) {
+  std::vector<guint8> sealed(BIOMETRIC_AEAD_NONCE_SIZE + length +
+                             BIOMETRIC_AEAD_TAG_SIZE);
+  GError *error = nullptr;
+  if (!biometric_random_bytes(sealed.data(), BIOMETRIC_AEAD_NONCE_SIZE,
+                              &error)) {
+    g_warning("Failed to store %s: %s", name.c_str(), error->message);
+    g_error_free(error);
+    co_return false;
+  }
+  // Only reads the key, large secrets are sealed on the thread pool.
+  ThreadPool *pool = length >= kOffloadMinSize ? pool_ : nullptr;
+  gboolean ok = co_await run_on(pool, [&] {
+    return biometric_aead_seal(key_, sealed.data(),
+                               (const guint8 *)name.data(), name.size(),
+                               (const guint8 *)content, length,
+                               sealed.data() + BIOMETRIC_AEAD_NONCE_SIZE,
+                               &error);
+  });
+  if (!ok) {
+    g_warning("Failed to store %s: %s", name.c_str(), error->message);
+    g_error_free(error);
+    co_return false;
+  }
+  if (!co_await log_.append(put_record(name, sealed))) {
+    co_return false;
+  }
+  auto existing = entries_.find(name);
+  if (existing != entries_.end()) {
+    live_bytes_ -= existing->second.size();
+  }
+  live_bytes_ += sealed.size();
+  entries_[name] = std::move(sealed);
+  co_return true;
+}
+
+Task<bool> FileStore::remove(std::string name, bool *existed) {
+  std::vector<guint8> record;
+  record.push_back(kRecordDelete);
+  append32(&record, name.size());
+  record.insert(record.end(), name.begin(), name.end());
+  if (!co_await log_.append(std::move(record))) {
+    co_return false;
+  }
+  auto existing = entries_.find(name);
+  *existed = existing != entries_.end();
+  if (*existed) {
+    live_bytes_ -= existing->second.size();
+    entries_.erase(existing);
+  }
+  co_return true;
+}
+
+bool FileStore::lookup(const gchar *name, SecretPtr *content) const {
+  auto entry = entries_.find(name);
+  if (entry == entries_.end()) {
+    return false;
+  }
+  const std::vector<guint8> &sealed = entry->second;
+  gsize length =
+      sealed.size() - BIOMETRIC_AEAD_NONCE_SIZE - BIOMETRIC_AEAD_TAG_SIZE;
+  gchar *plain = static_cast<gchar *>(g_malloc0(length + 1));
+  if (!biometric_aead_open(key_, sealed.data(), (const guint8 *)name,
+                           strlen(name),
+                           sealed.data() + BIOMETRIC_AEAD_NONCE_SIZE,
+                           sealed.size() - BIOMETRIC_AEAD_NONCE_SIZE,
+                           (guint8 *)plain)) {
+    g_warning("Stored content of %s failed authentication.", name);
+    g_free(plain);
+    return false;
+  }
+  content->reset(plain);
+  return true;
+}
+
+FlValue *FileStore::stats() const {
+  FlValue *stats = log_.stats();
+  fl_value_set_string_take(stats, "entries", fl_value_new_int(entries_.size()));
+  fl_value_set_string_take(stats, "liveBytes", fl_value_new_int(live_bytes_));
+  fl_value_set_string_take(stats, "compactions",
+                           fl_value_new_int(compactions_));
+  fl_value_set_string_take(stats, "corruptRecords",
+                           fl_value_new_int(corrupt_records_));
+  return stats;
+}
@@ -0,0 +1,64 @@
+#ifndef FLUTTER_PLUGIN_BIOMETRIC_STORAGE_FILE_STORE_H_
+#define FLUTTER_PLUGIN_BIOMETRIC_STORAGE_FILE_STORE_H_
+
+#include <flutter_linux/flutter_linux.h>
+
+#include <map>
+#include <string>
+#include <vector>
+
+#include "biometric_storage_crypto.h"
+#include "biometric_storage_file_log.h"
+#include "biometric_storage_offline_queue.h"
+
+// Secrets of storages initialized with the `linuxFileStore` option, kept in
+// a FileLog instead of the keyring. Every write is durable once it resolves,
+// concurrent writes share one fdatasync().
+//
+// Contents are sealed with ChaCha20-Poly1305 under a key kept in the
+// keyring, with a random nonce per record and the item name as associated
+// data. They stay sealed in memory and are only opened by lookup().
+//
+// Records are 'P', nonce, little endian 32 bit name length, name and sealed
+// content for a write, 'D', name length and name for a delete. The log is
+// compacted when it is opened and mostly consists of overwritten records.
+class FileStore {
+ public:
+  FileStore(const guint8 key[BIOMETRIC_AEAD_KEY_SIZE], ThreadPool *pool,
+            FileLog::Mode mode, gsize max_batch);
+  ~FileStore();
+
+  FileStore(const FileStore &) = delete;
+  FileStore &operator=(const FileStore &) = delete;
+
+  // Loads the log at `path`. Blocks, run it on the thread pool.
+  bool open(const gchar *path, GError **error);
+
+  // Stores `length` bytes of `content` as `name`, resolves to false if the
+  // write could not be committed.
+  Task<bool> put(std::string name, const gchar *content, gsize length);
+
+  // Deletes `name`, sets `existed` if there was such an item.
+  Task<bool> remove(std::string name, bool *existed);
+
+  // Returns true and sets `content` if `name` is stored and its content
+  // could be authenticated.
+  bool lookup(const gchar *name, SecretPtr *content) const;
+
+  // Entries and log statistics as a map for the `stats` method.
+  FlValue *stats() const;
+
+ private:
+  void apply(const guint8 *record, gsize length);
+
+  guint8 key_[BIOMETRIC_AEAD_KEY_SIZE];
+  ThreadPool *pool_;
+  FileLog log_;
+  // Nonce and sealed content by name.
+  std::map<std::string, std::vector<guint8>> entries_;
+  gsize live_bytes_ = 0;
+  guint64 compactions_ = 0;
+  guint64 corrupt_records_ = 0;
+};
+
+#endif  // FLUTTER_PLUGIN_BIOMETRIC_STORAGE_FILE_STORE_H_
@@ -0,0 +1,132 @@
+#include "biometric_storage_hot_keys.h"
+
+#include <string.h>
+
+#include <algorithm>
+
+HotKeys::HotKeys(gsize width, gsize depth, gsize top_k, gint64 half_life_us)
+    : width_(width),
+      depth_(depth),
+      top_k_(top_k),
+      half_life_us_(half_life_us),
+      counters_(width * depth) {
+  top_.reserve(top_k);
+}
+
+guint64 HotKeys::hash(const gchar *name) {
+  guint64 hash = 0xcbf29ce484222325;
+  for (const guchar *p = (const guchar *)name; *p != '\0'; p++) {
+    hash = (hash ^ *p) * 0x100000001b3;
+  }
+  return hash;
+}
+
+gchar *HotKeys::reported_hash(const gchar *name) { return report(hash(name)); }
+
+gchar *HotKeys::report(guint64 hash) {
+  static guint8 key[32];
+  static gsize initialized = 0;
+  if (g_once_init_enter(&initialized)) {
+    for (gsize i = 0; i < sizeof(key); i += sizeof(guint32)) {
+      guint32 random = g_random_int();
+      memcpy(key + i, &random, sizeof(random));
+    }
+    g_once_init_leave(&initialized, 1);
+  }
+  guint64 data = GUINT64_TO_LE(hash);
+  gchar *hmac = g_compute_hmac_for_data(G_CHECKSUM_SHA256, key, sizeof(key),
+                                        (const guchar *)&data, sizeof(data));
+  // 64 bits are plenty to tell the top entries apart.
+  hmac[16] = '\0';
+  return hmac;
+}
+
+// splitmix64 finalizer, spreads the FNV-1a hash over the sketch rows.
+static guint64 mix(guint64 x) {
+  x = (x ^ (x >> 30)) * 0xbf58476d1ce4e5b9;
+  x = (x ^ (x >> 27)) * 0x94d049bb133111eb;
+  return x ^ (x >> 31);
+}
+
+bool HotKeys::heavier(const Entry &a, const Entry &b) {
+  return a.count > b.count;
+}
+
+void HotKeys::decay(gint64 now_us) {
+  if (decayed_at_us_ < 0) {
+    decayed_at_us_ = now_us;
+    return;
+  }
+  gint64 halvings = (now_us - decayed_at_us_) / half_life_us_;
+  if (halvings <= 0) {
+    return;
+  }
+  decayed_at_us_ += halvings * half_life_us_;
+  guint shift = MIN(halvings, 32);
+  for (guint32 &counter : counters_) {
+    counter = shift < 32 ? counter >> shift : 0;
+  }
+  total_ = shift < 32 ? total_ >> shift : 0;
+  for (Entry &entry : top_) {
+    entry.count = shift < 32 ? entry.count >> shift : 0;
+  }
+  top_.erase(std::remove_if(top_.begin(), top_.end(),
+                            [](const Entry &e) { return e.count == 0; }),
+             top_.end());
+  std::make_heap(top_.begin(), top_.end(), heavier);
+}
+
+void HotKeys::record(const gchar *name, gint64 now_us) {
+  decay(now_us);
+  guint64 key = hash(name);
+  guint64 mixed = mix(key);
+  // Row i uses h1 + i * h2, as good as independent hashes for a sketch.
+  guint32 h1 = mixed, h2 = (mixed >> 32) | 1;
+  guint32 estimate = G_MAXUINT32;
+  for (gsize i = 0; i < depth_; i++) {
+    estimate = MIN(estimate, row(i)[(h1 + i * h2) % width_]);
+  }
+  if (estimate == G_MAXUINT32) {
+    return;
+  }
+  estimate++;
+  // Conservative update: only counters below the new estimate grow, which
+  // keeps collisions from inflating the other names.
+  for (gsize i = 0; i < depth_; i++) {
+    guint32 &counter = row(i)[(h1 + i * h2) % width_];
+    counter = MAX(counter, estimate);
+  }
+  total_++;
+
+  auto entry = std::find_if(top_.begin(), top_.end(),
+                            [key](const Entry &e) { return e.hash == key; });
+  if (entry != top_.end()) {
+    entry->count = estimate;
+    std::make_heap(top_.begin(), top_.end(), heavier);
+  } else if (top_.size() < top_k_) {
+    top_.push_back({key, estimate});
+    std::push_heap(top_.begin(), top_.end(), heavier);
+  } else if (!top_.empty() && estimate > top_.front().count) {
+    std::pop_heap(top_.begin(), top_.end(), heavier);
+    top_.back() = {key, estimate};
+    std::push_heap(top_.begin(), top_.end(), heavier);
+  }
+}
+
+FlValue *HotKeys::stats(gint64 now_us) {
+  decay(now_us);
+  std::vector<Entry> top = top_;
+  std::sort(top.begin(), top.end(), heavier);
+  FlValue *entries = fl_value_new_list();
+  for (const Entry &entry : top) {
+    FlValue *value = fl_value_new_map();
+    g_autofree gchar *hash = report(entry.hash);
+    fl_value_set_string_take(value, "hash", fl_value_new_string(hash));
+    fl_value_set_string_take(value, "count", fl_value_new_int(entry.count));
+    fl_value_append_take(entries, value);
+  }
+  FlValue *stats = fl_value_new_map();
+  fl_value_set_string_take(stats, "total", fl_value_new_int(total_));
+  fl_value_set_string_take(stats, "top", entries);
+  return stats;
+}
@@ -0,0 +1,63 @@
+#ifndef FLUTTER_PLUGIN_BIOMETRIC_STORAGE_HOT_KEYS_H_
+#define FLUTTER_PLUGIN_BIOMETRIC_STORAGE_HOT_KEYS_H_
+
+#include <flutter_linux/flutter_linux.h>
+
+#include <vector>
+
+// Approximate access counts of storage names in fixed memory, to find the
+// most used storages without keeping their names. Names are reduced to their
+// 64 bit FNV-1a hash, counted in a count-min sketch (with conservative
+// update) and the `top_k` largest estimates are kept in a min-heap.
+//
+// Storage names are short and guessable, so the FNV-1a hash is never
+// reported as is: stats() lists HMAC-SHA256 of it under a random key drawn
+// once per process, which cannot be matched against a dictionary of names.
+//
+// Counts decay exponentially: every `half_life_us` all counters are halved,
+// so the estimates follow what the app uses now rather than since it was
+// started. Decay is applied lazily by record() and stats().
+//
+// Only used on the main context, it does not lock.
+class HotKeys {
+ public:
+  HotKeys(gsize width, gsize depth, gsize top_k, gint64 half_life_us);
+
+  // Counts an access of `name` at monotonic time `now_us`.
+  void record(const gchar *name, gint64 now_us);
+
+  // Decayed total and the heaviest hashes as a map for the `stats` method.
+  FlValue *stats(gint64 now_us);
+
+  // Hash `name` is counted as.
+  static guint64 hash(const gchar *name);
+
+  // Hex id `name` is reported as in stats(), stable within this process.
+  static gchar *reported_hash(const gchar *name);
+
+ private:
+  struct Entry {
+    guint64 hash;
+    guint32 count;
+  };
+
+  // Heap order of `top_`.
+  static bool heavier(const Entry &a, const Entry &b);
+
+  static gchar *report(guint64 hash);
+
+  void decay(gint64 now_us);
+  guint32 *row(gsize i) { return counters_.data() + i * width_; }
+
+  const gsize width_;
+  const gsize depth_;
+  const gsize top_k_;
+  const gint64 half_life_us_;
+  std::vector<guint32> counters_;
+  // Min-heap on count, the smallest of the top entries is in front.
+  std::vector<Entry> top_;
+  guint64 total_ = 0;
+  gint64 decayed_at_us_ = -1;
+};
+
+#endif  // FLUTTER_PLUGIN_BIOMETRIC_STORAGE_HOT_KEYS_H_
@@ -0,0 +1,127 @@
+#include "biometric_storage_kernel_keyring.h"
+
+#include <errno.h>
+#include <gio/gio.h>
+#include <linux/keyctl.h>
+#include <sys/syscall.h>
+#include <unistd.h>
+
+#include "biometric_storage_crypto.h"
+
+static const char kKeyType[] = "user";
+// All permissions for possessors and for processes of the owning user
+// (KEY_POS_ALL | KEY_USR_ALL of keyutils.h).
+static const unsigned long kKeyPermissions = 0x3f3f0000;
+
+typedef gint32 key_serial_t;
+
+// No libkeyutils, the three calls needed are thin syscall wrappers.
+static long add_key(const gchar *description, const void *payload,
+                    gsize length, key_serial_t keyring) {
+  return syscall(SYS_add_key, kKeyType, description, payload, length,
+                 keyring);
+}
+
+static long keyctl(int operation, unsigned long arg2, unsigned long arg3,
+                   unsigned long arg4, unsigned long arg5) {
+  return syscall(SYS_keyctl, operation, arg2, arg3, arg4, arg5);
+}
+
+static void set_errno_error(GError **error, int saved_errno,
+                            const gchar *operation,
+                            const gchar *description) {
+  g_set_error(error, G_IO_ERROR, g_io_error_from_errno(saved_errno),
+              "Failed to %s kernel key %s: %s", operation, description,
+              g_strerror(saved_errno));
+}
+
+// Returns the serial of key `description` in the user keyring, 0 if there
+// is none.
+static gboolean search(const gchar *description, key_serial_t *serial,
+                       GError **error) {
+  long found = keyctl(KEYCTL_SEARCH, KEY_SPEC_USER_KEYRING,
+                      (unsigned long)kKeyType, (unsigned long)description, 0);
+  if (found >= 0) {
+    *serial = found;
+    return TRUE;
+  }
+  if (errno == ENOKEY || errno == EKEYEXPIRED || errno == EKEYREVOKED) {
+    *serial = 0;
+    return TRUE;
+  }
+  set_errno_error(error, errno, "look up", description);
+  return FALSE;
+}
+
+gboolean biometric_kernel_key_store(const gchar *description,
+                                    const gchar *data, gsize length,
+                                    GError **error) {
+  if (length > BIOMETRIC_KERNEL_KEY_MAX_SIZE) {
+    g_set_error(error, G_IO_ERROR, G_IO_ERROR_NO_SPACE,
+                "Secret of %s is too large for a kernel key", description);
+    return FALSE;
+  }
+  long serial = add_key(description, data, length, KEY_SPEC_USER_KEYRING);
+  if (serial < 0) {
+    // EDQUOT, the user's key quota is exhausted.
+    set_errno_error(error, errno == EDQUOT ? ENOSPC : errno, "store",
+                    description);
+    return FALSE;
+  }
+  // Readable without possessing the user keyring (it is not linked into
+  // every session keyring), like the items of an unlocked Secret Service.
+  keyctl(KEYCTL_SETPERM, serial, kKeyPermissions, 0, 0);
+  return TRUE;
+}
+
+gboolean biometric_kernel_key_lookup(const gchar *description, gchar **data,
+                                     GError **error) {
+  *data = nullptr;
+  key_serial_t serial;
+  if (!search(description, &serial, error)) {
+    return FALSE;
+  }
+  if (serial == 0) {
+    return TRUE;
+  }
+  // Grows the buffer until the key fits, it may be replaced in between.
+  gsize capacity = 256;
+  while (TRUE) {
+    gchar *buffer = static_cast<gchar *>(g_malloc(capacity + 1));
+    long length = keyctl(KEYCTL_READ, serial, (unsigned long)buffer,
+                         capacity, 0);
+    if (length < 0) {
+      int saved_errno = errno;
+      biometric_wipe(buffer, capacity + 1);
+      g_free(buffer);
+      if (saved_errno == ENOKEY || saved_errno == EKEYREVOKED) {
+        return TRUE;
+      }
+      set_errno_error(error, saved_errno, "read", description);
+      return FALSE;
+    }
+    if ((gsize)length <= capacity) {
+      buffer[length] = '\0';
+      *data = buffer;
+      return TRUE;
+    }
+    biometric_wipe(buffer, capacity + 1);
+    g_free(buffer);
+    capacity = length;
+  }
+}
+
+gboolean biometric_kernel_key_remove(const gchar *description,
+                                     gboolean *existed, GError **error) {
+  key_serial_t serial;
+  if (!search(description, &serial, error)) {
+    return FALSE;
+  }
+  *existed = serial != 0;
+  if (serial != 0 && keyctl(KEYCTL_INVALIDATE, serial, 0, 0, 0) < 0 &&
+      errno != ENOKEY) {
+    set_errno_error(error, errno, "remove", description);
+    return FALSE;
+  }
+  return TRUE;
+}
@@ -0,0 +1,34 @@
+#ifndef FLUTTER_PLUGIN_BIOMETRIC_STORAGE_KERNEL_KEYRING_H_
+#define FLUTTER_PLUGIN_BIOMETRIC_STORAGE_KERNEL_KEYRING_H_
+
+#include <glib.h>
+
+// Secrets kept as "user" keys in the user keyring of the kernel (keyctl(2)),
+// one syscall per operation instead of a D-Bus round trip. The keys live in
+// unswappable kernel memory, readable by processes of the same user, and are
+// gone after a reboot or once the user has no processes left, so only
+// storages which can be recreated (session tokens) belong there.
+//
+// The kernel limits a key to 32767 bytes and all keys of a user to
+// kernel.keys.maxbytes (20000 by default), writes beyond that fail with
+// G_IO_ERROR_NO_SPACE. Sandboxes commonly block the syscalls, which fails
+// with G_IO_ERROR_NOT_SUPPORTED or G_IO_ERROR_PERMISSION_DENIED.
+
+// Largest secret a "user" key holds.
+#define BIOMETRIC_KERNEL_KEY_MAX_SIZE 32767
+
+// Stores `length` bytes of `data` as key `description`, replacing it.
+gboolean biometric_kernel_key_store(const gchar *description,
+                                    const gchar *data, gsize length,
+                                    GError **error);
+
+// Sets `data` to the content of key `description` (nul terminated, free
+// with biometric_secret_free()), or to nullptr if there is no such key.
+gboolean biometric_kernel_key_lookup(const gchar *description, gchar **data,
+                                     GError **error);
+
+// Removes key `description`, sets `existed` if there was one.
+gboolean biometric_kernel_key_remove(const gchar *description,
+                                     gboolean *existed, GError **error);
+
+#endif  // FLUTTER_PLUGIN_BIOMETRIC_STORAGE_KERNEL_KEYRING_H_
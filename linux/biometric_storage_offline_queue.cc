@@ -0,0 +1,182 @@
+#include "biometric_storage_offline_queue.h"
+
+#include <string.h>
+#include <sys/mman.h>
+
+#include <algorithm>
+
+OfflineQueue::OfflineQueue(gsize max_entries, gsize max_bytes)
+    : max_entries_(max_entries), max_bytes_(max_bytes) {
+  // Best effort, keeps the key out of swap.
+  mlock(key_, sizeof(key_));
+  GError *error = nullptr;
+  has_key_ = biometric_random_bytes(key_, sizeof(key_), &error);
+  if (!has_key_) {
+    g_warning("Offline queue disabled: %s", error->message);
+    g_error_free(error);
+  }
+}
+
+OfflineQueue::~OfflineQueue() {
+  if (!entries_.empty()) {
+    g_warning("Discarding %" G_GSIZE_FORMAT
+              " queued keyring operations which were never replayed.",
+              entries_.size());
+  }
+  biometric_wipe(key_, sizeof(key_));
+  munlock(key_, sizeof(key_));
+}
+
+void OfflineQueue::nonce_for(guint64 id,
+                             guint8 nonce[BIOMETRIC_AEAD_NONCE_SIZE]) const {
+  memset(nonce, 0, BIOMETRIC_AEAD_NONCE_SIZE);
+  for (int i = 0; i < 8; i++) {
+    nonce[4 + i] = id >> (8 * i);
+  }
+}
+
+bool OfflineQueue::push(const gchar *name, GHashTable *attributes,
+                        const gchar *content) {
+  if (!has_key_) {
+    rejected_++;
+    return false;
+  }
+  auto existing =
+      std::find_if(entries_.begin(), entries_.end(),
+                   [name](const Entry &entry) { return entry.name == name; });
+  gsize length = content != nullptr ? strlen(content) : 0;
+  gsize sealed_size = content != nullptr ? length + BIOMETRIC_AEAD_TAG_SIZE : 0;
+  gsize existing_size =
+      existing != entries_.end() ? existing->sealed.size() : 0;
+  gsize entries = entries_.size() + (existing == entries_.end() ? 1 : 0);
+  if (entries > max_entries_ ||
+      bytes_ - existing_size + sealed_size > max_bytes_) {
+    rejected_++;
+    return false;
+  }
+
+  Entry entry;
+  entry.id = next_id_++;
+  entry.name = name;
+  entry.remove = content == nullptr;
+  entry.attributes = RefPtr<GHashTable>::ref(attributes);
+  entry.queued_at = g_get_monotonic_time();
+  if (content != nullptr) {
+    guint8 nonce[BIOMETRIC_AEAD_NONCE_SIZE];
+    nonce_for(entry.id, nonce);
+    entry.sealed.resize(sealed_size);
+    g_autoptr(GError) error = nullptr;
+    if (!biometric_aead_seal(key_, nonce, (const guint8 *)name, strlen(name),
+                             (const guint8 *)content, length,
+                             entry.sealed.data(), &error)) {
+      g_warning("Failed to queue %s: %s", name, error->message);
+      rejected_++;
+      return false;
+    }
+  }
+
+  if (existing != entries_.end()) {
+    bytes_ -= existing_size;
+    entries_.erase(existing);
+    coalesced_++;
+  }
+  bytes_ += sealed_size;
+  entries_.push_back(std::move(entry));
+  queued_++;
+  return true;
+}
+
+bool OfflineQueue::open(const Entry &entry, SecretPtr *content,
+                        GError **error) const {
+  content->reset();
+  if (entry.remove) {
+    return true;
+  }
+  guint8 nonce[BIOMETRIC_AEAD_NONCE_SIZE];
+  nonce_for(entry.id, nonce);
+  gsize length = entry.sealed.size() - BIOMETRIC_AEAD_TAG_SIZE;
+  SecretPtr opened(static_cast<gchar *>(g_malloc0(length + 1)));
+  // Only fails if the memory was corrupted, there is no way to recover the
+  // content then.
+  if (!biometric_aead_open(key_, nonce, (const guint8 *)entry.name.c_str(),
+                           entry.name.size(), entry.sealed.data(),
+                           entry.sealed.size(), (guint8 *)opened.get())) {
+    g_set_error(error, G_IO_ERROR, G_IO_ERROR_INVALID_DATA,
+                "Queued keyring content of %s failed authentication, the "
+                "write was lost",
+                entry.name.c_str());
+    return false;
+  }
+  *content = std::move(opened);
+  return true;
+}
+
+bool OfflineQueue::lookup(const gchar *name, SecretPtr *content,
+                          GError **error) {
+  for (const Entry &entry : entries_) {
+    if (entry.name == name) {
+      if (!open(entry, content, error)) {
+        complete(entry.id, false);
+        return false;
+      }
+      return true;
+    }
+  }
+  return false;
+}
+
+bool OfflineQueue::front(std::string *name, RefPtr<GHashTable> *attributes,
+                         SecretPtr *content, guint64 *id) {
+  while (!entries_.empty()) {
+    const Entry &entry = entries_.front();
+    g_autoptr(GError) error = nullptr;
+    if (!open(entry, content, &error)) {
+      g_warning("%s", error->message);
+      complete(entry.id, false);
+      continue;
+    }
+    *name = entry.name;
+    *attributes = entry.attributes;
+    *id = entry.id;
+    return true;
+  }
+  return false;
+}
+
+void OfflineQueue::complete(guint64 id, bool replayed) {
+  auto entry =
+      std::find_if(entries_.begin(), entries_.end(),
+                   [id](const Entry &entry) { return entry.id == id; });
+  if (entry == entries_.end()) {
+    return;
+  }
+  if (replayed) {
+    gint64 latency = g_get_monotonic_time() - entry->queued_at;
+    replayed_++;
+    replay_latency_total_us_ += latency;
+    replay_latency_max_us_ = MAX(replay_latency_max_us_, latency);
+  } else {
+    dropped_++;
+  }
+  bytes_ -= entry->sealed.size();
+  entries_.erase(entry);
+}
+
+FlValue *OfflineQueue::stats() const {
+  FlValue *stats = fl_value_new_map();
+  fl_value_set_string_take(stats, "depth", fl_value_new_int(entries_.size()));
+  fl_value_set_string_take(stats, "bytes", fl_value_new_int(bytes_));
+  fl_value_set_string_take(stats, "queued", fl_value_new_int(queued_));
+  fl_value_set_string_take(stats, "coalesced", fl_value_new_int(coalesced_));
+  fl_value_set_string_take(stats, "rejected", fl_value_new_int(rejected_));
+  fl_value_set_string_take(stats, "replayed", fl_value_new_int(replayed_));
+  fl_value_set_string_take(stats, "dropped", fl_value_new_int(dropped_));
+  fl_value_set_string_take(
+      stats, "replayLatencyAvgUs",
+      fl_value_new_float(replayed_ > 0
+                             ? (gdouble)replay_latency_total_us_ / replayed_
+                             : 0));
+  fl_value_set_string_take(stats, "replayLatencyMaxUs",
+                           fl_value_new_int(replay_latency_max_us_));
+  return stats;
+}
@@ -0,0 +1,99 @@
+#ifndef FLUTTER_PLUGIN_BIOMETRIC_STORAGE_OFFLINE_QUEUE_H_
+#define FLUTTER_PLUGIN_BIOMETRIC_STORAGE_OFFLINE_QUEUE_H_
+
+#include <flutter_linux/flutter_linux.h>
+
+#include <deque>
+#include <memory>
+#include <string>
+#include <vector>
+
+#include "biometric_storage_async.h"
+#include "biometric_storage_crypto.h"
+
+// Wipes and frees a secret string, for use with std::unique_ptr.
+struct SecretDeleter {
+  void operator()(gchar *secret) const { biometric_secret_free(secret); }
+};
+
+using SecretPtr = std::unique_ptr<gchar, SecretDeleter>;
+
+// Bounded in memory queue of keyring writes and deletes which failed because
+// the Secret Service was not reachable, for storages initialized with the
+// `linuxOfflineQueue` option.
+//
+// There is at most one operation per item name, queuing another one replaces
+// it and moves it to the end of the queue. The queue is lost when the app
+// exits, which is why the plugin answers queued operations with "queued"
+// instead of TRUE.
+//
+// Contents are encrypted with ChaCha20-Poly1305 under a random key which
+// only exists in this process. That does not protect them from anything
+// which can read the process memory (the key is right next to them), it
+// only keeps plaintext secrets out of core dumps of the heap and out of
+// freed memory, and detects corrupted entries.
+class OfflineQueue {
+ public:
+  OfflineQueue(gsize max_entries, gsize max_bytes);
+  ~OfflineQueue();
+
+  OfflineQueue(const OfflineQueue &) = delete;
+  OfflineQueue &operator=(const OfflineQueue &) = delete;
+
+  // Queues storing `content` as item `name` with `attributes`, or deleting
+  // the item if `content` is nullptr. Returns false if the queue is full.
+  bool push(const gchar *name, GHashTable *attributes, const gchar *content);
+
+  // Returns true if an operation is queued for `name`. `content` is set to
+  // the queued content, or nullptr if the item is queued for deletion. A
+  // queued write whose content fails authentication is dropped, false is
+  // returned with `error` set.
+  bool lookup(const gchar *name, SecretPtr *content, GError **error);
+
+  // Returns the oldest operation, to be passed to complete() once it was
+  // replayed. Corrupted writes are dropped. Returns false if the queue is
+  // empty.
+  bool front(std::string *name, RefPtr<GHashTable> *attributes,
+             SecretPtr *content, guint64 *id);
+
+  // Removes operation `id` after replaying it (`replayed`) or giving up on
+  // it. Does nothing if it was replaced in the meantime.
+  void complete(guint64 id, bool replayed);
+
+  bool empty() const { return entries_.empty(); }
+
+  // Depth and replay statistics as a map for the `stats` method.
+  FlValue *stats() const;
+
+ private:
+  struct Entry {
+    guint64 id;
+    std::string name;
+    bool remove;
+    RefPtr<GHashTable> attributes;
+    // Nonce is derived from `id`.
+    std::vector<guint8> sealed;
+    gint64 queued_at;
+  };
+
+  void nonce_for(guint64 id, guint8 nonce[BIOMETRIC_AEAD_NONCE_SIZE]) const;
+  bool open(const Entry &entry, SecretPtr *content, GError **error) const;
+
+  const gsize max_entries_;
+  const gsize max_bytes_;
+  guint8 key_[BIOMETRIC_AEAD_KEY_SIZE];
+  bool has_key_ = false;
+  std::deque<Entry> entries_;
+  gsize bytes_ = 0;
+  guint64 next_id_ = 1;
+
+  guint64 queued_ = 0;
+  guint64 coalesced_ = 0;
+  guint64 rejected_ = 0;
+  guint64 replayed_ = 0;
+  guint64 dropped_ = 0;
+  gint64 replay_latency_total_us_ = 0;
+  gint64 replay_latency_max_us_ = 0;
+};
+
+#endif  // FLUTTER_PLUGIN_BIOMETRIC_STORAGE_OFFLINE_QUEUE_H_
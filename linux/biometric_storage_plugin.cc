@@ -1,39 +1,23 @@
 #include "include/biometric_storage/biometric_storage_plugin.h"
+#include "biometric_storage_plugin_internal.h"
+#include "biometric_storage_buffer.h"
+#include "biometric_storage_portal.h"
 
 #include <flutter_linux/flutter_linux.h>
 #include <gtk/gtk.h>
-#include <sys/utsname.h>
 #include <libsecret/secret.h>
 
-#define BIOMETRIC_SCHEMA  biometric_get_schema ()
+const char kCorruptedSecretError[] = "Corrupted Secret";
+const char kProgressChannel[] = "biometric_storage/progress";
 
-const char kBadArgumentsError[] = "Bad Arguments";
-const char kSecurityAccessError[] = "Security Access Error";
-const char kMethodRead[] = "read";
-const char kMethodWrite[] = "write";
-const char kMethodDelete[] = "delete";
-const char kNamePrefix[] = "design.codeux.authpass";
-
-#define METHOD_PARAM_NAME(varName, args) \
-    g_autofree gchar * varName = g_strdup_printf("%s.%s", kNamePrefix, fl_value_get_string(fl_value_lookup_string(args, "name")))
-
-
-#define BIOMETRIC_STORAGE_PLUGIN(obj) \
-  (G_TYPE_CHECK_INSTANCE_CAST((obj), biometric_storage_plugin_get_type(), \
-                              BiometricStoragePlugin))
-
-#define IS_METHOD(name, equals) \
-  strcmp(method, equals) == 0
-
-struct _BiometricStoragePlugin {
-  GObject parent_instance;
-};
+const gsize kThreadPoolMaxQueued = 64;
 
 G_DEFINE_TYPE(BiometricStoragePlugin, biometric_storage_plugin, g_object_get_type())
 
+G_DEFINE_QUARK(biometric-storage-error-quark, biometric_storage_error)
 
-
-static FlMethodResponse* _handle_error(const gchar* message, GError *error) {
+FlMethodResponse* biometric_storage_handle_error(const gchar* message,
+                                                 GError *error) {
     const gchar* domain = g_quark_to_string(error->domain);
     g_autofree gchar *error_message = g_strdup_printf("%s: %s (%d) (%s)", message, error->message, error->code, domain);
     g_warning("%s", error_message);
@@ -41,11 +25,16 @@ static FlMethodResponse* _handle_error(const gchar* message, GError *error) {
     fl_value_set_string_take(error_details, "domain", fl_value_new_string(domain));
     fl_value_set_string_take(error_details, "code", fl_value_new_int(error->code));
     fl_value_set_string_take(error_details, "message", fl_value_new_string(error->message));
+    const gchar *code = g_error_matches(error, BIOMETRIC_STORAGE_ERROR,
+                                        BIOMETRIC_STORAGE_ERROR_CORRUPTED)
+                            ? kCorruptedSecretError
+                            : kSecurityAccessError;
     return FL_METHOD_RESPONSE(fl_method_error_response_new(
-                   kSecurityAccessError, error_message, error_details));
+                   code, error_message, error_details));
 }
 
-static FlMethodResponse *handleInit(FlValue *args) {
+static FlMethodResponse *handleInit(BiometricStoragePlugin *self,
+                                    FlValue *args) {
   FlValue* options = fl_value_lookup_string(args, "options");
   if (fl_value_get_type(options) != FL_VALUE_TYPE_MAP) {
     return FL_METHOD_RESPONSE(fl_method_error_response_new(
@@ -56,135 +45,327 @@ static FlMethodResponse *handleInit(FlValue *args) {
     return FL_METHOD_RESPONSE(fl_method_error_response_new(
         kBadArgumentsError, "Linux plugin only supports non-authenticated secure storage", nullptr));
   }
+  if (self->credentials != nullptr) {
+    // Keyring based options do not apply to credentials.
+    return FL_METHOD_RESPONSE(fl_method_success_response_new(fl_value_new_bool(true)));
+  }
+  // `linuxFileStore` is the older spelling of `linuxTier: file`.
+  StorageTier tier;
+  gboolean pinned = FALSE;
+  FlValue *tier_option = fl_value_lookup_string(options, "linuxTier");
+  FlValue *file_store = fl_value_lookup_string(options, "linuxFileStore");
+  if (tier_option != nullptr &&
+      fl_value_get_type(tier_option) == FL_VALUE_TYPE_STRING) {
+    if (!storage_tier_parse(fl_value_get_string(tier_option), &tier)) {
+      return FL_METHOD_RESPONSE(fl_method_error_response_new(
+          kBadArgumentsError, "Unknown linuxTier", nullptr));
+    }
+    pinned = TRUE;
+  } else if (file_store != nullptr &&
+             fl_value_get_type(file_store) == FL_VALUE_TYPE_BOOL &&
+             fl_value_get_bool(file_store)) {
+    tier = StorageTier::kFile;
+    pinned = TRUE;
+  }
+  g_autofree gchar *pinned_name = item_name(args);
+  plugin_router(self)->pin(pinned_name, pinned ? &tier : nullptr);
+  FlValue *offline_queue = fl_value_lookup_string(options, "linuxOfflineQueue");
+  if (offline_queue != nullptr &&
+      fl_value_get_type(offline_queue) == FL_VALUE_TYPE_BOOL &&
+      fl_value_get_bool(offline_queue)) {
+    g_hash_table_add(self->offline_queue_names, item_name(args));
+  } else {
+    g_autofree gchar *name = item_name(args);
+    g_hash_table_remove(self->offline_queue_names, name);
+  }
+  FlValue *prefetch = fl_value_lookup_string(options, "linuxPrefetch");
+  if (prefetch != nullptr &&
+      fl_value_get_type(prefetch) == FL_VALUE_TYPE_BOOL &&
+      fl_value_get_bool(prefetch)) {
+    g_hash_table_add(self->prefetching->names, item_name(args));
+  } else {
+    g_autofree gchar *name = item_name(args);
+    g_hash_table_remove(self->prefetching->names, name);
+  }
+  FlValue *warm_start = fl_value_lookup_string(options, "linuxWarmStart");
+  warm_start_enable(self, item_name(args),
+                    warm_start != nullptr &&
+                        fl_value_get_type(warm_start) == FL_VALUE_TYPE_BOOL &&
+                        fl_value_get_bool(warm_start));
+  migration_schedule(self);
   return FL_METHOD_RESPONSE(fl_method_success_response_new(fl_value_new_bool(true)));
 }
 
-const SecretSchema *
-biometric_get_schema (void)
-{
-    static const SecretSchema the_schema = {
-        "design.codeux.BiometricStorage", SECRET_SCHEMA_NONE,
-        {
-            {  "name", SECRET_SCHEMA_ATTRIBUTE_STRING },
-            // {  "NULL", 0 },
-        }
-    };
-    return &the_schema;
+gchar *prefixed_name(const gchar *name) {
+  return g_strdup_printf("%s.%s", kNamePrefix, name);
 }
 
-static void on_password_stored(GObject *source, GAsyncResult *result,
-                               gpointer user_data) {
-  GError *error = NULL;
-  FlMethodCall *method_call = (FlMethodCall *)user_data;
-  g_autoptr(FlMethodResponse) response = nullptr;
+gchar *item_name(FlValue *args) {
+  return prefixed_name(fl_value_get_string(fl_value_lookup_string(args, "name")));
+}
 
-  secret_password_store_finish(result, &error);
-  if (error != NULL) {
-    /* ... handle the failure here */
-    response = _handle_error("Failed to store secret", error);
-    g_error_free(error);
-  } else {
-    response = FL_METHOD_RESPONSE(fl_method_success_response_new(fl_value_new_bool(true)));
+GHashTable *attributes_new() {
+  return g_hash_table_new_full(g_str_hash, g_str_equal, g_free, g_free);
+}
+
+ThreadPool *plugin_thread_pool(BiometricStoragePlugin *self) {
+  if (self->thread_pool == nullptr) {
+    self->thread_pool = new ThreadPool(MIN(g_get_num_processors(), 4),
+                                       kThreadPoolMaxQueued);
   }
+  return self->thread_pool;
+}
 
-  fl_method_call_respond(method_call, response, nullptr);
-  g_object_unref(method_call);
+RefPtr<FlMethodResponse> success_response_take(FlValue *result) {
+  RefPtr<FlMethodResponse> response = RefPtr<FlMethodResponse>::adopt(
+      FL_METHOD_RESPONSE(fl_method_success_response_new(result)));
+  fl_value_unref(result);
+  return response;
 }
 
-static void on_password_cleared(GObject *source, GAsyncResult *result,
-                                gpointer user_data) {
-  GError *error = NULL;
-  FlMethodCall *method_call = (FlMethodCall *)user_data;
-  g_autoptr(FlMethodResponse) response = nullptr;
+FlValue *lookup_typed(FlValue *args, const gchar *key,
+                      FlValueType type) {
+  if (args == nullptr || fl_value_get_type(args) != FL_VALUE_TYPE_MAP) {
+    return nullptr;
+  }
+  FlValue *value = fl_value_lookup_string(args, key);
+  return value != nullptr && fl_value_get_type(value) == type ? value
+                                                               : nullptr;
+}
 
-  gboolean removed = secret_password_clear_finish(result, &error);
+RefPtr<FlMethodResponse> bad_arguments(const gchar *message) {
+  return RefPtr<FlMethodResponse>::adopt(FL_METHOD_RESPONSE(
+      fl_method_error_response_new(kBadArgumentsError, message, nullptr)));
+}
 
-  if (error != NULL) {
-    /* ... handle the failure here */
-    response = _handle_error("Failed to delete secret", error);
-    g_error_free(error);
+Task<RefPtr<FlMethodResponse>> handleWrite(BiometricStoragePlugin *self,
+                                           FlValue *args) {
+  RefPtr<FlMethodResponse> response = co_await write_storage(self, args);
+  if (FL_IS_METHOD_SUCCESS_RESPONSE(response.get())) {
+    change_log_record(self, args, FALSE);
+  }
+  co_return response;
+}
 
-  } else {
-    response = FL_METHOD_RESPONSE(fl_method_success_response_new(fl_value_new_bool(removed)));
+Task<RefPtr<FlMethodResponse>> handleDelete(BiometricStoragePlugin *self,
+                                            FlValue *args) {
+  RefPtr<FlMethodResponse> response = co_await delete_storage(self, args);
+  if (!FL_IS_METHOD_SUCCESS_RESPONSE(response.get())) {
+    co_return response;
+  }
+  // Deletes of storages which did not exist change nothing, queued ones
+  // are recorded like a write.
+  FlValue *result = fl_method_success_response_get_result(
+      FL_METHOD_SUCCESS_RESPONSE(response.get()));
+  if (fl_value_get_type(result) != FL_VALUE_TYPE_BOOL ||
+      fl_value_get_bool(result)) {
+    change_log_record(self, args, TRUE);
   }
-  fl_method_call_respond(method_call, response, nullptr);
-  g_object_unref(method_call);
+  co_return response;
 }
 
-static void on_password_lookup(GObject *source, GAsyncResult *result,
-                               gpointer user_data) {
+Task<RefPtr<FlMethodResponse>> handleRead(BiometricStoragePlugin *self,
+                                          FlValue *args) {
+  GAutoFree<gchar> name(item_name(args));
+  if (self->credentials != nullptr) {
+    SecretPtr stored;
+    RefPtr<FlMethodResponse> error_response;
+    if (!co_await credentials_read(self, name.get(), &stored,
+                                   &error_response)) {
+      co_return error_response;
+    }
+    co_return success_response_take(stored != nullptr
+                                         ? fl_value_new_string(stored.get())
+                                         : fl_value_new_null());
+  }
+  prefetch_observe(self, name.get());
+  StorageTier tier = plugin_router(self)->route_read(name.get());
+  if (tier != StorageTier::kSecretService) {
+    SecretPtr stored;
+    RefPtr<FlMethodResponse> error_response;
+    if (!co_await tier_read(self, name.get(), tier, &stored,
+                            &error_response)) {
+      co_return error_response;
+    }
+    co_return success_response_take(stored != nullptr
+                                         ? fl_value_new_string(stored.get())
+                                         : fl_value_new_null());
+  }
+  SecretPtr queued;
+  GError *queue_error = NULL;
+  if (offline_queue_lookup(self, name.get(), &queued, &queue_error)) {
+    if (queue_error != NULL) {
+      RefPtr<FlMethodResponse> response = RefPtr<FlMethodResponse>::adopt(
+          biometric_storage_handle_error("Failed to read secret",
+                                         queue_error));
+      g_error_free(queue_error);
+      co_return response;
+    }
+    // Not replayed yet, answer with what the keyring will contain.
+    co_return success_response_take(queued != nullptr
+                                         ? fl_value_new_string(queued.get())
+                                         : fl_value_new_null());
+  }
+  SecretPtr cached;
+  if (co_await warm_start_lookup(self, name.get(), &cached)) {
+    co_return success_response_take(fl_value_new_string(cached.get()));
+  }
+  SecretPtr prefetched;
+  if (co_await prefetch_take(self, name.get(), &prefetched)) {
+    co_return success_response_take(fl_value_new_string(prefetched.get()));
+  }
   GError *error = NULL;
-  FlMethodCall *method_call = (FlMethodCall *)user_data;
-  g_autoptr(FlMethodResponse) response = nullptr;
-
-  gchar *password = secret_password_lookup_finish(result, &error);
-
+  SecretValue *secret = co_await lookup_secret(self, name.get(), &error);
   if (error != NULL) {
-    /* ... handle the failure here */
-    response = _handle_error("Failed to lookup secret", error);
+    RefPtr<FlMethodResponse> response = RefPtr<FlMethodResponse>::adopt(
+        biometric_storage_handle_error("Failed to lookup secret", error));
     g_error_free(error);
-  } else if (password == NULL) {
-    /* password will be null, if no matching password found */
+    co_return response;
+  }
+  if (secret == NULL) {
     g_warning("Failed to lookup password (not found).");
-    response = FL_METHOD_RESPONSE(fl_method_success_response_new(fl_value_new_null()));
-  } else {
-    /* ... do something with the password */
-    response = FL_METHOD_RESPONSE(fl_method_success_response_new(fl_value_new_string(password)));
-    secret_password_free(password);
+    co_await warm_start_update(self, name.get(), nullptr, 0);
+    co_return success_response_take(fl_value_new_null());
   }
-  fl_method_call_respond(method_call, response, nullptr);
-  g_object_unref(method_call);
+  gsize length;
+  const gchar *data = secret_content(secret, &length);
+  co_await warm_start_update(self, name.get(), data, length);
+  FlValue *value = co_await offload(self, length, [secret] {
+    return take_secret_value(secret);
+  });
+  co_return success_response_take(value);
 }
 
-// Called when a method call is received from Flutter.
-static void
-biometric_storage_plugin_handle_method_call(BiometricStoragePlugin *self,
-                                            FlMethodCall *method_call) {
-  g_autoptr(FlMethodResponse) response = nullptr;
-
-  const gchar *method = fl_method_call_get_name(method_call);
-  FlValue *args = fl_method_call_get_args(method_call);
-
+static Task<RefPtr<FlMethodResponse>> dispatch_call(
+    BiometricStoragePlugin *self, const gchar *method, FlValue *args) {
   if (strcmp(method, "canAuthenticate") == 0) {
-    g_autoptr(FlValue) result = fl_value_new_string("ErrorHwUnavailable");
-    response = FL_METHOD_RESPONSE(fl_method_success_response_new(result));
+    co_return success_response_take(fl_value_new_string("ErrorHwUnavailable"));
   } else if (strcmp(method, "init") == 0) {
-    response = handleInit(args);
+    RefPtr<FlMethodResponse> response =
+        RefPtr<FlMethodResponse>::adopt(handleInit(self, args));
+#ifdef BIOMETRIC_STORAGE_BENCHMARKS
+    biometric_storage_plugin_trace("plugin_first_init");
+#endif
+    co_return response;
   } else if (IS_METHOD(method, kMethodWrite)) {
-    METHOD_PARAM_NAME(name, args);
-    // const gchar *name =
-    //     fl_value_get_string(fl_value_lookup_string(args, "name"));
-    const gchar *content =
-        fl_value_get_string(fl_value_lookup_string(args, "content"));
-    g_object_ref(method_call);
-    secret_password_store(BIOMETRIC_SCHEMA, SECRET_COLLECTION_DEFAULT, name,
-                          content, NULL, on_password_stored, method_call,
-                          "name", name, NULL);
-    return;
+    co_return co_await handleWrite(self, args);
   } else if (IS_METHOD(method, kMethodRead)) {
-    METHOD_PARAM_NAME(name, args);
-    // const gchar *name =
-    //     fl_value_get_string(fl_value_lookup_string(args, "name"));
-    g_object_ref(method_call);
-    secret_password_lookup(BIOMETRIC_SCHEMA, NULL, on_password_lookup,
-                           method_call, "name", name, NULL);
-    return;
+    RefPtr<FlMethodResponse> response = co_await handleRead(self, args);
+#ifdef BIOMETRIC_STORAGE_BENCHMARKS
+    biometric_storage_plugin_trace("plugin_first_read");
+#endif
+    co_return response;
   } else if (IS_METHOD(method, kMethodDelete)) {
-    METHOD_PARAM_NAME(name, args);
-    // const gchar *name =
-    //     fl_value_get_string(fl_value_lookup_string(args, "name"));
-    g_object_ref(method_call);
-    secret_password_clear(BIOMETRIC_SCHEMA, NULL, on_password_cleared,
-                          method_call, "name", name, NULL);
-    return;
-  } else {
-    response = FL_METHOD_RESPONSE(fl_method_not_implemented_response_new());
+    co_return co_await handleDelete(self, args);
+  } else if (IS_METHOD(method, kMethodReadMany)) {
+    co_return co_await handleBatch(self, args, handleRead);
+  } else if (IS_METHOD(method, kMethodDeleteMany)) {
+    co_return co_await handleBatch(self, args, handleDelete);
+  } else if (IS_METHOD(method, kMethodBatch)) {
+    co_return co_await handlePipeline(self, args);
+  } else if (IS_METHOD(method, kMethodBatchAck)) {
+    co_return RefPtr<FlMethodResponse>::adopt(handleBatchAck(self, args));
+  } else if (IS_METHOD(method, kMethodReadBuffer)) {
+    co_return co_await handleReadBuffer(self, args);
+  } else if (IS_METHOD(method, kMethodReadSnapshot)) {
+    co_return co_await handleReadSnapshot(self, args);
+  } else if (IS_METHOD(method, kMethodChangesSince)) {
+    co_return RefPtr<FlMethodResponse>::adopt(handleChangesSince(self, args));
+  } else if (IS_METHOD(method, kMethodSetTierPolicy)) {
+    co_return RefPtr<FlMethodResponse>::adopt(handleSetTierPolicy(self, args));
+  } else if (IS_METHOD(method, kMethodFindByTags)) {
+    co_return co_await handleFindByTags(self, args);
+  } else if (IS_METHOD(method, kMethodStats)) {
+    co_return RefPtr<FlMethodResponse>::adopt(handleStats(self));
+  }
+  co_return RefPtr<FlMethodResponse>::adopt(
+      FL_METHOD_RESPONSE(fl_method_not_implemented_response_new()));
+}
+
+Task<RefPtr<FlMethodResponse>> biometric_storage_plugin_call(
+    BiometricStoragePlugin *self, const gchar *method, FlValue *args) {
+  // Keeps the plugin alive while the operation is pending.
+  RefPtr<BiometricStoragePlugin> plugin = RefPtr<BiometricStoragePlugin>::ref(self);
+  hot_keys_record(self, method, args);
+  Migration *migration = self->migration;
+  migration->foreground_calls++;
+  RefPtr<FlMethodResponse> response =
+      co_await dispatch_call(self, method, args);
+  if (--migration->foreground_calls == 0) {
+    migration->foreground_idle.notify_all();
   }
+  co_return response;
+}
+
+static Task<> respond(BiometricStoragePlugin *self,
+                      RefPtr<FlMethodCall> method_call) {
+  RefPtr<FlMethodResponse> response = co_await biometric_storage_plugin_call(
+      self, fl_method_call_get_name(method_call.get()),
+      fl_method_call_get_args(method_call.get()));
+  fl_method_call_respond(method_call.get(), response.get(), nullptr);
+}
 
-  fl_method_call_respond(method_call, response, nullptr);
+// Called when a method call is received from Flutter.
+static void
+biometric_storage_plugin_handle_method_call(BiometricStoragePlugin *self,
+                                            FlMethodCall *method_call) {
+  task_detach(respond(self, RefPtr<FlMethodCall>::ref(method_call)));
 }
 
 static void biometric_storage_plugin_dispose(GObject* object) {
+  BiometricStoragePlugin* self = BIOMETRIC_STORAGE_PLUGIN(object);
+  if (self->cancellable != nullptr) {
+    g_cancellable_cancel(self->cancellable);
+    g_clear_object(&self->cancellable);
+  }
+  // Waits for running jobs, their coroutines hold a reference to the plugin
+  // so there are none left by the time we get here.
+  delete self->thread_pool;
+  self->thread_pool = nullptr;
+  if (self->progress_channel != nullptr) {
+    fl_event_channel_set_stream_handlers(self->progress_channel, nullptr,
+                                         nullptr, nullptr, nullptr);
+    g_clear_object(&self->progress_channel);
+  }
+  g_clear_pointer(&self->batches, g_hash_table_unref);
+  if (self->replay_source_id != 0) {
+    g_source_remove(self->replay_source_id);
+    self->replay_source_id = 0;
+  }
+  if (self->secrets_watch_id != 0) {
+    g_bus_unwatch_name(self->secrets_watch_id);
+    self->secrets_watch_id = 0;
+  }
+  delete self->offline_queue;
+  self->offline_queue = nullptr;
+  g_clear_pointer(&self->offline_queue_names, g_hash_table_unref);
+  g_clear_pointer(&self->unlock_lanes, g_hash_table_unref);
+  if (self->migration != nullptr && self->migration->start_source_id != 0) {
+    g_source_remove(self->migration->start_source_id);
+  }
+  delete self->migration;
+  self->migration = nullptr;
+  if (self->warm_start != nullptr) {
+    warm_start_flush(self);
+    delete self->warm_start;
+    self->warm_start = nullptr;
+  }
+  delete self->router;
+  self->router = nullptr;
+  delete self->change_log;
+  self->change_log = nullptr;
+  delete self->file_backend;
+  self->file_backend = nullptr;
+  delete self->credentials;
+  self->credentials = nullptr;
+  delete self->prefetching;
+  self->prefetching = nullptr;
+  for (HotKeys *&hot_keys : self->hot_keys) {
+    delete hot_keys;
+    hot_keys = nullptr;
+  }
+  biometric_buffer_free_unclaimed();
+  biometric_buffer_wipe_acquired();
   G_OBJECT_CLASS(biometric_storage_plugin_parent_class)->dispose(object);
 }
 
@@ -192,7 +373,29 @@ static void biometric_storage_plugin_class_init(BiometricStoragePluginClass* kla
   G_OBJECT_CLASS(klass)->dispose = biometric_storage_plugin_dispose;
 }
 
-static void biometric_storage_plugin_init(BiometricStoragePlugin* self) {}
+static void biometric_storage_plugin_init(BiometricStoragePlugin* self) {
+  self->cancellable = g_cancellable_new();
+  self->batches = g_hash_table_new(g_int64_hash, g_int64_equal);
+  self->offline_queue_names =
+      g_hash_table_new_full(g_str_hash, g_str_equal, g_free, nullptr);
+  self->unlock_lanes = g_hash_table_new_full(
+      g_str_hash, g_str_equal, g_free,
+      [](gpointer lane) { delete static_cast<UnlockLane *>(lane); });
+  self->migration = new Migration();
+  self->warm_start = new WarmStart();
+  self->file_backend = new FileBackend();
+  self->prefetching = new Prefetching();
+  const gchar *credentials_directory = g_getenv("CREDENTIALS_DIRECTORY");
+  if (credentials_directory != nullptr && *credentials_directory != '\0') {
+    self->credentials = new CredentialsBackend(credentials_directory);
+  } else {
+    self->file_backend->portal = biometric_portal_enabled();
+  }
+  for (HotKeys *&hot_keys : self->hot_keys) {
+    hot_keys = new HotKeys(kHotKeysWidth, kHotKeysDepth, kHotKeysTopK,
+                           kHotKeysHalfLifeSeconds * G_USEC_PER_SEC);
+  }
+}
 
 static void method_call_cb(FlMethodChannel* channel, FlMethodCall* method_call,
                            gpointer user_data) {
@@ -200,6 +403,51 @@ static void method_call_cb(FlMethodChannel* channel, FlMethodCall* method_call,
   biometric_storage_plugin_handle_method_call(plugin, method_call);
 }
 
+// Called when the engine shuts down and drops the method channel. Pending
+// method calls and background work (migration, offline queue replay,
+// prefetches, snapshot saves) hold references to the plugin, so it cannot
+// be disposed before they are done. Cancelling here makes them finish right
+// away, and nothing new is started.
+static void method_channel_closed_cb(gpointer user_data) {
+  BiometricStoragePlugin *self = BIOMETRIC_STORAGE_PLUGIN(user_data);
+  g_cancellable_cancel(self->cancellable);
+  if (self->migration->start_source_id != 0) {
+    g_source_remove(self->migration->start_source_id);
+    self->migration->start_source_id = 0;
+  }
+  if (self->replay_source_id != 0) {
+    g_source_remove(self->replay_source_id);
+    self->replay_source_id = 0;
+  }
+  if (self->secrets_watch_id != 0) {
+    g_bus_unwatch_name(self->secrets_watch_id);
+    self->secrets_watch_id = 0;
+  }
+  g_object_unref(self);
+}
+
+static FlMethodErrorResponse *progress_listen_cb(FlEventChannel *channel,
+                                                 FlValue *args,
+                                                 gpointer user_data) {
+  BIOMETRIC_STORAGE_PLUGIN(user_data)->progress_listening = TRUE;
+  return nullptr;
+}
+
+static FlMethodErrorResponse *progress_cancel_cb(FlEventChannel *channel,
+                                                 FlValue *args,
+                                                 gpointer user_data) {
+  BiometricStoragePlugin *self = BIOMETRIC_STORAGE_PLUGIN(user_data);
+  self->progress_listening = FALSE;
+  // Wake up items waiting for acknowledgements which will not come anymore.
+  GHashTableIter iter;
+  gpointer batch;
+  g_hash_table_iter_init(&iter, self->batches);
+  while (g_hash_table_iter_next(&iter, nullptr, &batch)) {
+    static_cast<Batch *>(batch)->changed.notify_all();
+  }
+  return nullptr;
+}
+
 void biometric_storage_plugin_register_with_registrar(FlPluginRegistrar* registrar) {
   BiometricStoragePlugin* plugin = BIOMETRIC_STORAGE_PLUGIN(
       g_object_new(biometric_storage_plugin_get_type(), nullptr));
@@ -211,7 +459,18 @@ void biometric_storage_plugin_register_with_registrar(FlPluginRegistrar* registr
                             FL_METHOD_CODEC(codec));
   fl_method_channel_set_method_call_handler(channel, method_call_cb,
                                             g_object_ref(plugin),
-                                            g_object_unref);
+                                            method_channel_closed_cb);
+
+  // Owned by the plugin, which clears the handlers on dispose.
+  plugin->progress_channel = fl_event_channel_new(
+      fl_plugin_registrar_get_messenger(registrar), kProgressChannel,
+      FL_METHOD_CODEC(codec));
+  fl_event_channel_set_stream_handlers(plugin->progress_channel,
+                                       progress_listen_cb, progress_cancel_cb,
+                                       plugin, nullptr);
 
   g_object_unref(plugin);
+#ifdef BIOMETRIC_STORAGE_BENCHMARKS
+  biometric_storage_plugin_trace("plugin_registered");
+#endif
 }
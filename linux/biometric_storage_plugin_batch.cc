@@ -0,0 +1,252 @@
+#include "biometric_storage_plugin_internal.h"
+
+#include <map>
+
+// Items of one batch operation which are processed concurrently.
+const guint kBatchConcurrency = 8;
+// Progress events of a batch which may be sent before dart acknowledged
+// them with `batchAck`, further items wait until it does.
+const gint64 kBatchMaxUnacked = 64;
+
+// State of a running `batch` call, see handlePipeline().
+struct Pipeline {
+  FlValue *operations;
+  // Response of each operation, empty until it finished.
+  std::vector<RefPtr<FlMethodResponse>> responses;
+  // Index of the previous operation on the same storage, -1 if there is
+  // none.
+  std::vector<gint64> previous;
+  // Lowest index of an operation which did not finish yet.
+  gsize first_pending = 0;
+  guint running = 0;
+  // Notified whenever an operation finished.
+  AsyncCondition changed;
+};
+
+// Sends a progress event, waiting while too many events of the batch are
+// unacknowledged. Events are dropped while nobody listens.
+static Task<> send_progress(BiometricStoragePlugin *self, Batch *batch,
+                            FlValue *event) {
+  while (self->progress_listening &&
+         batch->sent - batch->acked >= kBatchMaxUnacked) {
+    co_await batch->changed.wait();
+  }
+  if (!self->progress_listening) {
+    co_return;
+  }
+  batch->sent++;
+  GError *error = NULL;
+  if (!fl_event_channel_send(self->progress_channel, event, nullptr,
+                             &error)) {
+    g_warning("Failed to send progress event: %s", error->message);
+    g_error_free(error);
+  }
+}
+
+// The error of an item of a batch as sent to dart, which turns it into the
+// same exception as the error of a single item call.
+static FlValue *error_value(FlMethodErrorResponse *error_response) {
+  FlValue *details = fl_method_error_response_get_details(error_response);
+  FlValue *error = fl_value_new_map();
+  fl_value_set_string_take(
+      error, "code",
+      fl_value_new_string(fl_method_error_response_get_code(error_response)));
+  fl_value_set_string_take(
+      error, "message",
+      fl_value_new_string(fl_method_error_response_get_message(error_response)));
+  fl_value_set_string_take(
+      error, "details",
+      details != nullptr ? fl_value_ref(details) : fl_value_new_null());
+  return error;
+}
+
+static Task<> run_batch_item(BiometricStoragePlugin *self, Batch *batch,
+                             gint64 index, RefPtr<FlValue> name) {
+  RefPtr<FlValue> args = RefPtr<FlValue>::adopt(fl_value_new_map());
+  fl_value_set_string(args.get(), "name", name.get());
+  RefPtr<FlMethodResponse> response =
+      co_await batch->handler(self, args.get());
+  batch->done++;
+
+  RefPtr<FlValue> event = RefPtr<FlValue>::adopt(fl_value_new_map());
+  fl_value_set_string_take(event.get(), "batchId", fl_value_new_int(batch->id));
+  fl_value_set_string_take(event.get(), "index", fl_value_new_int(index));
+  fl_value_set_string(event.get(), "name", name.get());
+  fl_value_set_string_take(event.get(), "done", fl_value_new_int(batch->done));
+  fl_value_set_string_take(event.get(), "total",
+                           fl_value_new_int(batch->total));
+  if (FL_IS_METHOD_SUCCESS_RESPONSE(response.get())) {
+    fl_value_set_string(event.get(), "value",
+                        fl_method_success_response_get_result(
+                            FL_METHOD_SUCCESS_RESPONSE(response.get())));
+  } else {
+    batch->failed++;
+    fl_value_set_string_take(
+        event.get(), "error",
+        error_value(FL_METHOD_ERROR_RESPONSE(response.get())));
+  }
+  co_await send_progress(self, batch, event.get());
+
+  batch->running--;
+  batch->changed.notify_all();
+}
+
+Task<RefPtr<FlMethodResponse>> handleBatch(BiometricStoragePlugin *self,
+                                           FlValue *args,
+                                           ItemHandler handler) {
+  FlValue *batch_id = lookup_typed(args, "batchId", FL_VALUE_TYPE_INT);
+  FlValue *names = lookup_typed(args, "names", FL_VALUE_TYPE_LIST);
+  if (batch_id == nullptr || names == nullptr) {
+    co_return bad_arguments("Expected batchId and a list of names");
+  }
+  for (size_t i = 0; i < fl_value_get_length(names); i++) {
+    if (fl_value_get_type(fl_value_get_list_value(names, i)) !=
+        FL_VALUE_TYPE_STRING) {
+      co_return bad_arguments("Storage names must be strings");
+    }
+  }
+
+  Batch batch;
+  batch.id = fl_value_get_int(batch_id);
+  batch.handler = handler;
+  batch.total = fl_value_get_length(names);
+  if (g_hash_table_contains(self->batches, &batch.id)) {
+    co_return bad_arguments("A batch with this id is already running");
+  }
+  g_hash_table_insert(self->batches, &batch.id, &batch);
+
+  for (gint64 i = 0; i < batch.total; i++) {
+    while (batch.running >= kBatchConcurrency) {
+      co_await batch.changed.wait();
+    }
+    batch.running++;
+    task_detach(run_batch_item(
+        self, &batch, i,
+        RefPtr<FlValue>::ref(fl_value_get_list_value(names, i))));
+  }
+  while (batch.running > 0) {
+    co_await batch.changed.wait();
+  }
+  g_hash_table_remove(self->batches, &batch.id);
+
+  FlValue *result = fl_value_new_map();
+  fl_value_set_string_take(result, "total", fl_value_new_int(batch.total));
+  fl_value_set_string_take(result, "failed", fl_value_new_int(batch.failed));
+  co_return success_response_take(result);
+}
+
+static Task<> run_pipeline_operation(BiometricStoragePlugin *self,
+                                     Pipeline *pipeline, gsize index) {
+  PipelineStats *stats = &self->pipeline_stats;
+  FlValue *operation = fl_value_get_list_value(pipeline->operations, index);
+  FlValue *barrier = lookup_typed(operation, "barrier", FL_VALUE_TYPE_BOOL);
+  gboolean after_all = barrier != nullptr && fl_value_get_bool(barrier);
+  gint64 previous = pipeline->previous[index];
+  gboolean waited = FALSE;
+  while ((after_all && pipeline->first_pending < index) ||
+         (previous >= 0 && !pipeline->responses[previous])) {
+    waited = TRUE;
+    co_await pipeline->changed.wait();
+  }
+  if (waited) {
+    stats->dependency_waits++;
+  }
+  const gchar *method = fl_value_get_string(
+      lookup_typed(operation, "method", FL_VALUE_TYPE_STRING));
+  ItemHandler handler = IS_METHOD(method, kMethodRead)    ? handleRead
+                        : IS_METHOD(method, kMethodWrite) ? handleWrite
+                                                          : handleDelete;
+  RefPtr<FlMethodResponse> response = co_await handler(self, operation);
+  if (!FL_IS_METHOD_SUCCESS_RESPONSE(response.get())) {
+    stats->failed++;
+  }
+  pipeline->responses[index] = response;
+  while (pipeline->first_pending < pipeline->responses.size() &&
+         pipeline->responses[pipeline->first_pending]) {
+    pipeline->first_pending++;
+  }
+  pipeline->running--;
+  pipeline->changed.notify_all();
+}
+
+Task<RefPtr<FlMethodResponse>> handlePipeline(
+    BiometricStoragePlugin *self, FlValue *args) {
+  FlValue *operations = lookup_typed(args, "operations", FL_VALUE_TYPE_LIST);
+  if (operations == nullptr) {
+    co_return bad_arguments("Expected a list of operations");
+  }
+  Pipeline pipeline;
+  pipeline.operations = operations;
+  gsize count = fl_value_get_length(operations);
+  std::map<std::string, gint64> last;
+  for (gsize i = 0; i < count; i++) {
+    FlValue *operation = fl_value_get_list_value(operations, i);
+    FlValue *method = lookup_typed(operation, "method", FL_VALUE_TYPE_STRING);
+    FlValue *name = lookup_typed(operation, "name", FL_VALUE_TYPE_STRING);
+    const gchar *method_name =
+        method != nullptr ? fl_value_get_string(method) : "";
+    if (name == nullptr || (strcmp(method_name, kMethodRead) != 0 &&
+                            strcmp(method_name, kMethodWrite) != 0 &&
+                            strcmp(method_name, kMethodDelete) != 0)) {
+      co_return bad_arguments(
+          "Operations must have a name and a method of read, write or "
+          "delete");
+    }
+    if (strcmp(method_name, kMethodWrite) == 0 &&
+        lookup_typed(operation, "content", FL_VALUE_TYPE_STRING) == nullptr) {
+      co_return bad_arguments("Writes must have a content string");
+    }
+    auto found = last.find(fl_value_get_string(name));
+    pipeline.previous.push_back(found != last.end() ? found->second : -1);
+    last[fl_value_get_string(name)] = i;
+  }
+  pipeline.responses.resize(count);
+  PipelineStats *stats = &self->pipeline_stats;
+  stats->calls++;
+  stats->operations += count;
+
+  for (gsize i = 0; i < count; i++) {
+    while (pipeline.running >= kBatchConcurrency) {
+      co_await pipeline.changed.wait();
+    }
+    pipeline.running++;
+    task_detach(run_pipeline_operation(self, &pipeline, i));
+  }
+  while (pipeline.running > 0) {
+    co_await pipeline.changed.wait();
+  }
+
+  FlValue *result = fl_value_new_list();
+  for (RefPtr<FlMethodResponse> &response : pipeline.responses) {
+    FlValue *entry = fl_value_new_map();
+    if (FL_IS_METHOD_SUCCESS_RESPONSE(response.get())) {
+      fl_value_set_string(entry, "value",
+                          fl_method_success_response_get_result(
+                              FL_METHOD_SUCCESS_RESPONSE(response.get())));
+    } else {
+      fl_value_set_string_take(
+          entry, "error",
+          error_value(FL_METHOD_ERROR_RESPONSE(response.get())));
+    }
+    fl_value_append_take(result, entry);
+  }
+  co_return success_response_take(result);
+}
+
+FlMethodResponse *handleBatchAck(BiometricStoragePlugin *self,
+                                 FlValue *args) {
+  FlValue *batch_id = lookup_typed(args, "batchId", FL_VALUE_TYPE_INT);
+  FlValue *count = lookup_typed(args, "count", FL_VALUE_TYPE_INT);
+  if (batch_id == nullptr || count == nullptr) {
+    return FL_METHOD_RESPONSE(fl_method_error_response_new(
+        kBadArgumentsError, "Expected batchId and count", nullptr));
+  }
+  gint64 id = fl_value_get_int(batch_id);
+  Batch *batch = static_cast<Batch *>(g_hash_table_lookup(self->batches, &id));
+  if (batch != nullptr) {
+    batch->acked = MAX(batch->acked, fl_value_get_int(count));
+    batch->changed.notify_all();
+  }
+  g_autoptr(FlValue) result = fl_value_new_bool(batch != nullptr);
+  return FL_METHOD_RESPONSE(fl_method_success_response_new(result));
+}
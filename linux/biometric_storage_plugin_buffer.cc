@@ -0,0 +1,105 @@
+#include "biometric_storage_plugin_internal.h"
+
+#include "biometric_storage_buffer.h"
+
+// Copies `length` bytes of `data` into a new locked buffer and registers it,
+// see biometric_storage_buffer.h. Large secrets are copied on the thread pool.
+static Task<RefPtr<FlMethodResponse>> buffer_response(
+    BiometricStoragePlugin *self, const gchar *data, gsize length) {
+  guint8 *buffer = biometric_buffer_new(length);
+  if (buffer == nullptr) {
+    co_return RefPtr<FlMethodResponse>::adopt(
+        FL_METHOD_RESPONSE(fl_method_error_response_new(
+            kSecurityAccessError, "Failed to allocate secret buffer",
+            nullptr)));
+  }
+  co_await offload(self, length, [&] {
+    memcpy(buffer, data, length);
+    return true;
+  });
+  FlValue *result = fl_value_new_map();
+  fl_value_set_string_take(result, "handle",
+                           fl_value_new_int(biometric_buffer_register(buffer)));
+  fl_value_set_string_take(result, "length", fl_value_new_int(length));
+  co_return success_response_take(result);
+}
+
+Task<RefPtr<FlMethodResponse>> handleReadBuffer(
+    BiometricStoragePlugin *self, FlValue *args) {
+  GAutoFree<gchar> name(item_name(args));
+  if (self->credentials != nullptr) {
+    SecretPtr stored;
+    RefPtr<FlMethodResponse> error_response;
+    if (!co_await credentials_read(self, name.get(), &stored,
+                                   &error_response)) {
+      co_return error_response;
+    }
+    if (stored == nullptr) {
+      co_return success_response_take(fl_value_new_null());
+    }
+    co_return co_await buffer_response(self, stored.get(),
+                                       strlen(stored.get()));
+  }
+  prefetch_observe(self, name.get());
+  StorageTier tier = plugin_router(self)->route_read(name.get());
+  if (tier != StorageTier::kSecretService) {
+    SecretPtr stored;
+    RefPtr<FlMethodResponse> error_response;
+    if (!co_await tier_read(self, name.get(), tier, &stored,
+                            &error_response)) {
+      co_return error_response;
+    }
+    if (stored == nullptr) {
+      co_return success_response_take(fl_value_new_null());
+    }
+    co_return co_await buffer_response(self, stored.get(),
+                                       strlen(stored.get()));
+  }
+  SecretPtr queued;
+  GError *queue_error = NULL;
+  if (offline_queue_lookup(self, name.get(), &queued, &queue_error)) {
+    if (queue_error != NULL) {
+      RefPtr<FlMethodResponse> response = RefPtr<FlMethodResponse>::adopt(
+          biometric_storage_handle_error("Failed to read secret",
+                                         queue_error));
+      g_error_free(queue_error);
+      co_return response;
+    }
+    if (queued == nullptr) {
+      co_return success_response_take(fl_value_new_null());
+    }
+    co_return co_await buffer_response(self, queued.get(),
+                                       strlen(queued.get()));
+  }
+  SecretPtr cached;
+  if (co_await warm_start_lookup(self, name.get(), &cached)) {
+    co_return co_await buffer_response(self, cached.get(),
+                                       strlen(cached.get()));
+  }
+  SecretPtr prefetched;
+  if (co_await prefetch_take(self, name.get(), &prefetched)) {
+    co_return co_await buffer_response(self, prefetched.get(),
+                                       strlen(prefetched.get()));
+  }
+
+  GError *error = NULL;
+  SecretValue *value = co_await lookup_secret(self, name.get(), &error);
+  if (error != NULL) {
+    RefPtr<FlMethodResponse> response = RefPtr<FlMethodResponse>::adopt(
+        biometric_storage_handle_error("Failed to lookup secret", error));
+    g_error_free(error);
+    co_return response;
+  }
+  if (value == NULL) {
+    g_warning("Failed to lookup password (not found).");
+    co_await warm_start_update(self, name.get(), nullptr, 0);
+    co_return success_response_take(fl_value_new_null());
+  }
+  gsize length;
+  const gchar *data = secret_content(value, &length);
+  co_await warm_start_update(self, name.get(), data, length);
+  RefPtr<FlMethodResponse> response =
+      co_await buffer_response(self, data, length);
+  secret_value_unref(value);
+  co_return response;
+}
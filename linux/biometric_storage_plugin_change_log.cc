@@ -0,0 +1,71 @@
+#include "biometric_storage_plugin_internal.h"
+
+// Lines of the change log which trigger a compaction, see ChangeLog.
+const gsize kChangeLogMaxRecords = 4096;
+
+// One change log per name prefix, apps sharing $XDG_DATA_HOME do not see
+// each other's changes.
+static gchar *change_log_path() {
+  g_autofree gchar *file_name = g_strconcat(kNamePrefix, ".log", NULL);
+  return g_build_filename(g_get_user_data_dir(), "biometric_storage",
+                          "changes", file_name, NULL);
+}
+
+static ChangeLog *plugin_change_log(BiometricStoragePlugin *self) {
+  if (self->change_log == nullptr) {
+    g_autofree gchar *path = change_log_path();
+    self->change_log = new ChangeLog(path, kChangeLogMaxRecords);
+  }
+  return self->change_log;
+}
+
+void change_log_record(BiometricStoragePlugin *self, FlValue *args,
+                       gboolean deleted) {
+  GError *error = NULL;
+  if (!plugin_change_log(self)->record(
+          fl_value_get_string(fl_value_lookup_string(args, "name")), deleted,
+          &error)) {
+    g_warning("Failed to record change: %s", error->message);
+    g_error_free(error);
+  }
+}
+
+FlMethodResponse *handleChangesSince(BiometricStoragePlugin *self,
+                                     FlValue *args) {
+  FlValue *generation = lookup_typed(args, "generation", FL_VALUE_TYPE_INT);
+  FlValue *epoch = lookup_typed(args, "epoch", FL_VALUE_TYPE_STRING);
+  if (generation == nullptr || fl_value_get_int(generation) < 0) {
+    return FL_METHOD_RESPONSE(fl_method_error_response_new(
+        kBadArgumentsError, "Expected a generation", nullptr));
+  }
+  ChangeLog *change_log = plugin_change_log(self);
+  std::vector<ChangeLog::Entry> changes;
+  gboolean reset;
+  g_autoptr(GError) error = NULL;
+  if (!change_log->changes_since(
+          fl_value_get_int(generation),
+          epoch != nullptr ? fl_value_get_string(epoch) : nullptr, &changes,
+          &reset, &error)) {
+    return biometric_storage_handle_error("Failed to read change log", error);
+  }
+  g_autoptr(FlValue) result = fl_value_new_map();
+  fl_value_set_string_take(result, "epoch",
+                           fl_value_new_string(change_log->epoch().c_str()));
+  fl_value_set_string_take(result, "generation",
+                           fl_value_new_int(change_log->generation()));
+  fl_value_set_string_take(result, "reset", fl_value_new_bool(reset));
+  FlValue *list = fl_value_new_list();
+  for (const ChangeLog::Entry &entry : changes) {
+    FlValue *change = fl_value_new_map();
+    fl_value_set_string_take(change, "name",
+                             fl_value_new_string(entry.name.c_str()));
+    fl_value_set_string_take(
+        change, "change",
+        fl_value_new_string(ChangeLog::change_name(entry.change)));
+    fl_value_set_string_take(change, "generation",
+                             fl_value_new_int(entry.generation));
+    fl_value_append_take(list, change);
+  }
+  fl_value_set_string_take(result, "changes", list);
+  return FL_METHOD_RESPONSE(fl_method_success_response_new(result));
+}
@@ -0,0 +1,84 @@
+#include "biometric_storage_plugin_internal.h"
+
+// Path of the overlay of the credentials backend, in the state directory of
+// the service if it has one.
+static gchar *credentials_overlay_path() {
+  const gchar *state_directory = g_getenv("STATE_DIRECTORY");
+  if (state_directory != nullptr && *state_directory != '\0') {
+    g_auto(GStrv) directories = g_strsplit(state_directory, ":", 2);
+    return g_build_filename(directories[0], "credentials_overlay.log", NULL);
+  }
+  return g_build_filename(g_get_user_data_dir(), "biometric_storage",
+                          "credentials_overlay.log", NULL);
+}
+
+Task<CredentialStore *> credentials_open(BiometricStoragePlugin *self,
+                                         GError **error) {
+  CredentialsBackend *backend = self->credentials;
+  while (backend->opening) {
+    co_await backend->opened.wait();
+  }
+  if (backend->store != nullptr) {
+    co_return backend->store;
+  }
+  backend->opening = TRUE;
+  GError *local_error = NULL;
+  GAutoFree<gchar> path(credentials_overlay_path());
+  CredentialStore *store =
+      new CredentialStore(backend->directory, plugin_thread_pool(self));
+  gboolean opened = co_await run_on(plugin_thread_pool(self), [&] {
+    return store->open(path.get(), &local_error);
+  });
+  if (opened) {
+    backend->store = store;
+  } else {
+    delete store;
+  }
+  backend->opening = FALSE;
+  backend->opened.notify_all();
+  if (local_error != NULL) {
+    g_propagate_error(error, local_error);
+  }
+  co_return backend->store;
+}
+
+Task<RefPtr<FlMethodResponse>> credentials_write(
+    BiometricStoragePlugin *self, const gchar *name, const gchar *content) {
+  GError *error = NULL;
+  CredentialStore *store = co_await credentials_open(self, &error);
+  if (store != nullptr && co_await store->put(name, content, &error)) {
+    co_return success_response_take(fl_value_new_bool(true));
+  }
+  RefPtr<FlMethodResponse> response = RefPtr<FlMethodResponse>::adopt(
+      biometric_storage_handle_error("Failed to store secret", error));
+  g_error_free(error);
+  co_return response;
+}
+
+Task<RefPtr<FlMethodResponse>> credentials_delete(
+    BiometricStoragePlugin *self, const gchar *name) {
+  GError *error = NULL;
+  CredentialStore *store = co_await credentials_open(self, &error);
+  bool existed = false;
+  if (store != nullptr && co_await store->remove(name, &existed, &error)) {
+    co_return success_response_take(fl_value_new_bool(existed));
+  }
+  RefPtr<FlMethodResponse> response = RefPtr<FlMethodResponse>::adopt(
+      biometric_storage_handle_error("Failed to delete secret", error));
+  g_error_free(error);
+  co_return response;
+}
+
+Task<gboolean> credentials_read(BiometricStoragePlugin *self,
+                                const gchar *name, SecretPtr *content,
+                                RefPtr<FlMethodResponse> *response) {
+  GError *error = NULL;
+  CredentialStore *store = co_await credentials_open(self, &error);
+  if (store != nullptr && store->lookup(name, content, &error)) {
+    co_return TRUE;
+  }
+  *response = RefPtr<FlMethodResponse>::adopt(
+      biometric_storage_handle_error("Failed to lookup secret", error));
+  g_error_free(error);
+  co_return FALSE;
+}
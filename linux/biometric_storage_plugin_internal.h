@@ -0,0 +1,657 @@
+#ifndef FLUTTER_PLUGIN_BIOMETRIC_STORAGE_PLUGIN_INTERNAL_H_
+#define FLUTTER_PLUGIN_BIOMETRIC_STORAGE_PLUGIN_INTERNAL_H_
+
+#include <flutter_linux/flutter_linux.h>
+#include <libsecret/secret.h>
+#include <string.h>
+
+#include <string>
+#include <vector>
+
+#include "biometric_storage_async.h"
+#include "biometric_storage_change_log.h"
+#include "biometric_storage_credentials.h"
+#include "biometric_storage_envelope.h"
+#include "biometric_storage_file_store.h"
+#include "biometric_storage_hot_keys.h"
+#include "biometric_storage_offline_queue.h"
+#include "biometric_storage_plugin_private.h"
+#include "biometric_storage_prefetch.h"
+#include "biometric_storage_router.h"
+#include "biometric_storage_snapshot.h"
+#include "biometric_storage_thread_pool.h"
+
+// State of the plugin and the helpers its translation units share. The
+// method dispatch lives in biometric_storage_plugin.cc, the glue driving
+// each module in biometric_storage_plugin_<subsystem>.cc.
+
+#define BIOMETRIC_SCHEMA  biometric_get_schema ()
+
+const char kBadArgumentsError[] = "Bad Arguments";
+const char kSecurityAccessError[] = "Security Access Error";
+const char kMethodRead[] = "read";
+const char kMethodWrite[] = "write";
+const char kMethodDelete[] = "delete";
+const char kMethodStats[] = "stats";
+const char kMethodReadMany[] = "readMany";
+const char kMethodDeleteMany[] = "deleteMany";
+const char kMethodBatchAck[] = "batchAck";
+const char kMethodBatch[] = "batch";
+const char kMethodFindByTags[] = "findByTags";
+const char kMethodReadBuffer[] = "readBuffer";
+const char kMethodReadSnapshot[] = "readSnapshot";
+const char kMethodSetTierPolicy[] = "setTierPolicy";
+const char kMethodChangesSince[] = "changesSince";
+
+// Optional indexed attributes of an item, set by `write` and matched by
+// `findByTags`.
+const char *const kTagAttributes[] = {"account", "kind", "sensitivity"};
+const char kNamePrefix[] = BIOMETRIC_NAME_PREFIX;
+
+// Bounds of the warm start snapshot, see Snapshot.
+const gsize kSnapshotMaxEntries = 64;
+const gsize kSnapshotMaxBytes = 1024 * 1024;
+
+// Speculative reads of the storages which usually follow a read, see
+// Prefetcher.
+const gint64 kPrefetchWindowMs = 1000;
+const gsize kPrefetchMaxSources = 64;
+const gsize kPrefetchMaxSuccessors = 4;
+const guint32 kPrefetchMinObservations = 3;
+const guint32 kPrefetchMinConfidencePercent = 50;
+const gsize kPrefetchMaxEntries = 16;
+const gsize kPrefetchMaxBytes = 1024 * 1024;
+const gint64 kPrefetchTtlSeconds = 5;
+
+// Access telemetry per operation, see HotKeys. 4 KiB of counters each.
+const gsize kHotKeysWidth = 256;
+const gsize kHotKeysDepth = 4;
+const gsize kHotKeysTopK = 8;
+const gint64 kHotKeysHalfLifeSeconds = 300;
+// Operations counted in `hot_keys`, in order.
+const char *const kHotKeyOperations[] = {"read", "write", "delete"};
+
+#define BIOMETRIC_STORAGE_PLUGIN(obj) \
+  (G_TYPE_CHECK_INSTANCE_CAST((obj), biometric_storage_plugin_get_type(), \
+                              BiometricStoragePlugin))
+
+#define IS_METHOD(name, equals) \
+  strcmp(method, equals) == 0
+
+// Errors detected by the plugin itself, reported with their own error code
+// instead of kSecurityAccessError.
+#define BIOMETRIC_STORAGE_ERROR biometric_storage_error_quark()
+enum BiometricStorageError {
+  // The secret does not match its checksum attribute.
+  BIOMETRIC_STORAGE_ERROR_CORRUPTED,
+};
+GQuark biometric_storage_error_quark(void);
+
+// Lookups of secrets, with the time spent waiting on unlock prompts kept
+// apart from the time the Secret Service took.
+struct LookupStats {
+  guint64 lookups;
+  guint64 prompts_shown;
+  guint64 prompts_coalesced;
+  guint64 prompts_dismissed;
+  // Lookups currently waiting on a prompt.
+  guint64 waiting;
+  guint64 prompt_waits;
+  gint64 prompt_wait_total_us;
+  gint64 prompt_wait_max_us;
+  gint64 service_time_total_us;
+  gint64 service_time_max_us;
+};
+
+// Secrets checked against their checksum attribute. Items written before
+// checksums were stored have none.
+struct IntegrityStats {
+  guint64 verified;
+  guint64 unchecked;
+  guint64 corrupted;
+};
+
+struct PipelineStats {
+  guint64 calls;
+  guint64 operations;
+  guint64 failed;
+  // Operations which waited for an earlier one they depend on.
+  guint64 dependency_waits;
+};
+
+struct ReadSnapshotStats {
+  guint64 reads;
+  // Attempts which saw an item change while reading, and calls which gave
+  // up after kReadSnapshotMaxAttempts of them.
+  guint64 torn_reads;
+  guint64 conflicts;
+};
+
+// State of the migration of legacy items. `completed` and `migrated` are
+// persisted in the checkpoint file, see migration_save_checkpoint().
+struct Migration {
+  gboolean loaded = FALSE;
+  gboolean scheduled = FALSE;
+  gboolean completed = FALSE;
+  gboolean running = FALSE;
+  guint start_source_id = 0;
+  guint64 migrated = 0;
+  // Items of locked collections left for the next run, the migration never
+  // shows an unlock prompt.
+  guint64 skipped_locked = 0;
+  guint64 fallthrough_reads = 0;
+  gint64 busy_us = 0;
+  gint64 throttled_us = 0;
+  // Name of the item being migrated, and whether it was written or deleted
+  // in the meantime.
+  std::string current;
+  gboolean current_touched = FALSE;
+  // Method calls in progress, the migration waits until there are none.
+  guint foreground_calls = 0;
+  AsyncCondition foreground_idle;
+};
+
+// Warm start snapshot of the storages initialized with `linuxWarmStart`.
+// Loaded once the first of them is initialized, reads of them wait until it
+// is and are then served from the snapshot while it is revalidated against
+// the keyring.
+struct WarmStart {
+  Snapshot snapshot{kSnapshotMaxEntries, kSnapshotMaxBytes};
+  // Item names of the storages in the snapshot.
+  GHashTable *names =
+      g_hash_table_new_full(g_str_hash, g_str_equal, g_free, nullptr);
+  gboolean load_started = FALSE;
+  gboolean loaded = FALSE;
+  AsyncCondition load_done;
+  guint save_source_id = 0;
+  gboolean saving = FALSE;
+
+  ~WarmStart() { g_hash_table_unref(names); }
+};
+
+// Storages routed to StorageTier::kFile, kept in a FileStore instead of the
+// keyring. The store is opened on first use, see file_store_open().
+struct FileBackend {
+  FileStore *store = nullptr;
+  gboolean opening = FALSE;
+  AsyncCondition opened;
+
+  // Whether the key comes from the Secret portal, which also makes the
+  // file store the default tier. See biometric_storage_portal.h.
+  gboolean portal = FALSE;
+  guint64 portal_retrievals = 0;
+  guint64 portal_failures = 0;
+  gint64 portal_retrieve_us = 0;
+
+  ~FileBackend() { delete store; }
+};
+
+// All storages when the app runs as a systemd service with credentials, see
+// CredentialStore. The keyring is not used at all then. The store is opened
+// on first use, see credentials_open().
+struct CredentialsBackend {
+  explicit CredentialsBackend(const gchar *directory)
+      : directory(g_strdup(directory)) {}
+  ~CredentialsBackend() {
+    delete store;
+    g_free(directory);
+  }
+
+  gchar *directory;
+  CredentialStore *store = nullptr;
+  gboolean opening = FALSE;
+  AsyncCondition opened;
+};
+
+// Storages initialized with `linuxPrefetch`. Reads of them are learned and
+// the likely next ones fetched ahead, see prefetch_observe().
+struct Prefetching {
+  Prefetcher prefetcher{{
+      kPrefetchWindowMs * 1000,
+      kPrefetchMaxSources,
+      kPrefetchMaxSuccessors,
+      kPrefetchMinObservations,
+      kPrefetchMinConfidencePercent,
+      kPrefetchMaxEntries,
+      kPrefetchMaxBytes,
+      kPrefetchTtlSeconds * G_USEC_PER_SEC,
+  }};
+  GHashTable *names =
+      g_hash_table_new_full(g_str_hash, g_str_equal, g_free, nullptr);
+
+  ~Prefetching() { g_hash_table_unref(names); }
+};
+
+struct _BiometricStoragePlugin {
+  GObject parent_instance;
+
+  // Cancelled when the engine shuts down, aborts all pending keyring
+  // operations. See method_channel_closed_cb().
+  GCancellable *cancellable;
+
+  // Created on first use, see plugin_thread_pool().
+  ThreadPool *thread_pool;
+
+  // Progress events of batch operations, only sent while dart listens.
+  FlEventChannel *progress_channel;
+  gboolean progress_listening;
+  // Running batch operations, Batch by id.
+  GHashTable *batches;
+
+  // Item names of storages initialized with `linuxOfflineQueue`.
+  GHashTable *offline_queue_names;
+  // Created on first use, see plugin_offline_queue().
+  OfflineQueue *offline_queue;
+  guint secrets_watch_id;
+  guint replay_source_id;
+  guint replay_backoff_seconds;
+  gboolean replaying;
+
+  // Hybrid logical clock of the generations written, see
+  // biometric_generation_new().
+  guint64 generation_clock;
+
+  // UnlockLane by collection object path, see unlock_item().
+  GHashTable *unlock_lanes;
+  LookupStats lookup_stats;
+  IntegrityStats integrity_stats;
+  ReadSnapshotStats read_snapshot_stats;
+  PipelineStats pipeline_stats;
+
+  Migration *migration;
+
+  WarmStart *warm_start;
+
+  // Created on first use, see plugin_router().
+  TierRouter *router;
+
+  // Created on first use, see plugin_change_log().
+  ChangeLog *change_log;
+
+  FileBackend *file_backend;
+
+  // nullptr unless $CREDENTIALS_DIRECTORY is set.
+  CredentialsBackend *credentials;
+
+  Prefetching *prefetching;
+
+  // Accesses of storage names by `read`, `write` and `delete` (including
+  // their batch and buffer variants).
+  HotKeys *hot_keys[G_N_ELEMENTS(kHotKeyOperations)];
+};
+
+template <>
+struct RefTraits<SecretValue> {
+  static SecretValue *ref(SecretValue *ptr) { return secret_value_ref(ptr); }
+  static void unref(SecretValue *ptr) { secret_value_unref(ptr); }
+};
+
+typedef Task<RefPtr<FlMethodResponse>> (*ItemHandler)(
+    BiometricStoragePlugin *self, FlValue *args);
+
+// State of a running readMany/deleteMany call. Owned by handleBatch(), which
+// waits for all of its items before returning.
+struct Batch {
+  gint64 id;
+  ItemHandler handler;
+  gint64 total;
+  gint64 done = 0;
+  gint64 failed = 0;
+  guint running = 0;
+  // Progress events sent, and acknowledged by dart.
+  gint64 sent = 0;
+  gint64 acked = 0;
+  // Notified when an item finished, dart acknowledged events or stopped
+  // listening.
+  AsyncCondition changed;
+};
+
+// Unlock prompt of one collection. Lookups of locked items of the same
+// collection share the prompt in flight instead of queuing another one.
+struct UnlockLane {
+  gboolean prompting = FALSE;
+  // Incremented whenever a prompt finished.
+  guint64 generation = 0;
+  // Outcome of the last prompt, `error` is set if it failed.
+  gboolean unlocked = FALSE;
+  GError *error = nullptr;
+  AsyncCondition done;
+
+  ~UnlockLane() { g_clear_error(&error); }
+};
+
+// Keeps prefetches away from an item while it is written or deleted.
+class PrefetchWrite {
+ public:
+  PrefetchWrite(BiometricStoragePlugin *self, const gchar *name)
+      : prefetcher_(&self->prefetching->prefetcher), name_(name) {
+    prefetcher_->begin_write(name);
+  }
+  ~PrefetchWrite() { prefetcher_->end_write(name_); }
+
+  PrefetchWrite(const PrefetchWrite &) = delete;
+  PrefetchWrite &operator=(const PrefetchWrite &) = delete;
+
+ private:
+  Prefetcher *prefetcher_;
+  const gchar *name_;
+};
+
+// biometric_storage_plugin.cc
+
+// Returns the item name of storage `name`, see kNamePrefix.
+gchar *prefixed_name(const gchar *name);
+// Returns the item name of the storage args["name"].
+gchar *item_name(FlValue *args);
+// Returns an empty attribute table owning its keys and values.
+GHashTable *attributes_new();
+
+// Created on first use.
+ThreadPool *plugin_thread_pool(BiometricStoragePlugin *self);
+
+// Runs `func`, which hashes, seals or copies `length` bytes of secrets, on
+// the thread pool if that pays off (see kOffloadMinSize) and inline
+// otherwise.
+template <typename Func>
+ThreadPoolAwaiter<Func> offload(BiometricStoragePlugin *self, gsize length,
+                                Func func) {
+  return run_on(length >= kOffloadMinSize ? plugin_thread_pool(self) : nullptr,
+                std::move(func));
+}
+
+RefPtr<FlMethodResponse> success_response_take(FlValue *result);
+RefPtr<FlMethodResponse> bad_arguments(const gchar *message);
+// Returns args[key] if args is a map and the value has the given type.
+FlValue *lookup_typed(FlValue *args, const gchar *key, FlValueType type);
+
+// Handlers of `read`, `write` and `delete`, also run for the items of batch
+// calls.
+Task<RefPtr<FlMethodResponse>> handleRead(BiometricStoragePlugin *self,
+                                          FlValue *args);
+Task<RefPtr<FlMethodResponse>> handleWrite(BiometricStoragePlugin *self,
+                                           FlValue *args);
+Task<RefPtr<FlMethodResponse>> handleDelete(BiometricStoragePlugin *self,
+                                            FlValue *args);
+
+// biometric_storage_plugin_keyring.cc: storages in the Secret Service.
+
+Task<RefPtr<SecretService>> get_service(BiometricStoragePlugin *self,
+                                        GError **error);
+
+// Returns the items of `schema` matching `attributes`, without unlocking them
+// or loading their secrets. Free with g_list_free_full(items,
+// g_object_unref).
+Task<GList *> search_items(BiometricStoragePlugin *self,
+                           const SecretSchema *schema, GHashTable *attributes,
+                           GError **error);
+
+// Unlocks the collection of `item`. Only one prompt is shown per collection
+// at a time, lookups arriving while it is pending wait for its outcome.
+// Lookups of items in other or unlocked collections never wait here.
+Task<gboolean> unlock_item(BiometricStoragePlugin *self,
+                           SecretService *service, SecretItem *item,
+                           GError **error);
+
+// Looks up the secret of item `name`, see lookup_secret(). Adds the time
+// spent waiting on an unlock prompt to `prompt_wait`. With `prompt_wait`
+// nullptr, items of locked collections are treated as not found instead.
+Task<SecretValue *> find_secret(BiometricStoragePlugin *self,
+                                const SecretSchema *schema, const gchar *name,
+                                gint64 *prompt_wait, GError **error);
+
+// Returns the secret of item `name`, or nullptr if there is none or the
+// lookup failed (`error` is set then). Falls through to the legacy schema
+// until all items are migrated. Free with secret_value_unref().
+Task<SecretValue *> lookup_secret(BiometricStoragePlugin *self,
+                                  const gchar *name, GError **error);
+
+// Checks the secret `value` of `item`, stored with the current schema,
+// against the checksum in its header and copies its generation to
+// `generation`. Returns FALSE and sets `error` if a Secret Service returned
+// a corrupted or truncated secret.
+Task<gboolean> verify_envelope(
+    BiometricStoragePlugin *self, SecretItem *item, SecretValue *value,
+    gchar generation[BIOMETRIC_GENERATION_LENGTH + 1], GError **error);
+
+// Puts the secret of a legacy item behind a header, like the ones stored
+// with the current schema. Releases `value`.
+Task<SecretValue *> legacy_value_wrap(BiometricStoragePlugin *self,
+                                      SecretValue *value);
+
+// Returns the content of a secret returned by lookup_secret(), behind its
+// header.
+const gchar *secret_content(SecretValue *value, gsize *length);
+
+// Copies the content of a secret returned by lookup_secret() into a FlValue
+// and releases the original, which libsecret wipes.
+FlValue *take_secret_value(SecretValue *secret);
+
+// Whether `error` means the Secret Service could not be reached at all, as
+// opposed to the operation failing.
+gboolean is_service_unavailable(const GError *error);
+
+// The Secret Service only replaces items with identical attributes, so a
+// write with different tags leaves the previous variant behind. Deletes the
+// items named like the one just stored with `attributes` and `generation`
+// whose tags differ, but only if they are strictly older: of two writes with
+// different tags racing each other, only the older loses its item.
+Task<> purge_stale_variants(BiometricStoragePlugin *self,
+                            GHashTable *attributes, const gchar *generation);
+
+// Returns the key stored as `name`, see biometric_key_new_encoded(). If
+// there is none and `label` is given, a new one is stored with that label,
+// otherwise nullptr is returned without setting `error`. Free with
+// biometric_secret_free().
+Task<gchar *> lookup_key(BiometricStoragePlugin *self, const gchar *name,
+                         const gchar *label, GError **error);
+
+// Writes `content` to the Secret Service item `name`, tagged with `tags`.
+// The generation and checksum go into the header of the secret, so the
+// attributes only change with the tags and the item is replaced in place.
+Task<RefPtr<FlMethodResponse>> secret_service_write(
+    BiometricStoragePlugin *self, const gchar *name, const gchar *content,
+    FlValue *tags);
+Task<RefPtr<FlMethodResponse>> secret_service_delete(
+    BiometricStoragePlugin *self, const gchar *name);
+
+// Returns the names of all storages with the tags in args["tags"], matched
+// by the Secret Service without loading any secret.
+Task<RefPtr<FlMethodResponse>> handleFindByTags(BiometricStoragePlugin *self,
+                                                FlValue *args);
+
+// biometric_storage_plugin_migration.cc: moving legacy items to the current
+// schema.
+
+// Whether an earlier run or this one migrated all legacy items. Loads the
+// checkpoint on first use, also with the Secret portal where the migration
+// is never scheduled.
+gboolean migration_completed(Migration *migration);
+
+// Starts the migration kMigrationStartDelaySeconds after the first storage
+// was initialized, unless an earlier run completed it.
+void migration_schedule(BiometricStoragePlugin *self);
+
+// Marks `name` as written or deleted by dart, so that the migration does not
+// overwrite it with the legacy item.
+void migration_touch(BiometricStoragePlugin *self, const gchar *name);
+
+// Deletes the legacy item `name` while the migration is not completed, so
+// that it is neither read nor migrated after dart wrote or deleted `name`.
+// Returns whether there was one. Costs nothing once the migration completed.
+Task<gboolean> clear_legacy_item(BiometricStoragePlugin *self,
+                                 const gchar *name);
+
+// biometric_storage_plugin_offline_queue.cc: writes queued while the Secret
+// Service is unreachable.
+
+// Queues storing `content` with `attributes` (or deleting the item if
+// nullptr) until the Secret Service is reachable again. Returns FALSE if the
+// queue is full.
+gboolean offline_queue_push(BiometricStoragePlugin *self, const gchar *name,
+                            GHashTable *attributes, const gchar *content);
+
+// Whether a write to `name` has to go through the offline queue, because an
+// earlier one for the same item is still queued.
+gboolean offline_queue_has(BiometricStoragePlugin *self, const gchar *name);
+
+// Looks up `name` in the offline queue, see OfflineQueue::lookup(). Returns
+// TRUE if a read has to be answered from the queue, with `content` set or
+// with `error` set if the queued write was lost.
+gboolean offline_queue_lookup(BiometricStoragePlugin *self, const gchar *name,
+                              SecretPtr *content, GError **error);
+
+// biometric_storage_plugin_warm_start.cc: the warm start snapshot.
+
+// Adds (takes) item `name` to the storages kept in the snapshot, or removes
+// it. The snapshot is loaded when the first one is added.
+void warm_start_enable(BiometricStoragePlugin *self, gchar *name,
+                       gboolean enable);
+
+// Returns TRUE and sets `content` if `name` is kept in the snapshot and
+// cached, after waiting for the snapshot to be loaded.
+Task<gboolean> warm_start_lookup(BiometricStoragePlugin *self,
+                                 const gchar *name, SecretPtr *content);
+
+// Records what the keyring now contains for `name` (nullptr if it was
+// deleted), if it is kept in the snapshot.
+Task<> warm_start_update(BiometricStoragePlugin *self, const gchar *name,
+                         const gchar *content, gsize length);
+
+// Saves pending changes right away, on dispose.
+void warm_start_flush(BiometricStoragePlugin *self);
+
+// biometric_storage_plugin_tiers.cc: routing storages to tiers, and the
+// file store and kernel keyring tiers.
+
+// Created on first use.
+TierRouter *plugin_router(BiometricStoragePlugin *self);
+
+// Opens the file store on first use, with its key from the Secret portal or
+// the keyring (a new one if there is none yet). Concurrent callers wait for
+// the same attempt, a failed one is retried by the next call.
+Task<FileStore *> file_store_open(BiometricStoragePlugin *self,
+                                  GError **error);
+
+// Looks up `name` in `tier`, anything but the Secret Service. Returns FALSE
+// with `response` set to the error if the tier is not accessible.
+Task<gboolean> tier_read(BiometricStoragePlugin *self, const gchar *name,
+                         StorageTier tier, SecretPtr *content,
+                         RefPtr<FlMethodResponse> *response);
+
+// Writes or deletes the storage args["name"] in the tier it is routed to,
+// or with the credentials backend.
+Task<RefPtr<FlMethodResponse>> write_storage(BiometricStoragePlugin *self,
+                                             FlValue *args);
+Task<RefPtr<FlMethodResponse>> delete_storage(BiometricStoragePlugin *self,
+                                              FlValue *args);
+
+// Replaces the policy picking the tier of storages which were not pinned to
+// one by `init`, see TierRouter.
+FlMethodResponse *handleSetTierPolicy(BiometricStoragePlugin *self,
+                                      FlValue *args);
+
+// biometric_storage_plugin_shards.cc: the sharded tier.
+
+// Stores `content` in items of at most kShardMaxSize bytes, cut between
+// UTF-8 characters since the Secret Service holds text. The shards of a
+// write share a new generation, reads take the newest generation which is
+// complete and older ones are deleted once all shards are stored.
+Task<RefPtr<FlMethodResponse>> sharded_write(BiometricStoragePlugin *self,
+                                             const gchar *name,
+                                             const gchar *content);
+
+// Reads the shards of `name` and joins them. Returns FALSE with `response`
+// set to the error if the keyring failed or a shard is corrupted.
+Task<gboolean> sharded_read(BiometricStoragePlugin *self, const gchar *name,
+                            SecretPtr *content,
+                            RefPtr<FlMethodResponse> *response);
+
+Task<RefPtr<FlMethodResponse>> sharded_delete(BiometricStoragePlugin *self,
+                                              const gchar *name);
+
+// biometric_storage_plugin_credentials.cc: all storages when running with
+// systemd credentials.
+
+// Opens the credentials backend on first use. Concurrent callers wait for
+// the same attempt, a failed one is retried by the next call.
+Task<CredentialStore *> credentials_open(BiometricStoragePlugin *self,
+                                         GError **error);
+
+// Reads `name` from the credentials backend into `content` (nullptr if
+// there is none). Sets `response` and returns FALSE if that failed.
+Task<gboolean> credentials_read(BiometricStoragePlugin *self,
+                                const gchar *name, SecretPtr *content,
+                                RefPtr<FlMethodResponse> *response);
+
+Task<RefPtr<FlMethodResponse>> credentials_write(BiometricStoragePlugin *self,
+                                                 const gchar *name,
+                                                 const gchar *content);
+Task<RefPtr<FlMethodResponse>> credentials_delete(
+    BiometricStoragePlugin *self, const gchar *name);
+
+// biometric_storage_plugin_prefetch.cc: prefetching likely reads.
+
+// Learns that `name` is being read and starts prefetching the storages that
+// usually follow it.
+void prefetch_observe(BiometricStoragePlugin *self, const gchar *name);
+
+// Returns TRUE and sets `content` if `name` was prefetched, after waiting
+// for a prefetch of it in flight.
+Task<gboolean> prefetch_take(BiometricStoragePlugin *self, const gchar *name,
+                             SecretPtr *content);
+
+// biometric_storage_plugin_buffer.cc: secrets handed to dart in buffers.
+
+// Like `read`, but hands the secret to dart in a plugin owned buffer instead
+// of a string. libsecret's SecretValue is copied once, into that buffer, and
+// dart maps it directly (see biometric_storage_buffer.h).
+Task<RefPtr<FlMethodResponse>> handleReadBuffer(BiometricStoragePlugin *self,
+                                                FlValue *args);
+
+// biometric_storage_plugin_batch.cc: `readMany`, `deleteMany` and `batch`.
+
+// Runs `handler` for every name in args["names"], up to kBatchConcurrency at
+// a time. Each result is sent as a progress event as soon as it is available,
+// the response only contains the totals.
+Task<RefPtr<FlMethodResponse>> handleBatch(BiometricStoragePlugin *self,
+                                           FlValue *args, ItemHandler handler);
+
+// Runs the reads, writes and deletes in args["operations"] in one call, up
+// to kBatchConcurrency at a time. Operations on the same storage run in the
+// order given, an operation with "barrier" set waits for all operations
+// before it. Returns a list with a map per operation holding either its
+// "value" or its "error".
+Task<RefPtr<FlMethodResponse>> handlePipeline(BiometricStoragePlugin *self,
+                                              FlValue *args);
+
+// Dart acknowledges that it consumed args["count"] progress events of a batch.
+FlMethodResponse *handleBatchAck(BiometricStoragePlugin *self, FlValue *args);
+
+// biometric_storage_plugin_read_snapshot.cc: `readSnapshot`.
+
+// Reads args["names"] as of one point in time, see the definition.
+Task<RefPtr<FlMethodResponse>> handleReadSnapshot(BiometricStoragePlugin *self,
+                                                  FlValue *args);
+
+// biometric_storage_plugin_change_log.cc: `changesSince`.
+
+// Appends a successful write or delete of the storage args["name"] to the
+// change log. A failure only costs readers of the log a full resync.
+void change_log_record(BiometricStoragePlugin *self, FlValue *args,
+                       gboolean deleted);
+
+// Returns the storages written or deleted since args["generation"], see
+// ChangeLog. With args["epoch"] set to the epoch of an earlier result,
+// "reset" is also set if the log was started over since.
+FlMethodResponse *handleChangesSince(BiometricStoragePlugin *self,
+                                     FlValue *args);
+
+// biometric_storage_plugin_stats.cc: `stats` and access telemetry.
+
+// Counts the storage names `method` is called for, by operation.
+void hot_keys_record(BiometricStoragePlugin *self, const gchar *method,
+                     FlValue *args);
+
+FlMethodResponse *handleStats(BiometricStoragePlugin *self);
+
+#endif  // FLUTTER_PLUGIN_BIOMETRIC_STORAGE_PLUGIN_INTERNAL_H_
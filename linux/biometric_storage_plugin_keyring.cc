@@ -0,0 +1,618 @@
+#include "biometric_storage_plugin_internal.h"
+
+#include "biometric_storage_checksum.h"
+#include "biometric_storage_crypto.h"
+
+// Storages in the Secret Service: lookups, unlock prompts, writes and the
+// keys of the files the plugin encrypts.
+
+// Result of a write or delete which was only added to the offline queue,
+// instead of TRUE.
+const char kQueuedResult[] = "queued";
+
+const SecretSchema *
+biometric_get_schema (void)
+{
+    static const SecretSchema the_schema = {
+        "design.codeux.BiometricStorage.v2", SECRET_SCHEMA_NONE,
+        {
+            {  "name", SECRET_SCHEMA_ATTRIBUTE_STRING },
+            {  "account", SECRET_SCHEMA_ATTRIBUTE_STRING },
+            {  "kind", SECRET_SCHEMA_ATTRIBUTE_STRING },
+            {  "sensitivity", SECRET_SCHEMA_ATTRIBUTE_STRING },
+            // {  "NULL", 0 },
+        }
+    };
+    return &the_schema;
+}
+
+const SecretSchema *
+biometric_get_legacy_schema (void)
+{
+    static const SecretSchema the_schema = {
+        "design.codeux.BiometricStorage", SECRET_SCHEMA_NONE,
+        {
+            {  "name", SECRET_SCHEMA_ATTRIBUTE_STRING },
+            {  "account", SECRET_SCHEMA_ATTRIBUTE_STRING },
+            {  "kind", SECRET_SCHEMA_ATTRIBUTE_STRING },
+            {  "sensitivity", SECRET_SCHEMA_ATTRIBUTE_STRING },
+        }
+    };
+    return &the_schema;
+}
+
+// Schema of the items holding the keys of the files the plugin encrypts
+// (warm start snapshot, file store), see lookup_key().
+static const SecretSchema *key_schema() {
+  static const SecretSchema the_schema = {
+      "design.codeux.BiometricStorage.Key",
+      SECRET_SCHEMA_NONE,
+      {
+          {"name", SECRET_SCHEMA_ATTRIBUTE_STRING},
+      }};
+  return &the_schema;
+}
+
+Task<gboolean> verify_envelope(
+    BiometricStoragePlugin *self, SecretItem *item, SecretValue *value,
+    gchar generation[BIOMETRIC_GENERATION_LENGTH + 1], GError **error) {
+  IntegrityStats *stats = &self->integrity_stats;
+  gsize length;
+  const gchar *data = secret_value_get(value, &length);
+  gboolean valid = co_await offload(self, length, [&] {
+    return biometric_envelope_open(data, length, TRUE, generation);
+  });
+  if (!valid) {
+    stats->corrupted++;
+    g_autofree gchar *label = secret_item_get_label(item);
+    g_set_error(error, BIOMETRIC_STORAGE_ERROR,
+                BIOMETRIC_STORAGE_ERROR_CORRUPTED,
+                "Secret of %s (%" G_GSIZE_FORMAT
+                " bytes) does not match its checksum",
+                label, length);
+    co_return FALSE;
+  }
+  biometric_generation_observe(&self->generation_clock, generation);
+  stats->verified++;
+  co_return TRUE;
+}
+
+Task<SecretValue *> legacy_value_wrap(BiometricStoragePlugin *self,
+                                      SecretValue *value) {
+  self->integrity_stats.unchecked++;
+  gsize length;
+  const gchar *data = secret_value_get(value, &length);
+  SecretPtr envelope(co_await offload(self, length, [&] {
+    return biometric_envelope_new(BIOMETRIC_GENERATION_NONE, data, length);
+  }));
+  SecretValue *wrapped =
+      secret_value_new(envelope.get(), BIOMETRIC_ENVELOPE_HEADER_SIZE + length,
+                       secret_value_get_content_type(value));
+  secret_value_unref(value);
+  co_return wrapped;
+}
+
+const gchar *secret_content(SecretValue *value, gsize *length) {
+  const gchar *data = secret_value_get(value, length);
+  *length -= BIOMETRIC_ENVELOPE_HEADER_SIZE;
+  return data + BIOMETRIC_ENVELOPE_HEADER_SIZE;
+}
+
+// Adds the tags in `tags` (a map, or nullptr for none) to `attributes`.
+// Returns FALSE for unknown tags or non string values.
+static gboolean add_tag_attributes(GHashTable *attributes, FlValue *tags) {
+  if (tags == nullptr || fl_value_get_type(tags) == FL_VALUE_TYPE_NULL) {
+    return TRUE;
+  }
+  if (fl_value_get_type(tags) != FL_VALUE_TYPE_MAP) {
+    return FALSE;
+  }
+  for (size_t i = 0; i < fl_value_get_length(tags); i++) {
+    FlValue *key = fl_value_get_map_key(tags, i);
+    FlValue *value = fl_value_get_map_value(tags, i);
+    if (fl_value_get_type(key) != FL_VALUE_TYPE_STRING ||
+        fl_value_get_type(value) != FL_VALUE_TYPE_STRING) {
+      return FALSE;
+    }
+    gboolean known = FALSE;
+    for (const char *attribute : kTagAttributes) {
+      known = known || strcmp(attribute, fl_value_get_string(key)) == 0;
+    }
+    if (!known) {
+      return FALSE;
+    }
+    g_hash_table_insert(attributes, g_strdup(fl_value_get_string(key)),
+                        g_strdup(fl_value_get_string(value)));
+  }
+  return TRUE;
+}
+
+// Whether an item stored with `item_attributes` has exactly the tags in
+// `attributes`.
+static gboolean same_tags(GHashTable *item_attributes, GHashTable *attributes) {
+  for (const char *attribute : kTagAttributes) {
+    if (g_strcmp0(static_cast<const gchar *>(
+                      g_hash_table_lookup(item_attributes, attribute)),
+                  static_cast<const gchar *>(
+                      g_hash_table_lookup(attributes, attribute))) != 0) {
+      return FALSE;
+    }
+  }
+  return TRUE;
+}
+
+FlValue *take_secret_value(SecretValue *secret) {
+  gsize length;
+  const gchar *data = secret_content(secret, &length);
+  FlValue *value = fl_value_new_string_sized(data, length);
+  secret_value_unref(secret);
+  return value;
+}
+
+Task<RefPtr<SecretService>> get_service(BiometricStoragePlugin *self,
+                                        GError **error) {
+  RefPtr<GAsyncResult> result = co_await gio_async(
+      [&](GAsyncReadyCallback callback, gpointer user_data) {
+        secret_service_get(SECRET_SERVICE_NONE, self->cancellable, callback,
+                           user_data);
+      });
+  co_return RefPtr<SecretService>::adopt(
+      secret_service_get_finish(result.get(), error));
+}
+
+Task<GList *> search_items(BiometricStoragePlugin *self,
+                           const SecretSchema *schema,
+                           GHashTable *attributes, GError **error) {
+  RefPtr<SecretService> service = co_await get_service(self, error);
+  if (!service) {
+    co_return nullptr;
+  }
+  RefPtr<GAsyncResult> result = co_await gio_async(
+      [&](GAsyncReadyCallback callback, gpointer user_data) {
+        secret_service_search(service.get(), schema, attributes,
+                              SECRET_SEARCH_ALL, self->cancellable, callback,
+                              user_data);
+      });
+  co_return secret_service_search_finish(service.get(), result.get(), error);
+}
+
+Task<gboolean> unlock_item(BiometricStoragePlugin *self,
+                           SecretService *service, SecretItem *item,
+                           GError **error) {
+  GAutoFree<gchar> collection(
+      g_path_get_dirname(g_dbus_proxy_get_object_path(G_DBUS_PROXY(item))));
+  UnlockLane *lane = static_cast<UnlockLane *>(
+      g_hash_table_lookup(self->unlock_lanes, collection.get()));
+  if (lane == nullptr) {
+    lane = new UnlockLane();
+    g_hash_table_insert(self->unlock_lanes, g_strdup(collection.get()), lane);
+  }
+
+  LookupStats *stats = &self->lookup_stats;
+  gint64 started = g_get_monotonic_time();
+  stats->waiting++;
+  if (lane->prompting) {
+    stats->prompts_coalesced++;
+    guint64 generation = lane->generation;
+    while (lane->generation == generation) {
+      co_await lane->done.wait();
+    }
+  } else {
+    lane->prompting = TRUE;
+    stats->prompts_shown++;
+    GList *objects = g_list_append(nullptr, item);
+    RefPtr<GAsyncResult> result = co_await gio_async(
+        [&](GAsyncReadyCallback callback, gpointer user_data) {
+          secret_service_unlock(service, objects, self->cancellable, callback,
+                                user_data);
+        });
+    g_list_free(objects);
+    GList *unlocked = nullptr;
+    g_clear_error(&lane->error);
+    lane->unlocked = secret_service_unlock_finish(service, result.get(),
+                                                  &unlocked, &lane->error) > 0;
+    g_list_free_full(unlocked, g_object_unref);
+    if (!lane->unlocked && lane->error == nullptr) {
+      stats->prompts_dismissed++;
+      lane->error = g_error_new(SECRET_ERROR, SECRET_ERROR_IS_LOCKED,
+                                "Unlock prompt was dismissed");
+    }
+    lane->prompting = FALSE;
+    lane->generation++;
+    lane->done.notify_all();
+  }
+  gint64 waited = g_get_monotonic_time() - started;
+  stats->waiting--;
+  stats->prompt_waits++;
+  stats->prompt_wait_total_us += waited;
+  stats->prompt_wait_max_us = MAX(stats->prompt_wait_max_us, waited);
+
+  if (!lane->unlocked) {
+    g_propagate_error(error, g_error_copy(lane->error));
+  }
+  co_return lane->unlocked;
+}
+
+Task<SecretValue *> find_secret(BiometricStoragePlugin *self,
+                                const SecretSchema *schema,
+                                const gchar *name, gint64 *prompt_wait,
+                                GError **error) {
+  RefPtr<SecretService> service = co_await get_service(self, error);
+  if (!service) {
+    co_return nullptr;
+  }
+  RefPtr<GHashTable> attributes = RefPtr<GHashTable>::adopt(attributes_new());
+  g_hash_table_insert(attributes.get(), g_strdup("name"), g_strdup(name));
+  // Does not unlock, so that a locked collection only holds up this lookup.
+  // Returns all items: after a write changed the tags, the previous variant
+  // exists next to the new one until purge_stale_variants() deleted it.
+  RefPtr<GAsyncResult> result = co_await gio_async(
+      [&](GAsyncReadyCallback callback, gpointer user_data) {
+        secret_service_search(service.get(), schema, attributes.get(),
+                              SECRET_SEARCH_ALL, self->cancellable, callback,
+                              user_data);
+      });
+  GList *items =
+      secret_service_search_finish(service.get(), result.get(), error);
+  if (items == nullptr) {
+    co_return nullptr;
+  }
+
+  gboolean unlocked = TRUE;
+  for (GList *l = items; l != nullptr && unlocked; l = l->next) {
+    SecretItem *item = SECRET_ITEM(l->data);
+    if (!secret_item_get_locked(item)) {
+      continue;
+    }
+    if (prompt_wait == nullptr) {
+      unlocked = FALSE;
+      break;
+    }
+    gint64 started = g_get_monotonic_time();
+    unlocked = co_await unlock_item(self, service.get(), item, error);
+    *prompt_wait += g_get_monotonic_time() - started;
+  }
+  if (unlocked) {
+    result = co_await gio_async(
+        [&](GAsyncReadyCallback callback, gpointer user_data) {
+          secret_item_load_secrets(items, self->cancellable, callback,
+                                   user_data);
+        });
+    unlocked = secret_item_load_secrets_finish(result.get(), error);
+  }
+  // The variant with the newest generation in its header is current.
+  SecretValue *newest = nullptr;
+  gchar newest_generation[BIOMETRIC_GENERATION_LENGTH + 1] = "";
+  for (GList *l = items; l != nullptr && unlocked; l = l->next) {
+    SecretItem *item = SECRET_ITEM(l->data);
+    SecretValue *value = secret_item_get_secret(item);
+    if (value == nullptr) {
+      continue;
+    }
+    if (schema != BIOMETRIC_SCHEMA) {
+      newest = co_await legacy_value_wrap(self, value);
+      break;
+    }
+    gchar generation[BIOMETRIC_GENERATION_LENGTH + 1];
+    if (!co_await verify_envelope(self, item, value, generation, error)) {
+      secret_value_unref(value);
+      g_clear_pointer(&newest, secret_value_unref);
+      break;
+    }
+    if (newest == nullptr || g_strcmp0(generation, newest_generation) > 0) {
+      if (newest != nullptr) {
+        secret_value_unref(newest);
+      }
+      newest = value;
+      memcpy(newest_generation, generation, sizeof(newest_generation));
+    } else {
+      secret_value_unref(value);
+    }
+  }
+  g_list_free_full(items, g_object_unref);
+  co_return newest;
+}
+
+Task<SecretValue *> lookup_secret(BiometricStoragePlugin *self,
+                                  const gchar *name, GError **error) {
+  LookupStats *stats = &self->lookup_stats;
+  gint64 started = g_get_monotonic_time();
+  gint64 prompt_wait = 0;
+  stats->lookups++;
+  GError *local_error = NULL;
+  SecretValue *value = co_await find_secret(self, BIOMETRIC_SCHEMA, name,
+                                            &prompt_wait, &local_error);
+  if (value == nullptr && local_error == NULL &&
+      !migration_completed(self->migration)) {
+    value = co_await find_secret(self, biometric_get_legacy_schema(), name,
+                                 &prompt_wait, &local_error);
+    if (value != nullptr) {
+      self->migration->fallthrough_reads++;
+    }
+  }
+  if (local_error != NULL) {
+    g_propagate_error(error, local_error);
+  }
+  gint64 service_time = g_get_monotonic_time() - started - prompt_wait;
+  stats->service_time_total_us += service_time;
+  stats->service_time_max_us = MAX(stats->service_time_max_us, service_time);
+  co_return value;
+}
+
+Task<> purge_stale_variants(BiometricStoragePlugin *self,
+                            GHashTable *attributes,
+                            const gchar *generation) {
+  RefPtr<GHashTable> query = RefPtr<GHashTable>::adopt(attributes_new());
+  g_hash_table_insert(query.get(), g_strdup("name"),
+                      g_strdup(static_cast<const gchar *>(
+                          g_hash_table_lookup(attributes, "name"))));
+  GError *error = NULL;
+  GList *items =
+      co_await search_items(self, BIOMETRIC_SCHEMA, query.get(), &error);
+  if (error != NULL) {
+    g_warning("Failed to search for stale items: %s", error->message);
+    g_error_free(error);
+    co_return;
+  }
+  // Only the item just stored, as after every write which kept the tags.
+  if (items == nullptr || items->next == nullptr) {
+    g_list_free_full(items, g_object_unref);
+    co_return;
+  }
+  // Variants in a locked collection cannot be compared, reads still pick
+  // the newest of them.
+  GList *others = nullptr;
+  for (GList *l = items; l != nullptr; l = l->next) {
+    SecretItem *item = SECRET_ITEM(l->data);
+    g_autoptr(GHashTable) item_attributes = secret_item_get_attributes(item);
+    if (!same_tags(item_attributes, attributes) &&
+        !secret_item_get_locked(item)) {
+      others = g_list_prepend(others, item);
+    }
+  }
+  if (others != nullptr) {
+    RefPtr<GAsyncResult> result = co_await gio_async(
+        [&](GAsyncReadyCallback callback, gpointer user_data) {
+          secret_item_load_secrets(others, self->cancellable, callback,
+                                   user_data);
+        });
+    if (!secret_item_load_secrets_finish(result.get(), &error)) {
+      g_warning("Failed to load stale items: %s", error->message);
+      g_clear_error(&error);
+      g_clear_pointer(&others, g_list_free);
+    }
+  }
+  for (GList *l = others; l != nullptr; l = l->next) {
+    SecretItem *item = SECRET_ITEM(l->data);
+    // Unreadable headers count as oldest, reads fail on them anyway.
+    gchar other_generation[BIOMETRIC_GENERATION_LENGTH + 1] =
+        BIOMETRIC_GENERATION_NONE;
+    SecretValue *value = secret_item_get_secret(item);
+    if (value != nullptr) {
+      gsize length;
+      const gchar *data = secret_value_get(value, &length);
+      biometric_envelope_open(data, length, FALSE, other_generation);
+      secret_value_unref(value);
+    }
+    if (!biometric_generation_supersedes(generation, other_generation)) {
+      continue;
+    }
+    RefPtr<GAsyncResult> result = co_await gio_async(
+        [&](GAsyncReadyCallback callback, gpointer user_data) {
+          secret_item_delete(item, self->cancellable, callback, user_data);
+        });
+    if (!secret_item_delete_finish(item, result.get(), &error)) {
+      // Reads pick the newest variant, the next write purges again.
+      g_warning("Failed to delete stale item: %s", error->message);
+      g_clear_error(&error);
+    }
+  }
+  g_list_free(others);
+  g_list_free_full(items, g_object_unref);
+}
+
+gboolean is_service_unavailable(const GError *error) {
+  if (error->domain == G_DBUS_ERROR) {
+    switch (error->code) {
+      case G_DBUS_ERROR_SERVICE_UNKNOWN:
+      case G_DBUS_ERROR_NAME_HAS_NO_OWNER:
+      case G_DBUS_ERROR_NO_REPLY:
+      case G_DBUS_ERROR_NO_SERVER:
+      case G_DBUS_ERROR_TIMEOUT:
+      case G_DBUS_ERROR_TIMED_OUT:
+      case G_DBUS_ERROR_DISCONNECTED:
+      case G_DBUS_ERROR_SPAWN_EXEC_FAILED:
+      case G_DBUS_ERROR_SPAWN_CHILD_EXITED:
+      case G_DBUS_ERROR_SPAWN_SERVICE_NOT_FOUND:
+        return TRUE;
+    }
+    return FALSE;
+  }
+  return g_error_matches(error, G_IO_ERROR, G_IO_ERROR_CLOSED) ||
+         g_error_matches(error, G_IO_ERROR, G_IO_ERROR_TIMED_OUT) ||
+         g_error_matches(error, G_IO_ERROR, G_IO_ERROR_CONNECTION_CLOSED);
+}
+
+Task<gchar *> lookup_key(BiometricStoragePlugin *self,
+                         const gchar *name, const gchar *label,
+                         GError **error) {
+  RefPtr<GAsyncResult> result = co_await gio_async(
+      [&](GAsyncReadyCallback callback, gpointer user_data) {
+        secret_password_lookup(key_schema(), self->cancellable, callback,
+                               user_data, "name", name, NULL);
+      });
+  GError *local_error = NULL;
+  gchar *key = secret_password_lookup_finish(result.get(), &local_error);
+  if (key != nullptr || local_error != NULL || label == nullptr) {
+    if (local_error != NULL) {
+      g_propagate_error(error, local_error);
+    }
+    co_return key;
+  }
+  key = biometric_key_new_encoded(error);
+  if (key == nullptr) {
+    co_return nullptr;
+  }
+  result = co_await gio_async(
+      [&](GAsyncReadyCallback callback, gpointer user_data) {
+        secret_password_store(key_schema(), SECRET_COLLECTION_DEFAULT, label,
+                              key, self->cancellable, callback, user_data,
+                              "name", name, NULL);
+      });
+  if (!secret_password_store_finish(result.get(), error)) {
+    biometric_secret_free(key);
+    co_return nullptr;
+  }
+  co_return key;
+}
+
+Task<RefPtr<FlMethodResponse>> secret_service_write(
+    BiometricStoragePlugin *self, const gchar *name, const gchar *content,
+    FlValue *tags) {
+  RefPtr<GHashTable> attributes = RefPtr<GHashTable>::adopt(attributes_new());
+  g_hash_table_insert(attributes.get(), g_strdup("name"), g_strdup(name));
+  if (!add_tag_attributes(attributes.get(), tags)) {
+    co_return bad_arguments(
+        "Tags must map account, kind or sensitivity to strings");
+  }
+  gboolean queue_enabled =
+      g_hash_table_contains(self->offline_queue_names, name);
+  if (queue_enabled && offline_queue_has(self, name)) {
+    // Keeps the order of writes to the same item.
+    if (!offline_queue_push(self, name, attributes.get(), content)) {
+      co_return RefPtr<FlMethodResponse>::adopt(
+          FL_METHOD_RESPONSE(fl_method_error_response_new(
+              kSecurityAccessError, "Offline queue is full", nullptr)));
+    }
+    co_await warm_start_update(self, name, content, strlen(content));
+    co_return success_response_take(fl_value_new_string(kQueuedResult));
+  }
+  GAutoFree<gchar> generation(
+      biometric_generation_new(&self->generation_clock));
+  gsize length = strlen(content);
+  SecretPtr envelope(co_await offload(self, length, [&] {
+    return biometric_envelope_new(generation.get(), content, length);
+  }));
+  migration_touch(self, name);
+  RefPtr<GAsyncResult> result = co_await gio_async(
+      [&](GAsyncReadyCallback callback, gpointer user_data) {
+        secret_password_storev(BIOMETRIC_SCHEMA, attributes.get(),
+                               SECRET_COLLECTION_DEFAULT, name,
+                               envelope.get(), self->cancellable, callback,
+                               user_data);
+      });
+  envelope.reset();
+
+  GError *error = NULL;
+  secret_password_store_finish(result.get(), &error);
+  if (error != NULL && queue_enabled && is_service_unavailable(error) &&
+      offline_queue_push(self, name, attributes.get(), content)) {
+    g_warning("Secret Service unavailable, queued write: %s", error->message);
+    g_error_free(error);
+    co_await warm_start_update(self, name, content, length);
+    co_return success_response_take(fl_value_new_string(kQueuedResult));
+  }
+  if (error != NULL) {
+    RefPtr<FlMethodResponse> response = RefPtr<FlMethodResponse>::adopt(
+        biometric_storage_handle_error("Failed to store secret", error));
+    g_error_free(error);
+    co_return response;
+  }
+  co_await clear_legacy_item(self, name);
+  co_await purge_stale_variants(self, attributes.get(), generation.get());
+  co_await warm_start_update(self, name, content, length);
+  co_return success_response_take(fl_value_new_bool(true));
+}
+
+Task<RefPtr<FlMethodResponse>> secret_service_delete(
+    BiometricStoragePlugin *self, const gchar *name) {
+  gboolean queue_enabled =
+      g_hash_table_contains(self->offline_queue_names, name);
+  if (offline_queue_has(self, name)) {
+    // Keeps the order of writes to the same item, a queued write would
+    // otherwise bring the secret back when it is replayed.
+    if (!offline_queue_push(self, name, nullptr, nullptr)) {
+      co_return RefPtr<FlMethodResponse>::adopt(
+          FL_METHOD_RESPONSE(fl_method_error_response_new(
+              kSecurityAccessError, "Offline queue is full", nullptr)));
+    }
+    co_await warm_start_update(self, name, nullptr, 0);
+    co_return success_response_take(fl_value_new_string(kQueuedResult));
+  }
+  migration_touch(self, name);
+  RefPtr<GAsyncResult> result = co_await gio_async(
+      [&](GAsyncReadyCallback callback, gpointer user_data) {
+        secret_password_clear(BIOMETRIC_SCHEMA, self->cancellable, callback,
+                              user_data, "name", name, NULL);
+      });
+
+  GError *error = NULL;
+  gboolean removed = secret_password_clear_finish(result.get(), &error);
+  if (error != NULL && queue_enabled && is_service_unavailable(error) &&
+      offline_queue_push(self, name, nullptr, nullptr)) {
+    g_warning("Secret Service unavailable, queued delete: %s", error->message);
+    g_error_free(error);
+    co_await warm_start_update(self, name, nullptr, 0);
+    co_return success_response_take(fl_value_new_string(kQueuedResult));
+  }
+  if (error != NULL) {
+    RefPtr<FlMethodResponse> response = RefPtr<FlMethodResponse>::adopt(
+        biometric_storage_handle_error("Failed to delete secret", error));
+    g_error_free(error);
+    co_return response;
+  }
+  if (co_await clear_legacy_item(self, name)) {
+    removed = TRUE;
+  }
+  co_await warm_start_update(self, name, nullptr, 0);
+  co_return success_response_take(fl_value_new_bool(removed));
+}
+
+Task<RefPtr<FlMethodResponse>> handleFindByTags(
+    BiometricStoragePlugin *self, FlValue *args) {
+  if (self->credentials != nullptr) {
+    co_return bad_arguments("Tags are not supported with credentials");
+  }
+  RefPtr<GHashTable> query = RefPtr<GHashTable>::adopt(attributes_new());
+  if (!add_tag_attributes(query.get(),
+                          lookup_typed(args, "tags", FL_VALUE_TYPE_MAP)) ||
+      g_hash_table_size(query.get()) == 0) {
+    co_return bad_arguments(
+        "Expected tags mapping account, kind or sensitivity to strings");
+  }
+
+  GError *error = NULL;
+  GList *items =
+      co_await search_items(self, BIOMETRIC_SCHEMA, query.get(), &error);
+  if (error == NULL && !migration_completed(self->migration)) {
+    items = g_list_concat(
+        items, co_await search_items(self, biometric_get_legacy_schema(),
+                                     query.get(), &error));
+  }
+  if (error != NULL) {
+    g_list_free_full(items, g_object_unref);
+    RefPtr<FlMethodResponse> response = RefPtr<FlMethodResponse>::adopt(
+        biometric_storage_handle_error("Failed to search secrets", error));
+    g_error_free(error);
+    co_return response;
+  }
+
+  gsize prefix_length = strlen(kNamePrefix);
+  FlValue *names = fl_value_new_list();
+  RefPtr<GHashTable> seen = RefPtr<GHashTable>::adopt(
+      g_hash_table_new_full(g_str_hash, g_str_equal, g_free, nullptr));
+  for (GList *l = items; l != nullptr; l = l->next) {
+    GHashTable *attributes = secret_item_get_attributes(SECRET_ITEM(l->data));
+    const gchar *name =
+        static_cast<const gchar *>(g_hash_table_lookup(attributes, "name"));
+    if (name != nullptr && g_str_has_prefix(name, kNamePrefix) &&
+        name[prefix_length] == '.' &&
+        g_hash_table_add(seen.get(), g_strdup(name))) {
+      fl_value_append_take(names,
+                           fl_value_new_string(name + prefix_length + 1));
+    }
+    g_hash_table_unref(attributes);
+  }
+  g_list_free_full(items, g_object_unref);
+  co_return success_response_take(names);
+}
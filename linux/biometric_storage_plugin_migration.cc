@@ -0,0 +1,252 @@
+#include "biometric_storage_plugin_internal.h"
+
+#include <errno.h>
+
+// Items stored with the legacy schema are migrated in the background, see
+// migrate_legacy_items(). Bump kLayoutVersion to migrate again.
+const gint64 kLayoutVersion = 2;
+const guint kMigrationStartDelaySeconds = 10;
+// Share of the migration's wall clock time spent working, it sleeps for the
+// rest. Also the lower bound of the time between two items.
+const gint64 kMigrationBusyPercent = 10;
+const guint kMigrationMinIntervalMs = 100;
+const guint64 kMigrationCheckpointInterval = 16;
+
+static gchar *migration_checkpoint_path() {
+  return g_build_filename(g_get_user_data_dir(), "biometric_storage",
+                          "migration.ini", NULL);
+}
+
+// Loads the outcome of earlier runs. A checkpoint of another layout version
+// is ignored, the migration starts over.
+static void migration_load_checkpoint(Migration *migration) {
+  migration->loaded = TRUE;
+  g_autofree gchar *path = migration_checkpoint_path();
+  g_autoptr(GKeyFile) checkpoint = g_key_file_new();
+  if (!g_key_file_load_from_file(checkpoint, path, G_KEY_FILE_NONE, NULL) ||
+      g_key_file_get_int64(checkpoint, "migration", "layout", NULL) !=
+          kLayoutVersion) {
+    return;
+  }
+  migration->completed =
+      g_key_file_get_boolean(checkpoint, "migration", "completed", NULL);
+  migration->migrated =
+      g_key_file_get_int64(checkpoint, "migration", "migrated", NULL);
+}
+
+gboolean migration_completed(Migration *migration) {
+  if (!migration->loaded) {
+    migration_load_checkpoint(migration);
+  }
+  return migration->completed;
+}
+
+static void migration_save_checkpoint(const Migration *migration) {
+  g_autofree gchar *path = migration_checkpoint_path();
+  g_autofree gchar *dir = g_path_get_dirname(path);
+  g_autoptr(GKeyFile) checkpoint = g_key_file_new();
+  g_key_file_set_int64(checkpoint, "migration", "layout", kLayoutVersion);
+  g_key_file_set_boolean(checkpoint, "migration", "completed",
+                         migration->completed);
+  g_key_file_set_int64(checkpoint, "migration", "migrated",
+                       migration->migrated);
+  g_autoptr(GError) error = NULL;
+  if (g_mkdir_with_parents(dir, 0700) != 0 ||
+      !g_key_file_save_to_file(checkpoint, path, &error)) {
+    g_warning("Failed to save migration checkpoint %s: %s", path,
+              error != NULL ? error->message : g_strerror(errno));
+  }
+}
+
+void migration_touch(BiometricStoragePlugin *self, const gchar *name) {
+  if (self->migration->running && self->migration->current == name) {
+    self->migration->current_touched = TRUE;
+  }
+}
+
+// Moves legacy `item` to the current schema, unless dart wrote or deleted it
+// since. Returns FALSE if the Secret Service failed.
+static Task<gboolean> migrate_item(BiometricStoragePlugin *self,
+                                   SecretService *service, SecretItem *item,
+                                   const gchar *name) {
+  Migration *migration = self->migration;
+  migration->current = name;
+  migration->current_touched = FALSE;
+  RefPtr<GHashTable> item_attributes =
+      RefPtr<GHashTable>::adopt(secret_item_get_attributes(item));
+  // Copies the schema attributes only, not libsecret's "xdg:schema".
+  RefPtr<GHashTable> attributes = RefPtr<GHashTable>::adopt(attributes_new());
+  g_hash_table_insert(attributes.get(), g_strdup("name"), g_strdup(name));
+  for (const char *attribute : kTagAttributes) {
+    const gchar *value = static_cast<const gchar *>(
+        g_hash_table_lookup(item_attributes.get(), attribute));
+    if (value != nullptr) {
+      g_hash_table_insert(attributes.get(), g_strdup(attribute),
+                          g_strdup(value));
+    }
+  }
+
+  GError *error = NULL;
+  RefPtr<GHashTable> query = RefPtr<GHashTable>::adopt(attributes_new());
+  g_hash_table_insert(query.get(), g_strdup("name"), g_strdup(name));
+  GList *current = co_await search_items(self, BIOMETRIC_SCHEMA, query.get(),
+                                         &error);
+  gboolean exists = current != nullptr;
+  g_list_free_full(current, g_object_unref);
+  if (error == NULL && !exists) {
+    RefPtr<GAsyncResult> result = co_await gio_async(
+        [&](GAsyncReadyCallback callback, gpointer user_data) {
+          secret_item_load_secret(item, self->cancellable, callback,
+                                  user_data);
+        });
+    SecretValue *value =
+        secret_item_load_secret_finish(item, result.get(), &error)
+            ? secret_item_get_secret(item)
+            : nullptr;
+    // Issued right after the check, so a later write from dart reaches the
+    // Secret Service after this one.
+    if (value != nullptr && !migration->current_touched) {
+      // Older than any write from dart, which may race this one.
+      gsize length;
+      const gchar *data = secret_value_get(value, &length);
+      SecretPtr envelope(
+          biometric_envelope_new(BIOMETRIC_GENERATION_NONE, data, length));
+      SecretValue *stored =
+          secret_value_new(envelope.get(),
+                           BIOMETRIC_ENVELOPE_HEADER_SIZE + length,
+                           secret_value_get_content_type(value));
+      result = co_await gio_async(
+          [&](GAsyncReadyCallback callback, gpointer user_data) {
+            secret_service_store(service, BIOMETRIC_SCHEMA, attributes.get(),
+                                 SECRET_COLLECTION_DEFAULT, name, stored,
+                                 self->cancellable, callback, user_data);
+          });
+      secret_service_store_finish(service, result.get(), &error);
+      secret_value_unref(stored);
+    }
+    if (value != nullptr) {
+      secret_value_unref(value);
+    }
+  }
+  if (error == NULL) {
+    RefPtr<GAsyncResult> result = co_await gio_async(
+        [&](GAsyncReadyCallback callback, gpointer user_data) {
+          secret_item_delete(item, self->cancellable, callback, user_data);
+        });
+    secret_item_delete_finish(item, result.get(), &error);
+  }
+  migration->current.clear();
+  if (error != NULL) {
+    g_warning("Failed to migrate %s: %s", name, error->message);
+    g_error_free(error);
+    co_return FALSE;
+  }
+  co_return TRUE;
+}
+
+// Moves all items of the legacy schema to the current one, one at a time
+// while no method call is in progress and throttled to
+// kMigrationBusyPercent. Progress is checkpointed, an interrupted migration
+// continues with the remaining legacy items on the next start. Reads fall
+// through to the legacy schema until it completed.
+static Task<> migrate_legacy_items(BiometricStoragePlugin *self) {
+  RefPtr<BiometricStoragePlugin> plugin =
+      RefPtr<BiometricStoragePlugin>::ref(self);
+  Migration *migration = self->migration;
+  migration->running = TRUE;
+  migration->skipped_locked = 0;
+  GError *error = NULL;
+  RefPtr<SecretService> service = co_await get_service(self, &error);
+  RefPtr<GHashTable> query = RefPtr<GHashTable>::adopt(attributes_new());
+  GList *items = service ? co_await search_items(
+                               self, biometric_get_legacy_schema(),
+                               query.get(), &error)
+                         : nullptr;
+  gsize prefix_length = strlen(kNamePrefix);
+  guint64 since_checkpoint = 0;
+  gboolean failed = error != NULL;
+  for (GList *l = items; l != nullptr && !failed; l = l->next) {
+    while (migration->foreground_calls > 0) {
+      co_await migration->foreground_idle.wait();
+    }
+    gint64 started = g_get_monotonic_time();
+    SecretItem *item = SECRET_ITEM(l->data);
+    RefPtr<GHashTable> attributes =
+        RefPtr<GHashTable>::adopt(secret_item_get_attributes(item));
+    const gchar *name = static_cast<const gchar *>(
+        g_hash_table_lookup(attributes.get(), "name"));
+    if (name == nullptr || !g_str_has_prefix(name, kNamePrefix) ||
+        name[prefix_length] != '.') {
+      continue;
+    }
+    if (secret_item_get_locked(item)) {
+      migration->skipped_locked++;
+      continue;
+    }
+    failed = !co_await migrate_item(self, service.get(), item, name);
+    if (failed) {
+      break;
+    }
+    migration->migrated++;
+    if (++since_checkpoint == kMigrationCheckpointInterval) {
+      migration_save_checkpoint(migration);
+      since_checkpoint = 0;
+    }
+
+    gint64 busy = g_get_monotonic_time() - started;
+    guint interval = MAX((gint64)kMigrationMinIntervalMs,
+                         busy * (100 - kMigrationBusyPercent) /
+                             kMigrationBusyPercent / 1000);
+    migration->busy_us += busy;
+    migration->throttled_us += interval * 1000;
+    co_await sleep_ms(interval);
+  }
+  g_list_free_full(items, g_object_unref);
+  if (error != NULL) {
+    g_warning("Failed to migrate legacy items: %s", error->message);
+    g_error_free(error);
+  }
+  migration->completed = !failed && migration->skipped_locked == 0;
+  migration_save_checkpoint(migration);
+  migration->running = FALSE;
+}
+
+static gboolean migration_start_cb(gpointer user_data) {
+  BiometricStoragePlugin *self = BIOMETRIC_STORAGE_PLUGIN(user_data);
+  self->migration->start_source_id = 0;
+  task_detach(migrate_legacy_items(self));
+  return G_SOURCE_REMOVE;
+}
+
+void migration_schedule(BiometricStoragePlugin *self) {
+  Migration *migration = self->migration;
+  // With the Secret portal the keyring is only used for tagged storages.
+  if (migration->scheduled || self->file_backend->portal) {
+    return;
+  }
+  migration->scheduled = TRUE;
+  if (!migration_completed(migration)) {
+    migration->start_source_id = g_timeout_add_seconds(
+        kMigrationStartDelaySeconds, migration_start_cb, self);
+  }
+}
+
+Task<gboolean> clear_legacy_item(BiometricStoragePlugin *self,
+                                 const gchar *name) {
+  if (migration_completed(self->migration)) {
+    co_return FALSE;
+  }
+  RefPtr<GAsyncResult> result = co_await gio_async(
+      [&](GAsyncReadyCallback callback, gpointer user_data) {
+        secret_password_clear(biometric_get_legacy_schema(),
+                              self->cancellable, callback, user_data, "name",
+                              name, NULL);
+      });
+  GError *error = NULL;
+  gboolean removed = secret_password_clear_finish(result.get(), &error);
+  if (error != NULL) {
+    g_warning("Failed to delete legacy item %s: %s", name, error->message);
+    g_error_free(error);
+  }
+  co_return removed;
+}
@@ -0,0 +1,170 @@
+#include "biometric_storage_plugin_internal.h"
+
+// Bounds of the offline queue, see OfflineQueue.
+const gsize kOfflineQueueMaxEntries = 256;
+const gsize kOfflineQueueMaxBytes = 16 * 1024 * 1024;
+// Replay of the offline queue is retried with exponential backoff while the
+// Secret Service stays unreachable, and immediately when it shows up on the
+// bus.
+const guint kReplayMinBackoffSeconds = 1;
+const guint kReplayMaxBackoffSeconds = 60;
+
+static Task<> replay_offline_queue(BiometricStoragePlugin *self);
+
+static gboolean replay_timeout_cb(gpointer user_data) {
+  BiometricStoragePlugin *self = BIOMETRIC_STORAGE_PLUGIN(user_data);
+  self->replay_source_id = 0;
+  task_detach(replay_offline_queue(self));
+  return G_SOURCE_REMOVE;
+}
+
+static void schedule_replay(BiometricStoragePlugin *self) {
+  if (self->replaying || self->replay_source_id != 0) {
+    return;
+  }
+  self->replay_source_id = g_timeout_add_seconds(
+      self->replay_backoff_seconds, replay_timeout_cb, self);
+}
+
+static void secrets_appeared_cb(GDBusConnection *connection,
+                                const gchar *name, const gchar *name_owner,
+                                gpointer user_data) {
+  BiometricStoragePlugin *self = BIOMETRIC_STORAGE_PLUGIN(user_data);
+  if (self->replaying || self->offline_queue->empty()) {
+    return;
+  }
+  if (self->replay_source_id != 0) {
+    g_source_remove(self->replay_source_id);
+    self->replay_source_id = 0;
+  }
+  self->replay_backoff_seconds = kReplayMinBackoffSeconds;
+  task_detach(replay_offline_queue(self));
+}
+
+static OfflineQueue *plugin_offline_queue(BiometricStoragePlugin *self) {
+  if (self->offline_queue == nullptr) {
+    self->offline_queue =
+        new OfflineQueue(kOfflineQueueMaxEntries, kOfflineQueueMaxBytes);
+    self->replay_backoff_seconds = kReplayMinBackoffSeconds;
+    self->secrets_watch_id = g_bus_watch_name(
+        G_BUS_TYPE_SESSION, "org.freedesktop.secrets",
+        G_BUS_NAME_WATCHER_FLAGS_NONE, secrets_appeared_cb, nullptr, self,
+        nullptr);
+  }
+  return self->offline_queue;
+}
+
+gboolean offline_queue_push(BiometricStoragePlugin *self,
+                            const gchar *name, GHashTable *attributes,
+                            const gchar *content) {
+  if (!plugin_offline_queue(self)->push(name, attributes, content)) {
+    return FALSE;
+  }
+  schedule_replay(self);
+  return TRUE;
+}
+
+gboolean offline_queue_has(BiometricStoragePlugin *self,
+                           const gchar *name) {
+  SecretPtr content;
+  return self->offline_queue != nullptr &&
+         self->offline_queue->lookup(name, &content, nullptr);
+}
+
+gboolean offline_queue_lookup(BiometricStoragePlugin *self,
+                              const gchar *name, SecretPtr *content,
+                              GError **error) {
+  if (self->offline_queue == nullptr) {
+    return FALSE;
+  }
+  GError *queue_error = NULL;
+  if (self->offline_queue->lookup(name, content, &queue_error)) {
+    return TRUE;
+  }
+  if (queue_error == NULL) {
+    return FALSE;
+  }
+  g_set_error(error, BIOMETRIC_STORAGE_ERROR,
+              BIOMETRIC_STORAGE_ERROR_CORRUPTED, "%s", queue_error->message);
+  g_error_free(queue_error);
+  return TRUE;
+}
+
+// Replays the offline queue in order until it is empty or the Secret Service
+// is still unreachable.
+static Task<> replay_offline_queue(BiometricStoragePlugin *self) {
+  RefPtr<BiometricStoragePlugin> plugin =
+      RefPtr<BiometricStoragePlugin>::ref(self);
+  self->replaying = TRUE;
+  gboolean retry = FALSE;
+  std::string name;
+  RefPtr<GHashTable> attributes;
+  SecretPtr content;
+  guint64 id;
+  while (self->offline_queue->front(&name, &attributes, &content, &id)) {
+    gboolean remove = content == nullptr;
+    // Stamped when it reaches the Secret Service, later than anything this
+    // process saw before.
+    GAutoFree<gchar> generation;
+    SecretPtr envelope;
+    if (!remove) {
+      generation.reset(biometric_generation_new(&self->generation_clock));
+      gsize length = strlen(content.get());
+      envelope.reset(co_await offload(self, length, [&] {
+        return biometric_envelope_new(generation.get(), content.get(), length);
+      }));
+      content.reset();
+    }
+    migration_touch(self, name.c_str());
+    RefPtr<GAsyncResult> result = co_await gio_async(
+        [&](GAsyncReadyCallback callback, gpointer user_data) {
+          if (!remove) {
+            secret_password_storev(BIOMETRIC_SCHEMA, attributes.get(),
+                                   SECRET_COLLECTION_DEFAULT, name.c_str(),
+                                   envelope.get(), self->cancellable,
+                                   callback, user_data);
+          } else {
+            secret_password_clear(BIOMETRIC_SCHEMA, self->cancellable,
+                                  callback, user_data, "name", name.c_str(),
+                                  NULL);
+          }
+        });
+    envelope.reset();
+
+    GError *error = NULL;
+    if (remove) {
+      secret_password_clear_finish(result.get(), &error);
+    } else {
+      secret_password_store_finish(result.get(), &error);
+    }
+    if (error == NULL) {
+      self->offline_queue->complete(id, true);
+      self->replay_backoff_seconds = kReplayMinBackoffSeconds;
+      co_await clear_legacy_item(self, name.c_str());
+      if (!remove) {
+        co_await purge_stale_variants(self, attributes.get(),
+                                      generation.get());
+      }
+      continue;
+    }
+    if (g_error_matches(error, G_IO_ERROR, G_IO_ERROR_CANCELLED)) {
+      g_error_free(error);
+      break;
+    }
+    if (is_service_unavailable(error)) {
+      self->replay_backoff_seconds = MIN(self->replay_backoff_seconds * 2,
+                                         kReplayMaxBackoffSeconds);
+      retry = TRUE;
+      g_error_free(error);
+      break;
+    }
+    g_warning("Dropping queued keyring operation for %s: %s", name.c_str(),
+              error->message);
+    g_error_free(error);
+    self->offline_queue->complete(id, false);
+  }
+  self->replaying = FALSE;
+  if (retry) {
+    schedule_replay(self);
+  }
+}
@@ -0,0 +1,63 @@
+#include "biometric_storage_plugin_internal.h"
+
+// Fetches `name` into the prefetcher. Never shows an unlock prompt, items of
+// locked collections are left to the read.
+static Task<> prefetch_item(BiometricStoragePlugin *self, std::string name,
+                            guint64 generation) {
+  // Keeps the plugin alive while the lookup is pending.
+  RefPtr<BiometricStoragePlugin> plugin =
+      RefPtr<BiometricStoragePlugin>::ref(self);
+  GError *error = NULL;
+  SecretValue *value = co_await find_secret(self, BIOMETRIC_SCHEMA,
+                                            name.c_str(), nullptr, &error);
+  if (error != NULL) {
+    g_debug("Failed to prefetch %s: %s", name.c_str(), error->message);
+    g_error_free(error);
+  }
+  gsize length = 0;
+  const gchar *data =
+      value != nullptr ? secret_content(value, &length) : nullptr;
+  self->prefetching->prefetcher.complete(name, generation, data, length);
+  if (value != nullptr) {
+    secret_value_unref(value);
+  }
+}
+
+void prefetch_observe(BiometricStoragePlugin *self, const gchar *name) {
+  Prefetching *prefetching = self->prefetching;
+  if (!g_hash_table_contains(prefetching->names, name)) {
+    return;
+  }
+  std::vector<std::string> predicted;
+  prefetching->prefetcher.observe(name, g_get_monotonic_time(), &predicted);
+  for (const std::string &successor : predicted) {
+    const gchar *next = successor.c_str();
+    // Storages answered without the keyring gain nothing.
+    if (!g_hash_table_contains(prefetching->names, next) ||
+        plugin_router(self)->location(next) != StorageTier::kSecretService ||
+        offline_queue_has(self, next) ||
+        g_hash_table_contains(self->warm_start->names, next)) {
+      continue;
+    }
+    guint64 generation;
+    if (prefetching->prefetcher.begin(successor, &generation)) {
+      task_detach(prefetch_item(self, successor, generation));
+    }
+  }
+}
+
+Task<gboolean> prefetch_take(BiometricStoragePlugin *self,
+                             const gchar *name, SecretPtr *content) {
+  Prefetcher *prefetcher = &self->prefetching->prefetcher;
+  while (true) {
+    switch (prefetcher->take(name, g_get_monotonic_time(), content)) {
+      case Prefetcher::Lookup::kHit:
+        co_return TRUE;
+      case Prefetcher::Lookup::kMiss:
+        co_return FALSE;
+      case Prefetcher::Lookup::kPending:
+        co_await prefetcher->changed().wait();
+        break;
+    }
+  }
+}
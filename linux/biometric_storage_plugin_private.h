@@ -0,0 +1,40 @@
+#ifndef FLUTTER_PLUGIN_BIOMETRIC_STORAGE_PLUGIN_PRIVATE_H_
+#define FLUTTER_PLUGIN_BIOMETRIC_STORAGE_PLUGIN_PRIVATE_H_
+
+#include <flutter_linux/flutter_linux.h>
+#include <libsecret/secret.h>
+
+#include "include/biometric_storage/biometric_storage_plugin.h"
+#include "biometric_storage_async.h"
+
+// Plugin internals which are not part of the public plugin API, but are
+// shared with the benchmarks in linux/benchmark.
+
+// Schema of all items stored by the plugin.
+const SecretSchema *biometric_get_schema(void);
+
+// Schema of items stored by plugin versions before the layout version 2.
+// They are moved to biometric_get_schema() in the background, see
+// migrate_legacy_items().
+const SecretSchema *biometric_get_legacy_schema(void);
+
+// Prefix prepended to every storage name to build the `name` attribute.
+#define BIOMETRIC_NAME_PREFIX "design.codeux.authpass"
+
+// Builds the error response sent to dart for a failed keyring operation.
+FlMethodResponse *biometric_storage_handle_error(const gchar *message, GError *error);
+
+#ifdef BIOMETRIC_STORAGE_BENCHMARKS
+// Records the time since process start at which `event` first happened, for
+// the cold start benchmark (linux/benchmark/cold_start_benchmark.sh). Does
+// nothing unless BIOMETRIC_STORAGE_TRACE is set to the file to append to.
+// Must be called from the main thread. Only built with the benchmarks.
+void biometric_storage_plugin_trace(const gchar *event);
+#endif
+
+// Runs the plugin method `method` with `args` (owned by the caller until the
+// task completed) and resolves to its response.
+Task<RefPtr<FlMethodResponse>> biometric_storage_plugin_call(
+    BiometricStoragePlugin *self, const gchar *method, FlValue *args);
+
+#endif  // FLUTTER_PLUGIN_BIOMETRIC_STORAGE_PLUGIN_PRIVATE_H_
@@ -0,0 +1,313 @@
+#include "biometric_storage_plugin_internal.h"
+
+#include <algorithm>
+
+#include "biometric_storage_checksum.h"
+#include "biometric_storage_kernel_keyring.h"
+#include "biometric_storage_stable_read.h"
+
+const char kSnapshotConflictError[] = "Snapshot Conflict";
+// `readSnapshot` reads its items again after a torn read, with a delay
+// doubling from kReadSnapshotRetryDelayMs, and gives up after this many
+// attempts.
+const guint kReadSnapshotMaxAttempts = 4;
+const guint kReadSnapshotRetryDelayMs = 20;
+
+// One item of a `readSnapshot` call.
+struct SnapshotItem {
+  // Storage name as passed by dart, and item name.
+  const gchar *storage;
+  GAutoFree<gchar> name;
+  StorageTier tier = StorageTier::kSecretService;
+  // Keyring items found by the last collect_snapshot_item(), several while
+  // a write changing the tags has not deleted the previous variant, and
+  // whether they are of the legacy schema.
+  std::vector<RefPtr<SecretItem>> items;
+  gboolean legacy = FALSE;
+  // Secret of the newest of `items` as loaded by load_snapshot() and its
+  // version: the generation in its header, or the checksum of a legacy
+  // secret. nullptr if there is none.
+  RefPtr<SecretValue> value;
+  GAutoFree<gchar> version;
+};
+
+struct SnapshotCollect {
+  guint running = 0;
+  GError *error = nullptr;
+  AsyncCondition done;
+};
+
+// Looks up the keyring items of `entry`, without loading the secrets.
+static Task<> collect_snapshot_item(BiometricStoragePlugin *self,
+                                    SnapshotItem *entry,
+                                    SnapshotCollect *collect) {
+  RefPtr<GHashTable> query = RefPtr<GHashTable>::adopt(attributes_new());
+  g_hash_table_insert(query.get(), g_strdup("name"),
+                      g_strdup(entry->name.get()));
+  GError *error = NULL;
+  GList *items =
+      co_await search_items(self, BIOMETRIC_SCHEMA, query.get(), &error);
+  entry->legacy = FALSE;
+  if (items == nullptr && error == NULL &&
+      !migration_completed(self->migration)) {
+    items = co_await search_items(self, biometric_get_legacy_schema(),
+                                  query.get(), &error);
+    entry->legacy = TRUE;
+  }
+  entry->items.clear();
+  if (error != NULL) {
+    if (collect->error == nullptr) {
+      collect->error = error;
+    } else {
+      g_error_free(error);
+    }
+  }
+  for (GList *l = items; l != nullptr; l = l->next) {
+    entry->items.push_back(RefPtr<SecretItem>::ref(SECRET_ITEM(l->data)));
+  }
+  g_list_free_full(items, g_object_unref);
+  if (--collect->running == 0) {
+    collect->done.notify_all();
+  }
+}
+
+// Picks the newest of the secrets loaded for `entry`. Returns FALSE and sets
+// `error` if one of them is corrupted.
+static Task<gboolean> resolve_snapshot_item(BiometricStoragePlugin *self,
+                                            SnapshotItem *entry,
+                                            GError **error) {
+  entry->value.reset();
+  entry->version.reset();
+  gchar newest_generation[BIOMETRIC_GENERATION_LENGTH + 1] = "";
+  for (RefPtr<SecretItem> &item : entry->items) {
+    SecretValue *value = secret_item_get_secret(item.get());
+    if (value == nullptr) {
+      continue;
+    }
+    if (entry->legacy) {
+      entry->value =
+          RefPtr<SecretValue>::adopt(co_await legacy_value_wrap(self, value));
+      gsize length;
+      const gchar *content = secret_content(entry->value.get(), &length);
+      entry->version.reset(co_await offload(self, length, [&] {
+        return biometric_checksum_encode(content, length);
+      }));
+      co_return TRUE;
+    }
+    gchar generation[BIOMETRIC_GENERATION_LENGTH + 1];
+    if (!co_await verify_envelope(self, item.get(), value, generation,
+                                  error)) {
+      secret_value_unref(value);
+      entry->value.reset();
+      co_return FALSE;
+    }
+    if (!entry->value || g_strcmp0(generation, newest_generation) > 0) {
+      entry->value = RefPtr<SecretValue>::adopt(value);
+      memcpy(newest_generation, generation, sizeof(newest_generation));
+    } else {
+      secret_value_unref(value);
+    }
+  }
+  if (entry->value) {
+    entry->version.reset(g_strdup(newest_generation));
+  }
+  co_return TRUE;
+}
+
+// Looks up the keyring items of all `entries` concurrently, loads all their
+// secrets in one call and resolves the newest of each. Sets `versions` to
+// their versions, see read_stable().
+static Task<bool> load_snapshot(BiometricStoragePlugin *self,
+                                SecretService *service,
+                                std::vector<SnapshotItem> *entries,
+                                std::vector<std::string> *versions,
+                                GError **error) {
+  SnapshotCollect collect;
+  collect.running = entries->size();
+  for (SnapshotItem &entry : *entries) {
+    task_detach(collect_snapshot_item(self, &entry, &collect));
+  }
+  while (collect.running > 0) {
+    co_await collect.done.wait();
+  }
+  GError *local_error = collect.error;
+  GList *items = nullptr;
+  for (SnapshotItem &entry : *entries) {
+    for (RefPtr<SecretItem> &item : entry.items) {
+      items = g_list_prepend(items, item.get());
+    }
+  }
+  for (GList *l = items; l != nullptr && local_error == NULL; l = l->next) {
+    SecretItem *item = SECRET_ITEM(l->data);
+    if (secret_item_get_locked(item)) {
+      co_await unlock_item(self, service, item, &local_error);
+    }
+  }
+  if (items != nullptr && local_error == NULL) {
+    RefPtr<GAsyncResult> result = co_await gio_async(
+        [&](GAsyncReadyCallback callback, gpointer user_data) {
+          secret_item_load_secrets(items, self->cancellable, callback,
+                                   user_data);
+        });
+    secret_item_load_secrets_finish(result.get(), &local_error);
+  }
+  g_list_free(items);
+  for (gsize i = 0; i < entries->size() && local_error == NULL; i++) {
+    co_await resolve_snapshot_item(self, &(*entries)[i], &local_error);
+  }
+  if (local_error != NULL) {
+    g_propagate_error(error, local_error);
+    co_return false;
+  }
+  versions->clear();
+  for (SnapshotItem &entry : *entries) {
+    versions->push_back(entry.version ? entry.version.get() : "");
+  }
+  co_return true;
+}
+
+// Reads args["names"] as of one point in time, see read_stable(). Every
+// write stamps the secret with a new generation, which is its version.
+// Secrets of the legacy schema have no generation, their checksum is
+// compared instead.
+//
+// Storages in the file store or kernel keyring and with queued offline
+// operations are read from the plugin's own state once the keyring read is
+// stable, the warm start snapshot and prefetched secrets are bypassed since
+// they may be out of date. Sharded storages span several items, which
+// cannot be read at one point in time, and are rejected.
+Task<RefPtr<FlMethodResponse>> handleReadSnapshot(
+    BiometricStoragePlugin *self, FlValue *args) {
+  FlValue *names = lookup_typed(args, "names", FL_VALUE_TYPE_LIST);
+  if (names == nullptr) {
+    co_return bad_arguments("Expected a list of names");
+  }
+  std::vector<SnapshotItem> entries;
+  std::vector<SnapshotItem> local;
+  for (size_t i = 0; i < fl_value_get_length(names); i++) {
+    FlValue *value = fl_value_get_list_value(names, i);
+    if (fl_value_get_type(value) != FL_VALUE_TYPE_STRING) {
+      co_return bad_arguments("Storage names must be strings");
+    }
+    SnapshotItem entry;
+    entry.storage = fl_value_get_string(value);
+    entry.name.reset(prefixed_name(entry.storage));
+    if (self->credentials == nullptr) {
+      entry.tier = plugin_router(self)->location(entry.name.get());
+    }
+    if (entry.tier == StorageTier::kSharded) {
+      co_return bad_arguments("Sharded storages cannot be read in a snapshot");
+    } else if (entry.tier != StorageTier::kSecretService) {
+      local.push_back(std::move(entry));
+    } else {
+      entries.push_back(std::move(entry));
+    }
+  }
+  ReadSnapshotStats *stats = &self->read_snapshot_stats;
+  stats->reads++;
+  GError *error = NULL;
+  if (self->credentials != nullptr) {
+    // Only this process writes the overlay, and credentials do not change
+    // while the service runs.
+    CredentialStore *store = co_await credentials_open(self, &error);
+    FlValue *result = fl_value_new_map();
+    for (gsize i = 0; store != nullptr && i < entries.size() + local.size();
+         i++) {
+      SnapshotItem &entry =
+          i < entries.size() ? entries[i] : local[i - entries.size()];
+      SecretPtr stored;
+      if (!store->lookup(entry.name.get(), &stored, &error)) {
+        break;
+      }
+      fl_value_set_string_take(result, entry.storage,
+                               stored != nullptr
+                                   ? fl_value_new_string(stored.get())
+                                   : fl_value_new_null());
+    }
+    if (error == NULL) {
+      co_return success_response_take(result);
+    }
+    fl_value_unref(result);
+    RefPtr<FlMethodResponse> response = RefPtr<FlMethodResponse>::adopt(
+        biometric_storage_handle_error("Failed to read snapshot", error));
+    g_error_free(error);
+    co_return response;
+  }
+  gboolean file_store_used =
+      std::any_of(local.begin(), local.end(), [](const SnapshotItem &entry) {
+        return entry.tier == StorageTier::kFile;
+      });
+  if (file_store_used && co_await file_store_open(self, &error) == nullptr) {
+    RefPtr<FlMethodResponse> response = RefPtr<FlMethodResponse>::adopt(
+        biometric_storage_handle_error("Failed to open file store", error));
+    g_error_free(error);
+    co_return response;
+  }
+  RefPtr<SecretService> service;
+  if (!entries.empty()) {
+    service = co_await get_service(self, &error);
+    if (!service) {
+      RefPtr<FlMethodResponse> response = RefPtr<FlMethodResponse>::adopt(
+          biometric_storage_handle_error("Failed to read snapshot", error));
+      g_error_free(error);
+      co_return response;
+    }
+  }
+
+  StableRead outcome = co_await read_stable(
+      [&](std::vector<std::string> *versions) {
+        return load_snapshot(self, service.get(), &entries, versions, &error);
+      },
+      kReadSnapshotMaxAttempts, kReadSnapshotRetryDelayMs,
+      &stats->torn_reads);
+  if (outcome == StableRead::kStable) {
+    FlValue *result = fl_value_new_map();
+    for (gsize i = 0; i < entries.size(); i++) {
+      SecretPtr queued;
+      if (offline_queue_lookup(self, entries[i].name.get(), &queued,
+                               &error)) {
+        if (error != NULL) {
+          break;
+        }
+        fl_value_set_string_take(result, entries[i].storage,
+                                 queued != nullptr
+                                     ? fl_value_new_string(queued.get())
+                                     : fl_value_new_null());
+        continue;
+      }
+      SecretValue *secret = entries[i].value.steal();
+      fl_value_set_string_take(result, entries[i].storage,
+                               secret != nullptr ? take_secret_value(secret)
+                                                 : fl_value_new_null());
+    }
+    for (gsize i = 0; i < local.size() && error == NULL; i++) {
+      SecretPtr stored;
+      gchar *data = nullptr;
+      if (local[i].tier == StorageTier::kFile) {
+        self->file_backend->store->lookup(local[i].name.get(), &stored);
+      } else if (biometric_kernel_key_lookup(local[i].name.get(), &data,
+                                             &error)) {
+        stored.reset(data);
+      }
+      fl_value_set_string_take(result, local[i].storage,
+                               stored != nullptr
+                                   ? fl_value_new_string(stored.get())
+                                   : fl_value_new_null());
+    }
+    if (error == NULL) {
+      co_return success_response_take(result);
+    }
+    fl_value_unref(result);
+  }
+  if (error != NULL) {
+    RefPtr<FlMethodResponse> response = RefPtr<FlMethodResponse>::adopt(
+        biometric_storage_handle_error("Failed to read snapshot", error));
+    g_error_free(error);
+    co_return response;
+  }
+  stats->conflicts++;
+  co_return RefPtr<FlMethodResponse>::adopt(
+      FL_METHOD_RESPONSE(fl_method_error_response_new(
+          kSnapshotConflictError,
+          "Storages kept changing while reading them", nullptr)));
+}
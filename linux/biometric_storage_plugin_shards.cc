@@ -0,0 +1,315 @@
+#include "biometric_storage_plugin_internal.h"
+
+#include <algorithm>
+#include <map>
+
+#include "biometric_storage_checksum.h"
+
+// Attributes of the shards of a sharded write. Storages in the Secret Service
+// keep both in the header of their secret instead, see
+// biometric_storage_envelope.h.
+const char kGenerationAttribute[] = "generation";
+// biometric_checksum_encode() of the shard, checked by every lookup, see
+// verify_checksum().
+const char kChecksumAttribute[] = "checksum";
+
+// Secrets of storages in StorageTier::kSharded are split into items of at
+// most this size, see sharded_write().
+const gsize kShardMaxSize = 512 * 1024;
+
+// Schema of the items holding the secrets of storages in
+// StorageTier::kSharded, see sharded_write().
+static const SecretSchema *shard_schema() {
+  static const SecretSchema the_schema = {
+      "design.codeux.BiometricStorage.Shard",
+      SECRET_SCHEMA_NONE,
+      {
+          {"name", SECRET_SCHEMA_ATTRIBUTE_STRING},
+          {"shard", SECRET_SCHEMA_ATTRIBUTE_STRING},
+          {"shards", SECRET_SCHEMA_ATTRIBUTE_STRING},
+          {"generation", SECRET_SCHEMA_ATTRIBUTE_STRING},
+          {"checksum", SECRET_SCHEMA_ATTRIBUTE_STRING},
+      }};
+  return &the_schema;
+}
+
+// Returns the generation attribute of a shard, nullptr if it has none.
+static gchar *item_generation(SecretItem *item) {
+  GHashTable *attributes = secret_item_get_attributes(item);
+  gchar *generation = g_strdup(static_cast<const gchar *>(
+      g_hash_table_lookup(attributes, kGenerationAttribute)));
+  g_hash_table_unref(attributes);
+  return generation;
+}
+
+// Checks the secret `value` of shard `item` against its checksum attribute.
+// Returns FALSE and sets `error` if a Secret Service returned a corrupted
+// or truncated secret.
+static gboolean verify_checksum(BiometricStoragePlugin *self, SecretItem *item,
+                                SecretValue *value, GError **error) {
+  IntegrityStats *stats = &self->integrity_stats;
+  g_autoptr(GHashTable) attributes = secret_item_get_attributes(item);
+  const gchar *expected = static_cast<const gchar *>(
+      g_hash_table_lookup(attributes, kChecksumAttribute));
+  if (expected == nullptr) {
+    stats->unchecked++;
+    return TRUE;
+  }
+  gsize length;
+  const gchar *data = secret_value_get(value, &length);
+  g_autofree gchar *actual = biometric_checksum_encode(data, length);
+  if (g_ascii_strcasecmp(actual, expected) != 0) {
+    stats->corrupted++;
+    g_autofree gchar *label = secret_item_get_label(item);
+    g_set_error(error, BIOMETRIC_STORAGE_ERROR,
+                BIOMETRIC_STORAGE_ERROR_CORRUPTED,
+                "Secret of %s (%" G_GSIZE_FORMAT
+                " bytes) does not match its checksum",
+                label, length);
+    return FALSE;
+  }
+  stats->verified++;
+  return TRUE;
+}
+
+// Shards of one sharded_write() stored concurrently.
+struct ShardWrite {
+  guint running = 0;
+  GError *error = nullptr;
+  AsyncCondition done;
+};
+
+static Task<> store_shard(BiometricStoragePlugin *self, const gchar *name,
+                          const gchar *generation, gsize index, gsize count,
+                          SecretPtr data, ShardWrite *write) {
+  RefPtr<GHashTable> attributes = RefPtr<GHashTable>::adopt(attributes_new());
+  g_hash_table_insert(attributes.get(), g_strdup("name"), g_strdup(name));
+  g_hash_table_insert(attributes.get(), g_strdup("shard"),
+                      g_strdup_printf("%" G_GSIZE_FORMAT, index));
+  g_hash_table_insert(attributes.get(), g_strdup("shards"),
+                      g_strdup_printf("%" G_GSIZE_FORMAT, count));
+  g_hash_table_insert(attributes.get(), g_strdup(kGenerationAttribute),
+                      g_strdup(generation));
+  g_hash_table_insert(attributes.get(), g_strdup(kChecksumAttribute),
+                      biometric_checksum_encode(data.get(), strlen(data.get())));
+  GAutoFree<gchar> label(g_strdup_printf(
+      "%s (%" G_GSIZE_FORMAT "/%" G_GSIZE_FORMAT ")", name, index + 1, count));
+  RefPtr<GAsyncResult> result = co_await gio_async(
+      [&](GAsyncReadyCallback callback, gpointer user_data) {
+        secret_password_storev(shard_schema(), attributes.get(),
+                               SECRET_COLLECTION_DEFAULT, label.get(),
+                               data.get(), self->cancellable, callback,
+                               user_data);
+      });
+  GError *error = NULL;
+  if (!secret_password_store_finish(result.get(), &error)) {
+    if (write->error == nullptr) {
+      write->error = error;
+    } else {
+      g_error_free(error);
+    }
+  }
+  if (--write->running == 0) {
+    write->done.notify_all();
+  }
+}
+
+// Deletes the shards of `name` which are not of `generation`.
+static Task<> purge_stale_shards(BiometricStoragePlugin *self,
+                                 const gchar *name, const gchar *generation) {
+  RefPtr<GHashTable> query = RefPtr<GHashTable>::adopt(attributes_new());
+  g_hash_table_insert(query.get(), g_strdup("name"), g_strdup(name));
+  GError *error = NULL;
+  GList *items =
+      co_await search_items(self, shard_schema(), query.get(), &error);
+  if (error != NULL) {
+    g_warning("Failed to search for stale shards: %s", error->message);
+    g_error_free(error);
+    co_return;
+  }
+  for (GList *l = items; l != nullptr; l = l->next) {
+    SecretItem *item = SECRET_ITEM(l->data);
+    GAutoFree<gchar> shard_generation(item_generation(item));
+    if (g_strcmp0(shard_generation.get(), generation) == 0) {
+      continue;
+    }
+    RefPtr<GAsyncResult> result = co_await gio_async(
+        [&](GAsyncReadyCallback callback, gpointer user_data) {
+          secret_item_delete(item, self->cancellable, callback, user_data);
+        });
+    if (!secret_item_delete_finish(item, result.get(), &error)) {
+      g_warning("Failed to delete stale shard: %s", error->message);
+      g_clear_error(&error);
+    }
+  }
+  g_list_free_full(items, g_object_unref);
+}
+
+Task<RefPtr<FlMethodResponse>> sharded_write(
+    BiometricStoragePlugin *self, const gchar *name, const gchar *content) {
+  gsize length = strlen(content);
+  std::vector<gsize> ends;
+  gsize start = 0;
+  do {
+    gsize end = MIN(start + kShardMaxSize, length);
+    // A character has at most three continuation bytes.
+    for (int i = 0; i < 3 && end < length && (content[end] & 0xc0) == 0x80;
+         i++) {
+      end--;
+    }
+    ends.push_back(end);
+    start = end;
+  } while (start < length);
+
+  GAutoFree<gchar> generation(
+      biometric_generation_new(&self->generation_clock));
+  ShardWrite write;
+  write.running = ends.size();
+  start = 0;
+  for (gsize i = 0; i < ends.size(); i++) {
+    task_detach(store_shard(self, name, generation.get(), i, ends.size(),
+                            SecretPtr(g_strndup(content + start,
+                                                ends[i] - start)),
+                            &write));
+    start = ends[i];
+  }
+  while (write.running > 0) {
+    co_await write.done.wait();
+  }
+  if (write.error != nullptr) {
+    RefPtr<FlMethodResponse> response = RefPtr<FlMethodResponse>::adopt(
+        biometric_storage_handle_error("Failed to store shards", write.error));
+    g_error_free(write.error);
+    co_return response;
+  }
+  co_await purge_stale_shards(self, name, generation.get());
+  co_return success_response_take(fl_value_new_bool(true));
+}
+
+// Returns the shards of the newest generation in `items` which has all of
+// them, in order, or none if there is no complete generation.
+static std::vector<SecretItem *> newest_shards(GList *items) {
+  guint length = g_list_length(items);
+  std::map<std::string, std::vector<SecretItem *>> generations;
+  for (GList *l = items; l != nullptr; l = l->next) {
+    SecretItem *item = SECRET_ITEM(l->data);
+    g_autoptr(GHashTable) attributes = secret_item_get_attributes(item);
+    const gchar *generation = static_cast<const gchar *>(
+        g_hash_table_lookup(attributes, kGenerationAttribute));
+    const gchar *shard =
+        static_cast<const gchar *>(g_hash_table_lookup(attributes, "shard"));
+    const gchar *shards =
+        static_cast<const gchar *>(g_hash_table_lookup(attributes, "shards"));
+    guint64 index, count;
+    if (generation == nullptr || shard == nullptr || shards == nullptr ||
+        !g_ascii_string_to_unsigned(shards, 10, 1, length, &count, NULL) ||
+        !g_ascii_string_to_unsigned(shard, 10, 0, count - 1, &index, NULL)) {
+      continue;
+    }
+    std::vector<SecretItem *> &found = generations[generation];
+    if (found.empty()) {
+      found.resize(count, nullptr);
+    }
+    if (found.size() == count) {
+      found[index] = item;
+    }
+  }
+  for (auto it = generations.rbegin(); it != generations.rend(); it++) {
+    if (std::find(it->second.begin(), it->second.end(), nullptr) ==
+        it->second.end()) {
+      return it->second;
+    }
+  }
+  return {};
+}
+
+Task<gboolean> sharded_read(BiometricStoragePlugin *self,
+                            const gchar *name, SecretPtr *content,
+                            RefPtr<FlMethodResponse> *response) {
+  content->reset();
+  GError *error = NULL;
+  RefPtr<SecretService> service = co_await get_service(self, &error);
+  GList *items = nullptr;
+  if (service) {
+    RefPtr<GHashTable> query = RefPtr<GHashTable>::adopt(attributes_new());
+    g_hash_table_insert(query.get(), g_strdup("name"), g_strdup(name));
+    items = co_await search_items(self, shard_schema(), query.get(), &error);
+  }
+  std::vector<SecretItem *> shards = newest_shards(items);
+  for (SecretItem *shard : shards) {
+    if (error == NULL && secret_item_get_locked(shard)) {
+      co_await unlock_item(self, service.get(), shard, &error);
+    }
+  }
+  if (error == NULL && !shards.empty()) {
+    GList *list = nullptr;
+    for (auto it = shards.rbegin(); it != shards.rend(); it++) {
+      list = g_list_prepend(list, *it);
+    }
+    RefPtr<GAsyncResult> result = co_await gio_async(
+        [&](GAsyncReadyCallback callback, gpointer user_data) {
+          secret_item_load_secrets(list, self->cancellable, callback,
+                                   user_data);
+        });
+    secret_item_load_secrets_finish(result.get(), &error);
+    g_list_free(list);
+  }
+  std::vector<SecretValue *> values;
+  gsize length = 0;
+  for (gsize i = 0; i < shards.size() && error == NULL; i++) {
+    SecretValue *value = secret_item_get_secret(shards[i]);
+    if (value == nullptr) {
+      g_set_error(&error, BIOMETRIC_STORAGE_ERROR,
+                  BIOMETRIC_STORAGE_ERROR_CORRUPTED,
+                  "Shard %" G_GSIZE_FORMAT " of %s has no secret", i, name);
+      break;
+    }
+    values.push_back(value);
+    if (verify_checksum(self, shards[i], value, &error)) {
+      gsize shard_length;
+      secret_value_get(value, &shard_length);
+      length += shard_length;
+    }
+  }
+  if (error == NULL && !shards.empty()) {
+    gchar *joined = static_cast<gchar *>(g_malloc(length + 1));
+    gsize offset = 0;
+    for (SecretValue *value : values) {
+      gsize shard_length;
+      const gchar *data = secret_value_get(value, &shard_length);
+      memcpy(joined + offset, data, shard_length);
+      offset += shard_length;
+    }
+    joined[length] = '\0';
+    content->reset(joined);
+  }
+  for (SecretValue *value : values) {
+    secret_value_unref(value);
+  }
+  g_list_free_full(items, g_object_unref);
+  if (error != NULL) {
+    *response = RefPtr<FlMethodResponse>::adopt(
+        biometric_storage_handle_error("Failed to read shards", error));
+    g_error_free(error);
+    co_return FALSE;
+  }
+  co_return TRUE;
+}
+
+Task<RefPtr<FlMethodResponse>> sharded_delete(
+    BiometricStoragePlugin *self, const gchar *name) {
+  RefPtr<GAsyncResult> result = co_await gio_async(
+      [&](GAsyncReadyCallback callback, gpointer user_data) {
+        secret_password_clear(shard_schema(), self->cancellable, callback,
+                              user_data, "name", name, NULL);
+      });
+  GError *error = NULL;
+  gboolean removed = secret_password_clear_finish(result.get(), &error);
+  if (error != NULL) {
+    RefPtr<FlMethodResponse> response = RefPtr<FlMethodResponse>::adopt(
+        biometric_storage_handle_error("Failed to delete shards", error));
+    g_error_free(error);
+    co_return response;
+  }
+  co_return success_response_take(fl_value_new_bool(removed));
+}
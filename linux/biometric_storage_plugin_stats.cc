@@ -0,0 +1,202 @@
+#include "biometric_storage_plugin_internal.h"
+
+static FlValue *integrity_stats(const IntegrityStats *stats) {
+  FlValue *value = fl_value_new_map();
+  fl_value_set_string_take(value, "verified",
+                           fl_value_new_int(stats->verified));
+  fl_value_set_string_take(value, "unchecked",
+                           fl_value_new_int(stats->unchecked));
+  fl_value_set_string_take(value, "corrupted",
+                           fl_value_new_int(stats->corrupted));
+  return value;
+}
+
+static FlValue *lookup_stats(const LookupStats *stats) {
+  FlValue *value = fl_value_new_map();
+  fl_value_set_string_take(value, "lookups", fl_value_new_int(stats->lookups));
+  fl_value_set_string_take(value, "promptsShown",
+                           fl_value_new_int(stats->prompts_shown));
+  fl_value_set_string_take(value, "promptsCoalesced",
+                           fl_value_new_int(stats->prompts_coalesced));
+  fl_value_set_string_take(value, "promptsDismissed",
+                           fl_value_new_int(stats->prompts_dismissed));
+  fl_value_set_string_take(value, "waitingForPrompt",
+                           fl_value_new_int(stats->waiting));
+  fl_value_set_string_take(
+      value, "promptWaitAvgUs",
+      fl_value_new_float(stats->prompt_waits > 0
+                             ? (gdouble)stats->prompt_wait_total_us /
+                                   stats->prompt_waits
+                             : 0));
+  fl_value_set_string_take(value, "promptWaitMaxUs",
+                           fl_value_new_int(stats->prompt_wait_max_us));
+  fl_value_set_string_take(
+      value, "serviceTimeAvgUs",
+      fl_value_new_float(stats->lookups > 0
+                             ? (gdouble)stats->service_time_total_us /
+                                   stats->lookups
+                             : 0));
+  fl_value_set_string_take(value, "serviceTimeMaxUs",
+                           fl_value_new_int(stats->service_time_max_us));
+  return value;
+}
+
+static FlValue *migration_stats(const Migration *migration) {
+  FlValue *value = fl_value_new_map();
+  fl_value_set_string_take(value, "completed",
+                           fl_value_new_bool(migration->completed));
+  fl_value_set_string_take(value, "running",
+                           fl_value_new_bool(migration->running));
+  fl_value_set_string_take(value, "migrated",
+                           fl_value_new_int(migration->migrated));
+  fl_value_set_string_take(value, "skippedLocked",
+                           fl_value_new_int(migration->skipped_locked));
+  fl_value_set_string_take(value, "fallthroughReads",
+                           fl_value_new_int(migration->fallthrough_reads));
+  fl_value_set_string_take(value, "busyUs",
+                           fl_value_new_int(migration->busy_us));
+  fl_value_set_string_take(value, "throttledUs",
+                           fl_value_new_int(migration->throttled_us));
+  return value;
+}
+
+static FlValue *pipeline_stats(const PipelineStats *stats) {
+  FlValue *value = fl_value_new_map();
+  fl_value_set_string_take(value, "calls", fl_value_new_int(stats->calls));
+  fl_value_set_string_take(value, "operations",
+                           fl_value_new_int(stats->operations));
+  fl_value_set_string_take(value, "failed", fl_value_new_int(stats->failed));
+  fl_value_set_string_take(value, "dependencyWaits",
+                           fl_value_new_int(stats->dependency_waits));
+  return value;
+}
+
+static FlValue *read_snapshot_stats(const ReadSnapshotStats *stats) {
+  FlValue *value = fl_value_new_map();
+  fl_value_set_string_take(value, "reads", fl_value_new_int(stats->reads));
+  fl_value_set_string_take(value, "tornReads",
+                           fl_value_new_int(stats->torn_reads));
+  fl_value_set_string_take(value, "conflicts",
+                           fl_value_new_int(stats->conflicts));
+  return value;
+}
+
+void hot_keys_record(BiometricStoragePlugin *self, const gchar *method,
+                     FlValue *args) {
+  if (IS_METHOD(method, kMethodBatch)) {
+    FlValue *operations = lookup_typed(args, "operations", FL_VALUE_TYPE_LIST);
+    for (size_t i = 0; operations != nullptr &&
+                       i < fl_value_get_length(operations);
+         i++) {
+      FlValue *operation = fl_value_get_list_value(operations, i);
+      FlValue *operation_method =
+          lookup_typed(operation, "method", FL_VALUE_TYPE_STRING);
+      if (operation_method != nullptr &&
+          strcmp(fl_value_get_string(operation_method), kMethodBatch) != 0) {
+        hot_keys_record(self, fl_value_get_string(operation_method),
+                        operation);
+      }
+    }
+    return;
+  }
+  HotKeys *hot_keys;
+  if (IS_METHOD(method, kMethodRead) || IS_METHOD(method, kMethodReadBuffer) ||
+      IS_METHOD(method, kMethodReadMany)) {
+    hot_keys = self->hot_keys[0];
+  } else if (IS_METHOD(method, kMethodWrite)) {
+    hot_keys = self->hot_keys[1];
+  } else if (IS_METHOD(method, kMethodDelete) ||
+             IS_METHOD(method, kMethodDeleteMany)) {
+    hot_keys = self->hot_keys[2];
+  } else {
+    return;
+  }
+  if (fl_value_get_type(args) != FL_VALUE_TYPE_MAP) {
+    return;
+  }
+  gint64 now = g_get_monotonic_time();
+  FlValue *name = lookup_typed(args, "name", FL_VALUE_TYPE_STRING);
+  if (name != nullptr) {
+    hot_keys->record(fl_value_get_string(name), now);
+  }
+  FlValue *names = lookup_typed(args, "names", FL_VALUE_TYPE_LIST);
+  for (size_t i = 0; names != nullptr && i < fl_value_get_length(names); i++) {
+    FlValue *item = fl_value_get_list_value(names, i);
+    if (fl_value_get_type(item) == FL_VALUE_TYPE_STRING) {
+      hot_keys->record(fl_value_get_string(item), now);
+    }
+  }
+}
+
+static FlValue *hot_keys_stats(BiometricStoragePlugin *self) {
+  gint64 now = g_get_monotonic_time();
+  FlValue *stats = fl_value_new_map();
+  fl_value_set_string_take(stats, "halfLifeSeconds",
+                           fl_value_new_int(kHotKeysHalfLifeSeconds));
+  for (gsize i = 0; i < G_N_ELEMENTS(kHotKeyOperations); i++) {
+    fl_value_set_string_take(stats, kHotKeyOperations[i],
+                             self->hot_keys[i]->stats(now));
+  }
+  return stats;
+}
+
+static FlValue *portal_stats(const FileBackend *backend) {
+  if (!backend->portal) {
+    return fl_value_new_null();
+  }
+  FlValue *value = fl_value_new_map();
+  fl_value_set_string_take(value, "retrievals",
+                           fl_value_new_int(backend->portal_retrievals));
+  fl_value_set_string_take(value, "failures",
+                           fl_value_new_int(backend->portal_failures));
+  fl_value_set_string_take(value, "retrieveUs",
+                           fl_value_new_int(backend->portal_retrieve_us));
+  return value;
+}
+
+FlMethodResponse *handleStats(BiometricStoragePlugin *self) {
+  g_autoptr(FlValue) stats = fl_value_new_map();
+  fl_value_set_string_take(stats, "threadPool",
+                           self->thread_pool != nullptr
+                               ? self->thread_pool->stats()
+                               : fl_value_new_null());
+  fl_value_set_string_take(stats, "offlineQueue",
+                           self->offline_queue != nullptr
+                               ? self->offline_queue->stats()
+                               : fl_value_new_null());
+  fl_value_set_string_take(stats, "lookups",
+                           lookup_stats(&self->lookup_stats));
+  fl_value_set_string_take(stats, "integrity",
+                           integrity_stats(&self->integrity_stats));
+  fl_value_set_string_take(stats, "batch",
+                           pipeline_stats(&self->pipeline_stats));
+  fl_value_set_string_take(stats, "readSnapshot",
+                           read_snapshot_stats(&self->read_snapshot_stats));
+  fl_value_set_string_take(stats, "migration",
+                           migration_stats(self->migration));
+  fl_value_set_string_take(stats, "changeLog",
+                           self->change_log != nullptr
+                               ? self->change_log->stats()
+                               : fl_value_new_null());
+  fl_value_set_string_take(stats, "tiers", self->router != nullptr
+                                               ? self->router->stats()
+                                               : fl_value_new_null());
+  fl_value_set_string_take(stats, "fileStore",
+                           self->file_backend->store != nullptr
+                               ? self->file_backend->store->stats()
+                               : fl_value_new_null());
+  fl_value_set_string_take(stats, "portal", portal_stats(self->file_backend));
+  fl_value_set_string_take(stats, "credentials",
+                           self->credentials != nullptr &&
+                                   self->credentials->store != nullptr
+                               ? self->credentials->store->stats()
+                               : fl_value_new_null());
+  fl_value_set_string_take(stats, "warmStart",
+                           self->warm_start->load_started
+                               ? self->warm_start->snapshot.stats()
+                               : fl_value_new_null());
+  fl_value_set_string_take(stats, "prefetch",
+                           self->prefetching->prefetcher.stats());
+  fl_value_set_string_take(stats, "hotKeys", hot_keys_stats(self));
+  return FL_METHOD_RESPONSE(fl_method_success_response_new(stats));
+}
@@ -0,0 +1,333 @@
+#include "biometric_storage_plugin_internal.h"
+
+#include "biometric_storage_crypto.h"
+#include "biometric_storage_kernel_keyring.h"
+#include "biometric_storage_portal.h"
+
+const char kFileStoreKeyName[] = "file_store";
+
+// The Secret portal has its own index, storages are in the file store
+// unless it says otherwise.
+static gchar *routes_path(gboolean portal) {
+  return g_build_filename(g_get_user_data_dir(), "biometric_storage",
+                          portal ? "portal_routes.ini" : "routes.ini", NULL);
+}
+
+TierRouter *plugin_router(BiometricStoragePlugin *self) {
+  if (self->router == nullptr) {
+    gboolean portal = self->file_backend->portal;
+    self->router = new TierRouter(
+        kNamePrefix, portal ? StorageTier::kFile : StorageTier::kSecretService);
+    g_autofree gchar *path = routes_path(portal);
+    self->router->load(path);
+  }
+  return self->router;
+}
+
+// Stores sealed with the key of the Secret portal and with the one from
+// the keyring are kept apart.
+static gchar *file_store_path(gboolean portal) {
+  return g_build_filename(g_get_user_data_dir(), "biometric_storage",
+                          portal ? "portal_store.log" : "store.log", NULL);
+}
+
+// Retrieves the file store key from the Secret portal.
+static Task<gboolean> portal_retrieve_key(BiometricStoragePlugin *self,
+                                          guint8 key[BIOMETRIC_AEAD_KEY_SIZE],
+                                          GError **error) {
+  FileBackend *backend = self->file_backend;
+  gint64 started = g_get_monotonic_time();
+  gboolean retrieved =
+      co_await biometric_portal_retrieve_key(key, self->cancellable, error);
+  backend->portal_retrieve_us = g_get_monotonic_time() - started;
+  backend->portal_retrievals++;
+  if (!retrieved) {
+    backend->portal_failures++;
+  }
+  co_return retrieved;
+}
+
+Task<FileStore *> file_store_open(BiometricStoragePlugin *self,
+                                  GError **error) {
+  FileBackend *backend = self->file_backend;
+  while (backend->opening) {
+    co_await backend->opened.wait();
+  }
+  if (backend->store != nullptr) {
+    co_return backend->store;
+  }
+  backend->opening = TRUE;
+  GError *local_error = NULL;
+  GAutoFree<gchar> path(file_store_path(backend->portal));
+  guint8 key[BIOMETRIC_AEAD_KEY_SIZE];
+  if (backend->portal) {
+    co_await portal_retrieve_key(self, key, &local_error);
+  } else {
+    gchar *encoded = co_await lookup_key(
+        self, kFileStoreKeyName, "Biometric storage file store key",
+        &local_error);
+    if (encoded != nullptr && !biometric_key_decode(encoded, key)) {
+      local_error = g_error_new(G_IO_ERROR, G_IO_ERROR_INVALID_DATA,
+                                "The file store key is malformed");
+    }
+    biometric_secret_free(encoded);
+  }
+  if (local_error == NULL) {
+    FileStore *store = new FileStore(key, plugin_thread_pool(self),
+                                     FileLog::Mode::kAuto, 0);
+    gboolean opened = co_await run_on(plugin_thread_pool(self), [&] {
+      return store->open(path.get(), &local_error);
+    });
+    if (opened) {
+      backend->store = store;
+    } else {
+      delete store;
+    }
+  }
+  biometric_wipe(key, sizeof(key));
+  backend->opening = FALSE;
+  backend->opened.notify_all();
+  if (local_error != NULL) {
+    g_propagate_error(error, local_error);
+  }
+  co_return backend->store;
+}
+
+static Task<RefPtr<FlMethodResponse>> file_store_write(
+    BiometricStoragePlugin *self, const gchar *name, const gchar *content) {
+  GError *error = NULL;
+  FileStore *store = co_await file_store_open(self, &error);
+  if (store == nullptr) {
+    RefPtr<FlMethodResponse> response = RefPtr<FlMethodResponse>::adopt(
+        biometric_storage_handle_error("Failed to open file store", error));
+    g_error_free(error);
+    co_return response;
+  }
+  if (!co_await store->put(name, content, strlen(content))) {
+    co_return RefPtr<FlMethodResponse>::adopt(
+        FL_METHOD_RESPONSE(fl_method_error_response_new(
+            kSecurityAccessError, "Failed to commit write to file store",
+            nullptr)));
+  }
+  co_return success_response_take(fl_value_new_bool(true));
+}
+
+static Task<RefPtr<FlMethodResponse>> file_store_delete(
+    BiometricStoragePlugin *self, const gchar *name) {
+  GError *error = NULL;
+  FileStore *store = co_await file_store_open(self, &error);
+  if (store == nullptr) {
+    RefPtr<FlMethodResponse> response = RefPtr<FlMethodResponse>::adopt(
+        biometric_storage_handle_error("Failed to open file store", error));
+    g_error_free(error);
+    co_return response;
+  }
+  bool existed = false;
+  if (!co_await store->remove(name, &existed)) {
+    co_return RefPtr<FlMethodResponse>::adopt(
+        FL_METHOD_RESPONSE(fl_method_error_response_new(
+            kSecurityAccessError, "Failed to commit delete to file store",
+            nullptr)));
+  }
+  co_return success_response_take(fl_value_new_bool(existed));
+}
+
+// Looks up `name` in the file store. Returns FALSE with `response` set to
+// the error if the store could not be opened.
+static Task<gboolean> file_store_read(BiometricStoragePlugin *self,
+                                      const gchar *name, SecretPtr *content,
+                                      RefPtr<FlMethodResponse> *response) {
+  GError *error = NULL;
+  FileStore *store = co_await file_store_open(self, &error);
+  if (store == nullptr) {
+    *response = RefPtr<FlMethodResponse>::adopt(
+        biometric_storage_handle_error("Failed to open file store", error));
+    g_error_free(error);
+    co_return FALSE;
+  }
+  if (!store->lookup(name, content)) {
+    content->reset();
+  }
+  co_return TRUE;
+}
+
+static RefPtr<FlMethodResponse> kernel_key_delete(const gchar *name) {
+  GError *error = NULL;
+  gboolean existed = FALSE;
+  if (!biometric_kernel_key_remove(name, &existed, &error)) {
+    RefPtr<FlMethodResponse> response = RefPtr<FlMethodResponse>::adopt(
+        biometric_storage_handle_error("Failed to delete kernel key", error));
+    g_error_free(error);
+    return response;
+  }
+  return success_response_take(fl_value_new_bool(existed));
+}
+
+// Looks up `name` in the kernel keyring. Returns FALSE with `response` set
+// to the error if the keyring is not accessible.
+static gboolean kernel_key_read(const gchar *name, SecretPtr *content,
+                                RefPtr<FlMethodResponse> *response) {
+  gchar *data = nullptr;
+  GError *error = NULL;
+  if (!biometric_kernel_key_lookup(name, &data, &error)) {
+    *response = RefPtr<FlMethodResponse>::adopt(
+        biometric_storage_handle_error("Failed to read kernel key", error));
+    g_error_free(error);
+    return FALSE;
+  }
+  content->reset(data);
+  return TRUE;
+}
+
+Task<gboolean> tier_read(BiometricStoragePlugin *self,
+                         const gchar *name, StorageTier tier,
+                         SecretPtr *content,
+                         RefPtr<FlMethodResponse> *response) {
+  switch (tier) {
+    case StorageTier::kFile:
+      co_return co_await file_store_read(self, name, content, response);
+    case StorageTier::kKernelKeyring:
+      co_return kernel_key_read(name, content, response);
+    case StorageTier::kSharded:
+      co_return co_await sharded_read(self, name, content, response);
+    case StorageTier::kSecretService:
+      break;
+  }
+  g_assert_not_reached();
+  co_return FALSE;
+}
+
+static Task<RefPtr<FlMethodResponse>> tier_delete(BiometricStoragePlugin *self,
+                                                  const gchar *name,
+                                                  StorageTier tier) {
+  switch (tier) {
+    case StorageTier::kFile:
+      co_return co_await file_store_delete(self, name);
+    case StorageTier::kKernelKeyring:
+      co_return kernel_key_delete(name);
+    case StorageTier::kSharded:
+      co_return co_await sharded_delete(self, name);
+    case StorageTier::kSecretService:
+      break;
+  }
+  co_return co_await secret_service_delete(self, name);
+}
+
+static void route_set(BiometricStoragePlugin *self, const gchar *name,
+                      StorageTier tier) {
+  GError *error = NULL;
+  if (!plugin_router(self)->move(name, tier, &error)) {
+    g_warning("Failed to save storage routes: %s", error->message);
+    g_error_free(error);
+  }
+}
+
+// Routes reads of `name` to `tier` after it was written there, and deletes
+// what the tier it was in before still holds.
+static Task<> route_moved(BiometricStoragePlugin *self, const gchar *name,
+                          StorageTier tier) {
+  StorageTier previous = plugin_router(self)->location(name);
+  route_set(self, name, tier);
+  if (previous == tier) {
+    co_return;
+  }
+  RefPtr<FlMethodResponse> response = co_await tier_delete(self, name, previous);
+  if (FL_IS_METHOD_ERROR_RESPONSE(response.get())) {
+    g_warning("Failed to delete %s from the %s tier after it moved", name,
+              storage_tier_name(previous));
+  }
+}
+
+Task<RefPtr<FlMethodResponse>> write_storage(
+    BiometricStoragePlugin *self, FlValue *args) {
+  GAutoFree<gchar> name(item_name(args));
+  PrefetchWrite prefetch_write(self, name.get());
+  const gchar *content =
+      fl_value_get_string(fl_value_lookup_string(args, "content"));
+  FlValue *tags = fl_value_lookup_string(args, "tags");
+  gboolean tagged =
+      tags != nullptr && fl_value_get_type(tags) != FL_VALUE_TYPE_NULL;
+  if (self->credentials != nullptr) {
+    if (tagged) {
+      co_return bad_arguments("Tags are not supported with credentials");
+    }
+    co_return co_await credentials_write(self, name.get(), content);
+  }
+  TierRouter *router = plugin_router(self);
+  gsize length = strlen(content);
+  StorageTier tier;
+  if (!router->route_write(name.get(), length, tagged, &tier)) {
+    co_return bad_arguments(
+        "Tags are only supported in the secretService tier");
+  }
+  RefPtr<FlMethodResponse> response;
+  GError *error = NULL;
+  switch (tier) {
+    case StorageTier::kFile:
+      response = co_await file_store_write(self, name.get(), content);
+      break;
+    case StorageTier::kSharded:
+      response = co_await sharded_write(self, name.get(), content);
+      break;
+    case StorageTier::kKernelKeyring:
+      if (biometric_kernel_key_store(name.get(), content, length, &error)) {
+        response = success_response_take(fl_value_new_bool(true));
+        break;
+      }
+      // Over quota or blocked by a sandbox. The default tier is the file
+      // store in portal mode, where the Secret Service may be missing.
+      tier = router->default_tier();
+      g_warning("Writing %s to the default tier (%s) instead: %s", name.get(),
+                storage_tier_name(tier), error->message);
+      g_error_free(error);
+      router->count_fallback();
+      if (tier == StorageTier::kFile) {
+        response = co_await file_store_write(self, name.get(), content);
+        break;
+      }
+      [[fallthrough]];
+    case StorageTier::kSecretService:
+      response = co_await secret_service_write(self, name.get(), content, tags);
+      break;
+  }
+  if (FL_IS_METHOD_SUCCESS_RESPONSE(response.get())) {
+    co_await route_moved(self, name.get(), tier);
+  }
+  co_return response;
+}
+
+Task<RefPtr<FlMethodResponse>> delete_storage(
+    BiometricStoragePlugin *self, FlValue *args) {
+  GAutoFree<gchar> name(item_name(args));
+  PrefetchWrite prefetch_write(self, name.get());
+  if (self->credentials != nullptr) {
+    co_return co_await credentials_delete(self, name.get());
+  }
+  TierRouter *router = plugin_router(self);
+  StorageTier tier = router->location(name.get());
+  RefPtr<FlMethodResponse> response =
+      co_await tier_delete(self, name.get(), tier);
+  if (tier != router->default_tier() &&
+      FL_IS_METHOD_SUCCESS_RESPONSE(response.get())) {
+    // Only storages which exist are kept in the index.
+    route_set(self, name.get(), router->default_tier());
+  }
+  co_return response;
+}
+
+FlMethodResponse *handleSetTierPolicy(BiometricStoragePlugin *self,
+                                      FlValue *args) {
+  if (self->credentials != nullptr) {
+    return FL_METHOD_RESPONSE(fl_method_error_response_new(
+        kBadArgumentsError, "Tiers are not supported with credentials",
+        nullptr));
+  }
+  g_autoptr(GError) error = NULL;
+  if (!plugin_router(self)->set_policy(
+          lookup_typed(args, "rules", FL_VALUE_TYPE_LIST), &error)) {
+    return FL_METHOD_RESPONSE(fl_method_error_response_new(
+        kBadArgumentsError, error->message, nullptr));
+  }
+  return FL_METHOD_RESPONSE(
+      fl_method_success_response_new(fl_value_new_bool(true)));
+}
@@ -0,0 +1,208 @@
+#include "biometric_storage_plugin_internal.h"
+
+#include <glib/gstdio.h>
+
+#include "biometric_storage_crypto.h"
+
+// Changes of the warm start snapshot are saved this long after the last one.
+const guint kSnapshotSaveDelaySeconds = 2;
+const char kSnapshotKeyName[] = "warm_start";
+
+static gchar *snapshot_path() {
+  return g_build_filename(g_get_user_cache_dir(), "biometric_storage",
+                          "snapshot.bin", NULL);
+}
+
+// Compares the cached secrets with the keyring, one at a time, and replaces
+// those which were changed by someone else since the snapshot was saved.
+static Task<> revalidate_snapshot(BiometricStoragePlugin *self) {
+  Snapshot *snapshot = &self->warm_start->snapshot;
+  for (const std::string &name : snapshot->names()) {
+    if (offline_queue_has(self, name.c_str())) {
+      continue;
+    }
+    guint64 version = snapshot->version(name.c_str());
+    GError *error = NULL;
+    SecretValue *value = co_await lookup_secret(self, name.c_str(), &error);
+    if (error != NULL) {
+      g_warning("Failed to revalidate %s: %s", name.c_str(), error->message);
+      g_error_free(error);
+      continue;
+    }
+    gsize length = 0;
+    const gchar *content =
+        value != nullptr ? secret_content(value, &length) : nullptr;
+    snapshot->revalidate(name.c_str(), version, content, length);
+    if (value != nullptr) {
+      secret_value_unref(value);
+    }
+  }
+}
+
+static void warm_start_schedule_save(BiometricStoragePlugin *self);
+
+// Looks up the snapshot key, which unlocks the keyring if needed, and loads
+// the snapshot with it. A snapshot which cannot be opened anymore (the key
+// item is gone) is deleted.
+static Task<> warm_start_load(BiometricStoragePlugin *self) {
+  RefPtr<BiometricStoragePlugin> plugin =
+      RefPtr<BiometricStoragePlugin>::ref(self);
+  WarmStart *warm_start = self->warm_start;
+  GAutoFree<gchar> path(snapshot_path());
+  if (g_file_test(path.get(), G_FILE_TEST_EXISTS)) {
+    GError *error = NULL;
+    gchar *key = co_await lookup_key(self, kSnapshotKeyName, nullptr, &error);
+    // Tries again on the next start if the keyring could not be asked.
+    gboolean keep = error != NULL && (is_service_unavailable(error) ||
+                                      g_error_matches(error, G_IO_ERROR,
+                                                      G_IO_ERROR_CANCELLED));
+    gboolean loaded = FALSE;
+    if (key != nullptr && warm_start->snapshot.set_key(key)) {
+      // Nothing touches the snapshot until it is loaded.
+      gint64 started = g_get_monotonic_time();
+      gsize file_size = 0;
+      GByteArray *plain =
+          co_await run_on(plugin_thread_pool(self), [&] {
+            return warm_start->snapshot.read(path.get(), &file_size, &error);
+          });
+      if (plain != nullptr) {
+        warm_start->snapshot.decode(plain, file_size, started);
+        loaded = TRUE;
+      }
+    }
+    biometric_secret_free(key);
+    if (error != NULL) {
+      g_warning("Failed to load warm start snapshot: %s", error->message);
+      g_error_free(error);
+    }
+    if (!loaded && !keep) {
+      g_unlink(path.get());
+    }
+  }
+  warm_start->loaded = TRUE;
+  warm_start->load_done.notify_all();
+  if (warm_start->snapshot.size() > 0) {
+    co_await revalidate_snapshot(self);
+    warm_start_schedule_save(self);
+  }
+}
+
+// Writes the snapshot, storing a new key in the keyring first if there is
+// none yet.
+static Task<> warm_start_save(BiometricStoragePlugin *self) {
+  RefPtr<BiometricStoragePlugin> plugin =
+      RefPtr<BiometricStoragePlugin>::ref(self);
+  WarmStart *warm_start = self->warm_start;
+  warm_start->saving = TRUE;
+  GError *error = NULL;
+  if (!warm_start->snapshot.has_key()) {
+    SecretPtr key(co_await lookup_key(self, kSnapshotKeyName,
+                                      "Biometric storage warm start key",
+                                      &error));
+    if (key != nullptr) {
+      warm_start->snapshot.set_key(key.get());
+    }
+  }
+  if (error == NULL) {
+    // Sealed and written on the thread pool, entries may change meanwhile.
+    GAutoFree<gchar> path(snapshot_path());
+    GByteArray *plain = warm_start->snapshot.encode();
+    gsize file_size = 0;
+    gboolean saved = co_await run_on(plugin_thread_pool(self), [&] {
+      return warm_start->snapshot.write(path.get(), plain, &file_size,
+                                        &error);
+    });
+    warm_start->snapshot.saved(saved, file_size);
+  }
+  if (error != NULL) {
+    g_warning("Failed to save warm start snapshot: %s", error->message);
+    g_error_free(error);
+  }
+  warm_start->saving = FALSE;
+  // Changed while saving.
+  warm_start_schedule_save(self);
+}
+
+static gboolean warm_start_save_cb(gpointer user_data) {
+  BiometricStoragePlugin *self = BIOMETRIC_STORAGE_PLUGIN(user_data);
+  self->warm_start->save_source_id = 0;
+  task_detach(warm_start_save(self));
+  return G_SOURCE_REMOVE;
+}
+
+static void warm_start_schedule_save(BiometricStoragePlugin *self) {
+  WarmStart *warm_start = self->warm_start;
+  if (!warm_start->snapshot.dirty() || warm_start->saving ||
+      warm_start->save_source_id != 0) {
+    return;
+  }
+  warm_start->save_source_id = g_timeout_add_seconds(
+      kSnapshotSaveDelaySeconds, warm_start_save_cb, self);
+}
+
+void warm_start_enable(BiometricStoragePlugin *self, gchar *name,
+                       gboolean enable) {
+  WarmStart *warm_start = self->warm_start;
+  if (!enable) {
+    if (g_hash_table_remove(warm_start->names, name) && warm_start->loaded) {
+      warm_start->snapshot.remove(name);
+      warm_start_schedule_save(self);
+    }
+    g_free(name);
+    return;
+  }
+  g_hash_table_add(warm_start->names, name);
+  if (!warm_start->load_started) {
+    warm_start->load_started = TRUE;
+    task_detach(warm_start_load(self));
+  }
+}
+
+Task<gboolean> warm_start_lookup(BiometricStoragePlugin *self,
+                                 const gchar *name,
+                                 SecretPtr *content) {
+  WarmStart *warm_start = self->warm_start;
+  if (!g_hash_table_contains(warm_start->names, name)) {
+    co_return FALSE;
+  }
+  while (!warm_start->loaded) {
+    co_await warm_start->load_done.wait();
+  }
+  co_return warm_start->snapshot.lookup(name, content);
+}
+
+Task<> warm_start_update(BiometricStoragePlugin *self,
+                         const gchar *name, const gchar *content,
+                         gsize length) {
+  WarmStart *warm_start = self->warm_start;
+  if (!g_hash_table_contains(warm_start->names, name)) {
+    co_return;
+  }
+  while (!warm_start->loaded) {
+    co_await warm_start->load_done.wait();
+  }
+  if (content != nullptr) {
+    warm_start->snapshot.put(name, content, length);
+  } else {
+    warm_start->snapshot.remove(name);
+  }
+  warm_start_schedule_save(self);
+}
+
+void warm_start_flush(BiometricStoragePlugin *self) {
+  WarmStart *warm_start = self->warm_start;
+  if (warm_start->save_source_id != 0) {
+    g_source_remove(warm_start->save_source_id);
+    warm_start->save_source_id = 0;
+  }
+  // The key already is in the keyring unless this is the first save.
+  g_autoptr(GError) error = NULL;
+  g_autofree gchar *path = snapshot_path();
+  gsize file_size = 0;
+  if (warm_start->loaded && warm_start->snapshot.dirty() &&
+      warm_start->snapshot.has_key() &&
+      !warm_start->snapshot.write(path, warm_start->snapshot.encode(),
+                                  &file_size, &error)) {
+    g_warning("Failed to save warm start snapshot: %s", error->message);
+  }
+}
@@ -0,0 +1,222 @@
+#include "biometric_storage_portal.h"
+
+#include <errno.h>
+#include <fcntl.h>
+#include <gio/gunixfdlist.h>
+#include <gio/gunixinputstream.h>
+#include <unistd.h>
+
+static const char kPortalBusName[] = "org.freedesktop.portal.Desktop";
+static const char kPortalPath[] = "/org/freedesktop/portal/desktop";
+static const char kSecretInterface[] = "org.freedesktop.portal.Secret";
+static const char kRequestInterface[] = "org.freedesktop.portal.Request";
+static const char kKeyInfo[] = "biometric_storage file store";
+// The portal may have to unlock the host keyring first.
+static const guint kPortalTimeoutSeconds = 120;
+// Secrets of the portal backends are 64 bytes.
+static const gsize kMaxSecretSize = 4096;
+
+gboolean biometric_portal_enabled() {
+  return g_strcmp0(g_getenv("BIOMETRIC_STORAGE_SECRET_PORTAL"), "1") == 0;
+}
+
+// Outcome of a request, from its Response signal.
+struct Request {
+  gboolean done = FALSE;
+  gboolean timed_out = FALSE;
+  gboolean cancelled = FALSE;
+  guint32 response = 0;
+  guint timeout_id = 0;
+  AsyncCondition changed;
+};
+
+static void response_cb(GDBusConnection *connection, const gchar *sender,
+                        const gchar *path, const gchar *interface,
+                        const gchar *signal, GVariant *parameters,
+                        gpointer user_data) {
+  Request *request = static_cast<Request *>(user_data);
+  g_variant_get(parameters, "(u@a{sv})", &request->response, NULL);
+  request->done = TRUE;
+  request->changed.notify_all();
+}
+
+static gboolean timeout_cb(gpointer user_data) {
+  Request *request = static_cast<Request *>(user_data);
+  request->timed_out = TRUE;
+  request->timeout_id = 0;
+  request->changed.notify_all();
+  return G_SOURCE_REMOVE;
+}
+
+static void cancelled_cb(GCancellable *cancellable, gpointer user_data) {
+  Request *request = static_cast<Request *>(user_data);
+  request->cancelled = TRUE;
+  request->changed.notify_all();
+}
+
+// Object path of the request with `token`, known before the call so that
+// the Response signal cannot be missed.
+static gchar *request_path(GDBusConnection *connection, const gchar *token) {
+  g_autofree gchar *sender =
+      g_strdup(g_dbus_connection_get_unique_name(connection) + 1);
+  g_strdelimit(sender, ".", '_');
+  return g_strdup_printf("%s/request/%s/%s", kPortalPath, sender, token);
+}
+
+static guint subscribe(GDBusConnection *connection, const gchar *path,
+                       Request *request) {
+  return g_dbus_connection_signal_subscribe(
+      connection, kPortalBusName, kRequestInterface, "Response", path, NULL,
+      G_DBUS_SIGNAL_FLAGS_NONE, response_cb, request, NULL);
+}
+
+// Waits for the Response signal of `request`, or until it timed out or
+// `cancellable` was cancelled. Returns whether the portal granted it.
+static Task<gboolean> wait_response(Request *request,
+                                    GCancellable *cancellable,
+                                    GError **error) {
+  request->timeout_id =
+      g_timeout_add_seconds(kPortalTimeoutSeconds, timeout_cb, request);
+  gulong cancelled_id =
+      cancellable != nullptr
+          ? g_cancellable_connect(cancellable, G_CALLBACK(cancelled_cb),
+                                  request, NULL)
+          : 0;
+  while (!request->done && !request->timed_out && !request->cancelled) {
+    co_await request->changed.wait();
+  }
+  if (cancelled_id != 0) {
+    g_cancellable_disconnect(cancellable, cancelled_id);
+  }
+  if (request->timeout_id != 0) {
+    g_source_remove(request->timeout_id);
+  }
+  if (request->cancelled) {
+    g_cancellable_set_error_if_cancelled(cancellable, error);
+    co_return FALSE;
+  }
+  if (request->timed_out) {
+    g_set_error(error, G_IO_ERROR, G_IO_ERROR_TIMED_OUT,
+                "The secret portal did not respond");
+    co_return FALSE;
+  }
+  if (request->response != 0) {
+    g_set_error(error, G_IO_ERROR, G_IO_ERROR_PERMISSION_DENIED,
+                "The secret portal denied the request (%u)",
+                request->response);
+    co_return FALSE;
+  }
+  co_return TRUE;
+}
+
+// Reads the secret the portal wrote to `stream` until it closed its end.
+// The secret never leaves `secret`, which has room for kMaxSecretSize bytes.
+static Task<gboolean> read_secret(GInputStream *stream, guint8 *secret,
+                                  gsize *length, GCancellable *cancellable,
+                                  GError **error) {
+  *length = 0;
+  RefPtr<GAsyncResult> result = co_await gio_async(
+      [&](GAsyncReadyCallback callback, gpointer user_data) {
+        g_input_stream_read_all_async(stream, secret, kMaxSecretSize,
+                                      G_PRIORITY_DEFAULT, cancellable,
+                                      callback, user_data);
+      });
+  if (!g_input_stream_read_all_finish(stream, result.get(), length,
+                                      error)) {
+    g_prefix_error(error, "Failed to read the portal secret: ");
+    co_return FALSE;
+  }
+  if (*length == kMaxSecretSize) {
+    g_set_error(error, G_IO_ERROR, G_IO_ERROR_INVALID_DATA,
+                "The portal secret is too long");
+    co_return FALSE;
+  }
+  co_return TRUE;
+}
+
+Task<gboolean> biometric_portal_retrieve_key(
+    guint8 key[BIOMETRIC_AEAD_KEY_SIZE], GCancellable *cancellable,
+    GError **error) {
+  // The plugin may drop its reference while the portal asks the user.
+  RefPtr<GCancellable> cancellable_ref = RefPtr<GCancellable>::ref(cancellable);
+  RefPtr<GAsyncResult> result = co_await gio_async(
+      [&](GAsyncReadyCallback callback, gpointer user_data) {
+        g_bus_get(G_BUS_TYPE_SESSION, cancellable, callback, user_data);
+      });
+  RefPtr<GDBusConnection> connection =
+      RefPtr<GDBusConnection>::adopt(g_bus_get_finish(result.get(), error));
+  if (!connection) {
+    co_return FALSE;
+  }
+  int fds[2];
+  if (pipe2(fds, O_CLOEXEC) != 0) {
+    int saved_errno = errno;
+    g_set_error(error, G_IO_ERROR, g_io_error_from_errno(saved_errno),
+                "Failed to create pipe: %s", g_strerror(saved_errno));
+    co_return FALSE;
+  }
+  // Read without blocking the main context, closes the read end.
+  RefPtr<GInputStream> stream =
+      RefPtr<GInputStream>::adopt(g_unix_input_stream_new(fds[0], TRUE));
+  RefPtr<GUnixFDList> fd_list =
+      RefPtr<GUnixFDList>::adopt(g_unix_fd_list_new());
+  gint handle = g_unix_fd_list_append(fd_list.get(), fds[1], error);
+  close(fds[1]);
+  if (handle < 0) {
+    co_return FALSE;
+  }
+
+  Request request;
+  GAutoFree<gchar> token(
+      g_strdup_printf("biometric_storage_%u", g_random_int()));
+  GAutoFree<gchar> path(request_path(connection.get(), token.get()));
+  guint subscription = subscribe(connection.get(), path.get(), &request);
+  GVariantBuilder options;
+  g_variant_builder_init(&options, G_VARIANT_TYPE_VARDICT);
+  g_variant_builder_add(&options, "{sv}", "handle_token",
+                        g_variant_new_string(token.get()));
+  result = co_await gio_async(
+      [&](GAsyncReadyCallback callback, gpointer user_data) {
+        g_dbus_connection_call_with_unix_fd_list(
+            connection.get(), kPortalBusName, kPortalPath, kSecretInterface,
+            "RetrieveSecret",
+            g_variant_new("(h@a{sv})", handle,
+                          g_variant_builder_end(&options)),
+            G_VARIANT_TYPE("(o)"), G_DBUS_CALL_FLAGS_NONE, -1, fd_list.get(),
+            cancellable, callback, user_data);
+      });
+  GVariant *reply = g_dbus_connection_call_with_unix_fd_list_finish(
+      connection.get(), NULL, result.get(), error);
+  // Only the portal holds the write end now, reads end once it closed it.
+  fd_list.reset();
+  gboolean retrieved = FALSE;
+  if (reply != nullptr) {
+    const gchar *handle_path;
+    g_variant_get(reply, "(&o)", &handle_path);
+    if (g_strcmp0(handle_path, path.get()) != 0) {
+      // Portals older than handle_token pick their own path.
+      g_dbus_connection_signal_unsubscribe(connection.get(), subscription);
+      subscription = subscribe(connection.get(), handle_path, &request);
+    }
+    g_variant_unref(reply);
+    retrieved = co_await wait_response(&request, cancellable, error);
+  }
+  g_dbus_connection_signal_unsubscribe(connection.get(), subscription);
+
+  guint8 secret[kMaxSecretSize];
+  gsize length = 0;
+  if (retrieved) {
+    retrieved = co_await read_secret(stream.get(), secret, &length,
+                                     cancellable, error);
+  }
+  if (retrieved && length == 0) {
+    g_set_error(error, G_IO_ERROR, G_IO_ERROR_INVALID_DATA,
+                "The secret portal returned an empty secret");
+    retrieved = FALSE;
+  }
+  if (retrieved) {
+    biometric_key_derive(secret, length, kKeyInfo, key);
+  }
+  biometric_wipe(secret, length);
+  co_return retrieved;
+}
@@ -0,0 +1,33 @@
+#ifndef FLUTTER_PLUGIN_BIOMETRIC_STORAGE_PORTAL_H_
+#define FLUTTER_PLUGIN_BIOMETRIC_STORAGE_PORTAL_H_
+
+#include <gio/gio.h>
+
+#include "biometric_storage_async.h"
+#include "biometric_storage_crypto.h"
+
+// Key of the file store when the app runs in a sandbox (Flatpak), from the
+// Secret portal (org.freedesktop.portal.Secret) instead of the keyring.
+//
+// The portal hands every app one master secret of its own, kept in the
+// host keyring. RetrieveSecret is called once per process, the file store
+// key is derived from that secret and all storages are kept in the file
+// store, so reads and writes never leave the sandbox.
+//
+// Enabled by setting $BIOMETRIC_STORAGE_SECRET_PORTAL to 1 (e.g. with
+// `--env=` in the `finish-args` of the Flatpak manifest), outside of a
+// sandbox too, which allows running against a mock portal on a private
+// session bus. Storages already in the keyring are not moved.
+
+// Whether $BIOMETRIC_STORAGE_SECRET_PORTAL enables the portal.
+gboolean biometric_portal_enabled();
+
+// Retrieves the master secret of the app from the portal on the session
+// bus and derives the file store key from it. Resolves once the portal
+// responded, kPortalTimeoutSeconds passed or `cancellable` was cancelled,
+// without blocking the main context.
+Task<gboolean> biometric_portal_retrieve_key(
+    guint8 key[BIOMETRIC_AEAD_KEY_SIZE], GCancellable *cancellable,
+    GError **error);
+
+#endif  // FLUTTER_PLUGIN_BIOMETRIC_STORAGE_PORTAL_H_
@@ -0,0 +1,265 @@
+#include "biometric_storage_prefetch.h"
+
+#include <string.h>
+#include <sys/mman.h>
+
+#include <algorithm>
+
+// Counts of a name are halved once it was read this often, so that the
+// model follows changes of the access pattern.
+static const guint32 kMaxReads = 256;
+
+Prefetcher::Prefetcher(const PrefetchOptions &options) : options_(options) {
+  // Best effort, keeps the key out of swap.
+  mlock(key_, sizeof(key_));
+  GError *error = nullptr;
+  has_key_ = biometric_random_bytes(key_, sizeof(key_), &error);
+  if (!has_key_) {
+    g_warning("Prefetching disabled: %s", error->message);
+    g_error_free(error);
+  }
+}
+
+Prefetcher::~Prefetcher() {
+  biometric_wipe(key_, sizeof(key_));
+  munlock(key_, sizeof(key_));
+}
+
+void Prefetcher::nonce_for(guint64 generation,
+                           guint8 nonce[BIOMETRIC_AEAD_NONCE_SIZE]) const {
+  memset(nonce, 0, BIOMETRIC_AEAD_NONCE_SIZE);
+  for (int i = 0; i < 8; i++) {
+    nonce[4 + i] = generation >> (8 * i);
+  }
+}
+
+Prefetcher::Source *Prefetcher::source(const std::string &name,
+                                       gint64 now_us) {
+  auto found = sources_.find(name);
+  if (found == sources_.end()) {
+    if (sources_.size() >= options_.max_sources) {
+      auto oldest = std::min_element(
+          sources_.begin(), sources_.end(), [](const auto &a, const auto &b) {
+            return a.second.last_read_us < b.second.last_read_us;
+          });
+      sources_.erase(oldest);
+    }
+    found = sources_.emplace(name, Source()).first;
+  }
+  found->second.last_read_us = now_us;
+  return &found->second;
+}
+
+void Prefetcher::learn(const std::string &from, const std::string &to) {
+  auto found = sources_.find(from);
+  if (found == sources_.end()) {
+    return;
+  }
+  std::vector<Successor> &successors = found->second.successors;
+  auto successor =
+      std::find_if(successors.begin(), successors.end(),
+                   [&to](const Successor &s) { return s.name == to; });
+  if (successor != successors.end()) {
+    successor->count = MIN(successor->count + 1, found->second.reads);
+  } else if (successors.size() < options_.max_successors) {
+    successors.push_back({to, 1});
+  } else if (!successors.empty()) {
+    auto rarest = std::min_element(
+        successors.begin(), successors.end(),
+        [](const Successor &a, const Successor &b) { return a.count < b.count; });
+    *rarest = {to, 1};
+  }
+}
+
+void Prefetcher::observe(const gchar *name, gint64 now_us,
+                         std::vector<std::string> *predicted) {
+  observed_++;
+  expire(now_us);
+  std::string current(name);
+  recent_.erase(std::remove_if(recent_.begin(), recent_.end(),
+                               [&](const auto &read) {
+                                 return read.first == current ||
+                                        now_us - read.second >
+                                            options_.window_us;
+                               }),
+                recent_.end());
+  for (const auto &read : recent_) {
+    learn(read.first, current);
+  }
+  if (recent_.size() >= options_.max_sources) {
+    recent_.erase(recent_.begin());
+  }
+  recent_.emplace_back(current, now_us);
+
+  Source *read = source(current, now_us);
+  if (++read->reads > kMaxReads) {
+    read->reads /= 2;
+    for (Successor &successor : read->successors) {
+      successor.count /= 2;
+    }
+    read->successors.erase(
+        std::remove_if(read->successors.begin(), read->successors.end(),
+                       [](const Successor &s) { return s.count == 0; }),
+        read->successors.end());
+  }
+  if (read->reads < options_.min_observations) {
+    return;
+  }
+  for (const Successor &successor : read->successors) {
+    if ((guint64)successor.count * 100 >=
+        (guint64)options_.min_confidence_percent * read->reads) {
+      predicted->push_back(successor.name);
+      predicted_++;
+    }
+  }
+}
+
+bool Prefetcher::begin(const std::string &name, guint64 *generation) {
+  if (entries_.count(name) > 0) {
+    return false;
+  }
+  if (!has_key_ || writing_.count(name) > 0 ||
+      entries_.size() >= options_.max_entries) {
+    rejected_++;
+    return false;
+  }
+  Entry entry;
+  entry.generation = *generation = next_generation_++;
+  entries_.emplace(name, std::move(entry));
+  issued_++;
+  return true;
+}
+
+void Prefetcher::complete(const std::string &name, guint64 generation,
+                          const gchar *content, gsize length) {
+  auto entry = entries_.find(name);
+  if (entry == entries_.end() || entry->second.generation != generation) {
+    // Dropped by a write in the meantime.
+    return;
+  }
+  gsize sealed_size = length + BIOMETRIC_AEAD_TAG_SIZE;
+  if (content == nullptr || bytes_ + sealed_size > options_.max_bytes) {
+    if (content == nullptr) {
+      empty_++;
+    } else {
+      rejected_++;
+    }
+    drop(entry);
+    changed_.notify_all();
+    return;
+  }
+  guint8 nonce[BIOMETRIC_AEAD_NONCE_SIZE];
+  nonce_for(generation, nonce);
+  entry->second.sealed.resize(sealed_size);
+  g_autoptr(GError) error = nullptr;
+  if (!biometric_aead_seal(key_, nonce, (const guint8 *)name.c_str(),
+                           name.size(), (const guint8 *)content, length,
+                           entry->second.sealed.data(), &error)) {
+    g_warning("Failed to prefetch %s: %s", name.c_str(), error->message);
+    rejected_++;
+    drop(entry);
+    changed_.notify_all();
+    return;
+  }
+  entry->second.ready = true;
+  entry->second.ready_at_us = g_get_monotonic_time();
+  bytes_ += sealed_size;
+  changed_.notify_all();
+}
+
+Prefetcher::Lookup Prefetcher::take(const gchar *name, gint64 now_us,
+                                    SecretPtr *content) {
+  expire(now_us);
+  auto entry = entries_.find(name);
+  if (entry == entries_.end()) {
+    return Lookup::kMiss;
+  }
+  if (!entry->second.ready) {
+    entry->second.waited = true;
+    return Lookup::kPending;
+  }
+  guint8 nonce[BIOMETRIC_AEAD_NONCE_SIZE];
+  nonce_for(entry->second.generation, nonce);
+  const std::vector<guint8> &sealed = entry->second.sealed;
+  gsize length = sealed.size() - BIOMETRIC_AEAD_TAG_SIZE;
+  content->reset(static_cast<gchar *>(g_malloc0(length + 1)));
+  // Only fails if the memory was corrupted, the keyring still has it.
+  if (!biometric_aead_open(key_, nonce, (const guint8 *)name, strlen(name),
+                           sealed.data(), sealed.size(),
+                           (guint8 *)content->get())) {
+    g_warning("Prefetched content of %s failed authentication.", name);
+    content->reset();
+    rejected_++;
+    drop(entry);
+    changed_.notify_all();
+    return Lookup::kMiss;
+  }
+  hits_++;
+  if (entry->second.waited) {
+    pending_hits_++;
+  }
+  drop(entry);
+  return Lookup::kHit;
+}
+
+void Prefetcher::begin_write(const gchar *name) {
+  writing_[name]++;
+  auto entry = entries_.find(name);
+  if (entry != entries_.end()) {
+    invalidated_++;
+    drop(entry);
+    changed_.notify_all();
+  }
+}
+
+void Prefetcher::end_write(const gchar *name) {
+  auto writing = writing_.find(name);
+  if (writing != writing_.end() && --writing->second == 0) {
+    writing_.erase(writing);
+  }
+}
+
+void Prefetcher::expire(gint64 now_us) {
+  for (auto entry = entries_.begin(); entry != entries_.end();) {
+    auto next = std::next(entry);
+    if (entry->second.ready &&
+        now_us - entry->second.ready_at_us > options_.ttl_us) {
+      expired_++;
+      drop(entry);
+    }
+    entry = next;
+  }
+}
+
+void Prefetcher::drop(std::map<std::string, Entry>::iterator entry) {
+  bytes_ -= entry->second.sealed.size();
+  biometric_wipe(entry->second.sealed.data(), entry->second.sealed.size());
+  entries_.erase(entry);
+}
+
+FlValue *Prefetcher::stats() const {
+  gsize transitions = 0;
+  for (const auto &source : sources_) {
+    transitions += source.second.successors.size();
+  }
+  FlValue *stats = fl_value_new_map();
+  fl_value_set_string_take(stats, "sources", fl_value_new_int(sources_.size()));
+  fl_value_set_string_take(stats, "transitions", fl_value_new_int(transitions));
+  fl_value_set_string_take(stats, "entries", fl_value_new_int(entries_.size()));
+  fl_value_set_string_take(stats, "bytes", fl_value_new_int(bytes_));
+  fl_value_set_string_take(stats, "observedReads", fl_value_new_int(observed_));
+  fl_value_set_string_take(stats, "predicted", fl_value_new_int(predicted_));
+  fl_value_set_string_take(stats, "issued", fl_value_new_int(issued_));
+  fl_value_set_string_take(stats, "rejected", fl_value_new_int(rejected_));
+  fl_value_set_string_take(stats, "empty", fl_value_new_int(empty_));
+  fl_value_set_string_take(stats, "hits", fl_value_new_int(hits_));
+  fl_value_set_string_take(stats, "pendingHits",
+                           fl_value_new_int(pending_hits_));
+  fl_value_set_string_take(stats, "expired", fl_value_new_int(expired_));
+  fl_value_set_string_take(stats, "invalidated",
+                           fl_value_new_int(invalidated_));
+  fl_value_set_string_take(
+      stats, "hitRate",
+      fl_value_new_float(issued_ > 0 ? (gdouble)hits_ / issued_ : 0));
+  return stats;
+}
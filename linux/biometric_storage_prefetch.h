@@ -0,0 +1,134 @@
+#ifndef FLUTTER_PLUGIN_BIOMETRIC_STORAGE_PREFETCH_H_
+#define FLUTTER_PLUGIN_BIOMETRIC_STORAGE_PREFETCH_H_
+
+#include <flutter_linux/flutter_linux.h>
+
+#include <map>
+#include <string>
+#include <vector>
+
+#include "biometric_storage_async.h"
+#include "biometric_storage_crypto.h"
+#include "biometric_storage_offline_queue.h"
+
+struct PrefetchOptions {
+  // A read counts as following every other read this recent.
+  gint64 window_us;
+  // Names whose successors are tracked, and successors per name. The least
+  // recently read name, and the rarest successor, are replaced.
+  gsize max_sources;
+  gsize max_successors;
+  // A successor is prefetched once its name was read `min_observations`
+  // times and was followed by it in at least `min_confidence_percent` of
+  // them.
+  guint32 min_observations;
+  guint32 min_confidence_percent;
+  // Bounds of the prefetched contents, which are dropped if they were not
+  // read within `ttl_us`.
+  gsize max_entries;
+  gsize max_bytes;
+  gint64 ttl_us;
+};
+
+// Learns which storages are read shortly after each other (first order
+// transitions A -> B within a time window) and keeps the contents of the
+// likely successors of a read, fetched speculatively by the plugin, until
+// they are read.
+//
+// Prefetched contents are sealed with ChaCha20-Poly1305 under a random key
+// which only exists in this process, and handed out once. Writes and deletes
+// drop them, see begin_write().
+class Prefetcher {
+ public:
+  enum class Lookup { kMiss, kHit, kPending };
+
+  explicit Prefetcher(const PrefetchOptions &options);
+  ~Prefetcher();
+
+  Prefetcher(const Prefetcher &) = delete;
+  Prefetcher &operator=(const Prefetcher &) = delete;
+
+  // Records a read of `name` and appends the successors worth prefetching
+  // to `predicted`.
+  void observe(const gchar *name, gint64 now_us,
+               std::vector<std::string> *predicted);
+
+  // Reserves an entry for prefetching `name`, returns false if it is
+  // already prefetched, written right now or there is no room.
+  bool begin(const std::string &name, guint64 *generation);
+
+  // Stores the prefetched `content` of `name`, or drops the entry if
+  // `content` is nullptr (not found, locked or failed).
+  void complete(const std::string &name, guint64 generation,
+                const gchar *content, gsize length);
+
+  // Takes the prefetched content of `name`. kPending means the prefetch is
+  // still in flight, wait for changed() and try again.
+  Lookup take(const gchar *name, gint64 now_us, SecretPtr *content);
+
+  // Drops anything prefetched for `name` and blocks prefetches of it until
+  // end_write(), a prefetch racing with the write could see the old secret.
+  void begin_write(const gchar *name);
+  void end_write(const gchar *name);
+
+  // Notified whenever a prefetch completed or was dropped.
+  AsyncCondition &changed() { return changed_; }
+
+  // Model size, prefetches and their outcome as a map for the `stats`
+  // method.
+  FlValue *stats() const;
+
+ private:
+  struct Successor {
+    std::string name;
+    guint32 count;
+  };
+  struct Source {
+    guint32 reads = 0;
+    gint64 last_read_us = 0;
+    std::vector<Successor> successors;
+  };
+  struct Entry {
+    guint64 generation;
+    bool ready = false;
+    // Nonce is derived from `generation`.
+    std::vector<guint8> sealed;
+    gint64 ready_at_us = 0;
+    // A read waited for it while in flight.
+    bool waited = false;
+  };
+
+  void learn(const std::string &from, const std::string &to);
+  Source *source(const std::string &name, gint64 now_us);
+  void expire(gint64 now_us);
+  void drop(std::map<std::string, Entry>::iterator entry);
+  void nonce_for(guint64 generation,
+                 guint8 nonce[BIOMETRIC_AEAD_NONCE_SIZE]) const;
+
+  const PrefetchOptions options_;
+  guint8 key_[BIOMETRIC_AEAD_KEY_SIZE];
+  bool has_key_ = false;
+
+  std::map<std::string, Source> sources_;
+  // Recent reads, oldest first, at most one per name.
+  std::vector<std::pair<std::string, gint64>> recent_;
+
+  std::map<std::string, Entry> entries_;
+  gsize bytes_ = 0;
+  guint64 next_generation_ = 1;
+  // Writes and deletes in progress by name.
+  std::map<std::string, guint> writing_;
+  AsyncCondition changed_;
+
+  guint64 observed_ = 0;
+  guint64 predicted_ = 0;
+  guint64 issued_ = 0;
+  guint64 rejected_ = 0;
+  guint64 empty_ = 0;
+  guint64 hits_ = 0;
+  guint64 pending_hits_ = 0;
+  guint64 expired_ = 0;
+  guint64 invalidated_ = 0;
+};
+
+#endif  // FLUTTER_PLUGIN_BIOMETRIC_STORAGE_PREFETCH_H_
@@ -0,0 +1,234 @@
+#include "biometric_storage_router.h"
+
+#include <errno.h>
+#include <fnmatch.h>
+#include <gio/gio.h>
+#include <glib/gstdio.h>
+#include <string.h>
+
+static const char kRoutesGroup[] = "routes";
+static const char *const kTierNames[kStorageTiers] = {
+    "secretService", "kernelKeyring", "sharded", "file"};
+
+const gchar *storage_tier_name(StorageTier tier) {
+  return kTierNames[static_cast<gsize>(tier)];
+}
+
+gboolean storage_tier_parse(const gchar *name, StorageTier *tier) {
+  for (gsize i = 0; i < kStorageTiers; i++) {
+    if (g_strcmp0(name, kTierNames[i]) == 0) {
+      *tier = static_cast<StorageTier>(i);
+      return TRUE;
+    }
+  }
+  return FALSE;
+}
+
+TierRouter::TierRouter(const gchar *name_prefix, StorageTier default_tier)
+    : name_prefix_(g_strdup_printf("%s.", name_prefix)),
+      default_tier_(default_tier) {}
+
+TierRouter::~TierRouter() {
+  g_free(name_prefix_);
+  g_free(path_);
+}
+
+// The index on disk tells which storages exist, but not their names.
+std::string TierRouter::index_key(const gchar *name) {
+  g_autofree gchar *hash =
+      g_compute_checksum_for_string(G_CHECKSUM_SHA256, name, -1);
+  return hash;
+}
+
+void TierRouter::load(const gchar *path) {
+  g_free(path_);
+  path_ = g_strdup(path);
+  index_.clear();
+  g_autoptr(GKeyFile) routes = g_key_file_new();
+  g_autoptr(GError) error = NULL;
+  if (!g_key_file_load_from_file(routes, path, G_KEY_FILE_NONE, &error)) {
+    if (!g_error_matches(error, G_FILE_ERROR, G_FILE_ERROR_NOENT)) {
+      g_warning("Failed to load storage routes %s: %s", path, error->message);
+    }
+    return;
+  }
+  g_auto(GStrv) keys = g_key_file_get_keys(routes, kRoutesGroup, NULL, NULL);
+  for (gsize i = 0; keys != nullptr && keys[i] != nullptr; i++) {
+    g_autofree gchar *value =
+        g_key_file_get_string(routes, kRoutesGroup, keys[i], NULL);
+    StorageTier tier;
+    if (storage_tier_parse(value, &tier) && tier != default_tier_) {
+      index_[keys[i]] = tier;
+    }
+  }
+}
+
+gboolean TierRouter::save(GError **error) {
+  if (path_ == nullptr) {
+    return TRUE;
+  }
+  g_autofree gchar *dir = g_path_get_dirname(path_);
+  if (g_mkdir_with_parents(dir, 0700) != 0) {
+    int saved_errno = errno;
+    g_set_error(error, G_FILE_ERROR, g_file_error_from_errno(saved_errno),
+                "Failed to create %s: %s", dir, g_strerror(saved_errno));
+    return FALSE;
+  }
+  g_autoptr(GKeyFile) routes = g_key_file_new();
+  for (const auto &route : index_) {
+    g_key_file_set_string(routes, kRoutesGroup, route.first.c_str(),
+                          storage_tier_name(route.second));
+  }
+  return g_key_file_save_to_file(routes, path_, error);
+}
+
+gboolean TierRouter::set_policy(FlValue *rules, GError **error) {
+  if (rules == nullptr || fl_value_get_type(rules) != FL_VALUE_TYPE_LIST) {
+    g_set_error(error, G_IO_ERROR, G_IO_ERROR_INVALID_ARGUMENT,
+                "Expected a list of rules");
+    return FALSE;
+  }
+  std::vector<Rule> policy;
+  for (size_t i = 0; i < fl_value_get_length(rules); i++) {
+    FlValue *value = fl_value_get_list_value(rules, i);
+    if (fl_value_get_type(value) != FL_VALUE_TYPE_MAP) {
+      g_set_error(error, G_IO_ERROR, G_IO_ERROR_INVALID_ARGUMENT,
+                  "Rule %zu is not a map", i);
+      return FALSE;
+    }
+    Rule rule;
+    FlValue *tier = fl_value_lookup_string(value, "tier");
+    if (tier == nullptr || fl_value_get_type(tier) != FL_VALUE_TYPE_STRING ||
+        !storage_tier_parse(fl_value_get_string(tier), &rule.tier)) {
+      g_set_error(error, G_IO_ERROR, G_IO_ERROR_INVALID_ARGUMENT,
+                  "Rule %zu has no valid tier", i);
+      return FALSE;
+    }
+    FlValue *pattern = fl_value_lookup_string(value, "pattern");
+    if (pattern != nullptr && fl_value_get_type(pattern) == FL_VALUE_TYPE_STRING) {
+      rule.pattern = fl_value_get_string(pattern);
+    } else if (pattern != nullptr &&
+               fl_value_get_type(pattern) != FL_VALUE_TYPE_NULL) {
+      g_set_error(error, G_IO_ERROR, G_IO_ERROR_INVALID_ARGUMENT,
+                  "Pattern of rule %zu is not a string", i);
+      return FALSE;
+    }
+    const gchar *bounds[] = {"minSize", "maxSize"};
+    gsize *sizes[] = {&rule.min_size, &rule.max_size};
+    for (gsize j = 0; j < G_N_ELEMENTS(bounds); j++) {
+      FlValue *size = fl_value_lookup_string(value, bounds[j]);
+      if (size == nullptr || fl_value_get_type(size) == FL_VALUE_TYPE_NULL) {
+        continue;
+      }
+      if (fl_value_get_type(size) != FL_VALUE_TYPE_INT ||
+          fl_value_get_int(size) < 0) {
+        g_set_error(error, G_IO_ERROR, G_IO_ERROR_INVALID_ARGUMENT,
+                    "%s of rule %zu is not a size", bounds[j], i);
+        return FALSE;
+      }
+      *sizes[j] = fl_value_get_int(size);
+    }
+    policy.push_back(std::move(rule));
+  }
+  rules_ = std::move(policy);
+  return TRUE;
+}
+
+void TierRouter::pin(const gchar *name, const StorageTier *tier) {
+  if (tier != nullptr) {
+    pinned_[name] = *tier;
+  } else {
+    pinned_.erase(name);
+  }
+}
+
+gboolean TierRouter::route_write(const gchar *name, gsize size,
+                                 gboolean tagged, StorageTier *tier) {
+  auto pinned = pinned_.find(name);
+  if (pinned != pinned_.end()) {
+    if (tagged && pinned->second != StorageTier::kSecretService) {
+      return FALSE;
+    }
+    *tier = pinned->second;
+  } else {
+    *tier = tagged ? StorageTier::kSecretService : default_tier_;
+    gsize prefix_length = strlen(name_prefix_);
+    const gchar *storage = g_str_has_prefix(name, name_prefix_)
+                               ? name + prefix_length
+                               : name;
+    for (const Rule &rule : rules_) {
+      if (!tagged && size >= rule.min_size && size <= rule.max_size &&
+          (rule.pattern.empty() ||
+           fnmatch(rule.pattern.c_str(), storage, 0) == 0)) {
+        *tier = rule.tier;
+        break;
+      }
+    }
+  }
+  writes_[static_cast<gsize>(*tier)]++;
+  return TRUE;
+}
+
+StorageTier TierRouter::location(const gchar *name) const {
+  if (!index_.empty()) {
+    auto found = index_.find(index_key(name));
+    if (found != index_.end()) {
+      return found->second;
+    }
+  }
+  // Not written since it was pinned, it was kept there by earlier versions.
+  auto pinned = pinned_.find(name);
+  return pinned != pinned_.end() ? pinned->second : default_tier_;
+}
+
+StorageTier TierRouter::route_read(const gchar *name) {
+  StorageTier tier = location(name);
+  reads_[static_cast<gsize>(tier)]++;
+  return tier;
+}
+
+gboolean TierRouter::move(const gchar *name, StorageTier tier,
+                          GError **error) {
+  if (location(name) != tier) {
+    moves_++;
+  }
+  std::string key = index_key(name);
+  auto found = index_.find(key);
+  StorageTier indexed = found != index_.end() ? found->second : default_tier_;
+  if (indexed == tier) {
+    return TRUE;
+  }
+  if (tier == default_tier_) {
+    index_.erase(found);
+  } else {
+    index_[key] = tier;
+  }
+  if (!save(error)) {
+    save_failures_++;
+    return FALSE;
+  }
+  return TRUE;
+}
+
+FlValue *TierRouter::stats() const {
+  FlValue *stats = fl_value_new_map();
+  FlValue *writes = fl_value_new_map();
+  FlValue *reads = fl_value_new_map();
+  for (gsize i = 0; i < kStorageTiers; i++) {
+    fl_value_set_string_take(writes, kTierNames[i],
+                             fl_value_new_int(writes_[i]));
+    fl_value_set_string_take(reads, kTierNames[i], fl_value_new_int(reads_[i]));
+  }
+  fl_value_set_string_take(stats, "writes", writes);
+  fl_value_set_string_take(stats, "reads", reads);
+  fl_value_set_string_take(stats, "defaultTier",
+                           fl_value_new_string(storage_tier_name(default_tier_)));
+  fl_value_set_string_take(stats, "rules", fl_value_new_int(rules_.size()));
+  fl_value_set_string_take(stats, "pinned", fl_value_new_int(pinned_.size()));
+  fl_value_set_string_take(stats, "routes", fl_value_new_int(index_.size()));
+  fl_value_set_string_take(stats, "moves", fl_value_new_int(moves_));
+  fl_value_set_string_take(stats, "fallbacks", fl_value_new_int(fallbacks_));
+  fl_value_set_string_take(stats, "saveFailures",
+                           fl_value_new_int(save_failures_));
+  return stats;
+}
@@ -0,0 +1,116 @@
+#ifndef FLUTTER_PLUGIN_BIOMETRIC_STORAGE_ROUTER_H_
+#define FLUTTER_PLUGIN_BIOMETRIC_STORAGE_ROUTER_H_
+
+#include <flutter_linux/flutter_linux.h>
+
+#include <map>
+#include <string>
+#include <vector>
+
+// Backends a storage can be kept in.
+enum class StorageTier {
+  // One item in the Secret Service, the default.
+  kSecretService,
+  // A key in the kernel's user keyring, see biometric_storage_kernel_keyring.h.
+  kKernelKeyring,
+  // Several Secret Service items of a bounded size.
+  kSharded,
+  // The encrypted FileStore, see biometric_storage_file_store.h.
+  kFile,
+};
+
+const gsize kStorageTiers = 4;
+
+// Name of `tier` as used by dart ("secretService", "kernelKeyring",
+// "sharded", "file").
+const gchar *storage_tier_name(StorageTier tier);
+
+// Parses a name returned by storage_tier_name().
+gboolean storage_tier_parse(const gchar *name, StorageTier *tier);
+
+// Picks the tier each write goes to, and remembers where every storage was
+// written last so that reads go straight to that tier.
+//
+// A write goes to the tier its storage was pinned to by `init`, else to the
+// tier of the first policy rule matching the storage name (a glob) and the
+// size of the secret, else to the default tier (the Secret Service unless
+// the Secret portal is used). Tagged writes always go to the Secret
+// Service, tags are item attributes.
+//
+// The routing index only holds storages outside of the default tier, by
+// SHA-256 hash of their item name, and is saved as a key file whenever a
+// storage moved.
+class TierRouter {
+ public:
+  // `name_prefix` is stripped from item names before matching rules.
+  TierRouter(const gchar *name_prefix, StorageTier default_tier);
+  ~TierRouter();
+
+  TierRouter(const TierRouter &) = delete;
+  TierRouter &operator=(const TierRouter &) = delete;
+
+  // Loads the routing index from `path`, a missing file is an empty index.
+  void load(const gchar *path);
+
+  // Replaces the policy with `rules`, a list of maps with "tier" and any of
+  // "pattern", "minSize" and "maxSize". Keeps the old policy if one of them
+  // is malformed.
+  gboolean set_policy(FlValue *rules, GError **error);
+
+  // Pins storage `name` to `tier`, or unpins it if `tier` is nullptr.
+  void pin(const gchar *name, const StorageTier *tier);
+
+  // Picks the tier of a write of `size` bytes to `name`. Returns FALSE if
+  // the write is `tagged` but `name` is pinned outside the Secret Service.
+  gboolean route_write(const gchar *name, gsize size, gboolean tagged,
+                       StorageTier *tier);
+
+  // Tier `name` was last written to.
+  StorageTier route_read(const gchar *name);
+
+  // Like route_read(), without counting a read.
+  StorageTier location(const gchar *name) const;
+
+  // Records that `name` now lives in `tier` and saves the index if that
+  // changed. The new route is used even if saving failed.
+  gboolean move(const gchar *name, StorageTier tier, GError **error);
+
+  // Tier of storages which were neither pinned nor matched by a rule.
+  StorageTier default_tier() const { return default_tier_; }
+
+  // Counts a write which went to the default tier because its tier failed.
+  void count_fallback() { fallbacks_++; }
+
+  // Policy, index size and operations by tier as a map for the `stats`
+  // method.
+  FlValue *stats() const;
+
+ private:
+  struct Rule {
+    // fnmatch(3) pattern, empty matches every name.
+    std::string pattern;
+    gsize min_size = 0;
+    gsize max_size = G_MAXSIZE;
+    StorageTier tier;
+  };
+
+  static std::string index_key(const gchar *name);
+  gboolean save(GError **error);
+
+  gchar *name_prefix_;
+  const StorageTier default_tier_;
+  gchar *path_ = nullptr;
+  std::vector<Rule> rules_;
+  std::map<std::string, StorageTier> pinned_;
+  // Tier by index_key(), never `default_tier_`.
+  std::map<std::string, StorageTier> index_;
+
+  // By StorageTier.
+  guint64 writes_[kStorageTiers] = {};
+  guint64 reads_[kStorageTiers] = {};
+  guint64 moves_ = 0;
+  guint64 fallbacks_ = 0;
+  guint64 save_failures_ = 0;
+};
+
+#endif  // FLUTTER_PLUGIN_BIOMETRIC_STORAGE_ROUTER_H_
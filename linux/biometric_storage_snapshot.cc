@@ -0,0 +1,287 @@
+#include "biometric_storage_snapshot.h"
+
+#include <errno.h>
+#include <gio/gio.h>
+#include <string.h>
+#include <sys/mman.h>
+
+static const gchar kMagic[] = "BSSNAP01";
+static const gsize kMagicSize = sizeof(kMagic) - 1;
+static const gsize kHeaderSize = kMagicSize + BIOMETRIC_AEAD_NONCE_SIZE;
+
+static void append32(GByteArray *out, guint32 v) {
+  guint8 bytes[4] = {(guint8)v, (guint8)(v >> 8), (guint8)(v >> 16),
+                     (guint8)(v >> 24)};
+  g_byte_array_append(out, bytes, sizeof(bytes));
+}
+
+// Reads a length prefixed field at `*offset`, FALSE if it is truncated.
+static gboolean read_field(const guint8 *data, gsize length, gsize *offset,
+                           const guint8 **field, gsize *field_length) {
+  if (length - *offset < 4) {
+    return FALSE;
+  }
+  const guint8 *p = data + *offset;
+  guint32 n = (guint32)p[0] | ((guint32)p[1] << 8) | ((guint32)p[2] << 16) |
+              ((guint32)p[3] << 24);
+  if (length - *offset - 4 < n) {
+    return FALSE;
+  }
+  *field = p + 4;
+  *field_length = n;
+  *offset += 4 + n;
+  return TRUE;
+}
+
+// Wipes and frees a byte array which held secrets.
+static void wipe_byte_array(GByteArray *array) {
+  biometric_wipe(array->data, array->len);
+  g_byte_array_unref(array);
+}
+
+Snapshot::Snapshot(gsize max_entries, gsize max_bytes)
+    : max_entries_(max_entries), max_bytes_(max_bytes) {
+  // Best effort, keeps the key out of swap.
+  mlock(key_, sizeof(key_));
+}
+
+Snapshot::~Snapshot() {
+  biometric_wipe(key_, sizeof(key_));
+  munlock(key_, sizeof(key_));
+}
+
+bool Snapshot::set_key(const gchar *encoded) {
+  has_key_ = biometric_key_decode(encoded, key_);
+  return has_key_;
+}
+
+void Snapshot::put_entry(const std::string &name, const gchar *content,
+                         gsize length) {
+  auto existing = entries_.find(name);
+  if (existing != entries_.end()) {
+    bytes_ -= existing->second.length;
+    entries_.erase(existing);
+  }
+  removed_.erase(name);
+  gchar *copy = static_cast<gchar *>(g_malloc(length + 1));
+  memcpy(copy, content, length);
+  copy[length] = '\0';
+  entries_[name] = Entry{SecretPtr(copy), length, next_version_++};
+  bytes_ += length;
+}
+
+GByteArray *Snapshot::read(const gchar *path, gsize *file_size,
+                           GError **error) const {
+  gchar *data;
+  gsize length;
+  if (!g_file_get_contents(path, &data, &length, error)) {
+    return nullptr;
+  }
+  *file_size = length;
+  if (length < kHeaderSize + BIOMETRIC_AEAD_TAG_SIZE ||
+      memcmp(data, kMagic, kMagicSize) != 0) {
+    g_free(data);
+    g_set_error(error, G_IO_ERROR, G_IO_ERROR_INVALID_DATA,
+                "%s is not a snapshot", path);
+    return nullptr;
+  }
+  const guint8 *nonce = (const guint8 *)data + kMagicSize;
+  const guint8 *sealed = (const guint8 *)data + kHeaderSize;
+  gsize sealed_length = length - kHeaderSize;
+  GByteArray *plain = g_byte_array_sized_new(sealed_length);
+  g_byte_array_set_size(plain, sealed_length - BIOMETRIC_AEAD_TAG_SIZE);
+  gboolean opened =
+      has_key_ && biometric_aead_open(key_, nonce, (const guint8 *)kMagic,
+                                      kMagicSize, sealed, sealed_length,
+                                      plain->data);
+  g_free(data);
+  if (!opened) {
+    g_byte_array_unref(plain);
+    g_set_error(error, G_IO_ERROR, G_IO_ERROR_INVALID_DATA,
+                "%s was not sealed with the snapshot key", path);
+    return nullptr;
+  }
+  return plain;
+}
+
+void Snapshot::decode(GByteArray *plain, gsize file_size, gint64 started) {
+  entries_.clear();
+  bytes_ = 0;
+  gsize offset = 0;
+  const guint8 *name, *content;
+  gsize name_length, content_length;
+  while (offset < plain->len &&
+         read_field(plain->data, plain->len, &offset, &name, &name_length) &&
+         read_field(plain->data, plain->len, &offset, &content,
+                    &content_length)) {
+    if (entries_.size() < max_entries_ &&
+        bytes_ + content_length <= max_bytes_) {
+      put_entry(std::string((const gchar *)name, name_length),
+                (const gchar *)content, content_length);
+    }
+  }
+  wipe_byte_array(plain);
+  file_size_ = file_size;
+  loaded_ = entries_.size();
+  dirty_ = false;
+  load_us_ = g_get_monotonic_time() - started;
+}
+
+GByteArray *Snapshot::encode() {
+  GByteArray *plain = g_byte_array_sized_new(bytes_ + 8 * entries_.size());
+  for (const auto &entry : entries_) {
+    append32(plain, entry.first.size());
+    g_byte_array_append(plain, (const guint8 *)entry.first.data(),
+                        entry.first.size());
+    append32(plain, entry.second.length);
+    g_byte_array_append(plain, (const guint8 *)entry.second.content.get(),
+                        entry.second.length);
+  }
+  dirty_ = false;
+  return plain;
+}
+
+bool Snapshot::write(const gchar *path, GByteArray *plain, gsize *file_size,
+                     GError **error) const {
+  if (!has_key_) {
+    wipe_byte_array(plain);
+    g_set_error(error, G_IO_ERROR, G_IO_ERROR_FAILED, "No snapshot key");
+    return false;
+  }
+  gsize length = kHeaderSize + plain->len + BIOMETRIC_AEAD_TAG_SIZE;
+  g_autofree guint8 *file = static_cast<guint8 *>(g_malloc(length));
+  memcpy(file, kMagic, kMagicSize);
+  guint8 *nonce = file + kMagicSize;
+  if (!biometric_random_bytes(nonce, BIOMETRIC_AEAD_NONCE_SIZE, error)) {
+    wipe_byte_array(plain);
+    return false;
+  }
+  gboolean sealed =
+      biometric_aead_seal(key_, nonce, (const guint8 *)kMagic, kMagicSize,
+                          plain->data, plain->len, file + kHeaderSize, error);
+  wipe_byte_array(plain);
+  if (!sealed) {
+    return false;
+  }
+
+  g_autofree gchar *dir = g_path_get_dirname(path);
+  if (g_mkdir_with_parents(dir, 0700) != 0) {
+    int saved_errno = errno;
+    g_set_error(error, G_IO_ERROR, g_io_error_from_errno(saved_errno),
+                "Failed to create %s: %s", dir, g_strerror(saved_errno));
+    return false;
+  }
+  if (!g_file_set_contents_full(path, (const gchar *)file, length,
+                                G_FILE_SET_CONTENTS_CONSISTENT, 0600,
+                                error)) {
+    return false;
+  }
+  *file_size = length;
+  return true;
+}
+
+void Snapshot::saved(bool ok, gsize file_size) {
+  if (!ok) {
+    dirty_ = true;
+    return;
+  }
+  file_size_ = file_size;
+  saves_++;
+}
+
+bool Snapshot::lookup(const gchar *name, SecretPtr *content) {
+  auto entry = entries_.find(name);
+  if (entry == entries_.end()) {
+    misses_++;
+    return false;
+  }
+  hits_++;
+  gchar *copy = static_cast<gchar *>(g_malloc(entry->second.length + 1));
+  memcpy(copy, entry->second.content.get(), entry->second.length + 1);
+  content->reset(copy);
+  return true;
+}
+
+bool Snapshot::put(const gchar *name, const gchar *content, gsize length) {
+  auto existing = entries_.find(name);
+  if (existing != entries_.end() && existing->second.length == length &&
+      memcmp(existing->second.content.get(), content, length) == 0) {
+    return true;
+  }
+  gsize existing_length =
+      existing != entries_.end() ? existing->second.length : 0;
+  gsize entries = entries_.size() + (existing == entries_.end() ? 1 : 0);
+  if (entries > max_entries_ ||
+      bytes_ - existing_length + length > max_bytes_) {
+    remove(name);
+    return false;
+  }
+  put_entry(name, content, length);
+  dirty_ = true;
+  return true;
+}
+
+void Snapshot::remove(const gchar *name) {
+  auto entry = entries_.find(name);
+  if (entry == entries_.end()) {
+    return;
+  }
+  bytes_ -= entry->second.length;
+  entries_.erase(entry);
+  removed_[name] = next_version_++;
+  dirty_ = true;
+}
+
+guint64 Snapshot::version(const gchar *name) const {
+  auto entry = entries_.find(name);
+  if (entry != entries_.end()) {
+    return entry->second.version;
+  }
+  auto removed = removed_.find(name);
+  return removed != removed_.end() ? removed->second : 0;
+}
+
+void Snapshot::revalidate(const gchar *name, guint64 version,
+                          const gchar *content, gsize length) {
+  if (this->version(name) != version) {
+    return;
+  }
+  revalidated_++;
+  auto entry = entries_.find(name);
+  if (entry != entries_.end() && content != nullptr &&
+      entry->second.length == length &&
+      memcmp(entry->second.content.get(), content, length) == 0) {
+    return;
+  }
+  stale_++;
+  if (content != nullptr) {
+    put(name, content, length);
+  } else {
+    remove(name);
+  }
+}
+
+std::vector<std::string> Snapshot::names() const {
+  std::vector<std::string> names;
+  names.reserve(entries_.size());
+  for (const auto &entry : entries_) {
+    names.push_back(entry.first);
+  }
+  return names;
+}
+
+FlValue *Snapshot::stats() const {
+  FlValue *stats = fl_value_new_map();
+  fl_value_set_string_take(stats, "entries", fl_value_new_int(entries_.size()));
+  fl_value_set_string_take(stats, "bytes", fl_value_new_int(bytes_));
+  fl_value_set_string_take(stats, "loaded", fl_value_new_int(loaded_));
+  fl_value_set_string_take(stats, "loadUs", fl_value_new_int(load_us_));
+  fl_value_set_string_take(stats, "hits", fl_value_new_int(hits_));
+  fl_value_set_string_take(stats, "misses", fl_value_new_int(misses_));
+  fl_value_set_string_take(stats, "revalidated",
+                           fl_value_new_int(revalidated_));
+  fl_value_set_string_take(stats, "stale", fl_value_new_int(stale_));
+  fl_value_set_string_take(stats, "saves", fl_value_new_int(saves_));
+  fl_value_set_string_take(stats, "fileSize", fl_value_new_int(file_size_));
+  return stats;
+}
@@ -0,0 +1,119 @@
+#ifndef FLUTTER_PLUGIN_BIOMETRIC_STORAGE_SNAPSHOT_H_
+#define FLUTTER_PLUGIN_BIOMETRIC_STORAGE_SNAPSHOT_H_
+
+#include <flutter_linux/flutter_linux.h>
+
+#include <map>
+#include <string>
+#include <vector>
+
+#include "biometric_storage_crypto.h"
+#include "biometric_storage_offline_queue.h"
+
+// Cached secrets of storages initialized with the `linuxWarmStart` option,
+// persisted to a ChaCha20-Poly1305 encrypted file so that the next start can
+// serve them without asking the Secret Service for each one. The file key is
+// kept in the keyring, a single lookup makes the whole snapshot available.
+//
+// The file is sealed as a whole with a random nonce: "BSSNAP01", nonce, then
+// the sealed entries, each a little endian 32 bit name length, the name, a
+// 32 bit content length and the content.
+class Snapshot {
+ public:
+  Snapshot(gsize max_entries, gsize max_bytes);
+  ~Snapshot();
+
+  Snapshot(const Snapshot &) = delete;
+  Snapshot &operator=(const Snapshot &) = delete;
+
+  bool has_key() const { return has_key_; }
+
+  // Sets the key from its encoding as stored in the keyring, see
+  // biometric_key_new_encoded().
+  bool set_key(const gchar *encoded);
+
+  // Loading and saving are split, so that the file and the cipher can be
+  // handled on a thread pool while the entries keep changing on the main
+  // thread. Only read() and write() may run on another thread, they do not
+  // touch the entries.
+
+  // Reads the snapshot at `path` and returns its opened entries for
+  // decode(). Fails if the file was not sealed with the current key.
+  GByteArray *read(const gchar *path, gsize *file_size, GError **error) const;
+
+  // Replaces all entries with the ones in `plain` (wiped and freed), read()
+  // since `started` (monotonic time).
+  void decode(GByteArray *plain, gsize file_size, gint64 started);
+
+  // Returns all entries for write(). The snapshot counts as saved until it
+  // changes again or saved() reports a failure.
+  GByteArray *encode();
+
+  // Seals `plain` (wiped and freed) and writes it to `path`, readable by the
+  // user only.
+  bool write(const gchar *path, GByteArray *plain, gsize *file_size,
+             GError **error) const;
+
+  // Records the outcome of write().
+  void saved(bool ok, gsize file_size);
+
+  // Returns true and sets `content` if `name` is cached.
+  bool lookup(const gchar *name, SecretPtr *content);
+
+  // Caches `length` bytes of `content` as `name`. Returns false (and drops
+  // the entry) if it does not fit into the bounds.
+  bool put(const gchar *name, const gchar *content, gsize length);
+
+  void remove(const gchar *name);
+
+  // Version of the entry `name`, bumped whenever it is put or removed. Lets
+  // revalidation detect that dart wrote the item while it was looking it up.
+  guint64 version(const gchar *name) const;
+
+  // Replaces the entry `name` with what the keyring contains (nullptr if
+  // there is no such item), unless it was changed since `version`. Counts
+  // entries which were out of date.
+  void revalidate(const gchar *name, guint64 version, const gchar *content,
+                  gsize length);
+
+  std::vector<std::string> names() const;
+
+  bool dirty() const { return dirty_; }
+  gsize size() const { return entries_.size(); }
+
+  // Hit rate, revalidation outcome and file sizes as a map for the `stats`
+  // method.
+  FlValue *stats() const;
+
+ private:
+  struct Entry {
+    SecretPtr content;
+    gsize length;
+    guint64 version;
+  };
+
+  void put_entry(const std::string &name, const gchar *content, gsize length);
+
+  const gsize max_entries_;
+  const gsize max_bytes_;
+  guint8 key_[BIOMETRIC_AEAD_KEY_SIZE];
+  bool has_key_ = false;
+  std::map<std::string, Entry> entries_;
+  gsize bytes_ = 0;
+  guint64 next_version_ = 1;
+  // Versions of removed entries, so that revalidate() does not resurrect
+  // them.
+  std::map<std::string, guint64> removed_;
+  bool dirty_ = false;
+
+  guint64 loaded_ = 0;
+  guint64 hits_ = 0;
+  guint64 misses_ = 0;
+  guint64 revalidated_ = 0;
+  guint64 stale_ = 0;
+  guint64 saves_ = 0;
+  gsize file_size_ = 0;
+  gint64 load_us_ = 0;
+};
+
+#endif  // FLUTTER_PLUGIN_BIOMETRIC_STORAGE_SNAPSHOT_H_
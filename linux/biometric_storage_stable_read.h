@@ -0,0 +1,52 @@
+#ifndef FLUTTER_PLUGIN_BIOMETRIC_STORAGE_STABLE_READ_H_
+#define FLUTTER_PLUGIN_BIOMETRIC_STORAGE_STABLE_READ_H_
+
+#include <glib.h>
+
+#include <string>
+#include <vector>
+
+#include "biometric_storage_async.h"
+
+// Reads a set of items as of one point in time, for `readSnapshot`.
+//
+// `load(versions)` returns a Task<bool> which loads all items and sets
+// `versions` to their versions (empty for a missing item), or resolves to
+// false on an error. The items are loaded twice: if no version changed in
+// between, each item was current from its first to its second load, so all
+// of them at the same time. Otherwise another writer interfered, and both
+// loads are repeated after `delay_ms`, doubling with every retry, up to
+// `max_attempts` times. Every retry is counted in `torn_reads`.
+enum class StableRead {
+  // The items as of the last load are consistent.
+  kStable,
+  // `load` failed.
+  kFailed,
+  // Every attempt was torn.
+  kTorn,
+};
+
+template <typename Load>
+Task<StableRead> read_stable(Load load, guint max_attempts, guint delay_ms,
+                             guint64 *torn_reads) {
+  std::vector<std::string> first;
+  std::vector<std::string> second;
+  for (guint attempt = 0; attempt < max_attempts; attempt++) {
+    if (attempt > 0) {
+      (*torn_reads)++;
+      co_await sleep_ms(delay_ms << (attempt - 1));
+    }
+    if (!co_await load(&first)) {
+      co_return StableRead::kFailed;
+    }
+    if (!co_await load(&second)) {
+      co_return StableRead::kFailed;
+    }
+    if (first == second) {
+      co_return StableRead::kStable;
+    }
+  }
+  co_return StableRead::kTorn;
+}
+
+#endif  // FLUTTER_PLUGIN_BIOMETRIC_STORAGE_STABLE_READ_H_
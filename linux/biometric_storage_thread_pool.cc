@@ -0,0 +1,125 @@
+#include "biometric_storage_thread_pool.h"
+
+ThreadPool::ThreadPool(guint workers, gsize max_queued)
+    : max_queued_(max_queued), started_at_(g_get_monotonic_time()) {
+  for (guint i = 0; i < MAX(workers, 1u); i++) {
+    workers_.push_back(std::make_unique<Worker>());
+  }
+  for (guint i = 0; i < workers_.size(); i++) {
+    workers_[i]->thread = std::thread(&ThreadPool::run_worker, this, i);
+  }
+}
+
+ThreadPool::~ThreadPool() {
+  {
+    std::lock_guard<std::mutex> lock(sleep_mutex_);
+    stopping_ = true;
+  }
+  wake_.notify_all();
+  for (auto &worker : workers_) {
+    worker->thread.join();
+  }
+}
+
+bool ThreadPool::submit(Job job) {
+  if (pending_.fetch_add(1) >= max_queued_) {
+    pending_.fetch_sub(1);
+    return false;
+  }
+  guint index = next_worker_.fetch_add(1, std::memory_order_relaxed) %
+                workers_.size();
+  {
+    std::lock_guard<std::mutex> lock(workers_[index]->mutex);
+    workers_[index]->jobs.push_back({std::move(job), g_get_monotonic_time()});
+    queued_++;
+  }
+  // Workers check `queued_` under the sleep mutex before waiting, taking it
+  // here makes sure the notification below can not get lost.
+  { std::lock_guard<std::mutex> lock(sleep_mutex_); }
+  wake_.notify_one();
+  return true;
+}
+
+bool ThreadPool::take(guint index, QueuedJob *job) {
+  Worker *own = workers_[index].get();
+  {
+    std::lock_guard<std::mutex> lock(own->mutex);
+    if (!own->jobs.empty()) {
+      *job = std::move(own->jobs.front());
+      own->jobs.pop_front();
+      queued_--;
+      return true;
+    }
+  }
+  for (guint i = 1; i < workers_.size(); i++) {
+    Worker *victim = workers_[(index + i) % workers_.size()].get();
+    std::lock_guard<std::mutex> lock(victim->mutex);
+    if (!victim->jobs.empty()) {
+      *job = std::move(victim->jobs.back());
+      victim->jobs.pop_back();
+      queued_--;
+      steals_.fetch_add(1, std::memory_order_relaxed);
+      return true;
+    }
+  }
+  return false;
+}
+
+void ThreadPool::run_worker(guint index) {
+  Worker *worker = workers_[index].get();
+  while (true) {
+    QueuedJob job;
+    if (!take(index, &job)) {
+      std::unique_lock<std::mutex> lock(sleep_mutex_);
+      wake_.wait(lock, [this] { return stopping_ || queued_.load() > 0; });
+      if (stopping_ && queued_.load() == 0) {
+        return;
+      }
+      continue;
+    }
+
+    gint64 started = g_get_monotonic_time();
+    gint64 waited = started - job.queued_at;
+    wait_total_us_.fetch_add(waited, std::memory_order_relaxed);
+    gint64 max = wait_max_us_.load(std::memory_order_relaxed);
+    while (waited > max && !wait_max_us_.compare_exchange_weak(max, waited)) {
+    }
+
+    job.job();
+
+    worker->busy_us.fetch_add(g_get_monotonic_time() - started,
+                              std::memory_order_relaxed);
+    pending_.fetch_sub(1);
+    completed_.fetch_add(1, std::memory_order_relaxed);
+  }
+}
+
+FlValue *ThreadPool::stats() const {
+  gint64 busy_us = 0;
+  for (const auto &worker : workers_) {
+    busy_us += worker->busy_us.load(std::memory_order_relaxed);
+  }
+  gint64 elapsed_us = MAX(g_get_monotonic_time() - started_at_, 1);
+  guint64 completed = completed_.load(std::memory_order_relaxed);
+
+  FlValue *stats = fl_value_new_map();
+  fl_value_set_string_take(stats, "workers",
+                           fl_value_new_int(workers_.size()));
+  fl_value_set_string_take(stats, "queued", fl_value_new_int(queued_.load()));
+  fl_value_set_string_take(stats, "pending", fl_value_new_int(pending_.load()));
+  fl_value_set_string_take(stats, "completed", fl_value_new_int(completed));
+  fl_value_set_string_take(stats, "steals", fl_value_new_int(steals_.load()));
+  fl_value_set_string_take(stats, "inline",
+                           fl_value_new_int(inline_jobs_.load()));
+  fl_value_set_string_take(
+      stats, "utilization",
+      fl_value_new_float((gdouble)busy_us / (elapsed_us * workers_.size())));
+  fl_value_set_string_take(
+      stats, "queueWaitAvgUs",
+      fl_value_new_float(completed > 0
+                             ? (gdouble)wait_total_us_.load() / completed
+                             : 0));
+  fl_value_set_string_take(stats, "queueWaitMaxUs",
+                           fl_value_new_int(wait_max_us_.load()));
+  return stats;
+}
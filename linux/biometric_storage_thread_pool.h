@@ -0,0 +1,151 @@
+#ifndef FLUTTER_PLUGIN_BIOMETRIC_STORAGE_THREAD_POOL_H_
+#define FLUTTER_PLUGIN_BIOMETRIC_STORAGE_THREAD_POOL_H_
+
+#include <flutter_linux/flutter_linux.h>
+
+#include <atomic>
+#include <condition_variable>
+#include <coroutine>
+#include <deque>
+#include <functional>
+#include <memory>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+// Bounded work stealing pool for CPU heavy work on secrets (copying and
+// wiping large values, hashing, encryption), so it does not run on the GTK
+// main thread.
+//
+// Every worker owns a deque. Submitted jobs are distributed round robin, a
+// worker takes jobs from the front of its own deque and steals from the back
+// of the others when it runs dry. At most `max_queued` jobs are pending at a
+// time, beyond that submit() refuses the job and the caller runs it inline.
+//
+// Coroutines use run_on(), which resumes them on the main context once the
+// job finished:
+//
+//   FlValue *value = co_await run_on(pool, [&] { return expensive(); });
+//
+// Hashing, sealing or copying a secret only pays off on a worker from
+// kOffloadMinSize bytes, smaller jobs pass a nullptr pool and run inline.
+// Size of a secret from which hashing, sealing and copying it runs on the
+// pool. Below, the round trip to a worker and back through the main context
+// costs more than the work; see offload_benchmark in benchmark/README.md.
+const gsize kOffloadMinSize = 64 * 1024;
+
+class ThreadPool {
+ public:
+  using Job = std::function<void()>;
+
+  ThreadPool(guint workers, gsize max_queued);
+  ~ThreadPool();
+
+  ThreadPool(const ThreadPool &) = delete;
+  ThreadPool &operator=(const ThreadPool &) = delete;
+
+  // Queues `job`, returns false (without running it) if the pool is full.
+  bool submit(Job job);
+
+  // Records that a job was run inline because the pool was full.
+  void count_inline() { inline_jobs_.fetch_add(1, std::memory_order_relaxed); }
+
+  // Utilization and queue wait statistics as a map for the `stats` method.
+  FlValue *stats() const;
+
+ private:
+  struct QueuedJob {
+    Job job;
+    gint64 queued_at;
+  };
+  struct Worker {
+    std::mutex mutex;
+    std::deque<QueuedJob> jobs;
+    std::thread thread;
+    std::atomic<gint64> busy_us{0};
+  };
+
+  void run_worker(guint index);
+  bool take(guint index, QueuedJob *job);
+
+  std::vector<std::unique_ptr<Worker>> workers_;
+  const gsize max_queued_;
+  const gint64 started_at_;
+
+  std::mutex sleep_mutex_;
+  std::condition_variable wake_;
+  // Jobs waiting in a deque, and waiting or running.
+  std::atomic<gsize> queued_{0};
+  std::atomic<gsize> pending_{0};
+  std::atomic<guint> next_worker_{0};
+  bool stopping_ = false;
+
+  std::atomic<guint64> completed_{0};
+  std::atomic<guint64> steals_{0};
+  std::atomic<guint64> inline_jobs_{0};
+  std::atomic<gint64> wait_total_us_{0};
+  std::atomic<gint64> wait_max_us_{0};
+};
+
+// Awaitable returned by run_on(), see ThreadPool.
+template <typename Func>
+class ThreadPoolAwaiter {
+ public:
+  using Result = decltype(std::declval<Func>()());
+
+  ThreadPoolAwaiter(ThreadPool *pool, Func func)
+      : pool_(pool), func_(std::move(func)) {}
+
+  bool await_ready() {
+    if (pool_ != nullptr) {
+      return false;
+    }
+    result_ = func_();
+    return true;
+  }
+
+  bool await_suspend(std::coroutine_handle<> handle) {
+    handle_ = handle;
+    context_ = g_main_context_ref_thread_default();
+    bool queued = pool_->submit([this] {
+      result_ = func_();
+      // Not g_main_context_invoke(), which may run `resume` right here if
+      // the main thread does not currently own its context.
+      GSource *source = g_idle_source_new();
+      g_source_set_callback(source, resume, this, nullptr);
+      g_source_attach(source, context_);
+      g_source_unref(source);
+    });
+    if (!queued) {
+      pool_->count_inline();
+      result_ = func_();
+      g_main_context_unref(context_);
+    }
+    return queued;
+  }
+
+  Result await_resume() { return std::move(result_); }
+
+ private:
+  static gboolean resume(gpointer user_data) {
+    auto *self = static_cast<ThreadPoolAwaiter *>(user_data);
+    g_main_context_unref(self->context_);
+    self->handle_.resume();
+    return G_SOURCE_REMOVE;
+  }
+
+  ThreadPool *pool_;
+  Func func_;
+  Result result_{};
+  std::coroutine_handle<> handle_;
+  GMainContext *context_ = nullptr;
+};
+
+// Runs `func` on `pool` and resumes the awaiting coroutine with its result
+// on the calling thread's main context. Runs it inline if `pool` is nullptr.
+template <typename Func>
+ThreadPoolAwaiter<Func> run_on(ThreadPool *pool, Func func) {
+  return ThreadPoolAwaiter<Func>(pool, std::move(func));
+}
+
+#endif  // FLUTTER_PLUGIN_BIOMETRIC_STORAGE_THREAD_POOL_H_
@@ -0,0 +1,62 @@
+#include <glib.h>
+#include <stdio.h>
+#include <string.h>
+#include <time.h>
+#include <unistd.h>
+
+// Cold start trace, see linux/benchmark/cold_start_benchmark.sh. Lines are
+// "<event>,<microseconds since the process started>", each event is only
+// recorded the first time. Only built into the plugin with
+// BIOMETRIC_STORAGE_BENCHMARKS, example/linux/startup_trace.cc records the
+// milestones of the app in the same format.
+
+static const gchar *trace_path = nullptr;
+static gint64 process_start_us = 0;
+static GHashTable *recorded = nullptr;
+
+static gint64 boottime_us() {
+  struct timespec now;
+  clock_gettime(CLOCK_BOOTTIME, &now);
+  return (gint64)now.tv_sec * G_USEC_PER_SEC + now.tv_nsec / 1000;
+}
+
+// Start time of this process on the CLOCK_BOOTTIME scale, from field 22 of
+// /proc/self/stat (in clock ticks since boot).
+static gint64 read_process_start_us() {
+  g_autofree gchar *stat = nullptr;
+  if (!g_file_get_contents("/proc/self/stat", &stat, nullptr, nullptr)) {
+    return boottime_us();
+  }
+  // The command name in field 2 may contain spaces, count after it.
+  const gchar *fields = strrchr(stat, ')');
+  g_auto(GStrv) parts = g_strsplit(fields != nullptr ? fields + 2 : stat,
+                                   " ", 21);
+  if (g_strv_length(parts) < 21) {
+    return boottime_us();
+  }
+  guint64 ticks = g_ascii_strtoull(parts[19], nullptr, 10);
+  return (gint64)(ticks * G_USEC_PER_SEC / sysconf(_SC_CLK_TCK));
+}
+
+void biometric_storage_plugin_trace(const gchar *event) {
+  static gsize initialized = 0;
+  if (g_once_init_enter(&initialized)) {
+    trace_path = g_getenv("BIOMETRIC_STORAGE_TRACE");
+    if (trace_path != nullptr) {
+      process_start_us = read_process_start_us();
+      recorded = g_hash_table_new(g_str_hash, g_str_equal);
+    }
+    g_once_init_leave(&initialized, 1);
+  }
+  if (trace_path == nullptr || g_hash_table_contains(recorded, event)) {
+    return;
+  }
+  gint64 now = boottime_us();
+  g_hash_table_add(recorded, g_strdup(event));
+  FILE *trace = fopen(trace_path, "a");
+  if (trace == nullptr) {
+    return;
+  }
+  fprintf(trace, "%s,%" G_GINT64_FORMAT "\n", event, now - process_start_us);
+  fclose(trace);
+}
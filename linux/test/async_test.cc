@@ -0,0 +1,197 @@
+// The coroutine layer: lazy tasks and their frames, resuming from GIO
+// callbacks and timeouts, AsyncCondition and RefPtr ownership.
+
+#include <flutter_linux/flutter_linux.h>
+#include <gio/gio.h>
+
+#include <string>
+#include <vector>
+
+#include "../biometric_storage_async.h"
+#include "test_util.h"
+
+// Counts its destruction, to tell when a coroutine frame was freed.
+struct FrameGuard {
+  gint *destroyed;
+  ~FrameGuard() { (*destroyed)++; }
+};
+
+static Task<gint> answer(gboolean *started) {
+  *started = TRUE;
+  co_return 42;
+}
+
+static Task<gint> sum(gboolean *started) {
+  gint first = co_await answer(started);
+  gint second = co_await answer(started);
+  co_return first + second;
+}
+
+static Task<> check_sum(gboolean *started) {
+  gint result = co_await sum(started);
+  g_assert_cmpint(result, ==, 84);
+}
+
+// Tasks only run once awaited, and hand their result to the awaiter.
+static void test_task_lazy_start() {
+  gboolean started = FALSE;
+  {
+    Task<gint> task = answer(&started);
+    g_assert_false(started);
+  }
+  g_assert_false(started);
+
+  test_run_task(check_sum(&started));
+  g_assert_true(started);
+}
+
+static Task<> wait_guarded(AsyncCondition *condition, gint *destroyed,
+                           std::vector<std::string> *events) {
+  FrameGuard guard{destroyed};
+  events->push_back("started");
+  co_await condition->wait();
+  events->push_back("resumed");
+}
+
+// A detached task runs up to its first suspension right away and frees its
+// frame once it completes. An unstarted task frees it when dropped.
+static void test_task_detach() {
+  AsyncCondition condition;
+  gint destroyed = 0;
+  std::vector<std::string> events;
+  task_detach(wait_guarded(&condition, &destroyed, &events));
+  g_assert_cmpuint(events.size(), ==, 1);
+  g_assert_cmpint(destroyed, ==, 0);
+
+  condition.notify_all();
+  while (g_main_context_iteration(nullptr, FALSE)) {
+  }
+  g_assert_cmpuint(events.size(), ==, 2);
+  g_assert_cmpstr(events[1].c_str(), ==, "resumed");
+  g_assert_cmpint(destroyed, ==, 1);
+
+  {
+    Task<> task = wait_guarded(&condition, &destroyed, &events);
+  }
+  g_assert_cmpuint(events.size(), ==, 2);
+  g_assert_cmpint(destroyed, ==, 1);
+}
+
+static void return_from_thread(GTask *task, gpointer source,
+                               gpointer task_data,
+                               GCancellable *cancellable) {
+  g_task_return_boolean(task, TRUE);
+}
+
+static Task<> await_gio(GThread *main_thread) {
+  RefPtr<GAsyncResult> result = co_await gio_async(
+      [](GAsyncReadyCallback callback, gpointer user_data) {
+        GTask *task = g_task_new(nullptr, nullptr, callback, user_data);
+        g_task_run_in_thread(task, return_from_thread);
+        g_object_unref(task);
+      });
+  g_assert_true(g_thread_self() == main_thread);
+  g_assert_true(result);
+  g_assert_true(g_task_propagate_boolean(G_TASK(result.get()), nullptr));
+}
+
+// gio_async() resumes on the main context, even when the operation
+// completes on another thread.
+static void test_gio_async() { test_run_task(await_gio(g_thread_self())); }
+
+static Task<> await_sleep(guint interval) {
+  gint64 started = g_get_monotonic_time();
+  co_await sleep_ms(interval);
+  g_assert_cmpint(g_get_monotonic_time() - started, >=, interval * 1000);
+}
+
+static void test_sleep() { test_run_task(await_sleep(20)); }
+
+// Waits until `*value` reaches `target`, re-checking after every wake up.
+static Task<> wait_for_value(AsyncCondition *condition, gint *value,
+                             gint target, std::vector<gint> *woken) {
+  while (*value < target) {
+    co_await condition->wait();
+    woken->push_back(target);
+  }
+}
+
+// notify_all() resumes every waiter from the main context, in the order
+// they started waiting, and never from inside the caller.
+static void test_condition() {
+  AsyncCondition condition;
+  condition.notify_all();
+
+  gint value = 0;
+  std::vector<gint> woken;
+  task_detach(wait_for_value(&condition, &value, 1, &woken));
+  task_detach(wait_for_value(&condition, &value, 2, &woken));
+
+  value = 1;
+  condition.notify_all();
+  g_assert_true(woken.empty());
+  while (g_main_context_iteration(nullptr, FALSE)) {
+  }
+  g_assert_cmpuint(woken.size(), ==, 2);
+  g_assert_cmpint(woken[0], ==, 1);
+  g_assert_cmpint(woken[1], ==, 2);
+
+  // Only the second one waits again.
+  value = 2;
+  condition.notify_all();
+  while (g_main_context_iteration(nullptr, FALSE)) {
+  }
+  g_assert_cmpuint(woken.size(), ==, 3);
+  g_assert_cmpint(woken[2], ==, 2);
+  condition.notify_all();
+  while (g_main_context_iteration(nullptr, FALSE)) {
+  }
+  g_assert_cmpuint(woken.size(), ==, 3);
+}
+
+static void on_finalized(gpointer data, GObject *object) {
+  *static_cast<gboolean *>(data) = TRUE;
+}
+
+// Copies take a reference, moves and steal() hand it over.
+static void test_ref_ptr() {
+  gboolean finalized = FALSE;
+  GObject *object = G_OBJECT(g_object_new(G_TYPE_OBJECT, nullptr));
+  g_object_weak_ref(object, on_finalized, &finalized);
+  {
+    RefPtr<GObject> owner = RefPtr<GObject>::adopt(object);
+    {
+      RefPtr<GObject> copy = owner;
+      g_assert_true(copy.get() == object);
+    }
+    g_assert_false(finalized);
+
+    RefPtr<GObject> moved = std::move(owner);
+    g_assert_false(owner);
+    g_assert_true(moved.get() == object);
+
+    RefPtr<GObject> other = RefPtr<GObject>::ref(object);
+    other.reset();
+    g_assert_false(other);
+    g_assert_false(finalized);
+
+    GObject *stolen = moved.steal();
+    g_assert_false(moved);
+    owner = RefPtr<GObject>::adopt(stolen);
+  }
+  g_assert_true(finalized);
+
+  RefPtr<GObject> empty = RefPtr<GObject>::ref(nullptr);
+  g_assert_false(empty);
+}
+
+int main(int argc, char **argv) {
+  g_test_init(&argc, &argv, nullptr);
+  g_test_add_func("/async/task-lazy-start", test_task_lazy_start);
+  g_test_add_func("/async/task-detach", test_task_detach);
+  g_test_add_func("/async/gio-async", test_gio_async);
+  g_test_add_func("/async/sleep", test_sleep);
+  g_test_add_func("/async/condition", test_condition);
+  g_test_add_func("/async/ref-ptr", test_ref_ptr);
+  return g_test_run();
+}
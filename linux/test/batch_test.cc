@@ -0,0 +1,158 @@
+// `readMany` and `deleteMany`: results of all items, failures of single
+// items and batch ids, run against the credentials backend.
+
+#include <flutter_linux/flutter_linux.h>
+#include <glib/gstdio.h>
+
+#include <string>
+
+#include "test_util.h"
+
+typedef struct {
+  gchar *dir;
+  BiometricStoragePlugin *plugin;
+} Fixture;
+
+static void fixture_set_up(Fixture *fixture, gconstpointer user_data) {
+  fixture->dir = test_tmp_dir_new();
+  fixture->plugin = test_plugin_new(fixture->dir, TRUE);
+}
+
+static void fixture_tear_down(Fixture *fixture, gconstpointer user_data) {
+  g_object_unref(fixture->plugin);
+  test_remove_tree(fixture->dir);
+  g_free(fixture->dir);
+}
+
+static void store(Fixture *fixture, const gchar *name, const gchar *content) {
+  g_autoptr(FlValue) args = fl_value_new_map();
+  fl_value_set_string_take(args, "name", fl_value_new_string(name));
+  fl_value_set_string_take(args, "content", fl_value_new_string(content));
+  g_autoptr(FlMethodResponse) response =
+      test_plugin_call(fixture->plugin, "write", args);
+  test_response_result(response);
+}
+
+static FlValue *batch_args_new(gint64 id, gint count) {
+  FlValue *args = fl_value_new_map();
+  fl_value_set_string_take(args, "batchId", fl_value_new_int(id));
+  FlValue *names = fl_value_new_list();
+  for (gint i = 0; i < count; i++) {
+    std::string name = "item" + std::to_string(i);
+    fl_value_append_take(names, fl_value_new_string(name.c_str()));
+  }
+  fl_value_set_string_take(args, "names", names);
+  return args;
+}
+
+static gint64 result_int(FlMethodResponse *response, const gchar *key) {
+  return fl_value_get_int(
+      fl_value_lookup_string(test_response_result(response), key));
+}
+
+// More items than run concurrently. An item which fails is counted and does
+// not stop the others.
+static void test_read_many(Fixture *fixture, gconstpointer user_data) {
+  for (gint i = 0; i < 20; i += 2) {
+    store(fixture, ("item" + std::to_string(i)).c_str(), "value");
+  }
+  // Reading a directory instead of a credential file fails.
+  g_autofree gchar *broken = g_build_filename(
+      fixture->dir, "credentials", BIOMETRIC_NAME_PREFIX ".item5", NULL);
+  g_assert_cmpint(g_mkdir(broken, 0700), ==, 0);
+
+  g_autoptr(FlValue) args = batch_args_new(1, 20);
+  g_test_expect_message(nullptr, G_LOG_LEVEL_WARNING,
+                        "Failed to lookup secret*");
+  g_autoptr(FlMethodResponse) response =
+      test_plugin_call(fixture->plugin, "readMany", args);
+  g_test_assert_expected_messages();
+  g_assert_cmpint(result_int(response, "total"), ==, 20);
+  g_assert_cmpint(result_int(response, "failed"), ==, 1);
+}
+
+static void test_delete_many(Fixture *fixture, gconstpointer user_data) {
+  for (gint i = 0; i < 12; i++) {
+    store(fixture, ("item" + std::to_string(i)).c_str(), "value");
+  }
+  g_autoptr(FlValue) args = batch_args_new(2, 12);
+  g_autoptr(FlMethodResponse) response =
+      test_plugin_call(fixture->plugin, "deleteMany", args);
+  g_assert_cmpint(result_int(response, "total"), ==, 12);
+  g_assert_cmpint(result_int(response, "failed"), ==, 0);
+
+  for (gint i = 0; i < 12; i++) {
+    std::string name = "item" + std::to_string(i);
+    g_autoptr(FlValue) read_args = fl_value_new_map();
+    fl_value_set_string_take(read_args, "name",
+                             fl_value_new_string(name.c_str()));
+    g_autoptr(FlMethodResponse) read =
+        test_plugin_call(fixture->plugin, "read", read_args);
+    g_assert_cmpint(fl_value_get_type(test_response_result(read)), ==,
+                    FL_VALUE_TYPE_NULL);
+  }
+}
+
+static void test_rejects_bad_arguments(Fixture *fixture,
+                                       gconstpointer user_data) {
+  g_autoptr(FlValue) args = fl_value_new_map();
+  fl_value_set_string_take(args, "batchId", fl_value_new_int(3));
+  FlValue *names = fl_value_new_list();
+  fl_value_append_take(names, fl_value_new_int(1));
+  fl_value_set_string_take(args, "names", names);
+  g_autoptr(FlMethodResponse) response =
+      test_plugin_call(fixture->plugin, "readMany", args);
+  g_assert_true(FL_IS_METHOD_ERROR_RESPONSE(response));
+}
+
+static Task<> read_many(BiometricStoragePlugin *plugin, FlValue *args,
+                        FlMethodResponse **response) {
+  RefPtr<FlMethodResponse> result =
+      co_await biometric_storage_plugin_call(plugin, "readMany", args);
+  *response = result.steal();
+}
+
+// Ids identify running batches for `batchAck`, a second batch with the id
+// of a running one is rejected.
+static void test_batch_ids(Fixture *fixture, gconstpointer user_data) {
+  g_autoptr(FlValue) args = batch_args_new(4, 3);
+  FlMethodResponse *first = nullptr;
+  // Suspends while the credentials overlay is opened on the thread pool.
+  task_detach(read_many(fixture->plugin, args, &first));
+  g_assert_null(first);
+
+  g_autoptr(FlMethodResponse) second =
+      test_plugin_call(fixture->plugin, "readMany", args);
+  g_assert_true(FL_IS_METHOD_ERROR_RESPONSE(second));
+
+  g_autoptr(FlValue) ack_args = fl_value_new_map();
+  fl_value_set_string_take(ack_args, "batchId", fl_value_new_int(4));
+  fl_value_set_string_take(ack_args, "count", fl_value_new_int(1));
+  g_autoptr(FlMethodResponse) ack =
+      test_plugin_call(fixture->plugin, "batchAck", ack_args);
+  g_assert_true(fl_value_get_bool(test_response_result(ack)));
+
+  while (first == nullptr) {
+    g_main_context_iteration(nullptr, TRUE);
+  }
+  g_assert_cmpint(result_int(first, "total"), ==, 3);
+  g_object_unref(first);
+
+  // Finished batches are unknown.
+  g_autoptr(FlMethodResponse) late_ack =
+      test_plugin_call(fixture->plugin, "batchAck", ack_args);
+  g_assert_false(fl_value_get_bool(test_response_result(late_ack)));
+}
+
+int main(int argc, char **argv) {
+  g_test_init(&argc, &argv, G_TEST_OPTION_ISOLATE_DIRS, nullptr);
+  g_test_add("/batch/read-many", Fixture, nullptr, fixture_set_up,
+             test_read_many, fixture_tear_down);
+  g_test_add("/batch/delete-many", Fixture, nullptr, fixture_set_up,
+             test_delete_many, fixture_tear_down);
+  g_test_add("/batch/rejects-bad-arguments", Fixture, nullptr,
+             fixture_set_up, test_rejects_bad_arguments, fixture_tear_down);
+  g_test_add("/batch/batch-ids", Fixture, nullptr, fixture_set_up,
+             test_batch_ids, fixture_tear_down);
+  return g_test_run();
+}
@@ -0,0 +1,60 @@
+// Ownership of the secret buffers handed to dart: registered, acquired and
+// released, and what is left of them when the plugin goes away.
+
+#include <glib.h>
+#include <string.h>
+
+#include "../biometric_storage_buffer.h"
+
+static guint8 *buffer_with_secret(gsize length) {
+  guint8 *data = biometric_buffer_new(length);
+  g_assert_nonnull(data);
+  memset(data, 0xa5, length);
+  return data;
+}
+
+static gboolean is_wiped(const guint8 *data, gsize length) {
+  for (gsize i = 0; i < length; i++) {
+    if (data[i] != 0) {
+      return FALSE;
+    }
+  }
+  return TRUE;
+}
+
+static void test_buffer_acquire_once() {
+  guint8 *data = buffer_with_secret(100);
+  gint64 handle = biometric_buffer_register(data);
+  g_assert_true(biometric_storage_buffer_acquire(handle) == data);
+  g_assert_null(biometric_storage_buffer_acquire(handle));
+  g_assert_null(biometric_storage_buffer_acquire(handle + 1000));
+  biometric_storage_buffer_release(data);
+}
+
+// Dart never ran the finalizer of `held`: it is wiped but stays mapped
+// until released. Released buffers are no longer touched.
+static void test_buffer_wipe_acquired() {
+  const gsize kLength = 5000;
+  guint8 *held = buffer_with_secret(kLength);
+  guint8 *released = buffer_with_secret(kLength);
+  biometric_storage_buffer_acquire(biometric_buffer_register(held));
+  biometric_storage_buffer_acquire(biometric_buffer_register(released));
+  biometric_storage_buffer_release(released);
+  guint8 *unclaimed = buffer_with_secret(kLength);
+  gint64 unclaimed_handle = biometric_buffer_register(unclaimed);
+
+  biometric_buffer_free_unclaimed();
+  biometric_buffer_wipe_acquired();
+  g_assert_true(is_wiped(held, kLength));
+  g_assert_null(biometric_storage_buffer_acquire(unclaimed_handle));
+  biometric_storage_buffer_release(held);
+  // Nothing left to wipe.
+  biometric_buffer_wipe_acquired();
+}
+
+int main(int argc, char **argv) {
+  g_test_init(&argc, &argv, nullptr);
+  g_test_add_func("/buffer/acquire-once", test_buffer_acquire_once);
+  g_test_add_func("/buffer/wipe-acquired", test_buffer_wipe_acquired);
+  return g_test_run();
+}
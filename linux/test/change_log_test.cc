@@ -0,0 +1,198 @@
+// Cursor semantics of `changesSince`: generations, epochs, compaction and
+// recovery from a torn append.
+
+#include <flutter_linux/flutter_linux.h>
+#include <stdio.h>
+
+#include "../biometric_storage_change_log.h"
+#include "test_util.h"
+
+typedef struct {
+  gchar *dir;
+  gchar *path;
+} Fixture;
+
+static void fixture_set_up(Fixture *fixture, gconstpointer user_data) {
+  fixture->dir = test_tmp_dir_new();
+  fixture->path = g_build_filename(fixture->dir, "changes", "test.log", NULL);
+}
+
+static void fixture_tear_down(Fixture *fixture, gconstpointer user_data) {
+  test_remove_tree(fixture->dir);
+  g_free(fixture->path);
+  g_free(fixture->dir);
+}
+
+static void record(ChangeLog *log, const gchar *name, gboolean deleted) {
+  g_autoptr(GError) error = nullptr;
+  g_assert_true(log->record(name, deleted, &error));
+  g_assert_no_error(error);
+}
+
+// Asserts the changes after `generation`, as "<generation> <change> <name>"
+// lines, or "reset".
+static void expect_changes(ChangeLog *log, guint64 generation,
+                           const gchar *epoch, const gchar *expected) {
+  std::vector<ChangeLog::Entry> entries;
+  gboolean reset = FALSE;
+  g_autoptr(GError) error = nullptr;
+  g_assert_true(log->changes_since(generation, epoch, &entries, &reset,
+                                   &error));
+  g_assert_no_error(error);
+  g_autoptr(GString) text = g_string_new(reset ? "reset" : "");
+  g_assert_true(!reset || entries.empty());
+  for (const ChangeLog::Entry &entry : entries) {
+    g_string_append_printf(text, "%" G_GUINT64_FORMAT " %s %s\n",
+                           entry.generation,
+                           ChangeLog::change_name(entry.change),
+                           entry.name.c_str());
+  }
+  g_assert_cmpstr(text->str, ==, expected);
+}
+
+static void test_change_log_cursor(Fixture *fixture, gconstpointer data) {
+  ChangeLog log(fixture->path, 64);
+  expect_changes(&log, 0, nullptr, "");
+  g_assert_cmpuint(log.generation(), ==, 0);
+
+  record(&log, "a", FALSE);
+  record(&log, "b", FALSE);
+  record(&log, "a", FALSE);
+  record(&log, "b", TRUE);
+  g_assert_cmpuint(log.generation(), ==, 4);
+  // Only the last change of each name, in generation order.
+  expect_changes(&log, 0, nullptr,
+                 "3 modified a\n"
+                 "4 deleted b\n");
+  expect_changes(&log, 3, nullptr, "4 deleted b\n");
+  expect_changes(&log, 4, nullptr, "");
+  // From the future, the log was replaced.
+  expect_changes(&log, 5, nullptr, "reset");
+
+  // A write after a delete creates the storage again.
+  record(&log, "b", FALSE);
+  expect_changes(&log, 4, nullptr, "5 created b\n");
+}
+
+static void test_change_log_epoch(Fixture *fixture, gconstpointer data) {
+  ChangeLog log(fixture->path, 64);
+  record(&log, "a", FALSE);
+  std::string epoch = log.epoch();
+  g_assert_cmpuint(epoch.size(), ==, 16);
+  expect_changes(&log, 1, epoch.c_str(), "");
+  expect_changes(&log, 1, "0000000000000000", "reset");
+
+  // A new log gets a new epoch, its generations continue.
+  g_assert_cmpint(g_unlink(fixture->path), ==, 0);
+  expect_changes(&log, 1, epoch.c_str(), "reset");
+  g_assert_cmpstr(log.epoch().c_str(), !=, epoch.c_str());
+  record(&log, "b", FALSE);
+  g_assert_cmpuint(log.generation(), ==, 2);
+  expect_changes(&log, 1, log.epoch().c_str(), "2 created b\n");
+}
+
+// Another process appending to the log, seen by the next call.
+static void test_change_log_shared(Fixture *fixture, gconstpointer data) {
+  ChangeLog first(fixture->path, 64);
+  ChangeLog second(fixture->path, 64);
+  record(&first, "a", FALSE);
+  record(&second, "a", FALSE);
+  record(&first, "b", FALSE);
+  expect_changes(&second, 0, nullptr,
+                 "2 modified a\n"
+                 "3 created b\n");
+  g_assert_cmpstr(first.epoch().c_str(), ==, second.epoch().c_str());
+}
+
+// Compaction keeps the last change of each name, dropping the oldest once
+// there are more than half of max_records.
+static void test_change_log_compaction(Fixture *fixture, gconstpointer data) {
+  ChangeLog log(fixture->path, 8);
+  for (gint i = 0; i < 4; i++) {
+    record(&log, "a", FALSE);
+    record(&log, "b", FALSE);
+  }
+  // The 9th record compacted the log to "a" and "b".
+  record(&log, "a", TRUE);
+  expect_changes(&log, 0, nullptr,
+                 "8 modified b\n"
+                 "9 deleted a\n");
+
+  for (gint i = 0; i < 8; i++) {
+    g_autofree gchar *name = g_strdup_printf("n%d", i);
+    record(&log, name, FALSE);
+  }
+  // Compacted at generation 16 to its last 4 names, callers from before
+  // generation 12 have to read everything again.
+  expect_changes(&log, 11, nullptr, "reset");
+  expect_changes(&log, 12, nullptr,
+                 "13 created n3\n"
+                 "14 created n4\n"
+                 "15 created n5\n"
+                 "16 created n6\n"
+                 "17 created n7\n");
+
+  // The compacted file answers the same for a new reader.
+  ChangeLog reader(fixture->path, 8);
+  expect_changes(&reader, 14, nullptr,
+                 "15 created n5\n"
+                 "16 created n6\n"
+                 "17 created n7\n");
+}
+
+// A change without its newline, left by a process which died while
+// appending, is dropped.
+static void test_change_log_torn(Fixture *fixture, gconstpointer data) {
+  {
+    ChangeLog log(fixture->path, 64);
+    record(&log, "a", FALSE);
+  }
+  FILE *file = fopen(fixture->path, "a");
+  g_assert_nonnull(file);
+  fputs("2 m a", file);
+  fclose(file);
+
+  ChangeLog log(fixture->path, 64);
+  g_test_expect_message(G_LOG_DOMAIN, G_LOG_LEVEL_WARNING,
+                        "Dropping 5 bytes of a torn change in *");
+  expect_changes(&log, 0, nullptr, "1 created a\n");
+  g_test_assert_expected_messages();
+  record(&log, "b", FALSE);
+  expect_changes(&log, 1, nullptr, "2 created b\n");
+  g_autofree gchar *contents = nullptr;
+  g_assert_true(g_file_get_contents(fixture->path, &contents, nullptr,
+                                    nullptr));
+  g_assert_true(g_str_has_suffix(contents, "\n1 c a\n2 c b\n"));
+}
+
+// Names are escaped, one change per line.
+static void test_change_log_names(Fixture *fixture, gconstpointer data) {
+  const gchar *name = "a b\nc\\d";
+  {
+    ChangeLog log(fixture->path, 64);
+    record(&log, name, FALSE);
+  }
+  ChangeLog log(fixture->path, 64);
+  std::vector<ChangeLog::Entry> entries;
+  gboolean reset;
+  g_assert_true(log.changes_since(0, nullptr, &entries, &reset, nullptr));
+  g_assert_cmpuint(entries.size(), ==, 1);
+  g_assert_cmpstr(entries[0].name.c_str(), ==, name);
+}
+
+int main(int argc, char **argv) {
+  g_test_init(&argc, &argv, nullptr);
+  g_test_add("/change-log/cursor", Fixture, nullptr, fixture_set_up,
+             test_change_log_cursor, fixture_tear_down);
+  g_test_add("/change-log/epoch", Fixture, nullptr, fixture_set_up,
+             test_change_log_epoch, fixture_tear_down);
+  g_test_add("/change-log/shared", Fixture, nullptr, fixture_set_up,
+             test_change_log_shared, fixture_tear_down);
+  g_test_add("/change-log/compaction", Fixture, nullptr, fixture_set_up,
+             test_change_log_compaction, fixture_tear_down);
+  g_test_add("/change-log/torn", Fixture, nullptr, fixture_set_up,
+             test_change_log_torn, fixture_tear_down);
+  g_test_add("/change-log/names", Fixture, nullptr, fixture_set_up,
+             test_change_log_names, fixture_tear_down);
+  return g_test_run();
+}
@@ -0,0 +1,88 @@
+// XXH3-64 against the reference implementation, for every length class of
+// the algorithm. Inputs longer than 240 bytes take the SSE2 path on x86.
+
+#include <glib.h>
+#include <string.h>
+
+#include "../biometric_storage_checksum.h"
+
+// XXH3_64bits() of the first `length` bytes of fill_sanity_buffer(), from
+// xxHash 0.8.
+static const struct {
+  gsize length;
+  guint64 hash;
+} kVectors[] = {
+    {0, 0x2D06800538D394C2ULL},    {1, 0xC44BDFF4074EECDBULL},
+    {3, 0x54247382A8D6B94DULL},    {4, 0xE5DC74BC51848A51ULL},
+    {8, 0x24CCC9ACAA9F65E4ULL},    {9, 0x14D5001C15DD3F2BULL},
+    {16, 0x981B17D36C7498C9ULL},   {17, 0x796F5ACD3A60F862ULL},
+    {128, 0xFCFF24126754D861ULL},  {129, 0x98F1B0A679A2CA29ULL},
+    {240, 0x81C3C2B67F568CCFULL},  {241, 0xC5A639ECD2030E5EULL},
+    {1024, 0xDD85C9B5C1109C5CULL}, {1025, 0xD870C0FA13211C6AULL},
+    {4159, 0x4414D090B4A6043FULL}, {8192, 0xD63690A28889A350ULL},
+};
+
+static const gsize kBufferSize = 8192;
+
+// The pseudo random input of xxHash's own sanity check.
+static void fill_sanity_buffer(guint8 *buffer, gsize length) {
+  guint64 generator = 2654435761U;
+  for (gsize i = 0; i < length; i++) {
+    buffer[i] = generator >> 56;
+    generator *= 11400714785074694797ULL;
+  }
+}
+
+static void test_checksum_vectors() {
+  g_autofree guint8 *buffer = static_cast<guint8 *>(g_malloc(kBufferSize));
+  fill_sanity_buffer(buffer, kBufferSize);
+  for (gsize i = 0; i < G_N_ELEMENTS(kVectors); i++) {
+    g_test_message("length %" G_GSIZE_FORMAT, kVectors[i].length);
+    g_assert_cmphex(biometric_checksum(buffer, kVectors[i].length), ==,
+                    kVectors[i].hash);
+  }
+}
+
+// The stripes are loaded unaligned, the address must not matter.
+static void test_checksum_unaligned() {
+  g_autofree guint8 *buffer =
+      static_cast<guint8 *>(g_malloc(kBufferSize + 1));
+  for (gsize i = 0; i < G_N_ELEMENTS(kVectors); i++) {
+    fill_sanity_buffer(buffer + 1, kVectors[i].length);
+    g_test_message("length %" G_GSIZE_FORMAT, kVectors[i].length);
+    g_assert_cmphex(biometric_checksum(buffer + 1, kVectors[i].length), ==,
+                    kVectors[i].hash);
+  }
+}
+
+static void test_checksum_encode() {
+  g_autofree gchar *empty = biometric_checksum_encode("", 0);
+  g_assert_cmpstr(empty, ==, "2d06800538d394c2");
+  guint8 byte;
+  fill_sanity_buffer(&byte, 1);
+  g_autofree gchar *one = biometric_checksum_encode(&byte, 1);
+  g_assert_cmpstr(one, ==, "c44bdff4074eecdb");
+}
+
+// A flipped bit anywhere in a long input changes the checksum.
+static void test_checksum_detects_corruption() {
+  g_autofree guint8 *buffer = static_cast<guint8 *>(g_malloc(kBufferSize));
+  fill_sanity_buffer(buffer, kBufferSize);
+  guint64 intact = biometric_checksum(buffer, kBufferSize);
+  for (gsize offset = 0; offset < kBufferSize; offset += 509) {
+    buffer[offset] ^= 0x10;
+    g_assert_cmphex(biometric_checksum(buffer, kBufferSize), !=, intact);
+    buffer[offset] ^= 0x10;
+  }
+  g_assert_cmphex(biometric_checksum(buffer, kBufferSize - 1), !=, intact);
+}
+
+int main(int argc, char **argv) {
+  g_test_init(&argc, &argv, nullptr);
+  g_test_add_func("/checksum/vectors", test_checksum_vectors);
+  g_test_add_func("/checksum/unaligned", test_checksum_unaligned);
+  g_test_add_func("/checksum/encode", test_checksum_encode);
+  g_test_add_func("/checksum/detects-corruption",
+                  test_checksum_detects_corruption);
+  return g_test_run();
+}
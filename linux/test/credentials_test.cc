@@ -0,0 +1,152 @@
+// The credentials backend: credentials are read from the credentials
+// directory, writes and deletes go to the overlay, which hides the
+// credentials below it.
+
+#include <flutter_linux/flutter_linux.h>
+
+#include "test_util.h"
+
+typedef struct {
+  gchar *dir;
+  BiometricStoragePlugin *plugin;
+} Fixture;
+
+// `user_data` is non-null for a plugin without the overlay key.
+static void fixture_set_up(Fixture *fixture, gconstpointer user_data) {
+  fixture->dir = test_tmp_dir_new();
+  fixture->plugin = test_plugin_new(fixture->dir, user_data == nullptr);
+}
+
+static void fixture_tear_down(Fixture *fixture, gconstpointer user_data) {
+  g_object_unref(fixture->plugin);
+  test_remove_tree(fixture->dir);
+  g_free(fixture->dir);
+}
+
+// Passes `name` as a credential.
+static void provide(Fixture *fixture, const gchar *name,
+                    const gchar *content) {
+  g_autofree gchar *file_name = g_strconcat(BIOMETRIC_NAME_PREFIX ".", name,
+                                            NULL);
+  g_autofree gchar *path =
+      g_build_filename(fixture->dir, "credentials", file_name, NULL);
+  g_autoptr(GError) error = nullptr;
+  g_file_set_contents(path, content, -1, &error);
+  g_assert_no_error(error);
+}
+
+static FlMethodResponse *call(Fixture *fixture, const gchar *method,
+                              const gchar *name,
+                              const gchar *content = nullptr) {
+  g_autoptr(FlValue) args = fl_value_new_map();
+  fl_value_set_string_take(args, "name", fl_value_new_string(name));
+  if (content != nullptr) {
+    fl_value_set_string_take(args, "content", fl_value_new_string(content));
+  }
+  return test_plugin_call(fixture->plugin, method, args);
+}
+
+static void assert_read(Fixture *fixture, const gchar *name,
+                        const gchar *expected) {
+  g_autoptr(FlMethodResponse) response = call(fixture, "read", name);
+  FlValue *value = test_response_result(response);
+  if (expected == nullptr) {
+    g_assert_cmpint(fl_value_get_type(value), ==, FL_VALUE_TYPE_NULL);
+  } else {
+    g_assert_cmpstr(fl_value_get_string(value), ==, expected);
+  }
+}
+
+static gint64 credentials_stat(Fixture *fixture, const gchar *key) {
+  g_autoptr(FlValue) args = fl_value_new_null();
+  g_autoptr(FlMethodResponse) response =
+      test_plugin_call(fixture->plugin, "stats", args);
+  FlValue *credentials =
+      fl_value_lookup_string(test_response_result(response), "credentials");
+  return fl_value_get_int(fl_value_lookup_string(credentials, key));
+}
+
+static void test_reads_credential(Fixture *fixture, gconstpointer user_data) {
+  provide(fixture, "token", "from systemd");
+  assert_read(fixture, "token", "from systemd");
+  assert_read(fixture, "missing", nullptr);
+  g_assert_cmpint(credentials_stat(fixture, "credentialReads"), ==, 1);
+  g_assert_cmpint(credentials_stat(fixture, "misses"), ==, 1);
+}
+
+// A write hides the credential, deleting it again reveals nothing.
+static void test_write_overrides(Fixture *fixture, gconstpointer user_data) {
+  provide(fixture, "token", "from systemd");
+  g_autoptr(FlMethodResponse) write = call(fixture, "write", "token", "new");
+  test_response_result(write);
+  assert_read(fixture, "token", "new");
+  g_assert_cmpint(credentials_stat(fixture, "overlayReads"), ==, 1);
+
+  g_autoptr(FlMethodResponse) remove = call(fixture, "delete", "token");
+  g_assert_true(fl_value_get_bool(test_response_result(remove)));
+  assert_read(fixture, "token", nullptr);
+}
+
+// Deleting a credential records a whiteout, the credential file stays.
+static void test_delete_records_whiteout(Fixture *fixture,
+                                         gconstpointer user_data) {
+  provide(fixture, "token", "from systemd");
+  g_autoptr(FlMethodResponse) remove = call(fixture, "delete", "token");
+  g_assert_true(fl_value_get_bool(test_response_result(remove)));
+  assert_read(fixture, "token", nullptr);
+  g_assert_cmpint(credentials_stat(fixture, "whiteouts"), ==, 1);
+
+  // A second delete finds nothing.
+  g_autoptr(FlMethodResponse) again = call(fixture, "delete", "token");
+  g_assert_false(fl_value_get_bool(test_response_result(again)));
+  g_assert_cmpint(credentials_stat(fixture, "whiteouts"), ==, 1);
+}
+
+// The overlay outlives the plugin, with the same overlay key.
+static void test_overlay_persists(Fixture *fixture, gconstpointer user_data) {
+  provide(fixture, "deleted", "from systemd");
+  g_autoptr(FlMethodResponse) write = call(fixture, "write", "token", "new");
+  test_response_result(write);
+  g_autoptr(FlMethodResponse) remove = call(fixture, "delete", "deleted");
+  test_response_result(remove);
+
+  g_object_unref(fixture->plugin);
+  fixture->plugin = test_plugin_new(fixture->dir, FALSE);
+  assert_read(fixture, "token", "new");
+  assert_read(fixture, "deleted", nullptr);
+}
+
+// Without the overlay key credentials can be read, but not changed.
+static void test_read_only(Fixture *fixture, gconstpointer user_data) {
+  provide(fixture, "token", "from systemd");
+  assert_read(fixture, "token", "from systemd");
+  g_assert_cmpint(credentials_stat(fixture, "credentialReads"), ==, 1);
+
+  g_test_expect_message(nullptr, G_LOG_LEVEL_WARNING,
+                        "Failed to store secret*");
+  g_autoptr(FlMethodResponse) write = call(fixture, "write", "token", "new");
+  g_test_assert_expected_messages();
+  g_assert_true(FL_IS_METHOD_ERROR_RESPONSE(write));
+
+  g_test_expect_message(nullptr, G_LOG_LEVEL_WARNING,
+                        "Failed to delete secret*");
+  g_autoptr(FlMethodResponse) remove = call(fixture, "delete", "token");
+  g_test_assert_expected_messages();
+  g_assert_true(FL_IS_METHOD_ERROR_RESPONSE(remove));
+  assert_read(fixture, "token", "from systemd");
+}
+
+int main(int argc, char **argv) {
+  g_test_init(&argc, &argv, G_TEST_OPTION_ISOLATE_DIRS, nullptr);
+  g_test_add("/credentials/reads-credential", Fixture, nullptr,
+             fixture_set_up, test_reads_credential, fixture_tear_down);
+  g_test_add("/credentials/write-overrides", Fixture, nullptr,
+             fixture_set_up, test_write_overrides, fixture_tear_down);
+  g_test_add("/credentials/delete-records-whiteout", Fixture, nullptr,
+             fixture_set_up, test_delete_records_whiteout, fixture_tear_down);
+  g_test_add("/credentials/overlay-persists", Fixture, nullptr,
+             fixture_set_up, test_overlay_persists, fixture_tear_down);
+  g_test_add("/credentials/read-only", Fixture, "read-only", fixture_set_up,
+             test_read_only, fixture_tear_down);
+  return g_test_run();
+}
@@ -0,0 +1,151 @@
+// ChaCha20-Poly1305 against the AEAD test vector of RFC 8439 and the key
+// derivation against RFC 5869.
+
+#include <glib.h>
+#include <string.h>
+
+#include <vector>
+
+#include "../biometric_storage_crypto.h"
+
+static std::vector<guint8> from_hex(const gchar *hex) {
+  std::vector<guint8> bytes;
+  for (const gchar *p = hex; p[0] != '\0' && p[1] != '\0'; p += 2) {
+    bytes.push_back(g_ascii_xdigit_value(p[0]) << 4 |
+                    g_ascii_xdigit_value(p[1]));
+  }
+  return bytes;
+}
+
+// RFC 8439, section 2.8.2.
+static const gchar kAeadPlaintext[] =
+    "Ladies and Gentlemen of the class of '99: If I could offer you only one "
+    "tip for the future, sunscreen would be it.";
+static const gchar kAeadAd[] = "50515253c0c1c2c3c4c5c6c7";
+static const gchar kAeadKey[] =
+    "808182838485868788898a8b8c8d8e8f909192939495969798999a9b9c9d9e9f";
+static const gchar kAeadNonce[] = "070000004041424344454647";
+static const gchar kAeadCiphertext[] =
+    "d31a8d34648e60db7b86afbc53ef7ec2a4aded51296e08fea9e2b5a736ee62d6"
+    "3dbea45e8ca9671282fafb69da92728b1a71de0a9e060b2905d6a5b67ecd3b36"
+    "92ddbd7f2d778b8c9803aee328091b58fab324e4fad675945585808b4831d7bc"
+    "3ff4def08e4b7a9de576d26586cec64b6116"
+    "1ae10b594f09e26a7e902ecbd0600691";
+
+static void test_aead_seal_rfc8439() {
+  std::vector<guint8> key = from_hex(kAeadKey);
+  std::vector<guint8> nonce = from_hex(kAeadNonce);
+  std::vector<guint8> ad = from_hex(kAeadAd);
+  std::vector<guint8> expected = from_hex(kAeadCiphertext);
+  gsize length = strlen(kAeadPlaintext);
+  g_assert_cmpuint(expected.size(), ==, length + BIOMETRIC_AEAD_TAG_SIZE);
+
+  std::vector<guint8> sealed(length + BIOMETRIC_AEAD_TAG_SIZE);
+  g_assert_true(biometric_aead_seal(key.data(), nonce.data(), ad.data(),
+                                    ad.size(), (const guint8 *)kAeadPlaintext,
+                                    length, sealed.data(), nullptr));
+  g_assert_cmpmem(sealed.data(), sealed.size(), expected.data(),
+                  expected.size());
+}
+
+static void test_aead_open_rfc8439() {
+  std::vector<guint8> key = from_hex(kAeadKey);
+  std::vector<guint8> nonce = from_hex(kAeadNonce);
+  std::vector<guint8> ad = from_hex(kAeadAd);
+  std::vector<guint8> sealed = from_hex(kAeadCiphertext);
+
+  std::vector<guint8> opened(sealed.size() - BIOMETRIC_AEAD_TAG_SIZE);
+  g_assert_true(biometric_aead_open(key.data(), nonce.data(), ad.data(),
+                                    ad.size(), sealed.data(), sealed.size(),
+                                    opened.data()));
+  g_assert_cmpmem(opened.data(), opened.size(), kAeadPlaintext,
+                  strlen(kAeadPlaintext));
+}
+
+// Any modified byte of the ciphertext, the tag or the associated data fails
+// authentication and leaves nothing decrypted behind.
+static void test_aead_open_rejects_modified() {
+  std::vector<guint8> key = from_hex(kAeadKey);
+  std::vector<guint8> nonce = from_hex(kAeadNonce);
+  std::vector<guint8> ad = from_hex(kAeadAd);
+  std::vector<guint8> sealed = from_hex(kAeadCiphertext);
+  std::vector<guint8> opened(sealed.size() - BIOMETRIC_AEAD_TAG_SIZE);
+  std::vector<guint8> zeros(opened.size());
+
+  for (gsize i = 0; i < sealed.size(); i++) {
+    sealed[i] ^= 0x01;
+    memset(opened.data(), 0xaa, opened.size());
+    g_assert_false(biometric_aead_open(key.data(), nonce.data(), ad.data(),
+                                       ad.size(), sealed.data(),
+                                       sealed.size(), opened.data()));
+    g_assert_cmpmem(opened.data(), opened.size(), zeros.data(),
+                    zeros.size());
+    sealed[i] ^= 0x01;
+  }
+  ad[0] ^= 0x01;
+  g_assert_false(biometric_aead_open(key.data(), nonce.data(), ad.data(),
+                                     ad.size(), sealed.data(), sealed.size(),
+                                     opened.data()));
+}
+
+static void test_aead_empty_plaintext() {
+  guint8 key[BIOMETRIC_AEAD_KEY_SIZE] = {1};
+  guint8 nonce[BIOMETRIC_AEAD_NONCE_SIZE] = {2};
+  guint8 empty[1] = {};
+  guint8 sealed[BIOMETRIC_AEAD_TAG_SIZE];
+  g_assert_true(
+      biometric_aead_seal(key, nonce, empty, 0, empty, 0, sealed, nullptr));
+  g_assert_true(biometric_aead_open(key, nonce, empty, 0, sealed,
+                                    sizeof(sealed), empty));
+  nonce[0] ^= 0x01;
+  g_assert_false(biometric_aead_open(key, nonce, empty, 0, sealed,
+                                     sizeof(sealed), empty));
+}
+
+// RFC 5869, test case 3: SHA-256 without salt and info. The key is the
+// first 32 bytes of the 42 byte OKM.
+static void test_key_derive_rfc5869() {
+  std::vector<guint8> ikm(22, 0x0b);
+  std::vector<guint8> expected = from_hex(
+      "8da4e775a563c18f715f802a063c5a31b8a11f5c5ee1879ec3454e5f3c738d2d");
+  guint8 key[BIOMETRIC_AEAD_KEY_SIZE];
+  biometric_key_derive(ikm.data(), ikm.size(), "", key);
+  g_assert_cmpmem(key, sizeof(key), expected.data(), expected.size());
+}
+
+static void test_key_derive_info() {
+  guint8 secret[64];
+  memset(secret, 0x5c, sizeof(secret));
+  guint8 a[BIOMETRIC_AEAD_KEY_SIZE], b[BIOMETRIC_AEAD_KEY_SIZE],
+      again[BIOMETRIC_AEAD_KEY_SIZE];
+  biometric_key_derive(secret, sizeof(secret), "biometric_storage a", a);
+  biometric_key_derive(secret, sizeof(secret), "biometric_storage b", b);
+  biometric_key_derive(secret, sizeof(secret), "biometric_storage a", again);
+  g_assert_cmpmem(a, sizeof(a), again, sizeof(again));
+  g_assert_true(memcmp(a, b, sizeof(a)) != 0);
+}
+
+static void test_key_encoding() {
+  g_autoptr(GError) error = nullptr;
+  gchar *encoded = biometric_key_new_encoded(&error);
+  g_assert_no_error(error);
+  g_assert_nonnull(encoded);
+  guint8 key[BIOMETRIC_AEAD_KEY_SIZE];
+  g_assert_true(biometric_key_decode(encoded, key));
+  biometric_secret_free(encoded);
+  g_assert_false(biometric_key_decode("not a key", key));
+  g_assert_false(biometric_key_decode("", key));
+}
+
+int main(int argc, char **argv) {
+  g_test_init(&argc, &argv, nullptr);
+  g_test_add_func("/crypto/aead/seal-rfc8439", test_aead_seal_rfc8439);
+  g_test_add_func("/crypto/aead/open-rfc8439", test_aead_open_rfc8439);
+  g_test_add_func("/crypto/aead/open-rejects-modified",
+                  test_aead_open_rejects_modified);
+  g_test_add_func("/crypto/aead/empty-plaintext", test_aead_empty_plaintext);
+  g_test_add_func("/crypto/key/derive-rfc5869", test_key_derive_rfc5869);
+  g_test_add_func("/crypto/key/derive-info", test_key_derive_info);
+  g_test_add_func("/crypto/key/encoding", test_key_encoding);
+  return g_test_run();
+}
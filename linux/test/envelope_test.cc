@@ -0,0 +1,192 @@
+// Header of the secrets stored with the current schema, and the ordering of
+// generations which decides which variant a purge may delete.
+
+#include <glib.h>
+#include <string.h>
+
+#include <string>
+#include <vector>
+
+#include "../biometric_storage_crypto.h"
+#include "../biometric_storage_envelope.h"
+
+static void test_envelope_round_trip() {
+  guint64 clock = 0;
+  g_autofree gchar *generation = biometric_generation_new(&clock);
+  g_assert_cmpuint(strlen(generation), ==, BIOMETRIC_GENERATION_LENGTH);
+  const gchar content[] = "{\"secret\": true}";
+  gchar *envelope =
+      biometric_envelope_new(generation, content, strlen(content));
+  gsize length = strlen(envelope);
+  g_assert_cmpuint(length, ==,
+                   BIOMETRIC_ENVELOPE_HEADER_SIZE + strlen(content));
+  g_assert_cmpstr(envelope + BIOMETRIC_ENVELOPE_HEADER_SIZE, ==, content);
+
+  gchar opened[BIOMETRIC_GENERATION_LENGTH + 1];
+  g_assert_true(biometric_envelope_open(envelope, length, TRUE, opened));
+  g_assert_cmpstr(opened, ==, generation);
+  biometric_secret_free(envelope);
+
+  envelope = biometric_envelope_new(generation, "", 0);
+  g_assert_true(biometric_envelope_open(envelope, strlen(envelope), TRUE,
+                                        opened));
+  biometric_secret_free(envelope);
+}
+
+static void test_envelope_rejects_corrupted() {
+  guint64 clock = 0;
+  g_autofree gchar *generation = biometric_generation_new(&clock);
+  const gchar content[] = "correct horse battery staple";
+  gchar *envelope =
+      biometric_envelope_new(generation, content, strlen(content));
+  gsize length = strlen(envelope);
+  gchar opened[BIOMETRIC_GENERATION_LENGTH + 1];
+
+  // Truncated content only passes without verification.
+  g_assert_false(biometric_envelope_open(envelope, length - 1, TRUE, opened));
+  g_assert_true(biometric_envelope_open(envelope, length - 1, FALSE, opened));
+  envelope[length - 1] ^= 0x01;
+  g_assert_false(biometric_envelope_open(envelope, length, TRUE, opened));
+  envelope[length - 1] ^= 0x01;
+
+  // A damaged header fails even without verification.
+  for (gsize offset : {gsize(0), gsize(4), gsize(20), gsize(29), gsize(46)}) {
+    gchar saved = envelope[offset];
+    envelope[offset] = 'x';
+    g_assert_false(biometric_envelope_open(envelope, length, FALSE, opened));
+    envelope[offset] = saved;
+  }
+  g_assert_false(biometric_envelope_open(
+      envelope, BIOMETRIC_ENVELOPE_HEADER_SIZE - 1, FALSE, opened));
+  g_assert_false(
+      biometric_envelope_open(content, strlen(content), FALSE, opened));
+  biometric_secret_free(envelope);
+}
+
+// Generations keep increasing when the wall clock is behind a generation
+// seen before, e.g. after it stepped back.
+static void test_generation_clock() {
+  guint64 clock = 0;
+  g_autofree gchar *first = biometric_generation_new(&clock);
+  g_autofree gchar *second = biometric_generation_new(&clock);
+  g_assert_cmpint(g_strcmp0(first, second), <, 0);
+
+  const gchar future[] = "7fffffff00000000.00000000";
+  biometric_generation_observe(&clock, future);
+  g_autofree gchar *third = biometric_generation_new(&clock);
+  g_assert_cmpint(g_strcmp0(future, third), <, 0);
+
+  // Anything but a generation is ignored.
+  guint64 before = clock;
+  biometric_generation_observe(&clock, "ffffffffffffffff");
+  biometric_generation_observe(&clock, nullptr);
+  g_assert_cmpuint(clock, ==, before);
+
+  g_assert_cmpint(g_strcmp0(BIOMETRIC_GENERATION_NONE, first), <, 0);
+}
+
+// A keyring item of one storage, see purge_stale_variants().
+struct Variant {
+  std::string tags;
+  std::string generation;
+};
+
+// Stores a variant with `tags` and `generation`, replacing one with the
+// same tags like the Secret Service does.
+static void store(std::vector<Variant> *keyring, const std::string &tags,
+                  const std::string &generation) {
+  for (Variant &variant : *keyring) {
+    if (variant.tags == tags) {
+      variant.generation = generation;
+      return;
+    }
+  }
+  keyring->push_back({tags, generation});
+}
+
+static void purge(std::vector<Variant> *keyring, const std::string &tags,
+                  const std::string &generation) {
+  std::vector<Variant> kept;
+  for (const Variant &variant : *keyring) {
+    if (variant.tags == tags ||
+        !biometric_generation_supersedes(generation.c_str(),
+                                         variant.generation.c_str())) {
+      kept.push_back(variant);
+    }
+  }
+  *keyring = kept;
+}
+
+// Returns the generation a read picks, see find_secret().
+static std::string newest(const std::vector<Variant> &keyring) {
+  std::string generation;
+  for (const Variant &variant : keyring) {
+    if (generation.empty() ||
+        biometric_generation_supersedes(variant.generation.c_str(),
+                                        generation.c_str())) {
+      generation = variant.generation;
+    }
+  }
+  return generation;
+}
+
+// Two instances write the same storage with different tags at the same
+// time, in every interleaving of their store and purge. Neither deletes
+// the item of the other if that is newer, so reads always see the newer
+// write. An older item stored after the newer purge stays until the next
+// write.
+static void test_racing_writes() {
+  guint64 clock_a = 0;
+  guint64 clock_b = 0;
+  g_autofree gchar *a = biometric_generation_new(&clock_a);
+  g_autofree gchar *b = biometric_generation_new(&clock_b);
+  g_assert_cmpstr(a, !=, b);
+  const gchar *newer = g_strcmp0(a, b) > 0 ? a : b;
+
+  // Steps: 0 = A stores, 1 = A purges, 2 = B stores, 3 = B purges.
+  const int orders[][4] = {
+      {0, 1, 2, 3}, {0, 2, 1, 3}, {0, 2, 3, 1},
+      {2, 0, 1, 3}, {2, 0, 3, 1}, {2, 3, 0, 1},
+  };
+  for (const auto &order : orders) {
+    std::vector<Variant> keyring = {{"", BIOMETRIC_GENERATION_NONE}};
+    for (int step : order) {
+      switch (step) {
+        case 0:
+          store(&keyring, "kind=a", a);
+          break;
+        case 1:
+          purge(&keyring, "kind=a", a);
+          break;
+        case 2:
+          store(&keyring, "kind=b", b);
+          break;
+        case 3:
+          purge(&keyring, "kind=b", b);
+          break;
+      }
+      g_assert_false(keyring.empty());
+    }
+    g_assert_cmpuint(keyring.size(), <=, 2);
+    std::string read = newest(keyring);
+    g_assert_cmpstr(read.c_str(), ==, newer);
+
+    // The next write of A, which has seen the newest item, leaves one.
+    biometric_generation_observe(&clock_a, read.c_str());
+    g_autofree gchar *next = biometric_generation_new(&clock_a);
+    store(&keyring, "kind=a", next);
+    purge(&keyring, "kind=a", next);
+    g_assert_cmpuint(keyring.size(), ==, 1);
+    g_assert_cmpstr(keyring[0].generation.c_str(), ==, next);
+  }
+}
+
+int main(int argc, char **argv) {
+  g_test_init(&argc, &argv, nullptr);
+  g_test_add_func("/envelope/round-trip", test_envelope_round_trip);
+  g_test_add_func("/envelope/rejects-corrupted",
+                  test_envelope_rejects_corrupted);
+  g_test_add_func("/envelope/generation-clock", test_generation_clock);
+  g_test_add_func("/envelope/racing-writes", test_racing_writes);
+  return g_test_run();
+}
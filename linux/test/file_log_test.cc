@@ -0,0 +1,235 @@
+// Group commit and crash recovery of the FileLog, once committing through
+// io_uring (where the kernel allows it) and once on the thread pool.
+
+#include <fcntl.h>
+#include <flutter_linux/flutter_linux.h>
+#include <string.h>
+#include <unistd.h>
+
+#include <string>
+#include <vector>
+
+#include "../biometric_storage_file_log.h"
+#include "test_util.h"
+
+typedef struct {
+  gchar *dir;
+  gchar *path;
+  ThreadPool *pool;
+} Fixture;
+
+static const FileLog::Mode kIoUring = FileLog::Mode::kIoUring;
+static const FileLog::Mode kThread = FileLog::Mode::kThread;
+
+static void fixture_set_up(Fixture *fixture, gconstpointer user_data) {
+  fixture->dir = test_tmp_dir_new();
+  fixture->path = g_build_filename(fixture->dir, "log", "test.log", NULL);
+  fixture->pool = new ThreadPool(2, 64);
+}
+
+static void fixture_tear_down(Fixture *fixture, gconstpointer user_data) {
+  delete fixture->pool;
+  test_remove_tree(fixture->dir);
+  g_free(fixture->path);
+  g_free(fixture->dir);
+}
+
+static FileLog::Mode mode(gconstpointer user_data) {
+  return *static_cast<const FileLog::Mode *>(user_data);
+}
+
+static std::vector<guint8> record_new(const std::string &text) {
+  return std::vector<guint8>(text.begin(), text.end());
+}
+
+// Opens the log at `path`, returns its records.
+static std::vector<std::string> replay(FileLog *log, const gchar *path) {
+  std::vector<std::string> records;
+  g_autoptr(GError) error = nullptr;
+  g_assert_true(log->open(
+      path,
+      [&records](const guint8 *data, gsize length) {
+        records.emplace_back((const gchar *)data, length);
+      },
+      &error));
+  g_assert_no_error(error);
+  return records;
+}
+
+static Task<> append_all(FileLog *log, std::vector<std::string> records) {
+  for (const std::string &record : records) {
+    bool appended = co_await log->append(record_new(record));
+    g_assert_true(appended);
+  }
+}
+
+static Task<> append_one(FileLog *log, std::string record, gint *pending) {
+  bool appended = co_await log->append(record_new(record));
+  g_assert_true(appended);
+  (*pending)--;
+}
+
+// Appends `count` records at once, like concurrent writes of the plugin.
+static void append_concurrently(FileLog *log, gint count) {
+  gint pending = count;
+  for (gint i = 0; i < count; i++) {
+    task_detach(append_one(log, "record " + std::to_string(i), &pending));
+  }
+  while (pending > 0) {
+    g_main_context_iteration(nullptr, TRUE);
+  }
+}
+
+static gint64 stat_int(FileLog *log, const gchar *key) {
+  g_autoptr(FlValue) stats = log->stats();
+  return fl_value_get_int(fl_value_lookup_string(stats, key));
+}
+
+static void append_bytes(const gchar *path, const void *data, gsize length) {
+  int fd = open(path, O_WRONLY | O_APPEND);
+  g_assert_cmpint(fd, >=, 0);
+  g_assert_cmpint(write(fd, data, length), ==, (gssize)length);
+  close(fd);
+}
+
+static void test_file_log_replay(Fixture *fixture, gconstpointer data) {
+  {
+    FileLog log(fixture->pool, mode(data), 0);
+    g_assert_cmpuint(replay(&log, fixture->path).size(), ==, 0);
+    test_run_task(append_all(&log, {"first", "", "third"}));
+    g_assert_cmpuint(log.size(), ==, 3 * 8 + 10);
+  }
+  FileLog log(fixture->pool, mode(data), 0);
+  std::vector<std::string> records = replay(&log, fixture->path);
+  g_assert_cmpuint(records.size(), ==, 3);
+  g_assert_cmpstr(records[0].c_str(), ==, "first");
+  g_assert_cmpstr(records[1].c_str(), ==, "");
+  g_assert_cmpstr(records[2].c_str(), ==, "third");
+}
+
+// Records appended while a commit is in flight share the next one.
+static void test_file_log_group_commit(Fixture *fixture, gconstpointer data) {
+  FileLog log(fixture->pool, mode(data), 0);
+  replay(&log, fixture->path);
+  append_concurrently(&log, 32);
+  g_assert_cmpint(stat_int(&log, "records"), ==, 32);
+  g_assert_cmpint(stat_int(&log, "commits"), <, 32);
+  g_assert_cmpint(stat_int(&log, "failedCommits"), ==, 0);
+
+  FileLog reopened(fixture->pool, mode(data), 0);
+  std::vector<std::string> records = replay(&reopened, fixture->path);
+  g_assert_cmpuint(records.size(), ==, 32);
+  for (gsize i = 0; i < records.size(); i++) {
+    g_assert_cmpstr(records[i].c_str(), ==,
+                    ("record " + std::to_string(i)).c_str());
+  }
+}
+
+static void test_file_log_max_batch(Fixture *fixture, gconstpointer data) {
+  FileLog log(fixture->pool, mode(data), 4);
+  replay(&log, fixture->path);
+  append_concurrently(&log, 10);
+  g_assert_cmpint(stat_int(&log, "records"), ==, 10);
+  g_assert_cmpint(stat_int(&log, "commits"), >=, 3);
+  g_assert_cmpint(stat_int(&log, "recordsPerCommitMax"), <=, 4);
+}
+
+// A record torn by a crash during its commit is dropped by open(), and the
+// next append overwrites it.
+static void test_file_log_torn_record(Fixture *fixture, gconstpointer data) {
+  {
+    FileLog log(fixture->pool, mode(data), 0);
+    replay(&log, fixture->path);
+    test_run_task(append_all(&log, {"kept", "also kept"}));
+  }
+  // Claims 100 bytes of payload, only 7 made it to the disk.
+  const guint8 torn[] = {100, 0, 0, 0, 1, 2, 3, 4, 'p', 'a', 'r', 't', 'i',
+                         'a', 'l'};
+  append_bytes(fixture->path, torn, sizeof(torn));
+
+  FileLog log(fixture->pool, mode(data), 0);
+  g_test_expect_message(G_LOG_DOMAIN, G_LOG_LEVEL_WARNING,
+                        "Dropping 15 bytes of a torn record in *");
+  std::vector<std::string> records = replay(&log, fixture->path);
+  g_test_assert_expected_messages();
+  g_assert_cmpuint(records.size(), ==, 2);
+  g_assert_cmpstr(records[1].c_str(), ==, "also kept");
+
+  test_run_task(append_all(&log, {"after"}));
+  FileLog reopened(fixture->pool, mode(data), 0);
+  records = replay(&reopened, fixture->path);
+  g_assert_cmpuint(records.size(), ==, 3);
+  g_assert_cmpstr(records[2].c_str(), ==, "after");
+}
+
+// A complete record with a wrong checksum ends the log as well.
+static void test_file_log_corrupt_record(Fixture *fixture,
+                                         gconstpointer data) {
+  {
+    FileLog log(fixture->pool, mode(data), 0);
+    replay(&log, fixture->path);
+    test_run_task(append_all(&log, {"one", "two", "three"}));
+  }
+  g_autofree gchar *contents = nullptr;
+  gsize length;
+  g_assert_true(g_file_get_contents(fixture->path, &contents, &length,
+                                    nullptr));
+  // Payload of "two".
+  contents[8 + 3 + 8] ^= 0x20;
+  g_assert_true(g_file_set_contents(fixture->path, contents, length,
+                                    nullptr));
+
+  FileLog log(fixture->pool, mode(data), 0);
+  g_test_expect_message(G_LOG_DOMAIN, G_LOG_LEVEL_WARNING,
+                        "Dropping 24 bytes of a torn record in *");
+  std::vector<std::string> records = replay(&log, fixture->path);
+  g_test_assert_expected_messages();
+  g_assert_cmpuint(records.size(), ==, 1);
+  g_assert_cmpstr(records[0].c_str(), ==, "one");
+  g_assert_cmpuint(log.size(), ==, 8 + 3);
+}
+
+static void test_file_log_rewrite(Fixture *fixture, gconstpointer data) {
+  FileLog log(fixture->pool, mode(data), 0);
+  replay(&log, fixture->path);
+  test_run_task(append_all(&log, {"a", "b", "c"}));
+  g_autoptr(GError) error = nullptr;
+  g_assert_true(
+      log.rewrite(fixture->path, {record_new("c"), record_new("d")}, &error));
+  g_assert_no_error(error);
+  test_run_task(append_all(&log, {"e"}));
+
+  FileLog reopened(fixture->pool, mode(data), 0);
+  std::vector<std::string> records = replay(&reopened, fixture->path);
+  g_assert_cmpuint(records.size(), ==, 3);
+  g_assert_cmpstr(records[0].c_str(), ==, "c");
+  g_assert_cmpstr(records[1].c_str(), ==, "d");
+  g_assert_cmpstr(records[2].c_str(), ==, "e");
+}
+
+static void add_tests(const gchar *mode_name, const FileLog::Mode *mode) {
+  const struct {
+    const gchar *name;
+    void (*test)(Fixture *, gconstpointer);
+  } tests[] = {
+      {"replay", test_file_log_replay},
+      {"group-commit", test_file_log_group_commit},
+      {"max-batch", test_file_log_max_batch},
+      {"torn-record", test_file_log_torn_record},
+      {"corrupt-record", test_file_log_corrupt_record},
+      {"rewrite", test_file_log_rewrite},
+  };
+  for (const auto &test : tests) {
+    g_autofree gchar *path =
+        g_strdup_printf("/file-log/%s/%s", mode_name, test.name);
+    g_test_add(path, Fixture, mode, fixture_set_up, test.test,
+               fixture_tear_down);
+  }
+}
+
+int main(int argc, char **argv) {
+  g_test_init(&argc, &argv, nullptr);
+  add_tests("io-uring", &kIoUring);
+  add_tests("thread", &kThread);
+  return g_test_run();
+}
@@ -0,0 +1,133 @@
+// Counting, top-k selection and decay of the access counts in `stats`.
+
+#include <flutter_linux/flutter_linux.h>
+#include <string.h>
+
+#include "../biometric_storage_hot_keys.h"
+
+static const gint64 kHalfLifeUs = 60 * G_USEC_PER_SEC;
+
+// Count of `name` in the top list of `stats`, -1 if it is not listed.
+static gint64 top_count(FlValue *stats, const gchar *name) {
+  g_autofree gchar *hash = HotKeys::reported_hash(name);
+  FlValue *top = fl_value_lookup_string(stats, "top");
+  for (gsize i = 0; i < fl_value_get_length(top); i++) {
+    FlValue *entry = fl_value_get_list_value(top, i);
+    if (g_strcmp0(fl_value_get_string(fl_value_lookup_string(entry, "hash")),
+                  hash) == 0) {
+      return fl_value_get_int(fl_value_lookup_string(entry, "count"));
+    }
+  }
+  return -1;
+}
+
+static gint64 total(FlValue *stats) {
+  return fl_value_get_int(fl_value_lookup_string(stats, "total"));
+}
+
+static void record_times(HotKeys *keys, const gchar *name, gint times,
+                         gint64 now_us) {
+  for (gint i = 0; i < times; i++) {
+    keys->record(name, now_us);
+  }
+}
+
+static void test_hot_keys_hash() {
+  // FNV-1a 64.
+  g_assert_cmphex(HotKeys::hash(""), ==, 0xcbf29ce484222325ULL);
+  g_assert_cmphex(HotKeys::hash("a"), ==, 0xaf63dc4c8601ec8cULL);
+}
+
+// Reported hashes are keyed, they match within the process but not the
+// plain FNV-1a hash of the name.
+static void test_hot_keys_reported_hash() {
+  g_autofree gchar *a = HotKeys::reported_hash("a");
+  g_autofree gchar *again = HotKeys::reported_hash("a");
+  g_autofree gchar *b = HotKeys::reported_hash("b");
+  g_autofree gchar *plain =
+      g_strdup_printf("%016" G_GINT64_MODIFIER "x", HotKeys::hash("a"));
+  g_assert_cmpuint(strlen(a), ==, 16);
+  g_assert_cmpstr(a, ==, again);
+  g_assert_cmpstr(a, !=, b);
+  g_assert_cmpstr(a, !=, plain);
+}
+
+static void test_hot_keys_top() {
+  HotKeys keys(1024, 4, 2, kHalfLifeUs);
+  record_times(&keys, "a", 10, 0);
+  record_times(&keys, "b", 3, 0);
+  record_times(&keys, "c", 1, 0);
+  g_autoptr(FlValue) stats = keys.stats(0);
+  g_assert_cmpint(total(stats), ==, 14);
+  FlValue *top = fl_value_lookup_string(stats, "top");
+  g_assert_cmpuint(fl_value_get_length(top), ==, 2);
+  // Heaviest first.
+  g_assert_cmpint(top_count(stats, "a"), ==, 10);
+  g_assert_cmpint(
+      fl_value_get_int(fl_value_lookup_string(
+          fl_value_get_list_value(top, 0), "count")),
+      ==, 10);
+  g_assert_cmpint(top_count(stats, "b"), ==, 3);
+  g_assert_cmpint(top_count(stats, "c"), ==, -1);
+}
+
+// A name counted more often than the smallest top entry replaces it.
+static void test_hot_keys_displacement() {
+  HotKeys keys(1024, 4, 1, kHalfLifeUs);
+  record_times(&keys, "a", 2, 0);
+  record_times(&keys, "b", 2, 0);
+  g_autoptr(FlValue) before = keys.stats(0);
+  g_assert_cmpint(top_count(before, "a"), ==, 2);
+  g_assert_cmpint(top_count(before, "b"), ==, -1);
+  keys.record("b", 0);
+  g_autoptr(FlValue) after = keys.stats(0);
+  g_assert_cmpint(top_count(after, "a"), ==, -1);
+  g_assert_cmpint(top_count(after, "b"), ==, 3);
+}
+
+// Every full half-life halves all counts, partial ones do nothing yet.
+static void test_hot_keys_decay() {
+  HotKeys keys(1024, 4, 4, kHalfLifeUs);
+  record_times(&keys, "a", 40, 0);
+  record_times(&keys, "b", 3, 0);
+
+  g_autoptr(FlValue) early = keys.stats(kHalfLifeUs - 1);
+  g_assert_cmpint(top_count(early, "a"), ==, 40);
+  g_autoptr(FlValue) one = keys.stats(kHalfLifeUs);
+  g_assert_cmpint(total(one), ==, 21);
+  g_assert_cmpint(top_count(one, "a"), ==, 20);
+  g_assert_cmpint(top_count(one, "b"), ==, 1);
+  // Two more at once, "b" decays to nothing and leaves the top list.
+  g_autoptr(FlValue) three = keys.stats(3 * kHalfLifeUs + kHalfLifeUs / 2);
+  g_assert_cmpint(top_count(three, "a"), ==, 5);
+  g_assert_cmpint(top_count(three, "b"), ==, -1);
+
+  // Counting continues from the decayed estimate.
+  keys.record("a", 3 * kHalfLifeUs + kHalfLifeUs / 2);
+  g_autoptr(FlValue) counted = keys.stats(4 * kHalfLifeUs - 1);
+  g_assert_cmpint(top_count(counted, "a"), ==, 6);
+}
+
+static void test_hot_keys_decay_to_zero() {
+  HotKeys keys(1024, 4, 4, kHalfLifeUs);
+  record_times(&keys, "a", 1000, 0);
+  g_autoptr(FlValue) stats = keys.stats(100 * kHalfLifeUs);
+  g_assert_cmpint(total(stats), ==, 0);
+  g_assert_cmpuint(fl_value_get_length(fl_value_lookup_string(stats, "top")),
+                   ==, 0);
+  keys.record("b", 100 * kHalfLifeUs);
+  g_autoptr(FlValue) fresh = keys.stats(100 * kHalfLifeUs);
+  g_assert_cmpint(top_count(fresh, "a"), ==, -1);
+  g_assert_cmpint(top_count(fresh, "b"), ==, 1);
+}
+
+int main(int argc, char **argv) {
+  g_test_init(&argc, &argv, nullptr);
+  g_test_add_func("/hot-keys/hash", test_hot_keys_hash);
+  g_test_add_func("/hot-keys/reported-hash", test_hot_keys_reported_hash);
+  g_test_add_func("/hot-keys/top", test_hot_keys_top);
+  g_test_add_func("/hot-keys/displacement", test_hot_keys_displacement);
+  g_test_add_func("/hot-keys/decay", test_hot_keys_decay);
+  g_test_add_func("/hot-keys/decay-to-zero", test_hot_keys_decay_to_zero);
+  return g_test_run();
+}
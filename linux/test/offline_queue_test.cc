@@ -0,0 +1,162 @@
+// Order in which queued keyring operations are replayed, coalescing and the
+// bounds of the offline queue.
+
+#include <flutter_linux/flutter_linux.h>
+
+#include <string>
+#include <vector>
+
+#include "../biometric_storage_offline_queue.h"
+
+static GHashTable *attributes_new(const gchar *name) {
+  GHashTable *attributes = g_hash_table_new(g_str_hash, g_str_equal);
+  g_hash_table_insert(attributes, (gpointer) "name", (gpointer)name);
+  return attributes;
+}
+
+// Replays the whole queue, returns "<name>=<content>" (or "<name> deleted")
+// in replay order.
+static std::vector<std::string> replay_all(OfflineQueue *queue) {
+  std::vector<std::string> replayed;
+  std::string name;
+  RefPtr<GHashTable> attributes;
+  SecretPtr content;
+  guint64 id;
+  while (queue->front(&name, &attributes, &content, &id)) {
+    replayed.push_back(content != nullptr ? name + "=" + content.get()
+                                          : name + " deleted");
+    queue->complete(id, true);
+  }
+  g_assert_true(queue->empty());
+  return replayed;
+}
+
+static gint64 stat_int(OfflineQueue *queue, const gchar *key) {
+  g_autoptr(FlValue) stats = queue->stats();
+  return fl_value_get_int(fl_value_lookup_string(stats, key));
+}
+
+static void test_offline_queue_fifo() {
+  OfflineQueue queue(16, 4096);
+  g_assert_true(queue.push("a", nullptr, "1"));
+  g_assert_true(queue.push("b", nullptr, nullptr));
+  g_assert_true(queue.push("c", nullptr, "3"));
+  std::vector<std::string> replayed = replay_all(&queue);
+  g_assert_cmpuint(replayed.size(), ==, 3);
+  g_assert_cmpstr(replayed[0].c_str(), ==, "a=1");
+  g_assert_cmpstr(replayed[1].c_str(), ==, "b deleted");
+  g_assert_cmpstr(replayed[2].c_str(), ==, "c=3");
+  g_assert_cmpint(stat_int(&queue, "replayed"), ==, 3);
+}
+
+// Queuing an item again replaces its operation and moves it to the end, so
+// a write queued after a delete is never undone by replaying the delete.
+static void test_offline_queue_coalesce() {
+  OfflineQueue queue(16, 4096);
+  g_assert_true(queue.push("a", nullptr, "1"));
+  g_assert_true(queue.push("b", nullptr, "2"));
+  g_assert_true(queue.push("a", nullptr, nullptr));
+  g_assert_true(queue.push("c", nullptr, "3"));
+  g_assert_true(queue.push("a", nullptr, "4"));
+
+  SecretPtr content;
+  g_assert_true(queue.lookup("a", &content, nullptr));
+  g_assert_cmpstr(content.get(), ==, "4");
+  g_assert_false(queue.lookup("d", &content, nullptr));
+
+  std::vector<std::string> replayed = replay_all(&queue);
+  g_assert_cmpuint(replayed.size(), ==, 3);
+  g_assert_cmpstr(replayed[0].c_str(), ==, "b=2");
+  g_assert_cmpstr(replayed[1].c_str(), ==, "c=3");
+  g_assert_cmpstr(replayed[2].c_str(), ==, "a=4");
+  g_assert_cmpint(stat_int(&queue, "coalesced"), ==, 2);
+}
+
+// An operation replaced while it was being replayed stays queued, the newer
+// one is replayed after the rest.
+static void test_offline_queue_replaced_during_replay() {
+  OfflineQueue queue(16, 4096);
+  g_assert_true(queue.push("a", nullptr, "1"));
+  g_assert_true(queue.push("b", nullptr, "2"));
+
+  std::string name;
+  RefPtr<GHashTable> attributes;
+  SecretPtr content;
+  guint64 id;
+  g_assert_true(queue.front(&name, &attributes, &content, &id));
+  g_assert_cmpstr(name.c_str(), ==, "a");
+  g_assert_true(queue.push("a", nullptr, "3"));
+  queue.complete(id, true);
+
+  std::vector<std::string> replayed = replay_all(&queue);
+  g_assert_cmpuint(replayed.size(), ==, 2);
+  g_assert_cmpstr(replayed[0].c_str(), ==, "b=2");
+  g_assert_cmpstr(replayed[1].c_str(), ==, "a=3");
+}
+
+// Giving up on an operation drops it without touching the others.
+static void test_offline_queue_drop() {
+  OfflineQueue queue(16, 4096);
+  g_assert_true(queue.push("a", nullptr, "1"));
+  g_assert_true(queue.push("b", nullptr, "2"));
+  std::string name;
+  RefPtr<GHashTable> attributes;
+  SecretPtr content;
+  guint64 id;
+  g_assert_true(queue.front(&name, &attributes, &content, &id));
+  queue.complete(id, false);
+  std::vector<std::string> replayed = replay_all(&queue);
+  g_assert_cmpuint(replayed.size(), ==, 1);
+  g_assert_cmpstr(replayed[0].c_str(), ==, "b=2");
+  g_assert_cmpint(stat_int(&queue, "dropped"), ==, 1);
+}
+
+static void test_offline_queue_attributes() {
+  OfflineQueue queue(16, 4096);
+  GHashTable *pushed = attributes_new("a");
+  g_assert_true(queue.push("a", pushed, "1"));
+  g_hash_table_unref(pushed);
+
+  std::string name;
+  RefPtr<GHashTable> attributes;
+  SecretPtr content;
+  guint64 id;
+  g_assert_true(queue.front(&name, &attributes, &content, &id));
+  g_assert_cmpstr((const gchar *)g_hash_table_lookup(attributes.get(), "name"),
+                  ==, "a");
+  queue.complete(id, true);
+}
+
+// Full queues reject new operations, replacing a queued one only counts the
+// size difference.
+static void test_offline_queue_bounds() {
+  OfflineQueue queue(2, 2 * (BIOMETRIC_AEAD_TAG_SIZE + 4));
+  g_assert_true(queue.push("a", nullptr, "1234"));
+  g_assert_true(queue.push("b", nullptr, "1234"));
+  g_assert_false(queue.push("c", nullptr, nullptr));
+  g_assert_false(queue.push("a", nullptr, "12345"));
+  g_assert_true(queue.push("a", nullptr, "4321"));
+  g_assert_true(queue.push("b", nullptr, nullptr));
+  g_assert_true(queue.push("a", nullptr, "1234512345"));
+  g_assert_cmpint(stat_int(&queue, "rejected"), ==, 2);
+  g_assert_cmpint(stat_int(&queue, "depth"), ==, 2);
+
+  std::vector<std::string> replayed = replay_all(&queue);
+  g_assert_cmpuint(replayed.size(), ==, 2);
+  g_assert_cmpstr(replayed[0].c_str(), ==, "b deleted");
+  g_assert_cmpstr(replayed[1].c_str(), ==, "a=1234512345");
+  g_assert_cmpint(stat_int(&queue, "bytes"), ==, 0);
+}
+
+int main(int argc, char **argv) {
+  g_test_init(&argc, &argv, nullptr);
+  g_test_add_func("/offline-queue/fifo", test_offline_queue_fifo);
+  g_test_add_func("/offline-queue/coalesce", test_offline_queue_coalesce);
+  g_test_add_func("/offline-queue/replaced-during-replay",
+                  test_offline_queue_replaced_during_replay);
+  g_test_add_func("/offline-queue/drop", test_offline_queue_drop);
+  g_test_add_func("/offline-queue/attributes",
+                  test_offline_queue_attributes);
+  g_test_add_func("/offline-queue/bounds", test_offline_queue_bounds);
+  return g_test_run();
+}
@@ -0,0 +1,192 @@
+// Ordering of the `batch` method: operations on the same storage run in
+// the order they were sent, barriers wait for everything before them and a
+// failed operation does not stop the others. Run against the credentials
+// backend.
+
+#include <flutter_linux/flutter_linux.h>
+#include <glib/gstdio.h>
+
+#include <map>
+#include <string>
+#include <vector>
+
+#include "test_util.h"
+
+typedef struct {
+  gchar *dir;
+  BiometricStoragePlugin *plugin;
+} Fixture;
+
+static void fixture_set_up(Fixture *fixture, gconstpointer user_data) {
+  fixture->dir = test_tmp_dir_new();
+  fixture->plugin = test_plugin_new(fixture->dir, TRUE);
+}
+
+static void fixture_tear_down(Fixture *fixture, gconstpointer user_data) {
+  g_object_unref(fixture->plugin);
+  test_remove_tree(fixture->dir);
+  g_free(fixture->dir);
+}
+
+// Appends an operation to `operations`, `content` only for writes.
+static FlValue *operation_append(FlValue *operations, const gchar *method,
+                                 const gchar *name,
+                                 const gchar *content = nullptr) {
+  FlValue *operation = fl_value_new_map();
+  fl_value_set_string_take(operation, "method", fl_value_new_string(method));
+  fl_value_set_string_take(operation, "name", fl_value_new_string(name));
+  if (content != nullptr) {
+    fl_value_set_string_take(operation, "content",
+                             fl_value_new_string(content));
+  }
+  fl_value_append_take(operations, operation);
+  return operation;
+}
+
+static FlMethodResponse *run_pipeline(Fixture *fixture,
+                                      FlValue *operations) {
+  g_autoptr(FlValue) args = fl_value_new_map();
+  fl_value_set_string(args, "operations", operations);
+  return test_plugin_call(fixture->plugin, "batch", args);
+}
+
+static gint64 dependency_waits(Fixture *fixture) {
+  g_autoptr(FlValue) args = fl_value_new_null();
+  g_autoptr(FlMethodResponse) response =
+      test_plugin_call(fixture->plugin, "stats", args);
+  FlValue *batch =
+      fl_value_lookup_string(test_response_result(response), "batch");
+  return fl_value_get_int(fl_value_lookup_string(batch, "dependencyWaits"));
+}
+
+// More operations than run concurrently, interleaved on a few storages.
+// Every read sees the write before it on the same storage, as if they ran
+// one after the other.
+static void test_same_storage_in_order(Fixture *fixture,
+                                       gconstpointer user_data) {
+  g_autoptr(FlValue) operations = fl_value_new_list();
+  const gchar *names[] = {"a", "b", "c"};
+  std::map<std::string, std::string> current;
+  std::vector<std::string> expected;
+  for (gint i = 0; i < 48; i++) {
+    const gchar *name = names[i % 3];
+    switch ((i / 3) % 4) {
+      case 0:
+      case 2: {
+        std::string content = std::string(name) + std::to_string(i);
+        operation_append(operations, "write", name, content.c_str());
+        current[name] = content;
+        expected.push_back("true");
+        break;
+      }
+      case 1:
+        operation_append(operations, "read", name);
+        expected.push_back(current[name]);
+        break;
+      case 3:
+        operation_append(operations, i % 2 == 0 ? "delete" : "read", name);
+        expected.push_back(i % 2 == 0 ? "true" : current[name]);
+        if (i % 2 == 0) {
+          current[name] = "null";
+        }
+        break;
+    }
+  }
+  g_autoptr(FlMethodResponse) response = run_pipeline(fixture, operations);
+  FlValue *results = test_response_result(response);
+  g_assert_cmpuint(fl_value_get_length(results), ==, expected.size());
+  for (gsize i = 0; i < expected.size(); i++) {
+    FlValue *value =
+        fl_value_lookup_string(fl_value_get_list_value(results, i), "value");
+    g_assert_nonnull(value);
+    std::string actual =
+        fl_value_get_type(value) == FL_VALUE_TYPE_STRING
+            ? fl_value_get_string(value)
+        : fl_value_get_type(value) == FL_VALUE_TYPE_BOOL
+            ? (fl_value_get_bool(value) ? "true" : "false")
+            : "null";
+    g_assert_cmpstr(actual.c_str(), ==, expected[i].c_str());
+  }
+  g_assert_cmpint(dependency_waits(fixture), >, 0);
+}
+
+// A barrier waits for all operations before it, even on other storages.
+static void test_barrier(Fixture *fixture, gconstpointer user_data) {
+  g_autoptr(FlValue) operations = fl_value_new_list();
+  operation_append(operations, "write", "a", "1");
+  operation_append(operations, "write", "b", "2");
+  FlValue *barrier = operation_append(operations, "read", "c");
+  fl_value_set_string_take(barrier, "barrier", fl_value_new_bool(true));
+  g_autoptr(FlMethodResponse) response = run_pipeline(fixture, operations);
+  FlValue *results = test_response_result(response);
+  g_assert_cmpuint(fl_value_get_length(results), ==, 3);
+  // The writes are still committing when the barrier starts.
+  g_assert_cmpint(dependency_waits(fixture), ==, 1);
+
+  // Without a barrier independent operations do not wait.
+  g_autoptr(FlValue) reads = fl_value_new_list();
+  operation_append(reads, "read", "a");
+  operation_append(reads, "read", "b");
+  operation_append(reads, "read", "c");
+  g_autoptr(FlMethodResponse) read_response = run_pipeline(fixture, reads);
+  FlValue *values = test_response_result(read_response);
+  g_assert_cmpstr(fl_value_get_string(fl_value_lookup_string(
+                      fl_value_get_list_value(values, 1), "value")),
+                  ==, "2");
+  g_assert_cmpint(dependency_waits(fixture), ==, 1);
+}
+
+// A failed operation is reported in its place, the operations after it on
+// the same storage still run.
+static void test_failure_in_place(Fixture *fixture,
+                                  gconstpointer user_data) {
+  // Reading a directory instead of a credential file fails.
+  g_autofree gchar *broken = g_build_filename(
+      fixture->dir, "credentials", BIOMETRIC_NAME_PREFIX ".broken", NULL);
+  g_assert_cmpint(g_mkdir(broken, 0700), ==, 0);
+
+  g_autoptr(FlValue) operations = fl_value_new_list();
+  operation_append(operations, "read", "broken");
+  operation_append(operations, "write", "broken", "fixed");
+  operation_append(operations, "read", "broken");
+  g_test_expect_message(nullptr, G_LOG_LEVEL_WARNING,
+                        "Failed to lookup secret*");
+  g_autoptr(FlMethodResponse) response = run_pipeline(fixture, operations);
+  g_test_assert_expected_messages();
+  FlValue *results = test_response_result(response);
+  FlValue *error =
+      fl_value_lookup_string(fl_value_get_list_value(results, 0), "error");
+  g_assert_nonnull(error);
+  g_assert_nonnull(fl_value_lookup_string(error, "code"));
+  g_assert_cmpstr(fl_value_get_string(fl_value_lookup_string(
+                      fl_value_get_list_value(results, 2), "value")),
+                  ==, "fixed");
+}
+
+static void test_rejects_bad_operations(Fixture *fixture,
+                                        gconstpointer user_data) {
+  g_autoptr(FlValue) unknown = fl_value_new_list();
+  operation_append(unknown, "read", "a");
+  operation_append(unknown, "readMany", "a");
+  g_autoptr(FlMethodResponse) response = run_pipeline(fixture, unknown);
+  g_assert_true(FL_IS_METHOD_ERROR_RESPONSE(response));
+
+  g_autoptr(FlValue) no_content = fl_value_new_list();
+  operation_append(no_content, "write", "a");
+  g_autoptr(FlMethodResponse) write_response =
+      run_pipeline(fixture, no_content);
+  g_assert_true(FL_IS_METHOD_ERROR_RESPONSE(write_response));
+}
+
+int main(int argc, char **argv) {
+  g_test_init(&argc, &argv, G_TEST_OPTION_ISOLATE_DIRS, nullptr);
+  g_test_add("/pipeline/same-storage-in-order", Fixture, nullptr,
+             fixture_set_up, test_same_storage_in_order, fixture_tear_down);
+  g_test_add("/pipeline/barrier", Fixture, nullptr, fixture_set_up,
+             test_barrier, fixture_tear_down);
+  g_test_add("/pipeline/failure-in-place", Fixture, nullptr, fixture_set_up,
+             test_failure_in_place, fixture_tear_down);
+  g_test_add("/pipeline/rejects-bad-operations", Fixture, nullptr,
+             fixture_set_up, test_rejects_bad_operations, fixture_tear_down);
+  return g_test_run();
+}
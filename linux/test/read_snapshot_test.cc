@@ -0,0 +1,170 @@
+// `readSnapshot`: the retry of torn reads against scripted loads, and the
+// method itself against the credentials backend.
+
+#include <flutter_linux/flutter_linux.h>
+
+#include <string>
+#include <vector>
+
+#include "../biometric_storage_stable_read.h"
+#include "test_util.h"
+
+// Versions returned by consecutive loads, "fail" for a load which fails.
+struct ScriptedLoads {
+  std::vector<std::string> script;
+  guint loads = 0;
+};
+
+static Task<bool> scripted_load(ScriptedLoads *loads,
+                                std::vector<std::string> *versions) {
+  g_assert_cmpuint(loads->loads, <, loads->script.size());
+  std::string version = loads->script[loads->loads++];
+  if (version == "fail") {
+    co_return false;
+  }
+  *versions = {"a", version};
+  co_return true;
+}
+
+static Task<> run_read_stable(ScriptedLoads *loads, guint max_attempts,
+                              guint delay_ms, guint64 *torn_reads,
+                              StableRead *outcome) {
+  *outcome = co_await read_stable(
+      [loads](std::vector<std::string> *versions) {
+        return scripted_load(loads, versions);
+      },
+      max_attempts, delay_ms, torn_reads);
+}
+
+static void test_stable() {
+  ScriptedLoads loads{{"1", "1"}};
+  guint64 torn_reads = 0;
+  StableRead outcome = StableRead::kFailed;
+  test_run_task(run_read_stable(&loads, 4, 5, &torn_reads, &outcome));
+  g_assert_true(outcome == StableRead::kStable);
+  g_assert_cmpuint(loads.loads, ==, 2);
+  g_assert_cmpuint(torn_reads, ==, 0);
+}
+
+// A write between the two loads retries both of them.
+static void test_retries_torn_read() {
+  ScriptedLoads loads{{"1", "2", "2", "2"}};
+  guint64 torn_reads = 0;
+  StableRead outcome = StableRead::kFailed;
+  test_run_task(run_read_stable(&loads, 4, 5, &torn_reads, &outcome));
+  g_assert_true(outcome == StableRead::kStable);
+  g_assert_cmpuint(loads.loads, ==, 4);
+  g_assert_cmpuint(torn_reads, ==, 1);
+}
+
+// Gives up after `max_attempts`, waiting twice as long before every retry.
+static void test_gives_up() {
+  ScriptedLoads loads;
+  for (gint i = 0; i < 8; i++) {
+    loads.script.push_back(std::to_string(i));
+  }
+  guint64 torn_reads = 0;
+  StableRead outcome = StableRead::kStable;
+  gint64 start = g_get_monotonic_time();
+  test_run_task(run_read_stable(&loads, 4, 5, &torn_reads, &outcome));
+  g_assert_true(outcome == StableRead::kTorn);
+  g_assert_cmpuint(loads.loads, ==, 8);
+  g_assert_cmpuint(torn_reads, ==, 3);
+  g_assert_cmpint(g_get_monotonic_time() - start, >=, (5 + 10 + 20) * 1000);
+}
+
+// A failed load is not retried.
+static void test_failure() {
+  ScriptedLoads loads{{"1", "2", "fail"}};
+  guint64 torn_reads = 0;
+  StableRead outcome = StableRead::kStable;
+  test_run_task(run_read_stable(&loads, 4, 5, &torn_reads, &outcome));
+  g_assert_true(outcome == StableRead::kFailed);
+  g_assert_cmpuint(loads.loads, ==, 3);
+  g_assert_cmpuint(torn_reads, ==, 1);
+}
+
+typedef struct {
+  gchar *dir;
+  BiometricStoragePlugin *plugin;
+} Fixture;
+
+static void fixture_set_up(Fixture *fixture, gconstpointer user_data) {
+  fixture->dir = test_tmp_dir_new();
+  fixture->plugin = test_plugin_new(fixture->dir, TRUE);
+}
+
+static void fixture_tear_down(Fixture *fixture, gconstpointer user_data) {
+  g_object_unref(fixture->plugin);
+  test_remove_tree(fixture->dir);
+  g_free(fixture->dir);
+}
+
+static void store(Fixture *fixture, const gchar *name, const gchar *content) {
+  g_autoptr(FlValue) args = fl_value_new_map();
+  fl_value_set_string_take(args, "name", fl_value_new_string(name));
+  fl_value_set_string_take(args, "content", fl_value_new_string(content));
+  g_autoptr(FlMethodResponse) response =
+      test_plugin_call(fixture->plugin, "write", args);
+  test_response_result(response);
+}
+
+static FlMethodResponse *read_snapshot(Fixture *fixture, FlValue *names) {
+  g_autoptr(FlValue) args = fl_value_new_map();
+  fl_value_set_string(args, "names", names);
+  return test_plugin_call(fixture->plugin, "readSnapshot", args);
+}
+
+static void test_reads_values(Fixture *fixture, gconstpointer user_data) {
+  store(fixture, "a", "1");
+  store(fixture, "b", "2");
+  g_autoptr(FlValue) names = fl_value_new_list();
+  fl_value_append_take(names, fl_value_new_string("a"));
+  fl_value_append_take(names, fl_value_new_string("b"));
+  fl_value_append_take(names, fl_value_new_string("missing"));
+  g_autoptr(FlMethodResponse) response = read_snapshot(fixture, names);
+  FlValue *result = test_response_result(response);
+  g_assert_cmpstr(fl_value_get_string(fl_value_lookup_string(result, "a")),
+                  ==, "1");
+  g_assert_cmpstr(fl_value_get_string(fl_value_lookup_string(result, "b")),
+                  ==, "2");
+  g_assert_cmpint(
+      fl_value_get_type(fl_value_lookup_string(result, "missing")), ==,
+      FL_VALUE_TYPE_NULL);
+
+  g_autoptr(FlValue) stats_args = fl_value_new_null();
+  g_autoptr(FlMethodResponse) stats =
+      test_plugin_call(fixture->plugin, "stats", stats_args);
+  FlValue *counters = fl_value_lookup_string(test_response_result(stats),
+                                             "readSnapshot");
+  g_assert_cmpint(fl_value_get_int(fl_value_lookup_string(counters, "reads")),
+                  ==, 1);
+  g_assert_cmpint(
+      fl_value_get_int(fl_value_lookup_string(counters, "tornReads")), ==, 0);
+}
+
+static void test_rejects_bad_arguments(Fixture *fixture,
+                                       gconstpointer user_data) {
+  g_autoptr(FlValue) names = fl_value_new_list();
+  fl_value_append_take(names, fl_value_new_int(1));
+  g_autoptr(FlMethodResponse) response = read_snapshot(fixture, names);
+  g_assert_true(FL_IS_METHOD_ERROR_RESPONSE(response));
+
+  g_autoptr(FlValue) args = fl_value_new_map();
+  g_autoptr(FlMethodResponse) missing =
+      test_plugin_call(fixture->plugin, "readSnapshot", args);
+  g_assert_true(FL_IS_METHOD_ERROR_RESPONSE(missing));
+}
+
+int main(int argc, char **argv) {
+  g_test_init(&argc, &argv, G_TEST_OPTION_ISOLATE_DIRS, nullptr);
+  g_test_add_func("/read-snapshot/stable", test_stable);
+  g_test_add_func("/read-snapshot/retries-torn-read", test_retries_torn_read);
+  g_test_add_func("/read-snapshot/gives-up", test_gives_up);
+  g_test_add_func("/read-snapshot/failure", test_failure);
+  g_test_add("/read-snapshot/reads-values", Fixture, nullptr, fixture_set_up,
+             test_reads_values, fixture_tear_down);
+  g_test_add("/read-snapshot/rejects-bad-arguments", Fixture, nullptr,
+             fixture_set_up, test_rejects_bad_arguments, fixture_tear_down);
+  return g_test_run();
+}
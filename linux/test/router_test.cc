@@ -0,0 +1,189 @@
+// Parsing of the tier policy set by `init`, and how it routes writes.
+
+#include <flutter_linux/flutter_linux.h>
+#include <gio/gio.h>
+#include <string.h>
+
+#include "../biometric_storage_router.h"
+#include "test_util.h"
+
+static const gchar kPrefix[] = "test";
+
+static FlValue *rule_new(const gchar *tier, const gchar *pattern) {
+  FlValue *rule = fl_value_new_map();
+  fl_value_set_string_take(rule, "tier", fl_value_new_string(tier));
+  if (pattern != nullptr) {
+    fl_value_set_string_take(rule, "pattern", fl_value_new_string(pattern));
+  }
+  return rule;
+}
+
+static StorageTier route(TierRouter *router, const gchar *name, gsize size,
+                         gboolean tagged = FALSE) {
+  StorageTier tier;
+  g_assert_true(router->route_write(name, size, tagged, &tier));
+  return tier;
+}
+
+static void test_router_tier_names() {
+  for (gsize i = 0; i < kStorageTiers; i++) {
+    StorageTier tier;
+    g_assert_true(storage_tier_parse(
+        storage_tier_name(static_cast<StorageTier>(i)), &tier));
+    g_assert_cmpint(static_cast<gsize>(tier), ==, i);
+  }
+  StorageTier tier;
+  g_assert_false(storage_tier_parse("keyring", &tier));
+  g_assert_false(storage_tier_parse(nullptr, &tier));
+}
+
+// Patterns are globs on the storage name without the prefix, the first
+// matching rule wins.
+static void test_router_glob_rules() {
+  TierRouter router(kPrefix, StorageTier::kSecretService);
+  g_autoptr(FlValue) rules = fl_value_new_list();
+  fl_value_append_take(rules, rule_new("file", "cache.*"));
+  fl_value_append_take(rules, rule_new("kernelKeyring", "session?"));
+  fl_value_append_take(rules, rule_new("sharded", "*"));
+  g_autoptr(GError) error = nullptr;
+  g_assert_true(router.set_policy(rules, &error));
+  g_assert_no_error(error);
+
+  g_assert_true(route(&router, "test.cache.images", 10) == StorageTier::kFile);
+  g_assert_true(route(&router, "test.session1", 10) ==
+                StorageTier::kKernelKeyring);
+  g_assert_true(route(&router, "test.session12", 10) ==
+                StorageTier::kSharded);
+  // Only the prefix of this plugin instance is stripped.
+  g_assert_true(route(&router, "other.cache.images", 10) ==
+                StorageTier::kSharded);
+}
+
+static void test_router_size_rules() {
+  TierRouter router(kPrefix, StorageTier::kSecretService);
+  g_autoptr(FlValue) rules = fl_value_new_list();
+  FlValue *small = rule_new("kernelKeyring", nullptr);
+  fl_value_set_string_take(small, "maxSize", fl_value_new_int(64));
+  fl_value_append_take(rules, small);
+  FlValue *large = rule_new("file", "blob*");
+  fl_value_set_string_take(large, "minSize", fl_value_new_int(4096));
+  fl_value_set_string_take(large, "maxSize", fl_value_new_null());
+  fl_value_append_take(rules, large);
+  g_autoptr(GError) error = nullptr;
+  g_assert_true(router.set_policy(rules, &error));
+  g_assert_no_error(error);
+
+  // Both bounds are inclusive.
+  g_assert_true(route(&router, "test.a", 0) == StorageTier::kKernelKeyring);
+  g_assert_true(route(&router, "test.a", 64) == StorageTier::kKernelKeyring);
+  g_assert_true(route(&router, "test.a", 65) == StorageTier::kSecretService);
+  g_assert_true(route(&router, "test.blob", 4095) ==
+                StorageTier::kSecretService);
+  g_assert_true(route(&router, "test.blob", 4096) == StorageTier::kFile);
+  g_assert_true(route(&router, "test.blob", G_MAXSIZE) == StorageTier::kFile);
+}
+
+// A malformed rule rejects the whole policy and keeps the previous one.
+static void test_router_malformed_rules() {
+  TierRouter router(kPrefix, StorageTier::kSecretService);
+  g_autoptr(FlValue) valid = fl_value_new_list();
+  fl_value_append_take(valid, rule_new("file", nullptr));
+  g_assert_true(router.set_policy(valid, nullptr));
+
+  g_autoptr(FlValue) not_a_list = fl_value_new_map();
+  g_autoptr(FlValue) not_a_map = fl_value_new_list();
+  fl_value_append_take(not_a_map, fl_value_new_string("file"));
+  g_autoptr(FlValue) no_tier = fl_value_new_list();
+  fl_value_append_take(no_tier, fl_value_new_map());
+  g_autoptr(FlValue) unknown_tier = fl_value_new_list();
+  fl_value_append_take(unknown_tier, rule_new("cloud", nullptr));
+  g_autoptr(FlValue) bad_pattern = fl_value_new_list();
+  FlValue *rule = rule_new("file", nullptr);
+  fl_value_set_string_take(rule, "pattern", fl_value_new_int(1));
+  fl_value_append_take(bad_pattern, rule);
+  g_autoptr(FlValue) negative_size = fl_value_new_list();
+  rule = rule_new("file", nullptr);
+  fl_value_set_string_take(rule, "minSize", fl_value_new_int(-1));
+  fl_value_append_take(negative_size, rule);
+  g_autoptr(FlValue) string_size = fl_value_new_list();
+  rule = rule_new("file", nullptr);
+  fl_value_set_string_take(rule, "maxSize", fl_value_new_string("1k"));
+  fl_value_append_take(string_size, rule);
+
+  FlValue *policies[] = {nullptr,       not_a_list,    not_a_map,
+                         no_tier,       unknown_tier,  bad_pattern,
+                         negative_size, string_size};
+  for (FlValue *policy : policies) {
+    g_autoptr(GError) error = nullptr;
+    g_assert_false(router.set_policy(policy, &error));
+    g_assert_error(error, G_IO_ERROR, G_IO_ERROR_INVALID_ARGUMENT);
+    g_assert_true(route(&router, "test.a", 1) == StorageTier::kFile);
+  }
+
+  g_autoptr(FlValue) empty = fl_value_new_list();
+  g_assert_true(router.set_policy(empty, nullptr));
+  g_assert_true(route(&router, "test.a", 1) == StorageTier::kSecretService);
+}
+
+// Tags are item attributes, tagged writes ignore the rules and cannot go to
+// a storage pinned elsewhere.
+static void test_router_tagged_and_pinned() {
+  TierRouter router(kPrefix, StorageTier::kFile);
+  g_autoptr(FlValue) rules = fl_value_new_list();
+  fl_value_append_take(rules, rule_new("kernelKeyring", "key*"));
+  g_assert_true(router.set_policy(rules, nullptr));
+
+  g_assert_true(route(&router, "test.other", 1) == StorageTier::kFile);
+  g_assert_true(route(&router, "test.key", 1) == StorageTier::kKernelKeyring);
+  g_assert_true(route(&router, "test.key", 1, TRUE) ==
+                StorageTier::kSecretService);
+
+  StorageTier sharded = StorageTier::kSharded;
+  router.pin("test.key", &sharded);
+  g_assert_true(route(&router, "test.key", 1) == StorageTier::kSharded);
+  StorageTier tier;
+  g_assert_false(router.route_write("test.key", 1, TRUE, &tier));
+  router.pin("test.key", nullptr);
+  g_assert_true(route(&router, "test.key", 1) == StorageTier::kKernelKeyring);
+}
+
+// The index remembers storages outside of the default tier across loads.
+static void test_router_index() {
+  g_autofree gchar *dir = test_tmp_dir_new();
+  g_autofree gchar *path = g_build_filename(dir, "routes.ini", NULL);
+  {
+    TierRouter router(kPrefix, StorageTier::kSecretService);
+    router.load(path);
+    g_assert_true(router.move("test.a", StorageTier::kFile, nullptr));
+    g_assert_true(router.move("test.b", StorageTier::kSharded, nullptr));
+    g_assert_true(router.move("test.b", StorageTier::kSecretService, nullptr));
+  }
+  TierRouter router(kPrefix, StorageTier::kSecretService);
+  router.load(path);
+  g_assert_true(router.route_read("test.a") == StorageTier::kFile);
+  g_assert_true(router.route_read("test.b") == StorageTier::kSecretService);
+  g_assert_true(router.route_read("test.c") == StorageTier::kSecretService);
+
+  // Names are only stored hashed.
+  g_autofree gchar *contents = nullptr;
+  g_assert_true(g_file_get_contents(path, &contents, nullptr, nullptr));
+  g_assert_null(strstr(contents, "test.a"));
+
+  // With another default tier, routes to it are not indexed.
+  TierRouter file_router(kPrefix, StorageTier::kFile);
+  file_router.load(path);
+  g_assert_true(file_router.route_read("test.a") == StorageTier::kFile);
+  g_assert_true(file_router.route_read("test.b") == StorageTier::kFile);
+  test_remove_tree(dir);
+}
+
+int main(int argc, char **argv) {
+  g_test_init(&argc, &argv, nullptr);
+  g_test_add_func("/router/tier-names", test_router_tier_names);
+  g_test_add_func("/router/glob-rules", test_router_glob_rules);
+  g_test_add_func("/router/size-rules", test_router_size_rules);
+  g_test_add_func("/router/malformed-rules", test_router_malformed_rules);
+  g_test_add_func("/router/tagged-and-pinned", test_router_tagged_and_pinned);
+  g_test_add_func("/router/index", test_router_index);
+  return g_test_run();
+}
@@ -0,0 +1,92 @@
+#include "test_util.h"
+
+#include <glib/gstdio.h>
+
+#include "../biometric_storage_credentials.h"
+#include "../biometric_storage_crypto.h"
+
+gchar *test_tmp_dir_new(void) {
+  g_autoptr(GError) error = nullptr;
+  gchar *path = g_dir_make_tmp("biometric_storage_test-XXXXXX", &error);
+  g_assert_no_error(error);
+  return path;
+}
+
+void test_remove_tree(const gchar *path) {
+  if (g_file_test(path, G_FILE_TEST_IS_DIR)) {
+    GDir *dir = g_dir_open(path, 0, nullptr);
+    const gchar *name;
+    while (dir != nullptr && (name = g_dir_read_name(dir)) != nullptr) {
+      g_autofree gchar *child = g_build_filename(path, name, NULL);
+      test_remove_tree(child);
+    }
+    if (dir != nullptr) {
+      g_dir_close(dir);
+    }
+    g_rmdir(path);
+  } else {
+    g_unlink(path);
+  }
+}
+
+static Task<> run_and_signal(Task<> task, gboolean *done) {
+  co_await task;
+  *done = TRUE;
+}
+
+void test_run_task(Task<> task) {
+  gboolean done = FALSE;
+  task_detach(run_and_signal(std::move(task), &done));
+  while (!done) {
+    g_main_context_iteration(nullptr, TRUE);
+  }
+}
+
+BiometricStoragePlugin *test_plugin_new(const gchar *directory,
+                                        gboolean writable) {
+  g_autofree gchar *credentials =
+      g_build_filename(directory, "credentials", NULL);
+  g_autofree gchar *state = g_build_filename(directory, "state", NULL);
+  g_assert_cmpint(g_mkdir_with_parents(credentials, 0700), ==, 0);
+  if (writable) {
+    g_autoptr(GError) error = nullptr;
+    gchar *key = biometric_key_new_encoded(&error);
+    g_assert_no_error(error);
+    g_autofree gchar *key_path =
+        g_build_filename(credentials, kCredentialsOverlayKey, NULL);
+    g_file_set_contents(key_path, key, -1, &error);
+    biometric_secret_free(key);
+    g_assert_no_error(error);
+  }
+  // Read when the plugin is created and when the overlay is opened.
+  g_setenv("CREDENTIALS_DIRECTORY", credentials, TRUE);
+  g_setenv("STATE_DIRECTORY", state, TRUE);
+  return static_cast<BiometricStoragePlugin *>(
+      g_object_new(biometric_storage_plugin_get_type(), nullptr));
+}
+
+static Task<> call_and_store(BiometricStoragePlugin *plugin,
+                             const gchar *method, FlValue *args,
+                             FlMethodResponse **response) {
+  RefPtr<FlMethodResponse> result =
+      co_await biometric_storage_plugin_call(plugin, method, args);
+  *response = result.steal();
+}
+
+FlMethodResponse *test_plugin_call(BiometricStoragePlugin *plugin,
+                                   const gchar *method, FlValue *args) {
+  FlMethodResponse *response = nullptr;
+  test_run_task(call_and_store(plugin, method, args, &response));
+  return response;
+}
+
+FlValue *test_response_result(FlMethodResponse *response) {
+  if (FL_IS_METHOD_ERROR_RESPONSE(response)) {
+    FlMethodErrorResponse *error = FL_METHOD_ERROR_RESPONSE(response);
+    g_error("%s: %s", fl_method_error_response_get_code(error),
+            fl_method_error_response_get_message(error));
+  }
+  g_assert_true(FL_IS_METHOD_SUCCESS_RESPONSE(response));
+  return fl_method_success_response_get_result(
+      FL_METHOD_SUCCESS_RESPONSE(response));
+}
@@ -0,0 +1,32 @@
+#ifndef BIOMETRIC_STORAGE_TEST_TEST_UTIL_H_
+#define BIOMETRIC_STORAGE_TEST_TEST_UTIL_H_
+
+#include <glib.h>
+
+#include "../biometric_storage_async.h"
+#include "../biometric_storage_plugin_private.h"
+
+// Creates an empty directory below $TMPDIR for the files of one test.
+gchar *test_tmp_dir_new(void);
+
+// Removes `path` and everything below it.
+void test_remove_tree(const gchar *path);
+
+// Runs `task` on the thread default main context until it completed.
+void test_run_task(Task<> task);
+
+// Creates a plugin keeping all storages in the credentials backend, so no
+// Secret Service is needed. Credentials are read from `directory`/credentials,
+// which gets the overlay key credential if `writable`, and the overlay is
+// written below `directory`/state.
+BiometricStoragePlugin *test_plugin_new(const gchar *directory,
+                                        gboolean writable);
+
+// Runs the plugin method `method` with `args` until it completed.
+FlMethodResponse *test_plugin_call(BiometricStoragePlugin *plugin,
+                                   const gchar *method, FlValue *args);
+
+// Returns the result of `response`, failing the test if it is an error.
+FlValue *test_response_result(FlMethodResponse *response);
+
+#endif  // BIOMETRIC_STORAGE_TEST_TEST_UTIL_H_
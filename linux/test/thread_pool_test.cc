@@ -0,0 +1,173 @@
+// Work stealing, the queue bound and draining of the ThreadPool, and
+// resuming coroutines on the main context through run_on().
+
+#include <flutter_linux/flutter_linux.h>
+
+#include <atomic>
+
+#include "../biometric_storage_thread_pool.h"
+#include "test_util.h"
+
+// Waits until `condition` holds, failing the test after a few seconds.
+template <typename Condition>
+static void wait_for(Condition condition) {
+  gint64 deadline = g_get_monotonic_time() + 5 * G_USEC_PER_SEC;
+  while (!condition()) {
+    g_assert_cmpint(g_get_monotonic_time(), <, deadline);
+    g_usleep(1000);
+  }
+}
+
+static gint64 pool_stat(ThreadPool *pool, const gchar *key) {
+  g_autoptr(FlValue) stats = pool->stats();
+  return fl_value_get_int(fl_value_lookup_string(stats, key));
+}
+
+static void test_runs_jobs_on_workers() {
+  ThreadPool pool(4, 64);
+  GThread *main_thread = g_thread_self();
+  std::atomic<gint> done{0};
+  std::atomic<gint> on_main{0};
+  for (gint i = 0; i < 32; i++) {
+    g_assert_true(pool.submit([&] {
+      if (g_thread_self() == main_thread) {
+        on_main++;
+      }
+      done++;
+    }));
+  }
+  wait_for([&] { return done.load() == 32; });
+  g_assert_cmpint(on_main.load(), ==, 0);
+  wait_for([&] { return pool_stat(&pool, "completed") == 32; });
+  g_assert_cmpint(pool_stat(&pool, "pending"), ==, 0);
+  g_assert_cmpint(pool_stat(&pool, "workers"), ==, 4);
+}
+
+// Jobs queued on the deque of a busy worker are stolen by the idle one.
+static void test_steals_from_busy_worker() {
+  ThreadPool pool(2, 64);
+  std::atomic<bool> started{false};
+  std::atomic<bool> release{false};
+  g_assert_true(pool.submit([&] {
+    started = true;
+    while (!release.load()) {
+      g_usleep(1000);
+    }
+  }));
+  wait_for([&] { return started.load(); });
+
+  // Distributed round robin, half of them land on the busy worker.
+  std::atomic<gint> done{0};
+  for (gint i = 0; i < 10; i++) {
+    g_assert_true(pool.submit([&] { done++; }));
+  }
+  wait_for([&] { return done.load() == 10; });
+  g_assert_cmpint(pool_stat(&pool, "steals"), >=, 1);
+  release = true;
+}
+
+// Beyond `max_queued` waiting or running jobs submit() refuses new ones.
+static void test_refuses_when_full() {
+  ThreadPool pool(1, 3);
+  std::atomic<bool> release{false};
+  std::atomic<gint> done{0};
+  for (gint i = 0; i < 3; i++) {
+    g_assert_true(pool.submit([&] {
+      while (!release.load()) {
+        g_usleep(1000);
+      }
+      done++;
+    }));
+  }
+  bool ran = false;
+  g_assert_false(pool.submit([&] { ran = true; }));
+  g_assert_false(ran);
+
+  release = true;
+  wait_for([&] { return done.load() == 3; });
+  wait_for([&] { return pool_stat(&pool, "pending") == 0; });
+  g_assert_true(pool.submit([&] { done++; }));
+  wait_for([&] { return done.load() == 4; });
+}
+
+// The destructor runs the jobs still queued before joining the workers.
+static void test_drains_on_destruction() {
+  std::atomic<gint> done{0};
+  {
+    ThreadPool pool(2, 64);
+    for (gint i = 0; i < 50; i++) {
+      g_assert_true(pool.submit([&] {
+        g_usleep(100);
+        done++;
+      }));
+    }
+  }
+  g_assert_cmpint(done.load(), ==, 50);
+}
+
+static Task<> await_on_pool(ThreadPool *pool) {
+  GThread *main_thread = g_thread_self();
+  GThread *ran_on = nullptr;
+  gint result = co_await run_on(pool, [&] {
+    ran_on = g_thread_self();
+    return 42;
+  });
+  g_assert_cmpint(result, ==, 42);
+  g_assert_true(ran_on != main_thread);
+  g_assert_true(g_thread_self() == main_thread);
+
+  // Without a pool the job runs inline.
+  result = co_await run_on(nullptr, [&] {
+    ran_on = g_thread_self();
+    return 7;
+  });
+  g_assert_cmpint(result, ==, 7);
+  g_assert_true(ran_on == main_thread);
+}
+
+static void test_run_on_resumes_on_main_context() {
+  ThreadPool pool(2, 64);
+  test_run_task(await_on_pool(&pool));
+}
+
+static Task<> await_on_full_pool(ThreadPool *pool,
+                                 std::atomic<bool> *release) {
+  GThread *main_thread = g_thread_self();
+  GThread *ran_on = nullptr;
+  gint result = co_await run_on(pool, [&] {
+    ran_on = g_thread_self();
+    return 1;
+  });
+  g_assert_cmpint(result, ==, 1);
+  g_assert_true(ran_on == main_thread);
+  *release = true;
+}
+
+// A full pool makes run_on() run the job inline and count it.
+static void test_run_on_full_pool_runs_inline() {
+  ThreadPool pool(1, 1);
+  std::atomic<bool> release{false};
+  g_assert_true(pool.submit([&] {
+    while (!release.load()) {
+      g_usleep(1000);
+    }
+  }));
+  test_run_task(await_on_full_pool(&pool, &release));
+  g_assert_cmpint(pool_stat(&pool, "inline"), ==, 1);
+}
+
+int main(int argc, char **argv) {
+  g_test_init(&argc, &argv, nullptr);
+  g_test_add_func("/thread-pool/runs-jobs-on-workers",
+                  test_runs_jobs_on_workers);
+  g_test_add_func("/thread-pool/steals-from-busy-worker",
+                  test_steals_from_busy_worker);
+  g_test_add_func("/thread-pool/refuses-when-full", test_refuses_when_full);
+  g_test_add_func("/thread-pool/drains-on-destruction",
+                  test_drains_on_destruction);
+  g_test_add_func("/thread-pool/run-on-resumes-on-main-context",
+                  test_run_on_resumes_on_main_context);
+  g_test_add_func("/thread-pool/run-on-full-pool-runs-inline",
+                  test_run_on_full_pool_runs_inline);
+  return g_test_run();
+}